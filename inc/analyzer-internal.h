@@ -1,6 +1,7 @@
 #include "../std/std.h"
 
 #include "hashmap.h"
+#include "vector.h"
 
 typedef struct ast ast;
 typedef struct sym sym;
@@ -30,6 +31,10 @@ typedef struct analyzerCtx {
     ///Current function context
     analyzerFnCtx fnctx;
 
+    ///Case and default labels found so far in the innermost switch,
+    ///used to find duplicates
+    vector/*<const ast*>*/* switchLabels;
+
     ///Incomplete types for which an incomplete decl or dereference error has
     ///already been issued, and subsequent errors are to be suppressed
     intset/*<const sym*>*/ incompleteDeclIgnore;
@@ -14,6 +14,7 @@ typedef enum osTag {
 } osTag;
 
 typedef struct architecture {
+    osTag os;
     int wordsize;
     vector/*<regIndex>*/ scratchRegs, calleeSaveRegs;
     archSymbolMangler symbolMangler;
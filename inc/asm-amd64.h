@@ -6,6 +6,7 @@
 typedef struct asmCtx asmCtx;
 typedef struct irBlock irBlock;
 typedef struct irCtx irCtx;
+typedef struct vector vector;
 typedef enum regIndex regIndex;
 
 typedef enum boperation {
@@ -31,8 +32,8 @@ typedef enum uoperation {
 void asmFilePrologue (asmCtx* ctx);
 void asmFileEpilogue (asmCtx* ctx);
 
-void asmFnLinkageBegin (FILE* file, const char* name);
-void asmFnLinkageEnd (FILE* file, const char* name);
+void asmFnLinkageBegin (asmCtx* ctx, const char* name);
+void asmFnLinkageEnd (asmCtx* ctx, const char* name);
 
 void asmFnPrologue (irCtx* ir, irBlock* block, int localSize);
 void asmFnEpilogue (irCtx* ir, irBlock* block);
@@ -46,13 +47,40 @@ void asmRestoreReg (irCtx* ir, irBlock* block, regIndex r);
 void asmDataSection (asmCtx* ctx);
 void asmRODataSection (asmCtx* ctx);
 
+/**
+ * Section of zero filled data, which takes no space in the object
+ */
+void asmBSSSection (asmCtx* ctx);
+
 void asmStaticData (asmCtx* ctx, const char* label, bool global, int size, intptr_t initial);
 
 /**
- * Place a string constant in the rodata section with the given label
+ * Zero filled static object, in the BSS section
+ */
+void asmStaticZero (asmCtx* ctx, const char* label, bool global, int size);
+
+/**
+ * Each of refs, in order of offset, is emitted as the word at its offset
+ */
+void asmStaticBytes (asmCtx* ctx, const char* label, bool global, int size, const char* bytes,
+                     const vector/*<irStaticRef*>*/* refs);
+
+/**
+ * Mergeable section for null terminated strings, which the linker may
+ * deduplicate across objects
+ */
+void asmStringSection (asmCtx* ctx);
+
+/**
+ * Place a string constant in the string section with the given label
  */
 void asmStringConstant (asmCtx* ctx, const char* label, const char* str);
 
+/**
+ * Label a string found offset bytes into the tail of another
+ */
+void asmStringConstantSuffix (asmCtx* ctx, const char* label, const char* outer, int offset);
+
 /**
  * Place a previously named label in the output
  */
@@ -67,6 +95,13 @@ void asmBranch (asmCtx* ctx, operand Condition, const char* label);
 void asmCall (asmCtx* ctx, const char* label);
 void asmCallIndirect (irBlock* block, operand L);
 
+/**
+ * Jump through a table of labels, indexed by a word sized register
+ * @see asmJumpTableData()
+ */
+void asmJumpTable (irCtx* ir, irBlock* block, const char* table, operand Index);
+void asmJumpTableData (irCtx* ir, const char* table, const vector/*<irBlock*>*/* targets);
+
 void asmReturn (asmCtx* ctx);
 
 void asmPush (irCtx* ir, irBlock* block, operand L);
@@ -75,8 +110,27 @@ void asmPop (irCtx* ir, irBlock* block, operand L);
 void asmPushN (irCtx* ir, irBlock* block, int n);
 void asmPopN (irCtx* ir, irBlock* block, int n);
 
+/**
+ * Moves from flags are materialized as 0 or 1 with setcc
+ */
 void asmMove (irCtx* ir, irBlock* block, operand Dest, operand Src);
+
+/**
+ * If Cond, move Src into Dest. Uses cmov when the operands allow it,
+ * otherwise branches around a move.
+ */
 void asmConditionalMove (irCtx* ir, irBlock* block, operand Cond, operand Dest, operand Src);
+/**
+ * Copy size bytes between memory operands: word moves when small,
+ * SSE2 16 byte moves for medium sizes, rep movs when large
+ */
+void asmBlockCopy (irCtx* ir, irBlock* block, operand Dest, operand Src, int size);
+/**
+ * Zero size bytes of memory, word or SSE2 16 byte stores
+ * @see asmRepStos() for large sizes
+ */
+void asmBlockZero (irCtx* ir, irBlock* block, operand Dest, int size);
+
 void asmRepStos (irCtx* ir, irBlock* block, operand RAX, operand RCX, operand RDI,
                  operand Dest, int length, operand Src);
 
@@ -84,6 +138,11 @@ void asmEvalAddress (irCtx* ir, irBlock* block, operand L, operand R);
 
 void asmCompare (irCtx* ir, irBlock* block, operand L, operand R);
 
+/**
+ * Set the carry flag to bit R of L, branch on it with conditionBelow
+ */
+void asmBitTest (irCtx* ir, irBlock* block, operand L, operand R);
+
 void asmBOP (irCtx* ir, irBlock* block, boperation Op, operand L, operand R);
 
 void asmDivision (irCtx* ir, irBlock* block, operand R);
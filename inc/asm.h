@@ -2,10 +2,12 @@
 
 #include "vector.h"
 #include "operand.h"
+#include "buffer.h"
 
 #include "stdio.h"
 
 typedef struct architecture architecture;
+typedef struct reg reg;
 
 typedef enum labelTag {
     labelReturn,
@@ -28,6 +30,11 @@ typedef struct asmCtx {
     ///File being written to
     char* filename;
     FILE* file;
+    ///Whether file is a pipe into an assembler, rather than filename
+    bool piped;
+    ///Everything is written through this, flushed into file in large
+    ///writes, or with no file at all kept whole, see asmEndBuffer
+    buffer out;
     ///Indentation depth level
     int depth;
 
@@ -41,11 +48,37 @@ typedef struct asmCtx {
     operand basePtr;
 } asmCtx;
 
-asmCtx* asmInit (const char* output, const architecture* arch);
-void asmEnd (asmCtx* ctx);
+/**
+ * Begin output into a file. If an assembler command is given, the output
+ * instead streams straight into it, started now, and the filename only
+ * names the module. With no output at all, it is kept in memory. The stack
+ * and base pointers are locked in the given register file.
+ */
+asmCtx* asmInit (const char* output, const char* assembler, const architecture* arch, reg* regs);
 
+/**
+ * Returns whether the assembler, if any, failed
+ */
+bool asmEnd (asmCtx* ctx);
+
+/**
+ * End a context kept in memory, returning what was written, which the
+ * caller then owns
+ */
+char* asmEndBuffer (asmCtx* ctx);
+
+/**
+ * Write a line, formatted as by printf
+ */
 void asmOutLn (asmCtx* ctx, const char* format, ...);
 
+/**
+ * Begin a line to be written directly into the buffer returned, then
+ * ended by asmEndLn. For the common lines, sparing the formatting.
+ */
+buffer* asmBeginLn (asmCtx* ctx);
+void asmEndLn (asmCtx* ctx);
+
 void asmComment (asmCtx* ctx, const char* str);
 
 /**
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../std/std.h"
+
+typedef struct architecture architecture;
+
+/**
+ * Assemble a file of fcc's own (Intel syntax) output directly into a
+ * relocatable object, without going through an external assembler.
+ *
+ * Only the subset of directives and instructions the code generator
+ * emits is understood. Returns whether it failed.
+ */
+bool assemble (const architecture* arch, const char* input, const char* output);
+
+/**
+ * As assemble, from assembly in memory, which is overwritten. The name is
+ * only for errors.
+ */
+bool assembleText (const architecture* arch, const char* name, char* text, const char* output);
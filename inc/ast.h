@@ -10,6 +10,12 @@
 
 typedef struct type type;
 typedef struct ast ast;
+typedef struct astPool astPool;
+
+/**
+ * The number of a node within its module's pool, see astPool
+ */
+typedef uint32_t astRef;
 
 /**
  * Kind of AST node. Adding a new one requires:
@@ -33,7 +39,8 @@ typedef enum astTag {
     astUsing,
     astFnImpl,
     astType, astDecl, astParam, astStruct, astUnion, astEnum, astConst,
-    astCode, astBranch, astLoop, astIter, astReturn, astBreak, astContinue,
+    astCode, astBranch, astLoop, astIter, astSwitch, astCase, astDefault,
+    astReturn, astBreak, astContinue,
     astBOP, astUOP, astTOP, astIndex, astCall, astCast, astSizeof, astLiteral,
     astVAStart, astVAEnd, astVAArg, astVACopy, astAssert, astEllipsis
 } astTag;
@@ -115,26 +122,37 @@ typedef enum literalTag {
  *        stored in symbol.
  *
  * Owns:
- *   - All children
- *      - Except for the right child of an astUsing.
  *   - dt
  *   - literal
+ *
+ * The nodes themselves, children included, are owned by their pool, and
+ * freed along with it.
  */
 typedef struct ast {
     astTag tag;
 
     tokenLocation location;
 
+    int children;
+    opTag o;
+
+    union {
+        /*astMarker*/
+        markerTag marker;
+        /*astLiteral*/
+        literalTag litTag;
+    };
+
+    ///Number within its pool, for side tables to be kept by
+    astRef index;
+
     /*Linked list for container nodes like a module or parameter list and children of containers*/
     ast* firstChild;
     ast* lastChild;
     ast* nextSibling;
-    ast* prevSibling;
-    int children;
 
     /*Binary tree*/
     ast* l;
-    opTag o;
     ast* r;      /*Always used for unary operators*/
     type* dt;    /*Result data type*/
 
@@ -144,23 +162,45 @@ typedef struct ast {
         /*(DeclExpr) astLiteral[lit=Ident]*/
         storageTag storage;
         /*(DeclExpr) astBOP[o=Assign]
-          astMarker[m=ArrayDesignator]*/
+          astMarker[m=ArrayDesignator]
+          astCase, after analysis*/
         intptr_t constant;
     };
 
-    union {
-        /*astMarker*/
-        markerTag marker;
-        /*astLiteral*/
-        struct {
-            literalTag litTag;
-            void* literal;
-        };
-    };
+    /*astLiteral, astUsing*/
+    void* literal;
 } ast;
 
+/**
+ * The nodes of a module, kept together in blocks so that nodes made one
+ * after another are near in memory, and numbered in the order made. A
+ * node is never moved, and never freed but with the whole pool.
+ *
+ * New nodes come from the current pool of the thread, see astPoolSwitch.
+ */
+astPool* astPoolCreate (void);
+
+/**
+ * Free every node of the pool, and what they own, in one sweep
+ */
+void astPoolDestroy (astPool* pool);
+
+/**
+ * Make a pool the one that new nodes on this thread come from, returning
+ * the one it replaces, for restoring after.
+ */
+astPool* astPoolSwitch (astPool* pool);
+
+/**
+ * The node of a given number
+ */
+ast* astPoolGet (const astPool* pool, astRef index);
+
+/**
+ * Make a node in the current pool. Without one (the tree of a module not
+ * found, say) it is allocated alone and never freed.
+ */
 ast* astCreate (astTag tag, tokenLocation location);
-void astDestroy (ast* Node);
 
 ast* astCreateInvalid (tokenLocation location);
 ast* astCreateMarker (tokenLocation location, markerTag marker);
@@ -191,6 +231,12 @@ ast* astCreateAssert (tokenLocation location, ast* expr);
 
 void astAddChild (ast* Parent, ast* Child);
 
+/**
+ * Write out the children of a node, for walking them other than first to
+ * last. There must be room for Node->children.
+ */
+void astGetChildren (const ast* Node, ast** children);
+
 bool astIsValueTag (astTag tag);
 
 /**
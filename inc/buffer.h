@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "stdio.h"
+#include "stdint.h"
+#include "stdarg.h"
+
+/**
+ * Text written in pieces into one block of memory. With a file, it is
+ * written out in large chunks whenever full, otherwise it grows to hold
+ * everything.
+ *
+ * The contents are not null terminated, see bufferTake.
+ */
+typedef struct buffer {
+    char* str;
+    int length, capacity;
+    ///Written into when full, if any
+    FILE* file;
+} buffer;
+
+buffer* bufferInit (buffer* buf, int capacity, FILE* file);
+
+/**
+ * Write out anything left, if there is a file, and free the contents
+ */
+void bufferFree (buffer* buf);
+
+/**
+ * End a buffer, returning what was written, null terminated, which the
+ * caller then owns
+ */
+char* bufferTake (buffer* buf);
+
+/**
+ * Write what's held into the file, if any
+ */
+void bufferFlush (buffer* buf);
+
+void bufferChar (buffer* buf, char c);
+
+/**
+ * A character repeated n times
+ */
+void bufferChars (buffer* buf, char c, int n);
+
+void bufferStr (buffer* buf, const char* str);
+void bufferStrN (buffer* buf, const char* str, int length);
+
+/**
+ * Decimal, as "%d"
+ */
+void bufferInt (buffer* buf, intmax_t n);
+
+/**
+ * Decimal, always signed, as "%+d"
+ */
+void bufferSignedInt (buffer* buf, intmax_t n);
+
+/**
+ * Formatted as by printf, for the rarer output not worth its own writer
+ */
+void bufferFormat (buffer* buf, const char* format, ...);
+void bufferVarFormat (buffer* buf, const char* format, va_list args);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "stdint.h"
+
+typedef struct compilerCtx compilerCtx;
+
+/**
+ * Compilation cache
+ *
+ * With compilerCtx::compileCache, the assembly of each input compiled
+ * cleanly is kept in that directory, and reused while the input and every
+ * module it imported are unchanged, skipping the compilation entirely.
+ *
+ * An input's entry is found by a hash of its name and contents, the
+ * settings and the build of the compiler. It lists the modules the input
+ * imported and any headers included (see preprocessor.h), and their
+ * hashes. These, folded into the key, name the assembly. Only compilations
+ * in a fresh context (see compilerReset) are cached, as otherwise the
+ * output depends on what came before.
+ */
+
+#define cacheHashInit 0xCBF29CE484222325
+
+/**
+ * Continue a hash (FNV-1a) from cacheHashInit or a hash so far
+ */
+uint64_t cacheHashBytes (uint64_t hash, const void* data, size_t length);
+
+/**
+ * Continue a hash with the contents of a file. Zero if it can't be read.
+ */
+uint64_t cacheHashFile (uint64_t hash, const char* filename);
+
+/**
+ * Continue a hash with the identity of this build of the compiler, so that
+ * nothing cached by one build is used by another: a hash of its executable,
+ * read once, or only its version if that can't be read.
+ */
+uint64_t cacheHashBuild (uint64_t hash);
+
+/**
+ * Attempt to produce an input's output from the cache, written into the
+ * output file, piped into the assembler command if given, or assembled
+ * into the object if given. Returns whether it did, and so whether the
+ * compilation can be skipped. If so, *fail is set if the assembler failed.
+ */
+bool cacheLookup (compilerCtx* comp, const char* input, const char* output, const char* assembler,
+                  const char* object, bool* fail);
+
+/**
+ * For an input compiled in a fresh context, with its assembly written into
+ * the output: if an assembler command or object is given, pipe it in or
+ * assemble it, and remove the output, as the compiler would have done
+ * directly. Keep a copy if it all went cleanly. Returns whether the
+ * assembler failed.
+ */
+bool cacheStore (compilerCtx* comp, const char* input, const char* output, const char* assembler,
+                 const char* object, bool clean);
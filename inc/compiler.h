@@ -3,11 +3,14 @@
 #include "../std/std.h"
 
 #include "hashmap.h"
+#include "vector.h"
+#include "paths.h"
 
-typedef struct vector vector;
 typedef struct architecture architecture;
 typedef struct sym sym;
 
+#define compilerVersion "v0.01b"
+
 /**
  * Indices of certain built in symbols for compilerCtx::types.
  * Used by the analyzer.
@@ -28,13 +31,75 @@ typedef struct compilerCtx {
 
     hashmap/*<parserResult*>*/ modules;
 
+    ///Full names of the modules first imported since the last compilation,
+    ///whether parsed or loaded from an interface. Owned by modules
+    vector/*<const char*>*/ loaded;
+    ///Whether no module has been imported yet, see compilerReset
+    bool fresh;
+
+    ///Where the files of modules and headers were found, for this compilation
+    pathsCtx paths;
+
+    ///Run each module through the preprocessor, see preprocessor.h
+    bool preprocess;
+    ///Headers lexed for the preprocessor, by full name, kept until reset
+    hashmap/*<ppFile*>*/ headers;
+    ///Full names of the headers first lexed since the last compilation.
+    ///Owned by headers
+    vector/*<const char*>*/ included;
+
+    ///Whether modules are kept for later compilations, see compilerRefresh
+    bool resident;
+    ///The modules kept, and the inputs compiled
+    vector/*<compilerModule*>*/ residents;
+    ///Modules no longer kept, that the symbol table may still refer to
+    vector/*<parserResult*>*/ dropped;
+
+    ///Directory of saved module interfaces, or null for none, see interface.h
+    const char* moduleCache;
+    ///Directory of cached compilations, or null for none, see cache.h
+    const char* compileCache;
+    int cacheHits, cacheMisses;
+
     const architecture* arch;
     const vector/*<char*>*/* searchPaths;
+    ///Threads to generate code over, see emitter
+    int threads;
 
     int errors, warnings;
+    ///Internal errors raised while compiling with this context
+    int internalErrors;
 } compilerCtx;
 
 void compilerInit (compilerCtx* ctx, const architecture* arch, const vector/*<char*>*/* searchPaths);
 void compilerEnd (compilerCtx* ctx);
 
-void compiler (compilerCtx* ctx, const char* input, const char* output);
+/**
+ * Forget the modules imported so far, as though the context were new,
+ * keeping the settings and counts
+ */
+void compilerReset (compilerCtx* ctx);
+
+/**
+ * In a resident context, prepare the modules kept for the compilation of
+ * an input. Those that changed on disk are dropped, as are those that an
+ * input redeclared symbols of, the input itself and the inputs before it.
+ * Then so are any importing those dropped, in turn.
+ *
+ * The symbols of modules dropped are left in the table until, with enough
+ * of them, the context is reset entirely.
+ */
+void compilerRefresh (compilerCtx* ctx, const char* input);
+
+/**
+ * Compile a module into an assembly file, or piped into an assembler
+ * command if given (see asmInit). Or if an object is given, assemble it
+ * there in process (see assembler.h), with the assembly only in memory
+ * and the output only naming the module. Returns whether the assembler
+ * failed, compilation errors are counted in the context.
+ *
+ * In a fresh context, the compilation may be reused from the cache
+ * instead, see cache.h. In a resident one, the modules kept from before
+ * are refreshed first.
+ */
+bool compiler (compilerCtx* ctx, const char* input, const char* output, const char* assembler, const char* object);
@@ -7,6 +7,7 @@ typedef struct type type;
 typedef struct ast ast;
 typedef struct sym sym;
 typedef struct operand operand;
+typedef struct reg reg;
 typedef struct architecture architecture;
 
 typedef enum debugMode {
@@ -16,8 +17,16 @@ typedef enum debugMode {
     debugSilent
 } debugMode;
 
+/**
+ * The debug state is per thread, so each thread that compiles must call this
+ */
 void debugInit (FILE* log);
 
+/**
+ * The log of this thread, to start another with
+ */
+FILE* debugGetLog (void);
+
 debugMode debugSetMode (debugMode mode);
 
 void debugWait (void);
@@ -53,7 +62,10 @@ void reportType (const type* DT);
 void reportSymbol (const sym* Symbol);
 void reportSymbolTree (const sym* Symbol, int level);
 void reportNode (const ast* Node);
-void reportRegs (void);
+void reportRegs (const reg* regs);
 void reportOperand (const architecture* arch, const operand* R);
 
-extern int internalErrors;
+/**
+ * Internal errors raised on this thread, see compilerCtx::internalErrors
+ */
+extern _Thread_local int internalErrors;
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "../std/std.h"
+
+typedef struct objFile objFile;
+
+/**
+ * Write a relocatable ELF object: ELF32 with REL relocations for a
+ * wordsize of 4 (i386), ELF64 with RELA for 8 (x86-64).
+ *
+ * The object should have been through objResolve. Returns whether it failed.
+ */
+bool elfWrite (objFile* obj, const char* filename);
@@ -1,10 +1,12 @@
 #include "operand.h"
+#include "hashmap.h"
 
 typedef struct ast ast;
 typedef struct architecture architecture;
 typedef struct irBlock irBlock;
 typedef struct irFn irFn;
 typedef struct irCtx irCtx;
+typedef struct vector vector;
 typedef enum regIndex regIndex;
 
 typedef struct emitterCtx {
@@ -13,6 +15,13 @@ typedef struct emitterCtx {
 
     irFn* curFn;
     irBlock *returnTo, *breakTo, *continueTo;
+
+    ///Within an imported module, whose functions and variables are only
+    ///declared, as they are defined by the module's own object
+    bool imported;
+
+    ///The blocks that case and default labels lead to
+    intmap/*<const ast*, irBlock*>*/ labels;
 } emitterCtx;
 
 /*==== emitter-helpers.c ==== Emitter helper functions ====*/
@@ -81,3 +90,11 @@ operand emitterValueSuggest (emitterCtx* ctx, irBlock** block, const ast* Node,
 operand emitterSymbol (emitterCtx* ctx, const sym* Symbol);
 
 void emitterCompoundInit (emitterCtx* ctx, irBlock** block, const ast* Node, operand base);
+
+/**
+ * Write the byte image of a constant initializer, compound or not, into a
+ * zeroed buffer of the given size. The addresses in it are left zero, and
+ * pushed onto refs as irStaticRefs to be relocated.
+ * @see evalIsConstantInit()
+ */
+void emitterInitData (emitterCtx* ctx, const ast* Node, char* data, int size, vector/*<irStaticRef*>*/* refs);
@@ -1,4 +1,19 @@
+#include "../std/std.h"
+
 typedef struct ast ast;
 typedef struct architecture architecture;
 
-void emitter (const ast* Tree, const char* output, const architecture* arch);
+/**
+ * Emit the assembly for a module into a file, or piped into an assembler
+ * command. Returns whether the assembler failed.
+ *
+ * Functions are generated over up to the given number of threads. The
+ * output is the same regardless.
+ */
+bool emitter (const ast* Tree, const char* output, const char* assembler, const architecture* arch, int threads);
+
+/**
+ * As emitter, keeping the assembly in memory instead. Returns it, for the
+ * caller to own.
+ */
+char* emitterBuffer (const ast* Tree, const architecture* arch, int threads);
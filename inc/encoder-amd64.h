@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "stdint.h"
+
+typedef struct objFile objFile;
+typedef struct objSection objSection;
+typedef struct objSymbol objSymbol;
+
+typedef enum encOperandTag {
+    encUndefined,
+    encReg,
+    ///[base + index*scale + symbol + disp]
+    encMem,
+    ///Literal, or the address of a symbol (plus disp)
+    encImm,
+    ///Target of a branch
+    encLabel
+} encOperandTag;
+
+typedef struct encOperand {
+    encOperandTag tag;
+    ///Size in bytes of the register or memory, 0 if not given
+    int size;
+
+    ///encReg: register number, 0 to 15, or the XMM number if size is 16
+    ///encMem: base and index registers, -1 if absent
+    int reg, index, scale;
+
+    objSymbol* symbol;
+    intptr_t disp;
+} encOperand;
+
+typedef struct encCtx {
+    objFile* obj;
+    objSection* section;
+    int wordsize;
+} encCtx;
+
+/**
+ * Encode an instruction into the section, with relocations for any
+ * symbols it refers to. The mnemonic may be preceded by prefixes
+ * already emitted (e.g. rep).
+ *
+ * Returns whether the instruction was recognised and its operands valid.
+ */
+bool encodeInstruction (encCtx* ctx, const char* mnemonic, const encOperand* operands, int operandNo);
@@ -7,11 +7,14 @@ typedef enum symTag symTag;
 typedef struct parserCtx parserCtx;
 typedef struct analyzerCtx analyzerCtx;
 typedef struct analyzerFnCtx analyzerFnCtx;
+typedef struct ppCtx ppCtx;
 
 void errorf (const char* format, ...);
 
 void errorParser (parserCtx* ctx, const char* format, ...);
 void errorAnalyzer (analyzerCtx* ctx, const ast* Node, const char* format, ...);
+void errorPreprocessor (ppCtx* ctx, const char* format, ...);
+void warningPreprocessor (ppCtx* ctx, const char* format, ...);
 
 void errorExpected (parserCtx* ctx, const char* expected);
 void errorUndefSym (parserCtx* ctx);
@@ -22,6 +25,18 @@ void errorRedeclaredSymAs (parserCtx* ctx, const sym* Symbol, symTag tag);
 void errorReimplementedSym (parserCtx* ctx, const sym* Symbol);
 void errorFileNotFound (parserCtx* ctx, const char* name);
 
+void errorDirectiveExpected (ppCtx* ctx, const char* expected, const char* directive);
+void errorUnknownDirective (ppCtx* ctx, const char* directive);
+void errorUnmatchedDirective (ppCtx* ctx, const char* directive);
+void errorUnterminatedConditional (ppCtx* ctx);
+void errorIncludeNotFound (ppCtx* ctx, const char* name);
+void errorIncludeDepth (ppCtx* ctx, const char* name);
+void errorMacroDegree (ppCtx* ctx, const char* macro, int expected, int found);
+void errorUnterminatedCall (ppCtx* ctx, const char* macro);
+void errorInvalidPaste (ppCtx* ctx, const char* l, const char* r);
+void errorConditionExpected (ppCtx* ctx, const char* expected, const char* found);
+void errorConditionDivision (ppCtx* ctx);
+
 void errorTypeExpected (analyzerCtx* ctx, const ast* Node,
                         const char* where, const char* expected);
 void errorOpTypeExpected (analyzerCtx* ctx, const ast* Node,
@@ -60,6 +75,8 @@ void errorIllegalSymAsValue (analyzerCtx* ctx, const ast* Node, const sym* Symbo
 void errorCompileTimeKnown (analyzerCtx* ctx, const ast* Node,
                             const sym* Symbol, const char* what);
 void errorStaticCompileTimeKnown (analyzerCtx* ctx, const ast* Node, const sym* Symbol);
+void errorCaseCompileTimeKnown (analyzerCtx* ctx, const ast* Node);
+void errorDuplicateLabel (analyzerCtx* ctx, const ast* Node, const ast* first);
 void errorIllegalArraySize (analyzerCtx* ctx, const ast* Node,
                             const sym* Symbol, int size);
 
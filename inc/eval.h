@@ -10,4 +10,16 @@ typedef struct evalResult {
 
 evalResult eval (const architecture* arch, const ast* Node);
 
+/**
+ * Can an initializer be computed at compile time: integer constants, the
+ * addresses in evalStaticAddress(), and compound initializers of them
+ */
 bool evalIsConstantInit (const ast* Node);
+
+/**
+ * If the node is the address of something statically stored, known once
+ * linked, returns the string literal or identifier it is the address of.
+ * That is a string literal, or a static or extern object or function,
+ * taken by & or by the decay of an array or function. Otherwise null.
+ */
+const ast* evalStaticAddress (const ast* Node);
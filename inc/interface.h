@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "stdint.h"
+
+typedef struct compilerCtx compilerCtx;
+typedef struct parserResult parserResult;
+
+/**
+ * Binary module interfaces
+ *
+ * A module that only declares things (types, structs, unions, enums,
+ * function prototypes and extern objects) is saved after it is first
+ * compiled as a symbol table in a file of compilerCtx::moduleCache. Later
+ * imports map that file in rather than parsing the module again.
+ *
+ * The file is named by interfaceKey, and records the hashes of the
+ * modules it imported, so it is only used while they are unchanged too.
+ */
+
+/**
+ * Hash of a module's source, the build of the compiler (see cacheHashBuild)
+ * and the architecture. Zero if there is no cache, or the file can't be
+ * read.
+ */
+uint64_t interfaceKey (const compilerCtx* comp, const char* fullname);
+
+/**
+ * Fold the hash of an imported module into that of the importer, in the
+ * order imported, see parserResult::hash
+ */
+uint64_t interfaceHashImport (uint64_t hash, uint64_t imported);
+
+/**
+ * Attempt to load a module's interface from the cache. On success, fills
+ * in the result as the parser would have (importing any dependencies
+ * through it), with a stub tree. Returns whether it succeeded.
+ */
+bool interfaceLoad (compilerCtx* comp, const char* filename, const char* fullname, parserResult* result);
+
+/**
+ * Save the interface of a module parsed from source, if it is one that
+ * can be, and wasn't itself loaded from one. Only once it has been
+ * compiled without error, as the layout of its records is decided by the
+ * emitter.
+ */
+void interfaceSave (compilerCtx* comp, const char* fullname, const parserResult* module);
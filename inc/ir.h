@@ -1,6 +1,9 @@
 #include "vector.h"
+#include "hashmap.h"
 #include "ast.h"
 #include "operand.h"
+#include "reg.h"
+#include "buffer.h"
 
 #include "stdint.h"
 
@@ -9,6 +12,7 @@ typedef struct architecture architecture;
 typedef struct asmCtx asmCtx;
 
 typedef struct irBlock irBlock;
+typedef struct irFn irFn;
 
 /*====  ====*/
 
@@ -34,6 +38,7 @@ typedef enum irTermTag {
     termBranch,
     termCall,
     termCallIndirect,
+    termJumpTable,
     termReturn
 } irTermTag;
 
@@ -58,6 +63,11 @@ typedef struct irTerm {
                 operand toAsOperand;
             };
         };
+        /*termJumpTable*/
+        struct {
+            char* tableLabel;
+            vector/*<irBlock*>*/ table;
+        };
     };
 } irTerm;
 
@@ -66,9 +76,18 @@ typedef struct irTerm {
 typedef enum irStaticDataTag {
     dataUndefined,
     dataRegular,
+    dataBytes,
     dataStringConstant
 } irStaticDataTag;
 
+/**
+ * The address of a label, stored at an offset into a static byte image
+ */
+typedef struct irStaticRef {
+    int offset;
+    const char* label;
+} irStaticRef;
+
 typedef struct irStaticData {
     irStaticDataTag tag;
 
@@ -80,6 +99,16 @@ typedef struct irStaticData {
             int size;
             intptr_t initial;
         };
+        /*dataBytes*/
+        struct {
+            char* byteslabel;
+            bool bytesglobal;
+            int bytesno;
+            ///Owned, bytesno long
+            char* bytes;
+            ///Owned, in order of offset, each a word left zero in bytes
+            vector/*<irStaticRef*>*/ refs;
+        };
         /*dataStringConstant*/
         struct {
             char* strlabel;
@@ -90,14 +119,27 @@ typedef struct irStaticData {
 
 /*====  ====*/
 
+/**
+ * A run of the assembly of a function, belonging to one of its blocks
+ */
+typedef struct irSpan {
+    int start, length;
+    ///Index of the block's next span, or -1
+    int next;
+} irSpan;
+
 typedef struct irBlock {
     vector/*<irInstr*>*/ instrs;
     irTerm* term;
 
-    char* label;
+    irFn* fn;
+
+    ///Numbered with the labels of the module (or fragment), see irBlockGetLabel
+    int label;
 
-    char* str;
-    int length, capacity;
+    ///Its instructions, rendered as emitted, as a list of the fn's spans,
+    ///-1 while empty. See irBlockBeginLn.
+    int firstSpan, lastSpan;
 
     ///Index in the parent Fn's vector
     int nthChild;
@@ -115,32 +157,129 @@ typedef struct irFn {
     irBlock *prologue, *entryPoint, *epilogue;
     ///Includes and owns the above blocks, as well as all others
     vector/*<irBlock*>*/ blocks;
+
+    ///The assembly of all the blocks, each line after the last written,
+    ///whichever block it was for
+    buffer out;
+    ///Where the line being written began
+    int lineStart;
+    ///Divide out into the blocks, see irBlock::firstSpan
+    irSpan* spans;
+    int spanNo, spanCapacity;
 } irFn;
 
 typedef struct irCtx {
     vector/*<irFn*>*/ fns;
     vector/*<irStaticData*>*/ data, rodata;
 
+    ///String constants, each distinct content once, keyed on it
+    vector/*<irStaticData*>*/ strings;
+    hashmap/*<irStaticData*>*/ stringPool;
+
     int labelNo;
+    ///Labels are qualified with this, or not at all if negative,
+    ///see irInitFragment
+    int fragment;
+
+    ///Assembly of functions already emitted by fragments, in the order
+    ///they were merged, following that of fns
+    vector/*<char*>*/ rendered;
+
+    ///Register file of this compilation, see regsInit
+    reg regs[regMax];
 
     asmCtx* asm;
     const architecture* arch;
 } irCtx;
 
-void irInit (irCtx* ctx, const char* output, const architecture* arch);
-void irFree (irCtx* ctx);
+/**
+ * Output goes to a file, piped into an assembler, or with neither is kept
+ * in memory (see asmInit)
+ */
+void irInit (irCtx* ctx, const char* output, const char* assembler, const architecture* arch);
+/**
+ * Returns whether the assembler, if any, failed
+ */
+bool irFree (irCtx* ctx);
+/**
+ * For a context with neither output nor assembler, returns what was
+ * written, which the caller then owns
+ */
+char* irFreeBuffer (irCtx* ctx);
+
+/**
+ * A fragment generates code in isolation from the rest of the module, so
+ * that several may do so concurrently. It writes to memory, and its labels
+ * are qualified by n, which must be unique within the module.
+ */
+void irInitFragment (irCtx* ctx, int n, const architecture* arch);
+
+/**
+ * Move the static data and emitted functions (see irEmitFns) of a fragment
+ * into ctx, after anything already there, then free it.
+ */
+void irMerge (irCtx* ctx, irCtx* fragment);
 
 void irEmit (irCtx* ctx);
 
+/**
+ * Emit just the functions, as a fragment does before being merged
+ */
+void irEmitFns (irCtx* ctx);
+
+enum {
+    ///Room for any label made by irCreateLabel or irBlockGetLabel
+    irLabelMax = 20
+};
+
+/**
+ * A label unique to the module (or fragment), owned by the caller
+ */
+char* irCreateLabel (irCtx* ctx);
+
 /**If no name is provided, one will be allocated*/
 irFn* irFnCreate (irCtx* ctx, const char* name, int stacksize);
 irBlock* irBlockCreate (irCtx* ctx, irFn* fn);
 
+/**
+ * The label of a block, written into room for irLabelMax characters.
+ * Only meaningful in the context that created the block.
+ */
+const char* irBlockGetLabel (const irCtx* ctx, const irBlock* block, char* label);
+
+/**
+ * Append a line to a block, formatted as by printf
+ */
 void irBlockOut (irBlock* block, const char* format, ...);
 
+/**
+ * Begin a line of a block to be written directly into the buffer returned,
+ * then ended by irBlockEndLn. For the common instructions, sparing the
+ * formatting. Only one line may be written at a time.
+ */
+buffer* irBlockBeginLn (irBlock* block);
+void irBlockEndLn (irBlock* block);
+
 /*==== Static data ====*/
 
 void irStaticValue (irCtx* ctx, const char* label, bool global, int size, intptr_t initial);
+
+/**
+ * Static object initialized with an arbitrary byte image, e.g. from a
+ * compound initializer, with the addresses in refs relocated into it.
+ * Takes ownership of the bytes and of refs and its references.
+ */
+void irStaticBytes (irCtx* ctx, const char* label, bool global, bool ro, int size, char* bytes,
+                    vector/*<irStaticRef*>*/* refs);
+
+/**
+ * Anonymous read only byte image, such as a template to copy an initializer
+ * from. Takes ownership as irStaticBytes, returns the offset of its label.
+ */
+operand irROBytes (irCtx* ctx, int size, char* bytes, vector/*<irStaticRef*>*/* refs);
+/**
+ * String constants are pooled: the same content always gives the same label
+ */
 operand irStringConstant (irCtx* ctx, const char* str);
 
 /*==== Terminal instructions ====*/
@@ -150,6 +289,13 @@ void irBranch (irBlock* block, operand cond, irBlock* ifTrue, irBlock* ifFalse);
 void irCall (irBlock* block, sym* to, irBlock* ret);
 void irCallIndirect (irBlock* block, operand to, irBlock* ret);
 
+/**
+ * Jump to the nth block of a table, where n is the value of the index, a
+ * word sized register. The index must already have been checked against
+ * the bounds of the table.
+ */
+void irJumpTable (irCtx* ctx, irBlock* block, operand index, const vector/*<irBlock*>*/* table);
+
 /*==== ====*/
 
 int irBlockGetPredNo (irFn* fn, irBlock* block);
@@ -163,3 +309,9 @@ void irBlocksCombine (irFn* fn, irBlock* pred, irBlock* succ);
 /*==== ====*/
 
 void irBlockLevelAnalysis (irCtx* ctx);
+
+/**
+ * Decide an order to emit the blocks of a function in, appending them to
+ * order. Blocks unreachable from the prologue are left out.
+ */
+void irLayoutFn (const irFn* fn, vector/*<irBlock*>*/* order);
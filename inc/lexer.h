@@ -2,6 +2,8 @@
 
 #include "stream.h"
 
+#include "stdint.h"
+
 typedef enum tokenTag {
     tokenUndefined,
     tokenOther,
@@ -11,13 +13,16 @@ typedef enum tokenTag {
     tokenIdent,
     tokenInt,
     tokenStr,
-    tokenChar
+    tokenChar,
+    ///A whole preprocessor line, from the #, only kept for the preprocessor
+    tokenDirective
 } tokenTag;
 
 typedef enum keywordTag {
     keywordUndefined,
     keywordUsing,
     keywordIf, keywordElse, keywordWhile, keywordDo, keywordFor,
+    keywordSwitch, keywordCase, keywordDefault,
     keywordReturn, keywordBreak, keywordContinue,
     keywordSizeof,
     keywordConst,
@@ -59,26 +64,89 @@ typedef enum punctTag {
     punctMinus, punctMinusAssign, punctMinusMinus, punctArrow,
     punctTimes, punctTimesAssign,
     punctDivide, punctDivideAssign,
-    punctModulo, punctModuloAssign
+    punctModulo, punctModuloAssign,
+
+    ///Only seen by the preprocessor
+    punctHash, punctHashHash,
+
+    punctMax
 } punctTag;
 
+/**
+ * The tokens of a file, as parallel arrays. The text of a token is a span
+ * of the file from its start, except for strings and characters, where it
+ * is what's between the quotes.
+ */
+typedef struct lexerTokens {
+    ///tokenTag
+    unsigned char* tags;
+    ///keywordTag or punctTag, for keywords and punctuators
+    unsigned char* subtags;
+    ///Offsets into the file
+    uint32_t* starts;
+    ///Of the text
+    uint32_t* lengths;
+    int length, capacity;
+
+    ///The text the starts are into, if not the file's, as after
+    ///preprocessing. Owned.
+    char* text;
+    ///The location of each, if not the file's base plus its start. Owned.
+    tokenLocation* locations;
+} lexerTokens;
+
 typedef struct lexerCtx {
     streamCtx* stream;
-    int line, lineChar;
+    ///The whole file, lexed up front. The last token is the end of file.
+    lexerTokens tokens;
+    ///Of the current token
+    int index;
 
+    ///The current token
+    tokenLocation location;
     tokenTag token;
     keywordTag keyword;
     punctTag punct;
 
+    ///Its text, null terminated, and its length including the null
     char* buffer;
     int bufferSize;
     int length;
 } lexerCtx;
 
-lexerCtx* lexerInit (const char* filename);
+/**
+ * Lex a whole file, adding it to the source manager under the given
+ * filename. A large file is split and lexed over up to the given number of
+ * threads.
+ *
+ * Preprocessor lines are skipped like comments, unless directives are
+ * asked for, in which case each becomes a tokenDirective, and a # anywhere
+ * else a punctuator (see preprocessor.h).
+ *
+ * The first token is loaded by lexerNext, as is each after.
+ */
+lexerCtx* lexerInit (const char* fullname, const char* filename, int threads, bool directives);
 void lexerEnd (lexerCtx* ctx);
 
 void lexerNext (lexerCtx* ctx);
 
+/**
+ * Look at a token n ahead (one or more) of the current without moving to
+ * it, giving its tag and, if asked, its keywordTag or punctTag. Past the
+ * end is the end of file.
+ */
+tokenTag lexerPeek (const lexerCtx* ctx, int n, int* subtag);
+
+/**
+ * Lex the tokens of some null terminated text, a line of it, onto the end
+ * of an array. A # is a punctuator, never a directive. The starts are
+ * offsets into the text.
+ */
+void lexerScanText (const char* text, int length, lexerTokens* tokens);
+
+void lexerTokensInit (lexerTokens* tokens, int capacity);
+void lexerTokensFree (lexerTokens* tokens);
+void lexerTokensPush (lexerTokens* tokens, tokenTag tag, int subtag, int start, int length);
+
 const char* keywordTagGetStr (keywordTag tag);
 const char* punctTagGetStr (punctTag tag);
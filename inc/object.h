@@ -0,0 +1,123 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "vector.h"
+#include "hashmap.h"
+
+#include "stdint.h"
+
+/*==== Object file model ====*/
+
+typedef struct objSymbol objSymbol;
+
+typedef enum objRelocTag {
+    relocUndefined,
+    ///Absolute address in 32 bits, as data
+    relocAbs32,
+    ///Absolute address in 32 bits, sign extended by the CPU (displacements, immediates)
+    relocAbs32Signed,
+    ///Absolute address in 64 bits
+    relocAbs64,
+    ///32 bit PC relative
+    relocPC32,
+    ///32 bit PC relative, the target of a call or jump
+    relocBranch32
+} objRelocTag;
+
+typedef struct objReloc {
+    objRelocTag tag;
+    ///Where in the section to patch
+    int offset;
+    objSymbol* symbol;
+    intptr_t addend;
+} objReloc;
+
+/*ELF section flags, which the other formats can be derived from*/
+enum {
+    sectionWrite = 0x1,
+    sectionAlloc = 0x2,
+    sectionExec = 0x4,
+    sectionMerge = 0x10,
+    sectionStrings = 0x20
+};
+
+typedef struct objSection {
+    char* name;
+    int flags;
+    ///Size of the entities in a mergeable section, otherwise 0
+    int entsize;
+    int align;
+    ///Zero filled, so only its length is written (e.g. .bss)
+    bool nobits;
+
+    char* data;
+    int length, capacity;
+
+    vector/*<objReloc*>*/ relocs;
+
+    ///Index in the output, set by the writer
+    int index;
+} objSection;
+
+struct objSymbol {
+    char* name;
+    ///Null if not (yet) defined
+    objSection* section;
+    intptr_t value;
+    bool global;
+
+    ///Defined (by .set) as another symbol plus an offset, resolved by objResolve
+    objSymbol* alias;
+    intptr_t aliasOffset;
+
+    ///Index in the output, set by the writer
+    int index;
+};
+
+typedef struct objFile {
+    int wordsize;
+
+    vector/*<objSection*>*/ sections;
+    vector/*<objSymbol*>*/ symbols;
+    hashmap/*<objSymbol*>*/ symbolMap;
+} objFile;
+
+void objInit (objFile* obj, int wordsize);
+void objFree (objFile* obj);
+
+/**
+ * Find a section by name, creating it if need be with flags guessed
+ * from its name
+ */
+objSection* objSectionGet (objFile* obj, const char* name);
+
+/**
+ * Find a symbol by name, creating an undefined one if need be
+ */
+objSymbol* objSymbolGet (objFile* obj, const char* name);
+
+void objEmitBytes (objSection* section, const void* bytes, int n);
+void objEmitByte (objSection* section, int byte);
+/**
+ * Emit a little endian integer of a given size in bytes, at most 8
+ */
+void objEmitInt (objSection* section, intptr_t value, int size);
+void objPatchInt (objSection* section, int offset, intptr_t value, int size);
+
+/**
+ * Pad to a multiple of align, with nops if executable
+ */
+void objAlign (objSection* section, int align);
+
+/**
+ * Emit size bytes of placeholder, to be filled from the symbol by the linker
+ * (or objResolve)
+ */
+void objEmitReloc (objSection* section, objRelocTag tag, objSymbol* symbol, intptr_t addend, int size);
+
+/**
+ * Resolve aliases, and patch PC relative references within a section
+ * instead of leaving them to the linker
+ */
+void objResolve (objFile* obj);
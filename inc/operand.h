@@ -5,6 +5,7 @@
 typedef struct reg reg;
 typedef struct architecture architecture;
 typedef enum opTag opTag;
+typedef struct buffer buffer;
 
 typedef enum operandTag {
     operandUndefined,
@@ -27,7 +28,12 @@ typedef enum conditionTag {
     conditionGreater,
     conditionGreaterEqual,
     conditionLess,
-    conditionLessEqual
+    conditionLessEqual,
+    /*Unsigned comparisons. Below is also the carry flag.*/
+    conditionAbove,
+    conditionAboveEqual,
+    conditionBelow,
+    conditionBelowEqual
 } conditionTag;
 
 typedef struct operand {
@@ -78,6 +84,14 @@ bool operandIsEqual (operand L, operand R);
 
 int operandGetSize (const architecture* arch, operand Value);
 
+/**
+ * Write an operand as it appears in an instruction
+ */
+void operandWrite (buffer* out, operand Value);
+
+/**
+ * As operandWrite, into a new string owned by the caller
+ */
 char* operandToStr (operand Value);
 
 const char* operandTagGetStr (operandTag tag);
@@ -87,3 +101,8 @@ const char* operandTagGetStr (operandTag tag);
 conditionTag conditionFromOp (opTag cond);
 
 conditionTag conditionNegate (conditionTag cond);
+
+/**
+ * The condition code, as suffixed to jcc, setcc and cmovcc
+ */
+const char* conditionGetStr (conditionTag cond);
@@ -10,13 +10,29 @@ typedef enum configMode {
     modeNoAssemble,
     modeNoLink,
     modeVersion,
-    modeHelp
+    modeHelp,
+    modeServer
 } configMode;
 
 typedef struct config {
     bool fail;
     configMode mode;
     bool deleteAsm;
+    ///Assemble in process instead of with the system assembler
+    bool integratedAs;
+    ///Run the preprocessor over each module, see preprocessor.h
+    bool preprocess;
+    ///Maximum number of inputs to compile concurrently
+    int jobs;
+    ///Directory to save module interfaces in, or null
+    char* moduleCache;
+    ///Directory to cache compilations in, or null
+    char* compileCache;
+    bool cacheStats;
+    ///Socket to serve compilations on, see server.h
+    char* socket;
+    ///Socket of a server to compile with instead, or null
+    char* connect;
 
     architecture arch;
 
@@ -3,6 +3,9 @@
 #include "../std/std.h"
 
 #include "lexer.h"
+#include "source.h"
+
+#include "stdint.h"
 
 typedef struct vector vector;
 typedef struct ast ast;
@@ -10,12 +13,6 @@ typedef struct sym sym;
 typedef struct compilerCtx compilerCtx;
 typedef struct lexerCtx lexerCtx;
 
-typedef struct tokenLocation {
-    const char* filename;
-    int line;
-    int lineChar;
-} tokenLocation;
-
 typedef struct parserCtx {
     lexerCtx* lexer;
     tokenLocation location;
@@ -34,9 +31,17 @@ typedef struct parserCtx {
 
     ///The levels of break-able control flows currently in
     int breakLevel;
+    ///Of those, the levels of loops (continue-able) and switches (labelable)
+    int loopLevel, switchLevel;
 
     int errors, warnings;
 
+    ///See parserResult::hash
+    uint64_t hash;
+
+    ///Parsing a module for an importer, so skipping function bodies
+    bool imported;
+
     ///The last line that an error occurred on
     int lastErrorLine;
 } parserCtx;
@@ -56,6 +61,11 @@ bool tokenIsDecl (const parserCtx* ctx);
 void tokenNext (parserCtx* ctx);
 void tokenSkipMaybe (parserCtx* ctx);
 
+/**
+ * Skip a brace delimited block, and any nested within, without parsing it
+ */
+void tokenSkipBlock (parserCtx* ctx);
+
 void tokenMatch (parserCtx* ctx);
 char* tokenDupMatch (parserCtx* ctx);
 
@@ -2,18 +2,39 @@
 
 #include "../std/std.h"
 
+#include "stdint.h"
+
 typedef struct ast ast;
+typedef struct astPool astPool;
 typedef struct sym sym;
 typedef struct compilerCtx compilerCtx;
 
 typedef struct parserResult {
     ast* tree;
+    ///Holding the nodes of the tree
+    astPool* nodes;
     const sym* scope;
     char* filename;
     int errors, warnings;
     bool firsttime, notfound;
+    ///Identifies the module's source and, in turn, those of its imports.
+    ///Zero without a module cache, see interface.h
+    uint64_t hash;
+    ///Loaded from a saved interface rather than parsed
+    bool cached;
 } parserResult;
 
-parserResult parser (const char* filename, const char* initialPath, compilerCtx* comp);
+/**
+ * Parse a module, or look it up if it has been already. An imported
+ * module, needed only for its declarations, has its function bodies
+ * skipped (see parserFnImpl).
+ */
+parserResult parser (const char* filename, const char* initialPath, bool imported, compilerCtx* comp);
+
+/**
+ * Full name of the file a module would be found at, or null if none. Looked
+ * up once per compilation, see paths.h.
+ */
+char* parserFindFile (compilerCtx* comp, const char* filename, const char* initialPath);
 
 void parserResultDestroy (parserResult* result);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "hashmap.h"
+
+typedef struct vector vector;
+
+/**
+ * Path resolution cache
+ *
+ * Finding the file a module or header name refers to means trying it in
+ * each search path in turn, and the same names are looked for by every file
+ * that imports them. Instead, each directory tried is listed once, and
+ * names looked up in the listing, and each resolution is remembered,
+ * keyed by the name and the path it was first looked for in.
+ *
+ * Files appearing or disappearing mid compilation aren't noticed, so the
+ * cache is cleared before each, see compiler.
+ */
+typedef struct pathsCtx {
+    ///Listings by directory name
+    hashmap/*<pathsDir*>*/ dirs;
+    ///Resolutions by initial path and name
+    hashmap/*<pathsFound*>*/ found;
+} pathsCtx;
+
+void pathsInit (pathsCtx* ctx);
+void pathsEnd (pathsCtx* ctx);
+
+/**
+ * Forget everything, as at the start of a compilation
+ */
+void pathsClear (pathsCtx* ctx);
+
+/**
+ * Full name of a file looked for in an initial path, if given, and then in
+ * the search paths from last to first. Null if none, otherwise owned by
+ * the caller.
+ */
+char* pathsFind (pathsCtx* ctx, const char* filename, const char* initialPath,
+                 const vector/*<char*>*/* searchPaths);
+
+/**
+ * Whether a file exists, going by the listing of its directory
+ */
+bool pathsExists (pathsCtx* ctx, const char* fullname);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../std/std.h"
+
+/**
+ * Called once on each thread the pool starts, before it takes any work
+ */
+typedef void (*poolInitFn)(void* ctx);
+typedef void (*poolTaskFn)(void* ctx, int n);
+
+/**
+ * Run task(ctx, n) for every n from 0 to count-1, over up to the given
+ * number of threads, the calling thread being one of them.
+ *
+ * Each thread starts with an even, contiguous share of the tasks, taken
+ * from the front. Once out, it steals from the back of the others'.
+ * The order in which tasks run is therefore unspecified; only that they
+ * have all finished when this returns.
+ */
+void poolRun (int threads, int count, poolInitFn init, poolTaskFn task, void* ctx);
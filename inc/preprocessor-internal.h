@@ -0,0 +1,150 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "hashmap.h"
+#include "vector.h"
+#include "lexer.h"
+
+typedef struct compilerCtx compilerCtx;
+typedef struct ppMacro ppMacro;
+
+/**
+ * The macros a token came out of the expansion of, which it can't be
+ * expanded by again. Shared between tokens and never changed.
+ */
+typedef struct ppHide {
+    const ppMacro* macro;
+    const struct ppHide* next;
+} ppHide;
+
+/**
+ * A token as the preprocessor sees it, from a file or made by it
+ */
+typedef struct ppToken {
+    tokenTag tag;
+    ///keywordTag or punctTag
+    int subtag;
+    ///Its spelling, in a file or in the preprocessor's own memory. Unlike
+    ///lexerTokens, strings and characters start at the quote.
+    const char* text;
+    ///As in lexerTokens, not counting quotes
+    int length;
+    tokenLocation location;
+    ///Whether there was whitespace before it, for stringizing
+    bool space;
+    const ppHide* hide;
+} ppToken;
+
+typedef struct ppList {
+    ppToken* tokens;
+    int length, capacity;
+} ppList;
+
+typedef enum ppBuiltin {
+    ppBuiltinNone,
+    ppBuiltinLine,
+    ppBuiltinFile
+} ppBuiltin;
+
+typedef struct ppMacro {
+    ///Owned, and the key it's mapped from
+    char* name;
+    ///Cleared by #undef, rather than removing it
+    bool defined;
+    ppBuiltin builtin;
+
+    bool function, variadic;
+    ///Of a function-like macro, the last being __VA_ARGS__ if variadic
+    int params;
+
+    ppToken* body;
+    ///For each token of the body, the parameter it names, or -1
+    int* bodyParams;
+    int length;
+} ppMacro;
+
+/**
+ * A header, read and lexed with its directives once per compilation and
+ * kept in compilerCtx::headers
+ */
+typedef struct ppFile {
+    ///Owned, and the key it's mapped from
+    char* fullname;
+    ///Its text and tokens, lexed with directives
+    lexerCtx* lexer;
+
+    ///The macro that an #ifndef around the whole file tests, or null
+    char* guard;
+    ///Seen a #pragma once
+    bool once;
+} ppFile;
+
+/**
+ * A file being read, included by the one before it
+ */
+typedef struct ppFrame {
+    const lexerTokens* tokens;
+    const char* text;
+    tokenLocation base;
+    int index;
+
+    ///Null for the module's own file
+    ppFile* file;
+    const char* fullname;
+
+    ///The conditionals open when it was entered, which it can't close
+    int conditionals;
+} ppFrame;
+
+typedef struct ppConditional {
+    tokenLocation location;
+    ///A group of it has been taken, so the rest are skipped
+    bool taken;
+    ///Past its #else
+    bool otherwise;
+} ppConditional;
+
+/**
+ * Preprocessor context, for one module
+ */
+typedef struct ppCtx {
+    compilerCtx* comp;
+    ///Of the current directive or token, for errors
+    tokenLocation location;
+
+    hashmap/*<ppMacro*>*/ macros;
+    ///A bit for each name length (mod 64) of macros starting with each
+    ///character, to pass over most identifiers without a lookup
+    uint64_t names[256];
+
+    ///The headers included so far, for #pragma once
+    intset/*<const ppFile*>*/ included;
+
+    ppFrame* frames;
+    int frameNo, frameCapacity;
+
+    ppConditional* conditionals;
+    int conditionalNo, conditionalCapacity;
+
+    ///Tokens to be read again before any more from the files, last first
+    ppList pending;
+
+    ///Memory for the text the preprocessor makes and for hide sets, all
+    ///freed at the end
+    vector/*<char*>*/ blocks;
+    int blockUsed, blockSize;
+
+    ///For lexing directive lines and pasted tokens
+    lexerTokens scratch;
+    ///For looking up macro names, null terminated
+    char* name;
+    int nameCapacity;
+
+    ///The output, with its own text and locations
+    lexerTokens out;
+    int textLength, textCapacity;
+    int locationCapacity;
+
+    int errors, warnings;
+} ppCtx;
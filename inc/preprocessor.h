@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../std/std.h"
+
+typedef struct compilerCtx compilerCtx;
+typedef struct lexerCtx lexerCtx;
+typedef struct ppFile ppFile;
+
+/**
+ * Preprocessor
+ *
+ * With compilerCtx::preprocess, each module's file is lexed keeping its
+ * directives, and the tokens run through here before parsing. #include,
+ * object and function-like #define (with # and ##), #undef, the
+ * conditionals, #error and #pragma once are understood.
+ *
+ * Each header is read and lexed once per compilation, kept in
+ * compilerCtx::headers. A header guarded by #pragma once, or by an #ifndef
+ * around the whole of it, is skipped without looking at its tokens again
+ * once included, or once its guard is defined.
+ *
+ * Each module starts with only __FCC__ defined, nothing from its importer.
+ */
+
+/**
+ * Replace the tokens of a lexer, made with directives from the file of the
+ * full name given, with what they preprocess to. The errors and warnings
+ * reported are added to the counts.
+ */
+void preprocess (compilerCtx* comp, lexerCtx* lexer, const char* fullname, int* errors, int* warnings);
+
+void ppFileDestroy (ppFile* file);
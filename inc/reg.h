@@ -2,15 +2,6 @@
 
 #include "../std/std.h"
 
-typedef struct reg {
-    ///Minimum size in bytes
-    int size;
-    ///Name when a byte, word, dword and qword
-    const char* names[4];
-    ///If unused, 0, else the size allocated as in bytes
-    int allocatedAs;
-} reg;
-
 typedef enum regIndex {
     regUndefined,
     /*It is important that every register between RAX and R15 is a general register*/
@@ -33,27 +24,41 @@ typedef enum regIndex {
     regMax
 } regIndex;
 
-extern reg regs[regMax];
+typedef struct reg {
+    regIndex index;
+    ///Minimum size in bytes
+    int size;
+    ///Name when a byte, word, dword and qword
+    const char* names[4];
+    ///If unused, 0, else the size allocated as in bytes
+    int allocatedAs;
+} reg;
+
+/**
+ * Reset a register file (an array of regMax registers) to all unused.
+ * Each compilation owns its own, see irCtx.
+ */
+void regsInit (reg* regs);
 
 /**
  * Check if a register is in use
  */
-bool regIsUsed (regIndex r);
+bool regIsUsed (const reg* regs, regIndex r);
 
-const reg* regGet (regIndex r);
+const reg* regGet (const reg* regs, regIndex r);
 
 /**
  * Attempt a lock on a register
  * Returns the register on success, 0 elsewise
  */
-reg* regRequest (regIndex r, int size);
+reg* regRequest (reg* regs, regIndex r, int size);
 
 void regFree (reg* r);
 
 /**
  * Attempt to allocate a register, returning it if successful.
  */
-reg* regAlloc (int size);
+reg* regAlloc (reg* regs, int size);
 
 const char* regIndexGetName (regIndex r, int size);
 
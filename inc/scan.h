@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../std/std.h"
+
+/**
+ * Searching of text in bulk, many characters at a time. Uses AVX2 or SSE2
+ * where the machine running has them, decided at runtime, otherwise one
+ * character at a time.
+ */
+
+/**
+ * Find the first character from str up to end which is one of the four in
+ * set, or with within, the first which isn't. Returns end if there is none.
+ *
+ * To search for fewer, repeat one.
+ */
+const char* scanFind (const char* str, const char* end, const char set[4], bool within);
+
+/**
+ * Count the occurrences of c from str up to end
+ */
+int scanCount (const char* str, const char* end, char c);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../std/std.h"
+
+/**
+ * Compile server
+ *
+ * A server listens on a Unix socket for command lines, each run in the
+ * working directory of the client that sent it, with what it prints sent
+ * back. It runs them one at a time, so a handler may keep state between
+ * them, like the modules of a resident compilerCtx.
+ */
+
+/**
+ * Run one command line, returning the exit status
+ */
+typedef int (*serverHandler)(void* ctx, int argc, char** argv);
+
+/**
+ * Serve requests until killed. Returns whether the socket couldn't be
+ * made, having already reported it.
+ */
+bool serverRun (const char* socket, serverHandler handler, void* ctx);
+
+/**
+ * Send a command line to a server and print what it does. Returns
+ * whether there was a server to answer, and if so sets its exit status.
+ */
+bool serverRequest (const char* socket, int argc, char** argv, int* status);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "../std/std.h"
+
+#include "stdint.h"
+
+/**
+ * A location in the source manager's address space. Each file added takes
+ * a range of offsets, one for each character and one more for its end, so
+ * that a location is a single offset. Which line and column it is on are
+ * only worked out when asked for, see sourceGetPosition.
+ *
+ * Zero, sourceNone, is no location at all.
+ */
+typedef uint32_t tokenLocation;
+
+enum {
+    sourceNone = 0
+};
+
+/**
+ * A location resolved, for diagnostics
+ */
+typedef struct sourcePosition {
+    ///Null for no location
+    const char* filename;
+    int line;
+    ///Counting tabs as four columns
+    int lineChar;
+} sourcePosition;
+
+/**
+ * Add a file's text, taking ownership of it, returning the location of its
+ * first character. The filename is only referred to, and must outlive it.
+ *
+ * Returns sourceNone, leaving the text with the caller, if no range of
+ * locations is left large enough.
+ *
+ * A file with no text (from a module interface, say) is on line zero.
+ */
+tokenLocation sourceAdd (const char* filename, char* text, int length);
+
+/**
+ * Forget the file containing a location, and free its text. Its locations
+ * may be given to another file added later.
+ */
+void sourceRelease (tokenLocation loc);
+
+/**
+ * Find the file, line and column of a location. The lines of a file are
+ * indexed the first time any of them is asked for.
+ */
+sourcePosition sourceGetPosition (tokenLocation loc);
+
+/**
+ * Whether two locations are within the same file
+ */
+bool sourceIsSameFile (tokenLocation l, tokenLocation r);
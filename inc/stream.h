@@ -1,19 +1,27 @@
 #pragma once
 
-#include "stdio.h"
+#include "source.h"
 
 /**
  * Stream context
  */
 typedef struct streamCtx {
-    FILE* file;
+    ///The whole file, read in at once, and null terminated.
+    ///Owned by the source manager
+    char* str;
+    int length;
+    ///Index of the current character
+    int pos;
+    ///Location of the first character
+    tokenLocation base;
 
     char current;
-    int line;
-    int lineChar;
 } streamCtx;
 
-streamCtx* streamInit (const char* filename);
+/**
+ * Read a file, adding it to the source manager under a name, see source.h
+ */
+streamCtx* streamInit (const char* fullname, const char* filename);
 void streamEnd (streamCtx* ctx);
 
 /**
@@ -25,3 +33,14 @@ char streamNext (streamCtx* ctx);
  * Backtrack a single character, return the old character (that is now next)
  */
 char streamPrev (streamCtx* ctx);
+
+/**
+ * Skip ahead to the next of up to four characters, or the end, returning
+ * the text skipped. Its length is written to length, if given.
+ */
+const char* streamSkipUntil (streamCtx* ctx, const char* chars, int* length);
+
+/**
+ * Skip ahead past any of up to four characters
+ */
+void streamSkipWhile (streamCtx* ctx, const char* chars);
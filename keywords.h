@@ -0,0 +1,44 @@
+/*This file gets [re]generated by makekeywords.sh, called by the makefile,
+  from keywordStrs in src/lexer.c.*/
+
+enum {
+    keywordHashA = 3,
+    keywordHashB = 15,
+    keywordHashSize = 128,
+    keywordLongest = 8
+};
+
+static const unsigned char keywordHashTable[keywordHashSize] = {
+    [109] = keywordUsing,
+    [55] = keywordIf,
+    [30] = keywordElse,
+    [85] = keywordWhile,
+    [47] = keywordDo,
+    [99] = keywordFor,
+    [119] = keywordSwitch,
+    [24] = keywordCase,
+    [127] = keywordDefault,
+    [78] = keywordReturn,
+    [112] = keywordBreak,
+    [28] = keywordContinue,
+    [89] = keywordSizeof,
+    [122] = keywordConst,
+    [40] = keywordAuto,
+    [44] = keywordStatic,
+    [39] = keywordExtern,
+    [93] = keywordTypedef,
+    [43] = keywordStruct,
+    [86] = keywordUnion,
+    [22] = keywordEnum,
+    [66] = keywordVoid,
+    [126] = keywordBool,
+    [91] = keywordChar,
+    [10] = keywordInt,
+    [75] = keywordTrue,
+    [34] = keywordFalse,
+    [54] = keywordVAStart,
+    [68] = keywordVAEnd,
+    [113] = keywordVAArg,
+    [0] = keywordVACopy,
+    [117] = keywordAssert,
+};
@@ -0,0 +1,91 @@
+# Generates the perfect hash table used by lookKeyword from the spellings
+# in keywordStrs, in the given lexer source. Searches for the multipliers,
+# and the smallest power of two table size, for which
+#     (first*A + last*B + length) % size
+# differs for every keyword.
+
+awk '
+BEGIN {
+    n = 0
+
+    for (i = 1; i < 256; i++)
+        ord[sprintf("%c", i)] = i
+}
+
+/^ *\[keyword[A-Za-z]*\] = "[a-z_]*",/ {
+    match($0, /keyword[A-Za-z]*/)
+    tag[n] = substr($0, RSTART, RLENGTH)
+    match($0, /"[a-z_]*"/)
+    str[n] = substr($0, RSTART+1, RLENGTH-2)
+    n++
+}
+
+function hash(s, a, b, size) {
+    return (ord[substr(s, 1, 1)]*a + ord[substr(s, length(s), 1)]*b + length(s)) % size
+}
+
+function perfect(a, b, size,    i, h, used) {
+    for (i = 0; i < n; i++) {
+        h = hash(str[i], a, b, size)
+
+        if (h in used)
+            return 0
+
+        used[h] = 1
+    }
+
+    return 1
+}
+
+END {
+    if (n == 0) {
+        print "makekeywords.sh: no keywords found" > "/dev/stderr"
+        exit 1
+    }
+
+    longest = 0
+
+    for (i = 0; i < n; i++)
+        if (length(str[i]) > longest)
+            longest = length(str[i])
+
+    for (size = 1; size < 2*n; size *= 2)
+        ;
+
+    found = 0
+
+    for (; !found && size <= 4096; size *= 2)
+        for (i = 1; !found && i < 64; i++)
+            for (j = 1; !found && j < 64; j++)
+                if (perfect(i, j, size)) {
+                    found = 1
+                    a = i
+                    b = j
+                    chosen = size
+                }
+
+    size = chosen
+
+    if (!found) {
+        print "makekeywords.sh: no perfect hash found" > "/dev/stderr"
+        exit 1
+    }
+
+    print "/*This file gets [re]generated by makekeywords.sh, called by the makefile,"
+    print "  from keywordStrs in src/lexer.c.*/"
+    print ""
+    print "enum {"
+    print "    keywordHashA = " a ","
+    print "    keywordHashB = " b ","
+    print "    keywordHashSize = " size ","
+    print "    keywordLongest = " longest
+    print "};"
+    print ""
+    print "static const unsigned char keywordHashTable[keywordHashSize] = {"
+
+    for (i = 0; i < n; i++)
+        print "    [" hash(str[i], a, b, size) "] = " tag[i] ","
+
+    print "};"
+}
+' $1
@@ -334,7 +334,7 @@ static const type* analyzerDeclAssignBOP (analyzerCtx* ctx, ast* Node, type* bas
     /*If this symbol is statically stored (implicitly, or by a
       previous decl) require a constant initializer*/
     else if (Node->l->symbol->storage == storageStatic) {
-        if (evalIsConstantInit(Node->r))
+        if (!evalIsConstantInit(Node->r))
             errorStaticCompileTimeKnown(ctx, Node->r, Node->l->symbol);
     }
 
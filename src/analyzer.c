@@ -7,6 +7,7 @@
 #include "../inc/sym.h"
 #include "../inc/error.h"
 #include "../inc/architecture.h"
+#include "../inc/eval.h"
 
 #include "../inc/compiler.h"
 
@@ -21,6 +22,9 @@ static void analyzerCode (analyzerCtx* ctx, ast* Node);
 static void analyzerBranch (analyzerCtx* ctx, ast* Node);
 static void analyzerLoop (analyzerCtx* ctx, ast* Node);
 static void analyzerIter (analyzerCtx* ctx, ast* Node);
+static void analyzerSwitch (analyzerCtx* ctx, ast* Node);
+static void analyzerLabel (analyzerCtx* ctx, ast* Node);
+static void analyzerLabelValue (analyzerCtx* ctx, ast* Node);
 static void analyzerReturn (analyzerCtx* ctx, ast* Node);
 
 static analyzerCtx* analyzerInit (sym** Types, const architecture* arch) {
@@ -31,6 +35,8 @@ static analyzerCtx* analyzerInit (sym** Types, const architecture* arch) {
     ctx->fnctx.fn = 0;
     ctx->fnctx.returnType = 0;
 
+    ctx->switchLabels = 0;
+
     intsetInit(&ctx->incompleteDeclIgnore, 16);
     intsetInit(&ctx->incompletePtrIgnore, 16);
 
@@ -102,6 +108,12 @@ void analyzerNode (analyzerCtx* ctx, ast* Node) {
     else if (Node->tag == astIter)
         analyzerIter(ctx, Node);
 
+    else if (Node->tag == astSwitch)
+        analyzerSwitch(ctx, Node);
+
+    else if (Node->tag == astCase || Node->tag == astDefault)
+        analyzerLabel(ctx, Node);
+
     else if (Node->tag == astReturn)
         analyzerReturn(ctx, Node);
 
@@ -152,14 +164,16 @@ static void analyzerFnImpl (analyzerCtx* ctx, ast* Node) {
     else if (!typeIsFunction(Node->symbol->dt))
         errorTypeExpected(ctx, Node->l->firstChild, "implementation", "function");
 
-    /*Analyze the implementation*/
+    /*Analyze the implementation, unless skipped in an imported module*/
 
-    /*Save the old one, functions may be (illegally) nested*/
-    analyzerFnCtx oldFnctx = analyzerPushFnctx(ctx, Node->symbol);
+    if (Node->r) {
+        /*Save the old one, functions may be (illegally) nested*/
+        analyzerFnCtx oldFnctx = analyzerPushFnctx(ctx, Node->symbol);
 
-    analyzerNode(ctx, Node->r);
+        analyzerNode(ctx, Node->r);
 
-    analyzerPopFnctx(ctx, oldFnctx);
+        analyzerPopFnctx(ctx, oldFnctx);
+    }
 }
 
 static void analyzerCode (analyzerCtx* ctx, ast* Node) {
@@ -232,6 +246,73 @@ static void analyzerIter (analyzerCtx* ctx, ast* Node) {
     analyzerNode(ctx, Node->l);
 }
 
+static void analyzerSwitch (analyzerCtx* ctx, ast* Node) {
+    /*Condition*/
+
+    const type* cond = analyzerValue(ctx, Node->l);
+
+    if (!typeIsNumeric(cond) || typeIsPtr(cond))
+        errorTypeExpected(ctx, Node->l, "switch", "integer");
+
+    /*Code, collecting the labels of this switch*/
+
+    vector/*<const ast*>*/ labels;
+    vectorInit(&labels, 8);
+
+    vector* oldLabels = ctx->switchLabels;
+    ctx->switchLabels = &labels;
+
+    analyzerNode(ctx, Node->r);
+
+    ctx->switchLabels = oldLabels;
+    vectorFree(&labels);
+}
+
+static void analyzerLabel (analyzerCtx* ctx, ast* Node) {
+    analyzerLabelValue(ctx, Node);
+    analyzerNode(ctx, Node->l);
+}
+
+static void analyzerLabelValue (analyzerCtx* ctx, ast* Node) {
+    /*Outside of a switch is a parsing issue*/
+    if (!ctx->switchLabels)
+        return;
+
+    /*Is the case value a compile time known integer?*/
+
+    if (Node->tag == astCase) {
+        const type* value = analyzerValue(ctx, Node->r);
+
+        if (!typeIsNumeric(value) || typeIsPtr(value)) {
+            errorTypeExpected(ctx, Node->r, "case", "integer");
+            return;
+        }
+
+        evalResult constant = eval(ctx->arch, Node->r);
+
+        if (!constant.known) {
+            errorCaseCompileTimeKnown(ctx, Node->r);
+            return;
+        }
+
+        Node->constant = constant.value;
+    }
+
+    /*Unique in this switch?*/
+
+    for (int i = 0; i < ctx->switchLabels->length; i++) {
+        const ast* label = vectorGet(ctx->switchLabels, i);
+
+        if (   label->tag == Node->tag
+            && (Node->tag == astDefault || label->constant == Node->constant)) {
+            errorDuplicateLabel(ctx, Node, label);
+            return;
+        }
+    }
+
+    vectorPush(ctx->switchLabels, Node);
+}
+
 static void analyzerReturn (analyzerCtx* ctx, ast* Node) {
     /*Return type, if any, matches?*/
 
@@ -18,6 +18,7 @@ static void manglerWindows (sym* Symbol);
 /*==== Ctor/dtor ====*/
 
 void archInit (architecture* arch) {
+    arch->os = osLinux;
     arch->wordsize = 0;
 
     vectorInit(&arch->scratchRegs, 4);
@@ -46,6 +47,7 @@ void archSetup (architecture* arch, osTag os, int wordsize) {
     /*Most details got from Agner Fog's calling convention manual;
        - http://www.agner.org/optimize/calling_conventions.pdf */
 
+    arch->os = os;
     arch->wordsize = wordsize;
 
     /*Calling conventon registers*/
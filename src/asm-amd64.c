@@ -9,6 +9,71 @@
 #include "stdlib.h"
 #include "stdarg.h"
 #include "stdio.h"
+#include "string.h"
+
+enum {
+    ///Room for any mnemonic, with a condition code
+    asmMnemonicMax = 16
+};
+
+/*==== Instructions ====*/
+
+/*The common instructions are written straight into their block, sparing
+  any formatting*/
+
+static void asmInstr (irBlock* block, const char* mnemonic) {
+    bufferStr(irBlockBeginLn(block), mnemonic);
+    irBlockEndLn(block);
+}
+
+/*With a register (or label) by name*/
+static void asmInstrName (irBlock* block, const char* mnemonic, const char* name) {
+    buffer* out = irBlockBeginLn(block);
+    bufferStr(out, mnemonic);
+    bufferChar(out, ' ');
+    bufferStr(out, name);
+    irBlockEndLn(block);
+}
+
+static void asmInstr1 (irBlock* block, const char* mnemonic, operand L) {
+    buffer* out = irBlockBeginLn(block);
+    bufferStr(out, mnemonic);
+    bufferChar(out, ' ');
+    operandWrite(out, L);
+    irBlockEndLn(block);
+}
+
+static void asmInstr2 (irBlock* block, const char* mnemonic, operand L, operand R) {
+    buffer* out = irBlockBeginLn(block);
+    bufferStr(out, mnemonic);
+    bufferChar(out, ' ');
+    operandWrite(out, L);
+    bufferStrN(out, ", ", 2);
+    operandWrite(out, R);
+    irBlockEndLn(block);
+}
+
+static void asmInstr3 (irBlock* block, const char* mnemonic, operand L, operand R, operand S) {
+    buffer* out = irBlockBeginLn(block);
+    bufferStr(out, mnemonic);
+    bufferChar(out, ' ');
+    operandWrite(out, L);
+    bufferStrN(out, ", ", 2);
+    operandWrite(out, R);
+    bufferStrN(out, ", ", 2);
+    operandWrite(out, S);
+    irBlockEndLn(block);
+}
+
+/*A mnemonic suffixed with a condition code, like sete, into room for
+  asmMnemonicMax*/
+static const char* asmConditional (char* mnemonic, const char* prefix, operand Cond) {
+    strcpy(mnemonic, prefix);
+    strcat(mnemonic, conditionGetStr(Cond.condition));
+    return mnemonic;
+}
+
+/*==== Module ====*/
 
 void asmComment (asmCtx* ctx, const char* str) {
     asmOutLn(ctx, ";%s", str);
@@ -23,15 +88,18 @@ void asmFileEpilogue (asmCtx* ctx) {
     (void) ctx;
 }
 
-void asmFnLinkageBegin (FILE* file, const char* name) {
-    /*Symbol, linkage and alignment*/
-    fprintf(file, ".balign 16\n");
-    fprintf(file, ".globl %s\n", name);
-    fprintf(file, "%s:\n", name);
+void asmFnLinkageBegin (asmCtx* ctx, const char* name) {
+    /*Symbol, linkage and alignment, unindented*/
+    buffer* out = &ctx->out;
+    bufferStrN(out, ".balign 16\n.globl ", 18);
+    bufferStr(out, name);
+    bufferChar(out, '\n');
+    bufferStr(out, name);
+    bufferStrN(out, ":\n", 2);
 }
 
-void asmFnLinkageEnd (FILE* file, const char* name) {
-    (void) file, (void) name;
+void asmFnLinkageEnd (asmCtx* ctx, const char* name) {
+    (void) ctx, (void) name;
 }
 
 void asmFnPrologue (irCtx* ir, irBlock* block, int localSize) {
@@ -66,12 +134,12 @@ void asmFnEpilogue (irCtx* ir, irBlock* block) {
 
 void asmSaveReg (irCtx* ir, irBlock* block, regIndex r) {
     asmCtx* ctx = ir->asm;
-    irBlockOut(block, "push %s", regIndexGetName(r, ctx->arch->wordsize));
+    asmInstrName(block, "push", regIndexGetName(r, ctx->arch->wordsize));
 }
 
 void asmRestoreReg (irCtx* ir, irBlock* block, regIndex r) {
     asmCtx* ctx = ir->asm;
-    irBlockOut(block, "pop %s", regIndexGetName(r, ctx->arch->wordsize));
+    asmInstrName(block, "pop", regIndexGetName(r, ctx->arch->wordsize));
 }
 
 void asmDataSection (asmCtx* ctx) {
@@ -82,6 +150,10 @@ void asmRODataSection (asmCtx* ctx) {
     asmOutLn(ctx, ".section .rodata");
 }
 
+void asmBSSSection (asmCtx* ctx) {
+    asmOutLn(ctx, ".section .bss");
+}
+
 void asmStaticData (asmCtx* ctx, const char* label, bool global, int size, intptr_t initial) {
     if (global)
         asmOutLn(ctx, ".globl %s", label);
@@ -89,52 +161,297 @@ void asmStaticData (asmCtx* ctx, const char* label, bool global, int size, intpt
     asmOutLn(ctx, "%s:", label);
 
     if (size == 1)
-        asmOutLn(ctx, ".byte %d", initial);
+        asmOutLn(ctx, ".byte %d", (int) initial);
 
     else if (size == 2)
-        asmOutLn(ctx, ".word %d", initial);
+        asmOutLn(ctx, ".word %d", (int) initial);
 
     else if (size == 4)
-        asmOutLn(ctx, ".quad %d", initial);
+        asmOutLn(ctx, ".long %d", (int) initial);
 
     else if (size == 8)
-        asmOutLn(ctx, ".octa %d", initial);
+        asmOutLn(ctx, ".quad %lld", (long long) initial);
+
+    /*Zero initialized records and arrays*/
+    else if (initial == 0)
+        asmOutLn(ctx, ".zero %d", size);
 
     else
         debugErrorUnhandledInt("asmStaticData", "data size", size);
 }
 
+void asmStaticZero (asmCtx* ctx, const char* label, bool global, int size) {
+    if (global)
+        asmOutLn(ctx, ".globl %s", label);
+
+    /*By the largest power of two dividing the size, up to the word size*/
+    int align = 1;
+
+    while (align < ctx->arch->wordsize && size % (align*2) == 0)
+        align *= 2;
+
+    asmOutLn(ctx, ".balign %d", align);
+    asmOutLn(ctx, "%s:", label);
+    asmOutLn(ctx, ".zero %d", size);
+}
+
+void asmStaticBytes (asmCtx* ctx, const char* label, bool global, int size, const char* bytes,
+                     const vector/*<irStaticRef*>*/* refs) {
+    if (global)
+        asmOutLn(ctx, ".globl %s", label);
+
+    asmOutLn(ctx, ".balign %d", ctx->arch->wordsize);
+    asmOutLn(ctx, "%s:", label);
+
+    int ref = 0;
+
+    /*Runs of zeros in one directive, other bytes sixteen to a line, up to
+      each address*/
+    for (int i = 0; i < size;) {
+        const irStaticRef* next = ref < refs->length ? vectorGet(refs, ref) : 0;
+        int end = next ? next->offset : size;
+
+        int zeros = 0;
+
+        while (i+zeros < end && bytes[i+zeros] == 0)
+            zeros++;
+
+        if (i == end) {
+            asmOutLn(ctx, "%s %s", ctx->arch->wordsize == 8 ? ".quad" : ".long", next->label);
+            i += ctx->arch->wordsize;
+            ref++;
+
+        } else if (zeros >= 8 || i+zeros == end) {
+            asmOutLn(ctx, ".zero %d", zeros);
+            i += zeros;
+
+        } else {
+            char line[16*5+1] = "";
+            int length = 0;
+
+            for (int j = 0; j < 16 && i < end; j++, i++)
+                length += sprintf(line+length, j == 0 ? "%d" : ", %d", (unsigned char) bytes[i]);
+
+            asmOutLn(ctx, ".byte %s", line);
+        }
+    }
+}
+
+void asmStringSection (asmCtx* ctx) {
+    asmOutLn(ctx, ".section .rodata.str1.1,\"aMS\",@progbits,1");
+}
+
 void asmStringConstant (asmCtx* ctx, const char* label, const char* str) {
     asmOutLn(ctx, "%s:", label);
     asmOutLn(ctx, ".asciz \"%s\"", str);
 }
 
+void asmStringConstantSuffix (asmCtx* ctx, const char* label, const char* outer, int offset) {
+    asmOutLn(ctx, ".set %s, %s+%d", label, outer, offset);
+}
+
 void asmLabel (asmCtx* ctx, const char* label) {
-    asmOutLn(ctx, "\t%s:", label);
+    buffer* out = asmBeginLn(ctx);
+    bufferChar(out, '\t');
+    bufferStr(out, label);
+    bufferChar(out, ':');
+    asmEndLn(ctx);
+}
+
+/*Jumps and calls to a label*/
+static void asmToLabel (asmCtx* ctx, const char* mnemonic, const char* label) {
+    buffer* out = asmBeginLn(ctx);
+    bufferStr(out, mnemonic);
+    bufferChar(out, ' ');
+    bufferStr(out, label);
+    asmEndLn(ctx);
 }
 
 void asmJump (asmCtx* ctx, const char* label) {
-    asmOutLn(ctx, "jmp %s", label);
+    asmToLabel(ctx, "jmp", label);
 }
 
 void asmBranch (asmCtx* ctx, operand Condition, const char* label) {
-    char* CStr = operandToStr(Condition);
-    asmOutLn(ctx, "j%s %s", CStr, label);
-    free(CStr);
+    char mnemonic[asmMnemonicMax];
+    asmToLabel(ctx, asmConditional(mnemonic, "j", Condition), label);
 }
 
 void asmCall (asmCtx* ctx, const char* label) {
-    asmOutLn(ctx, "call %s", label);
+    asmToLabel(ctx, "call", label);
 }
 
 void asmCallIndirect (irBlock* block, operand L) {
-    char* LStr = operandToStr(L);
-    irBlockOut(block, "call %s", LStr);
-    free(LStr);
+    asmInstr1(block, "call", L);
+}
+
+void asmJumpTable (irCtx* ir, irBlock* block, const char* table, operand Index) {
+    asmCtx* ctx = ir->asm;
+
+    /*jmp size ptr [table+index*wordsize]*/
+    buffer* out = irBlockBeginLn(block);
+    bufferStr(out, ctx->arch->wordsize == 8 ? "jmp qword ptr [" : "jmp dword ptr [");
+    bufferStr(out, table);
+    bufferChar(out, '+');
+    operandWrite(out, Index);
+    bufferChar(out, '*');
+    bufferInt(out, ctx->arch->wordsize);
+    bufferChar(out, ']');
+    irBlockEndLn(block);
+}
+
+void asmJumpTableData (irCtx* ir, const char* table, const vector/*<irBlock*>*/* targets) {
+    asmCtx* ctx = ir->asm;
+
+    asmOutLn(ctx, ".section .rodata");
+    asmOutLn(ctx, ".balign %d", ctx->arch->wordsize);
+    asmOutLn(ctx, "%s:", table);
+
+    for (int i = 0; i < targets->length; i++) {
+        const irBlock* target = vectorGet(targets, i);
+        char label[irLabelMax];
+        asmOutLn(ctx, "%s %s", ctx->arch->wordsize == 8 ? ".quad" : ".long", irBlockGetLabel(ir, target, label));
+    }
+
+    asmOutLn(ctx, ".text");
 }
 
 void asmReturn (asmCtx* ctx) {
-    asmOutLn(ctx, "ret");
+    bufferStrN(asmBeginLn(ctx), "ret", 3);
+    asmEndLn(ctx);
+}
+
+static bool operandIsMem (operand L) {
+    return L.tag == operandMem || L.tag == operandLabelMem;
+}
+
+/*==== Block copies ====*/
+
+/*Size tiers for block copies and zeroing, in bytes*/
+enum {
+    ///Below this, word by word moves through a register
+    asmBlockVectorMin = 32,
+    ///From here on, rep movs/stos
+    asmBlockRepMin = 256
+};
+
+static bool operandUsesReg (operand L, regIndex r) {
+    return    L.tag == operandMem
+           && (   (L.base && L.base->index == r)
+               || (L.index && L.index->index == r));
+}
+
+/*Move size bytes in the largest chunks that fit, down to a byte*/
+static void asmMoveChunks (irCtx* ir, irBlock* block, operand Dest, operand Src, int size) {
+    for (int chunk = ir->arch->wordsize; chunk != 0; chunk /= 2) {
+        Dest.size = Src.size = chunk;
+
+        for (; size >= chunk; size -= chunk, Dest.offset += chunk, Src.offset += chunk)
+            asmMove(ir, block, Dest, Src);
+    }
+}
+
+/*16 bytes at a time through xmm0, which nothing else uses.
+  A literal Src is only supported as zero.*/
+static void asmMoveVector (irCtx* ir, irBlock* block, operand Dest, operand Src, int size) {
+    bool zero = Src.tag == operandLiteral;
+
+    if (zero)
+        asmInstr(block, "pxor xmm0, xmm0");
+
+    Dest.size = Src.size = 16;
+
+    for (; size >= 16; size -= 16, Dest.offset += 16, Src.offset += 16) {
+        if (!zero) {
+            buffer* out = irBlockBeginLn(block);
+            bufferStrN(out, "movdqu xmm0, ", 13);
+            operandWrite(out, Src);
+            irBlockEndLn(block);
+        }
+
+        buffer* out = irBlockBeginLn(block);
+        bufferStrN(out, "movdqu ", 7);
+        operandWrite(out, Dest);
+        bufferStrN(out, ", xmm0", 6);
+        irBlockEndLn(block);
+    }
+
+    asmMoveChunks(ir, block, Dest, Src, size);
+}
+
+/*rep movs, taking over RSI, RDI and RCX. Any of them in use are saved
+  on the stack, so operands based on the stack pointer are adjusted.*/
+static void asmMoveRep (irCtx* ir, irBlock* block, operand Dest, operand Src, int size) {
+    asmCtx* ctx = ir->asm;
+
+    int wordsize = ctx->arch->wordsize;
+    regIndex taken[3] = {regRCX, regRSI, regRDI};
+    int oldSizes[3];
+
+    for (int i = 0; i < 3; i++) {
+        if (regIsUsed(ir->regs, taken[i])) {
+            asmSaveReg(ir, block, taken[i]);
+
+            if (Dest.base == ctx->stackPtr.base)
+                Dest.offset += wordsize;
+
+            if (Src.base == ctx->stackPtr.base)
+                Src.offset += wordsize;
+        }
+
+        oldSizes[i] = ir->regs[taken[i]].allocatedAs;
+        ir->regs[taken[i]].allocatedAs = wordsize;
+    }
+
+    asmEvalAddress(ir, block, operandCreateReg(&ir->regs[regRSI]), Src);
+    asmEvalAddress(ir, block, operandCreateReg(&ir->regs[regRDI]), Dest);
+    asmMove(ir, block, operandCreateReg(&ir->regs[regRCX]), operandCreateLiteral(size/wordsize));
+    asmInstr(block, wordsize == 8 ? "rep movsq" : "rep movsd");
+
+    /*RSI and RDI are left pointing at the tail*/
+    int tail = size % wordsize;
+
+    if (tail >= 4)
+        asmInstr(block, "movsd");
+
+    if (tail % 4 >= 2)
+        asmInstr(block, "movsw");
+
+    if (tail % 2)
+        asmInstr(block, "movsb");
+
+    for (int i = 2; i >= 0; i--) {
+        ir->regs[taken[i]].allocatedAs = oldSizes[i];
+
+        if (oldSizes[i])
+            asmRestoreReg(ir, block, taken[i]);
+    }
+}
+
+void asmBlockCopy (irCtx* ir, irBlock* block, operand Dest, operand Src, int size) {
+    /*rep movs needs the string registers free of the operands*/
+    bool repPossible = true;
+    regIndex taken[3] = {regRCX, regRSI, regRDI};
+
+    for (int i = 0; i < 3; i++)
+        if (operandUsesReg(Dest, taken[i]) || operandUsesReg(Src, taken[i]))
+            repPossible = false;
+
+    if (size >= asmBlockRepMin && repPossible)
+        asmMoveRep(ir, block, Dest, Src, size);
+
+    else if (size >= asmBlockVectorMin)
+        asmMoveVector(ir, block, Dest, Src, size);
+
+    else
+        asmMoveChunks(ir, block, Dest, Src, size);
+}
+
+void asmBlockZero (irCtx* ir, irBlock* block, operand Dest, int size) {
+    if (size >= asmBlockVectorMin)
+        asmMoveVector(ir, block, Dest, operandCreateLiteral(0), size);
+
+    else
+        asmMoveChunks(ir, block, Dest, operandCreateLiteral(0), size);
 }
 
 void asmPush (irCtx* ir, irBlock* block, operand L) {
@@ -142,9 +459,10 @@ void asmPush (irCtx* ir, irBlock* block, operand L) {
 
     /*Flags*/
     if (L.tag == operandFlags) {
+        /*Push doesn't touch the flags, set the low byte of the zero*/
         asmPush(ir, block, operandCreateLiteral(0));
-        operand top = operandCreateMem(ctx->stackPtr.base, 0, ctx->arch->wordsize);
-        asmConditionalMove(ir, block, L, top, operandCreateLiteral(1));
+        operand top = operandCreateMem(ctx->stackPtr.base, 0, 1);
+        asmMove(ir, block, top, L);
 
     /*Larger than word*/
     } else if (operandGetSize(ctx->arch, L) > ctx->arch->wordsize) {
@@ -153,36 +471,45 @@ void asmPush (irCtx* ir, irBlock* block, operand L) {
 
         int size = operandGetSize(ctx->arch, L);
 
-        /*Push on *backwards* in word chunks.
-          Start at the highest address*/
-        L.offset += size;
-        L.size = ctx->arch->wordsize;
+        /*Large: make the space, then block copy into it*/
+        if (size >= asmBlockVectorMin) {
+            int wordsize = ctx->arch->wordsize;
+            int padded = (size+wordsize-1)/wordsize*wordsize;
+
+            asmBOP(ir, block, bopSub, ctx->stackPtr, operandCreateLiteral(padded));
 
-        for (int i = 0; i < size; i += ctx->arch->wordsize) {
-            L.offset -= ctx->arch->wordsize;
-            asmPush(ir, block, L);
+            if (L.base == ctx->stackPtr.base)
+                L.offset += padded;
+
+            asmBlockCopy(ir, block, operandCreateMem(ctx->stackPtr.base, 0, size), L, size);
+
+        } else {
+            /*Push on *backwards* in word chunks.
+              Start at the highest address*/
+            L.offset += size;
+            L.size = ctx->arch->wordsize;
+
+            for (int i = 0; i < size; i += ctx->arch->wordsize) {
+                L.offset -= ctx->arch->wordsize;
+                asmPush(ir, block, L);
+            }
         }
 
     /*Smaller than a word*/
     } else if (L.tag == operandMem && operandGetSize(ctx->arch, L) < ctx->arch->wordsize) {
-        operand intermediate = operandCreateReg(regAlloc(ctx->arch->wordsize));
+        operand intermediate = operandCreateReg(regAlloc(ir->regs, ctx->arch->wordsize));
         asmMove(ir, block, intermediate, L);
         asmPush(ir, block, intermediate);
         operandFree(intermediate);
 
-    } else {
-        char* LStr = operandToStr(L);
-        irBlockOut(block, "push %s", LStr);
-        free(LStr);
-    }
+    } else
+        asmInstr1(block, "push", L);
 }
 
 void asmPop (irCtx* ir, irBlock* block, operand L) {
     (void) ir;
 
-    char* LStr = operandToStr(L);
-    irBlockOut(block, "pop %s", LStr);
-    free(LStr);
+    asmInstr1(block, "pop", L);
 }
 
 void asmPushN (irCtx* ir, irBlock* block, int n) {
@@ -199,8 +526,61 @@ void asmPopN (irCtx* ir, irBlock* block, int n) {
         asmBOP(ir, block, bopAdd, ctx->stackPtr, operandCreateLiteral(n*ctx->arch->wordsize));
 }
 
-static bool operandIsMem (operand L) {
-    return L.tag == operandMem || L.tag == operandLabelMem;
+/*Find a free register with a byte sized form, for setcc*/
+static reg* asmByteRegRequest (irCtx* ir) {
+    for (regIndex r = regRAX; r <= regRDX; r++)
+        if (!regIsUsed(ir->regs, r))
+            return regRequest(ir->regs, r, 1);
+
+    return 0;
+}
+
+/*Materialize flags as 0 or 1 with setcc instead of branching.
+  Neither mov nor movzx modify the flags, so zeroing may come first.*/
+static void asmSetCondition (irCtx* ir, irBlock* block, operand Dest, operand Cond) {
+    asmCtx* ctx = ir->asm;
+
+    char mnemonic[asmMnemonicMax];
+    asmConditional(mnemonic, "set", Cond);
+    int size = operandGetSize(ctx->arch, Dest);
+
+    /*Register with a byte form: setcc the low byte, zero extend*/
+    if (Dest.tag == operandReg && Dest.base->names[0]) {
+        asmInstrName(block, mnemonic, Dest.base->names[0]);
+
+        if (size > 1) {
+            buffer* out = irBlockBeginLn(block);
+            bufferStrN(out, "movzx ", 6);
+            operandWrite(out, Dest);
+            bufferStrN(out, ", ", 2);
+            bufferStr(out, Dest.base->names[0]);
+            irBlockEndLn(block);
+        }
+
+    /*Memory: zero it, set the low byte*/
+    } else if (operandIsMem(Dest)) {
+        if (size > 1)
+            asmMove(ir, block, Dest, operandCreateLiteral(0));
+
+        Dest.size = 1;
+        asmInstr1(block, mnemonic, Dest);
+
+    } else {
+        reg* byte = asmByteRegRequest(ir);
+
+        /*Go through a byte register, zero extending into Dest*/
+        if (byte) {
+            operand intermediate = operandCreateReg(byte);
+            asmSetCondition(ir, block, intermediate, Cond);
+            asmMove(ir, block, Dest, intermediate);
+            operandFree(intermediate);
+
+        /*No byte register free: fall back to a branch*/
+        } else {
+            asmMove(ir, block, Dest, operandCreateLiteral(0));
+            asmConditionalMove(ir, block, Cond, Dest, operandCreateLiteral(1));
+        }
+    }
 }
 
 void asmMove (irCtx* ir, irBlock* block, operand Dest, operand Src) {
@@ -217,63 +597,49 @@ void asmMove (irCtx* ir, irBlock* block, operand Dest, operand Src) {
                            operandGetSize(ctx->arch, Dest) == operandGetSize(ctx->arch, Src)))
             return;
 
-        int size = operandGetSize(ctx->arch, Dest);
-        int chunk = ctx->arch->wordsize;
-        Dest.size = Src.size = chunk;
-
-        /*Move up the operands, so far as a chunk would not go past their ends*/
-        for (int i = 0;
-             i+chunk <= size;
-             i += chunk, Dest.offset += chunk, Src.offset += chunk)
-            asmMove(ir, block, Dest, Src);
-
-        /*Were the operands not an even multiple of the chunk size?*/
-        if (size % chunk != 0) {
-            /*Final chunk size is the remainder*/
-            Dest.size = Src.size = size % chunk;
-            asmMove(ir, block, Dest, Src);
-        }
+        asmBlockCopy(ir, block, Dest, Src, operandGetSize(ctx->arch, Dest));
 
     /*Both memory operands*/
     } else if (operandIsMem(Dest) && operandIsMem(Src)) {
-        operand intermediate = operandCreateReg(regAlloc(max(Dest.size, Src.size)));
+        operand intermediate = operandCreateReg(regAlloc(ir->regs, max(Dest.size, Src.size)));
         asmMove(ir, block, intermediate, Src);
         asmMove(ir, block, Dest, intermediate);
         operandFree(intermediate);
 
     /*Flags*/
     } else if (Src.tag == operandFlags) {
-        asmMove(ir, block, Dest, operandCreateLiteral(0));
-        asmConditionalMove(ir, block, Src, Dest, operandCreateLiteral(1));
-
-    } else {
-        char* DestStr = operandToStr(Dest);
-        char* SrcStr = operandToStr(Src);
+        asmSetCondition(ir, block, Dest, Src);
 
-        if (   operandGetSize(ctx->arch, Dest) > operandGetSize(ctx->arch, Src)
-            && Src.tag != operandLiteral)
-            irBlockOut(block, "movzx %s, %s", DestStr, SrcStr);
+    } else if (   operandGetSize(ctx->arch, Dest) > operandGetSize(ctx->arch, Src)
+               && Src.tag != operandLiteral)
+        asmInstr2(block, "movzx", Dest, Src);
 
-        else
-            irBlockOut(block, "mov %s, %s", DestStr, SrcStr);
-
-        free(DestStr);
-        free(SrcStr);
-    }
+    else
+        asmInstr2(block, "mov", Dest, Src);
 }
 
 void asmConditionalMove (irCtx* ir, irBlock* block, operand Cond, operand Dest, operand Src) {
-    char falseLabel[10];
-    sprintf(falseLabel, ".%X", ir->labelNo++);
+    asmCtx* ctx = ir->asm;
 
-    Cond.condition = conditionNegate(Cond.condition);
-    char* cond = operandToStr(Cond);
+    char mnemonic[asmMnemonicMax];
 
-    irBlockOut(block, "j%s %s", cond, falseLabel);
-    asmMove(ir, block, Dest, Src);
-    irBlockOut(block, "%s:", falseLabel);
+    /*cmov: a word or larger register, from a register or memory of the same size*/
+    if (   Dest.tag == operandReg
+        && (Src.tag == operandReg || operandIsMem(Src))
+        && operandGetSize(ctx->arch, Dest) > 1
+        && operandGetSize(ctx->arch, Dest) == operandGetSize(ctx->arch, Src))
+        asmInstr2(block, asmConditional(mnemonic, "cmov", Cond), Dest, Src);
 
-    free(cond);
+    /*Otherwise jump around a mov*/
+    else {
+        char* falseLabel = irCreateLabel(ir);
+
+        Cond.condition = conditionNegate(Cond.condition);
+        asmInstrName(block, asmConditional(mnemonic, "j", Cond), falseLabel);
+        asmMove(ir, block, Dest, Src);
+        irBlockOut(block, "%s:", falseLabel);
+        free(falseLabel);
+    }
 }
 
 void asmRepStos (irCtx* ir, irBlock* block, operand RAX, operand RCX, operand RDI,
@@ -285,25 +651,21 @@ void asmRepStos (irCtx* ir, irBlock* block, operand RAX, operand RCX, operand RD
     asmMove(ir, block, RCX, operandCreateLiteral(iterations));
     asmEvalAddress(ir, block, RDI, Dest);
 
-    irBlockOut(block, "rep stos%s", chunksize == 8 ? "q" : "d");
+    asmInstr(block, chunksize == 8 ? "rep stosq" : "rep stosd");
 }
 
 void asmEvalAddress (irCtx* ir, irBlock* block, operand L, operand R) {
     asmCtx* ctx = ir->asm;
 
     if (operandIsMem(L) && operandIsMem(R)) {
-        operand intermediate = operandCreateReg(regAlloc(ctx->arch->wordsize));
+        operand intermediate = operandCreateReg(regAlloc(ir->regs, ctx->arch->wordsize));
         asmEvalAddress(ir, block, intermediate, R);
         asmMove(ir, block, L, intermediate);
         operandFree(intermediate);
 
     } else {
-        char* LStr = operandToStr(L);
         R.size = ctx->arch->wordsize;
-        char* RStr = operandToStr(R);
-        irBlockOut(block, "lea %s, %s", LStr, RStr);
-        free(LStr);
-        free(RStr);
+        asmInstr2(block, "lea", L, R);
     }
 }
 
@@ -312,7 +674,7 @@ void asmCompare (irCtx* ir, irBlock* block, operand L, operand R) {
 
     if (   (operandIsMem(L) && operandIsMem(R))
         || (L.tag == operandLiteral && R.tag == operandLiteral)) {
-        operand intermediate = operandCreateReg(regAlloc(L.tag == operandMem ? max(L.size, R.size)
+        operand intermediate = operandCreateReg(regAlloc(ir->regs, L.tag == operandMem ? max(L.size, R.size)
                                                                              : ctx->arch->wordsize));
         asmMove(ir, block, intermediate, L);
         asmCompare(ir, block, intermediate, R);
@@ -322,17 +684,19 @@ void asmCompare (irCtx* ir, irBlock* block, operand L, operand R) {
         asmCompare(ir, block, R, L);
 
     } else {
-        char* LStr = operandToStr(L);
-        char* RStr = operandToStr(R);
-        irBlockOut(block, "cmp %s, %s", LStr, RStr);
-        free(LStr);
-        free(RStr);
+        asmInstr2(block, "cmp", L, R);
     }
 }
 
+void asmBitTest (irCtx* ir, irBlock* block, operand L, operand R) {
+    (void) ir;
+
+    asmInstr2(block, "bt", L, R);
+}
+
 void asmBOP (irCtx* ir, irBlock* block, boperation Op, operand L, operand R) {
     if (operandIsMem(L) && operandIsMem(R)) {
-        operand intermediate = operandCreateReg(regAlloc(max(L.size, R.size)));
+        operand intermediate = operandCreateReg(regAlloc(ir->regs, max(L.size, R.size)));
         asmMove(ir, block, intermediate, R);
         asmBOP(ir, block, Op, L, intermediate);
         operandFree(intermediate);
@@ -346,24 +710,15 @@ void asmBOP (irCtx* ir, irBlock* block, boperation Op, operand L, operand R) {
             operandFree(R);
 
         } else {
-            operand tmp = operandCreateReg(regAlloc(max(L.size, R.size)));
+            operand tmp = operandCreateReg(regAlloc(ir->regs, max(L.size, R.size)));
 
-            char* LStr = operandToStr(L);
-            char* RStr = operandToStr(R);
-            char* tmpStr = operandToStr(tmp);
-            irBlockOut(block, "imul %s, %s, %s", tmpStr, LStr, RStr);
-            free(tmpStr);
-            free(LStr);
-            free(RStr);
+            asmInstr3(block, "imul", tmp, L, R);
 
             asmMove(ir, block, L, tmp);
             operandFree(tmp);
         }
 
     } else {
-        char* LStr = operandToStr(L);
-        char* RStr = operandToStr(R);
-
         const char* OpStr = Op == bopAdd ? "add" :
                             Op == bopSub ? "sub" :
                             Op == bopMul ? "imul" :
@@ -374,40 +729,31 @@ void asmBOP (irCtx* ir, irBlock* block, boperation Op, operand L, operand R) {
                             Op == bopShL ? "sal" : 0;
 
         if (OpStr)
-            irBlockOut(block, "%s %s, %s", OpStr, LStr, RStr);
+            asmInstr2(block, OpStr, L, R);
 
         else
             printf("asmBOP(): unhandled operator '%d'\n", Op);
-
-        free(LStr);
-        free(RStr);
     }
 }
 
 void asmDivision (irCtx* ir, irBlock* block, operand R) {
     (void) ir;
 
-    char* RStr = operandToStr(R);
-    irBlockOut(block, "idiv %s", RStr);
-    free(RStr);
+    asmInstr1(block, "idiv", R);
 }
 
 void asmUOP (irCtx* ir, irBlock* block, uoperation Op, operand R) {
     (void) ir;
 
-    char* RStr = operandToStr(R);
-
     if (Op == uopInc)
-        irBlockOut(block, "add %s, 1", RStr);
+        asmInstr2(block, "add", R, operandCreateLiteral(1));
 
     else if (Op == uopDec)
-        irBlockOut(block, "sub %s, 1", RStr);
+        asmInstr2(block, "sub", R, operandCreateLiteral(1));
 
     else if (Op == uopNeg || Op == uopBitwiseNot)
-        irBlockOut(block, "%s %s", Op == uopNeg ? "neg" : "not", RStr);
+        asmInstr1(block, Op == uopNeg ? "neg" : "not", R);
 
     else
         printf("asmUOP(): unhandled operator tag, %d", Op);
-
-    free(RStr);
 }
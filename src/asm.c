@@ -9,42 +9,91 @@
 #include "stdio.h"
 #include "stdarg.h"
 
-asmCtx* asmInit (const char* output, const architecture* arch) {
+enum {
+    ///Written out in chunks of this size
+    asmBufferSize = 1 << 16
+};
+
+asmCtx* asmInit (const char* output, const char* assembler, const architecture* arch, reg* regs) {
     asmCtx* ctx = malloc(sizeof(asmCtx));
-    ctx->filename = strdup(output);
-    ctx->file = fopen(output, "w");
+    ctx->filename = output ? strdup(output) : 0;
+    ctx->piped = assembler != 0;
+
+    if (ctx->piped)
+        ctx->file = popen(assembler, "w");
+
+    else if (output)
+        ctx->file = fopen(output, "w");
+
+    else
+        ctx->file = 0;
+
+    bufferInit(&ctx->out, asmBufferSize, ctx->file);
+
     ctx->lineNo = 1;
     ctx->depth = 0;
     ctx->arch = arch;
-    ctx->stackPtr = operandCreateReg(regRequest(regRSP, arch->wordsize));
-    ctx->basePtr = operandCreateReg(regRequest(regRBP, arch->wordsize));
+    ctx->stackPtr = operandCreateReg(regRequest(regs, regRSP, arch->wordsize));
+    ctx->basePtr = operandCreateReg(regRequest(regs, regRBP, arch->wordsize));
     return ctx;
 }
 
-void asmEnd (asmCtx* ctx) {
+bool asmEnd (asmCtx* ctx) {
+    bool fail = false;
+
+    bufferFree(&ctx->out);
+
+    if (ctx->piped)
+        fail = pclose(ctx->file) != 0;
+
+    else if (ctx->file)
+        fclose(ctx->file);
+
     free(ctx->filename);
-    fclose(ctx->file);
     operandFree(ctx->stackPtr);
     operandFree(ctx->basePtr);
     free(ctx);
+
+    return fail;
+}
+
+char* asmEndBuffer (asmCtx* ctx) {
+    char* text = bufferTake(&ctx->out);
+
+    operandFree(ctx->stackPtr);
+    operandFree(ctx->basePtr);
+    free(ctx);
+
+    return text;
 }
 
 void asmOutLn (asmCtx* ctx, const char* format, ...) {
-    for (int i = 0; i < 4*ctx->depth; i++)
-        fputc(' ', ctx->file);
-
-    va_list args[2];
-    va_start(args[0], format);
-    va_copy(args[1], args[0]);
-    debugVarMsg(format, args[0]);
-    vfprintf(ctx->file, format, args[1]);
-    va_end(args[1]);
-    va_end(args[0]);
-
-    fputc('\n', ctx->file);
-    ctx->lineNo++;
+    va_list args;
+    va_start(args, format);
+    bufferVarFormat(asmBeginLn(ctx), format, args);
+    va_end(args);
+
+    asmEndLn(ctx);
+}
 
-    //fprintf(ctx->file, ".loc 1 %d 0\n", ctx->lineNo+1);
+buffer* asmBeginLn (asmCtx* ctx) {
+    bufferChars(&ctx->out, ' ', 4*ctx->depth);
+    return &ctx->out;
+}
+
+void asmEndLn (asmCtx* ctx) {
+    #ifdef FCC_DEBUGMODE
+    /*The line, or as much of it as wasn't flushed*/
+    int start = ctx->out.length;
+
+    while (start > 0 && ctx->out.str[start-1] != '\n')
+        start--;
+
+    debugMsg("%.*s", ctx->out.length - start, ctx->out.str + start);
+    #endif
+
+    bufferChar(&ctx->out, '\n');
+    ctx->lineNo++;
 }
 
 void asmEnter (asmCtx* ctx) {
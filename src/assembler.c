@@ -0,0 +1,643 @@
+#include "../inc/assembler.h"
+
+#include "../inc/architecture.h"
+#include "../inc/object.h"
+#include "../inc/encoder-amd64.h"
+#include "../inc/elf.h"
+
+#include "stdlib.h"
+#include "string.h"
+#include "stdio.h"
+#include "ctype.h"
+
+enum {
+    assemblerMaxOperands = 3
+};
+
+typedef struct assemblerCtx {
+    const char* filename;
+    int lineNo;
+
+    objFile obj;
+    objSection* section;
+    encCtx enc;
+
+    bool fail;
+} assemblerCtx;
+
+typedef struct assemblerReg {
+    const char* str;
+    int reg, size;
+} assemblerReg;
+
+static const assemblerReg assemblerRegs[] = {
+    {"al", 0, 1}, {"cl", 1, 1}, {"dl", 2, 1}, {"bl", 3, 1},
+    {"ax", 0, 2}, {"cx", 1, 2}, {"dx", 2, 2}, {"bx", 3, 2},
+    {"sp", 4, 2}, {"bp", 5, 2}, {"si", 6, 2}, {"di", 7, 2},
+    {"eax", 0, 4}, {"ecx", 1, 4}, {"edx", 2, 4}, {"ebx", 3, 4},
+    {"esp", 4, 4}, {"ebp", 5, 4}, {"esi", 6, 4}, {"edi", 7, 4},
+    {"rax", 0, 8}, {"rcx", 1, 8}, {"rdx", 2, 8}, {"rbx", 3, 8},
+    {"rsp", 4, 8}, {"rbp", 5, 8}, {"rsi", 6, 8}, {"rdi", 7, 8},
+    {"r8", 8, 8}, {"r9", 9, 8}, {"r10", 10, 8}, {"r11", 11, 8},
+    {"r12", 12, 8}, {"r13", 13, 8}, {"r14", 14, 8}, {"r15", 15, 8},
+    {"r8d", 8, 4}, {"r9d", 9, 4}, {"r10d", 10, 4}, {"r11d", 11, 4},
+    {"r12d", 12, 4}, {"r13d", 13, 4}, {"r14d", 14, 4}, {"r15d", 15, 4},
+    {"r8w", 8, 2}, {"r9w", 9, 2}, {"r10w", 10, 2}, {"r11w", 11, 2},
+    {"r12w", 12, 2}, {"r13w", 13, 2}, {"r14w", 14, 2}, {"r15w", 15, 2},
+    {"r8b", 8, 1}, {"r9b", 9, 1}, {"r10b", 10, 1}, {"r11b", 11, 1},
+    {"r12b", 12, 1}, {"r13b", 13, 1}, {"r14b", 14, 1}, {"r15b", 15, 1},
+    {"xmm0", 0, 16}, {"xmm1", 1, 16}, {"xmm2", 2, 16}, {"xmm3", 3, 16},
+    {"xmm4", 4, 16}, {"xmm5", 5, 16}, {"xmm6", 6, 16}, {"xmm7", 7, 16},
+    {0, 0, 0}
+};
+
+static const assemblerReg assemblerSizes[] = {
+    {"byte", 0, 1}, {"word", 0, 2}, {"dword", 0, 4}, {"qword", 0, 8},
+    {"oword", 0, 16}, {"xmmword", 0, 16},
+    {0, 0, 0}
+};
+
+static void assemblerError (assemblerCtx* ctx, const char* format, const char* str) {
+    printf("%s:%d: assembler error: ", ctx->filename, ctx->lineNo);
+    printf(format, str);
+    putchar('\n');
+    ctx->fail = true;
+}
+
+/*==== Lexical helpers ====*/
+
+static char* assemblerTrim (char* str) {
+    while (*str == ' ' || *str == '\t')
+        str++;
+
+    char* end = str + strlen(str);
+
+    while (end != str && isspace((unsigned char) end[-1]))
+        *--end = 0;
+
+    return str;
+}
+
+static bool assemblerIsIdentChar (char c) {
+    return isalnum((unsigned char) c) || c == '_' || c == '.' || c == '$';
+}
+
+static const assemblerReg* assemblerLookup (const assemblerReg* table, const char* str, int length) {
+    for (int i = 0; table[i].str; i++)
+        if ((int) strlen(table[i].str) == length && !strncmp(table[i].str, str, length))
+            return &table[i];
+
+    return 0;
+}
+
+static bool assemblerIsNumber (const char* str) {
+    return isdigit((unsigned char) str[0]) || (str[0] == '-' && isdigit((unsigned char) str[1]));
+}
+
+/**
+ * Parse a number or symbol plus or minus a number, e.g. "label+8"
+ */
+static bool assemblerParseValue (assemblerCtx* ctx, char* str, objSymbol** symbol, intptr_t* value) {
+    str = assemblerTrim(str);
+    *symbol = 0;
+    *value = 0;
+
+    if (assemblerIsNumber(str)) {
+        char* end;
+        *value = (intptr_t) strtoll(str, &end, 0);
+        return *assemblerTrim(end) == 0;
+    }
+
+    int length = 0;
+
+    while (assemblerIsIdentChar(str[length]))
+        length++;
+
+    if (length == 0)
+        return false;
+
+    char* rest = assemblerTrim(str+length);
+
+    if (*rest && *rest != '+' && *rest != '-')
+        return false;
+
+    char* end = rest;
+
+    if (*rest) {
+        *value = (intptr_t) strtoll(rest[0] == '+' ? rest+1 : rest, &end, 0);
+
+        if (*assemblerTrim(end) != 0)
+            return false;
+    }
+
+    char saved = str[length];
+    str[length] = 0;
+    *symbol = objSymbolGet(&ctx->obj, str);
+    str[length] = saved;
+
+    return true;
+}
+
+/*==== Operands ====*/
+
+/**
+ * Memory reference, of terms separated by + and -: registers, scaled
+ * registers (either way around), numbers and at most one symbol
+ */
+static bool assemblerParseMem (assemblerCtx* ctx, char* str, encOperand* operand) {
+    operand->tag = encMem;
+    operand->reg = -1;
+    operand->index = -1;
+    operand->scale = 1;
+
+    char* term = str;
+
+    while (*term) {
+        term = assemblerTrim(term);
+        int sign = 1;
+
+        if (*term == '+')
+            term++;
+
+        else if (*term == '-')
+            sign = -1, term++;
+
+        term = assemblerTrim(term);
+
+        /*Find the end of the term, and terminate it*/
+        char* end = term;
+
+        while (*end && *end != '+' && *end != '-')
+            end++;
+
+        char next = *end;
+        *end = 0;
+        char* termStr = assemblerTrim(term);
+        char* star = strchr(termStr, '*');
+
+        if (star) {
+            *star = 0;
+            char *regStr = assemblerTrim(termStr), *scaleStr = assemblerTrim(star+1);
+
+            if (assemblerIsNumber(regStr)) {
+                char* tmp = regStr;
+                regStr = scaleStr, scaleStr = tmp;
+            }
+
+            const assemblerReg* reg = assemblerLookup(assemblerRegs, regStr, strlen(regStr));
+
+            if (!reg || operand->index >= 0 || sign < 0)
+                return false;
+
+            operand->index = reg->reg;
+            operand->scale = atoi(scaleStr);
+
+        } else {
+            const assemblerReg* reg = assemblerLookup(assemblerRegs, termStr, strlen(termStr));
+
+            if (reg && sign > 0 && operand->reg < 0)
+                operand->reg = reg->reg;
+
+            else if (reg && sign > 0 && operand->index < 0)
+                operand->index = reg->reg;
+
+            else if (assemblerIsNumber(termStr))
+                operand->disp += sign * (intptr_t) strtoll(termStr, 0, 0);
+
+            else if (!reg && !operand->symbol && sign > 0 && *termStr)
+                operand->symbol = objSymbolGet(&ctx->obj, termStr);
+
+            else
+                return false;
+        }
+
+        *end = next;
+        term = end;
+    }
+
+    return true;
+}
+
+static bool assemblerParseOperand (assemblerCtx* ctx, char* str, encOperand* operand) {
+    *operand = (encOperand) {encUndefined};
+    str = assemblerTrim(str);
+
+    /*<size> ptr*/
+    int wordLength = 0;
+
+    while (isalpha((unsigned char) str[wordLength]))
+        wordLength++;
+
+    const assemblerReg* size = assemblerLookup(assemblerSizes, str, wordLength);
+
+    if (size && strprefix(assemblerTrim(str+wordLength), "ptr")) {
+        operand->size = size->size;
+        str = assemblerTrim(assemblerTrim(str+wordLength) + 3);
+    }
+
+    const assemblerReg* reg = assemblerLookup(assemblerRegs, str, strlen(str));
+
+    if (str[0] == '[') {
+        char* close = strchr(str, ']');
+
+        if (!close || *assemblerTrim(close+1))
+            return false;
+
+        *close = 0;
+        return assemblerParseMem(ctx, str+1, operand);
+
+    } else if (strprefix(str, "offset ")) {
+        operand->tag = encImm;
+        return assemblerParseValue(ctx, str+7, &operand->symbol, &operand->disp);
+
+    } else if (reg) {
+        operand->tag = encReg;
+        operand->reg = reg->reg;
+        operand->size = reg->size;
+        return true;
+
+    } else {
+        bool valid = assemblerParseValue(ctx, str, &operand->symbol, &operand->disp);
+        operand->tag = operand->symbol ? encLabel : encImm;
+        return valid;
+    }
+}
+
+/*==== Instructions ====*/
+
+static void assemblerInstruction (assemblerCtx* ctx, char* line) {
+    char* mnemonic = line;
+
+    while (*line && !isspace((unsigned char) *line))
+        line++;
+
+    if (*line)
+        *line++ = 0;
+
+    line = assemblerTrim(line);
+
+    /*Prefixes*/
+    if (!strcmp(mnemonic, "rep")) {
+        objEmitByte(ctx->section, 0xF3);
+        assemblerInstruction(ctx, line);
+        return;
+    }
+
+    /*Split the operands on commas*/
+
+    encOperand operands[assemblerMaxOperands];
+    int operandNo = 0;
+
+    while (*line) {
+        char* comma = strchr(line, ',');
+
+        if (comma)
+            *comma = 0;
+
+        if (operandNo == assemblerMaxOperands) {
+            assemblerError(ctx, "too many operands for '%s'", mnemonic);
+            return;
+
+        } else if (!assemblerParseOperand(ctx, line, &operands[operandNo++])) {
+            assemblerError(ctx, "invalid operand '%s'", assemblerTrim(line));
+            return;
+        }
+
+        line = comma ? comma+1 : line + strlen(line);
+    }
+
+    ctx->enc.section = ctx->section;
+
+    if (!encodeInstruction(&ctx->enc, mnemonic, operands, operandNo))
+        assemblerError(ctx, "unsupported instruction or operands for '%s'", mnemonic);
+}
+
+/*==== Directives ====*/
+
+static void assemblerData (assemblerCtx* ctx, char* args, int size) {
+    if (ctx->section->nobits) {
+        assemblerError(ctx, "data in zero filled section '%s'", ctx->section->name);
+        return;
+    }
+
+    while (*args) {
+        char* comma = strchr(args, ',');
+
+        if (comma)
+            *comma = 0;
+
+        objSymbol* symbol;
+        intptr_t value;
+
+        if (!assemblerParseValue(ctx, args, &symbol, &value))
+            assemblerError(ctx, "invalid value '%s'", args);
+
+        else if (symbol && size >= 4)
+            objEmitReloc(ctx->section, size == 8 ? relocAbs64 : relocAbs32, symbol, value, size);
+
+        else if (symbol)
+            assemblerError(ctx, "symbol '%s' too wide for its data", symbol->name);
+
+        else
+            objEmitInt(ctx->section, value, size);
+
+        args = comma ? comma+1 : args + strlen(args);
+    }
+}
+
+static void assemblerString (assemblerCtx* ctx, char* args, bool terminate) {
+    if (ctx->section->nobits) {
+        assemblerError(ctx, "data in zero filled section '%s'", ctx->section->name);
+        return;
+
+    } else if (*args != '"') {
+        assemblerError(ctx, "expected string, found '%s'", args);
+        return;
+    }
+
+    char* c = args+1;
+
+    for (; *c && *c != '"'; c++) {
+        if (*c != '\\') {
+            objEmitByte(ctx->section, *c);
+            continue;
+        }
+
+        c++;
+        const char* escapes = "n\nt\tr\ra\ab\bf\fv\v";
+        const char* escape = *c ? strchr(escapes, *c) : 0;
+
+        if (escape && (escape - escapes) % 2 == 0)
+            objEmitByte(ctx->section, escape[1]);
+
+        else if (*c >= '0' && *c <= '7') {
+            int value = 0;
+
+            for (int i = 0; i < 3 && *c >= '0' && *c <= '7'; i++, c++)
+                value = value*8 + (*c - '0');
+
+            objEmitByte(ctx->section, value);
+            c--;
+
+        } else if (*c == 'x') {
+            int value = 0;
+
+            while (isxdigit((unsigned char) c[1])) {
+                c++;
+                value = value*16 + (isdigit((unsigned char) *c) ? *c - '0' : tolower(*c) - 'a' + 10);
+            }
+
+            objEmitByte(ctx->section, value);
+
+        } else if (*c)
+            objEmitByte(ctx->section, *c);
+
+        else
+            break;
+    }
+
+    if (*c != '"')
+        assemblerError(ctx, "unterminated string '%s'", args);
+
+    if (terminate)
+        objEmitByte(ctx->section, 0);
+}
+
+static void assemblerSection (assemblerCtx* ctx, char* args) {
+    char* comma = strchr(args, ',');
+
+    if (comma)
+        *comma = 0;
+
+    ctx->section = objSectionGet(&ctx->obj, assemblerTrim(args));
+
+    if (!comma)
+        return;
+
+    /*"flags", @type, entsize*/
+
+    char* flags = assemblerTrim(comma+1);
+
+    if (*flags == '"') {
+        ctx->section->flags = 0;
+
+        for (char* c = flags+1; *c && *c != '"'; c++) {
+            if (*c == 'a')
+                ctx->section->flags |= sectionAlloc;
+
+            else if (*c == 'w')
+                ctx->section->flags |= sectionWrite;
+
+            else if (*c == 'x')
+                ctx->section->flags |= sectionExec;
+
+            else if (*c == 'M')
+                ctx->section->flags |= sectionMerge;
+
+            else if (*c == 'S')
+                ctx->section->flags |= sectionStrings;
+        }
+    }
+
+    char* type = strchr(flags, ',');
+    char* entsize = type ? strchr(type+1, ',') : 0;
+
+    if (entsize)
+        ctx->section->entsize = atoi(entsize+1);
+}
+
+static void assemblerSet (assemblerCtx* ctx, char* args) {
+    char* comma = strchr(args, ',');
+
+    if (!comma) {
+        assemblerError(ctx, "expected a comma in '.set %s'", args);
+        return;
+    }
+
+    *comma = 0;
+    objSymbol* symbol = objSymbolGet(&ctx->obj, assemblerTrim(args));
+
+    objSymbol* alias;
+    intptr_t offset;
+
+    if (!assemblerParseValue(ctx, comma+1, &alias, &offset) || !alias)
+        assemblerError(ctx, "invalid value for '%s'", symbol->name);
+
+    else {
+        symbol->alias = alias;
+        symbol->aliasOffset = offset;
+    }
+}
+
+static void assemblerDirective (assemblerCtx* ctx, char* line) {
+    char* directive = line;
+
+    while (*line && !isspace((unsigned char) *line))
+        line++;
+
+    if (*line)
+        *line++ = 0;
+
+    char* args = assemblerTrim(line);
+
+    if (   !strcmp(directive, ".file") || !strcmp(directive, ".intel_syntax")
+        || !strcmp(directive, ".ident") || !strcmp(directive, ".type")
+        || !strcmp(directive, ".size"))
+        ;
+
+    else if (!strcmp(directive, ".globl") || !strcmp(directive, ".global"))
+        objSymbolGet(&ctx->obj, args)->global = true;
+
+    else if (!strcmp(directive, ".text") || !strcmp(directive, ".data") || !strcmp(directive, ".bss"))
+        ctx->section = objSectionGet(&ctx->obj, directive);
+
+    else if (!strcmp(directive, ".section"))
+        assemblerSection(ctx, args);
+
+    else if (!strcmp(directive, ".balign") || !strcmp(directive, ".align")) {
+        int align = atoi(args);
+
+        if (align > 0 && (align & (align-1)) == 0)
+            objAlign(ctx->section, align);
+
+        else
+            assemblerError(ctx, "invalid alignment '%s'", args);
+
+    } else if (!strcmp(directive, ".zero") || !strcmp(directive, ".skip")) {
+        for (int i = atoi(args); i > 0; i--)
+            objEmitByte(ctx->section, 0);
+
+    } else if (!strcmp(directive, ".byte"))
+        assemblerData(ctx, args, 1);
+
+    else if (!strcmp(directive, ".word") || !strcmp(directive, ".short"))
+        assemblerData(ctx, args, 2);
+
+    else if (!strcmp(directive, ".long") || !strcmp(directive, ".int"))
+        assemblerData(ctx, args, 4);
+
+    else if (!strcmp(directive, ".quad"))
+        assemblerData(ctx, args, 8);
+
+    else if (!strcmp(directive, ".asciz") || !strcmp(directive, ".string"))
+        assemblerString(ctx, args, true);
+
+    else if (!strcmp(directive, ".ascii"))
+        assemblerString(ctx, args, false);
+
+    else if (!strcmp(directive, ".set") || !strcmp(directive, ".equ"))
+        assemblerSet(ctx, args);
+
+    else
+        assemblerError(ctx, "unknown directive '%s'", directive);
+}
+
+/*==== Lines ====*/
+
+static void assemblerLine (assemblerCtx* ctx, char* line) {
+    line = assemblerTrim(line);
+
+    /*Label*/
+
+    int length = 0;
+
+    while (assemblerIsIdentChar(line[length]))
+        length++;
+
+    if (length != 0 && line[length] == ':') {
+        line[length] = 0;
+        objSymbol* symbol = objSymbolGet(&ctx->obj, line);
+
+        if (symbol->section || symbol->alias)
+            assemblerError(ctx, "symbol '%s' already defined", line);
+
+        symbol->section = ctx->section;
+        symbol->value = ctx->section->length;
+
+        line = assemblerTrim(line+length+1);
+    }
+
+    if (*line == 0 || *line == ';' || *line == '#')
+        ;
+
+    else if (*line == '.')
+        assemblerDirective(ctx, line);
+
+    else
+        assemblerInstruction(ctx, line);
+}
+
+static char* assemblerReadFile (const char* filename) {
+    FILE* file = fopen(filename, "rb");
+
+    if (!file)
+        return 0;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* buffer = malloc(length+1);
+    buffer[fread(buffer, 1, length, file)] = 0;
+
+    fclose(file);
+    return buffer;
+}
+
+bool assembleText (const architecture* arch, const char* name, char* text, const char* output) {
+    assemblerCtx ctx = {
+        .filename = name,
+        .lineNo = 0,
+        .fail = false
+    };
+
+    objInit(&ctx.obj, arch->wordsize);
+    ctx.section = objSectionGet(&ctx.obj, ".text");
+    ctx.enc = (encCtx) {&ctx.obj, ctx.section, arch->wordsize};
+
+    for (char* line = text; line; ) {
+        char* next = strchr(line, '\n');
+
+        if (next)
+            *next++ = 0;
+
+        ctx.lineNo++;
+        assemblerLine(&ctx, line);
+        line = next;
+    }
+
+    objResolve(&ctx.obj);
+
+    for (int i = 0; i < ctx.obj.symbols.length; i++) {
+        objSymbol* symbol = vectorGet(&ctx.obj.symbols, i);
+
+        if (symbol->alias) {
+            printf("%s: assembler error: '%s' set to undefined '%s'\n",
+                   name, symbol->name, symbol->alias->name);
+            ctx.fail = true;
+        }
+    }
+
+    if (!ctx.fail && elfWrite(&ctx.obj, output)) {
+        printf("fcc: Unable to write object '%s'\n", output);
+        ctx.fail = true;
+    }
+
+    objFree(&ctx.obj);
+
+    return ctx.fail;
+}
+
+bool assemble (const architecture* arch, const char* input, const char* output) {
+    char* source = assemblerReadFile(input);
+
+    if (!source) {
+        printf("fcc: Unable to read assembly '%s'\n", input);
+        return true;
+    }
+
+    bool fail = assembleText(arch, input, source, output);
+    free(source);
+
+    return fail;
+}
@@ -7,30 +7,78 @@
 #include "stdio.h"
 #include "stdlib.h"
 
-ast* astCreate (astTag tag, tokenLocation location) {
-    ast* Node = calloc(1, sizeof(ast));
-    Node->tag = tag;
-    Node->location = location;
-    return Node;
+/*==== Pools ====*/
+
+struct astPool {
+    ///Each of astBlockSize nodes
+    ast** blocks;
+    int blockNo, blockCapacity;
+    ///Nodes made
+    astRef length;
+};
+
+enum {
+    astBlockSize = 256
+};
+
+static _Thread_local astPool* astCurrentPool;
+
+astPool* astPoolCreate (void) {
+    return calloc(1, sizeof(astPool));
+}
+
+void astPoolDestroy (astPool* pool) {
+    if (!pool)
+        return;
+
+    for (astRef i = 0; i < pool->length; i++) {
+        ast* Node = astPoolGet(pool, i);
+
+        if (Node->dt)
+            typeDestroy(Node->dt);
+
+        free(Node->literal);
+    }
+
+    for (int i = 0; i < pool->blockNo; i++)
+        free(pool->blocks[i]);
+
+    free(pool->blocks);
+    free(pool);
 }
 
-void astDestroy (ast* Node) {
-    for (ast *Current = Node->firstChild, *Next = Current ? Current->nextSibling : 0;
-         Current;
-         Current = Next, Next = Next ? Next->nextSibling : 0)
-        astDestroy(Current);
+astPool* astPoolSwitch (astPool* pool) {
+    astPool* old = astCurrentPool;
+    astCurrentPool = pool;
+    return old;
+}
 
-    if (Node->l)
-        astDestroy(Node->l);
+ast* astPoolGet (const astPool* pool, astRef index) {
+    return &pool->blocks[index / astBlockSize][index % astBlockSize];
+}
 
-    if (Node->r && Node->tag != astUsing)
-        astDestroy(Node->r);
+static ast* astPoolNew (astPool* pool) {
+    if (pool->length == (astRef) pool->blockNo*astBlockSize) {
+        if (pool->blockNo == pool->blockCapacity) {
+            pool->blockCapacity = pool->blockCapacity ? 2*pool->blockCapacity : 16;
+            pool->blocks = realloc(pool->blocks, sizeof(ast*)*pool->blockCapacity);
+        }
 
-    if (Node->dt)
-        typeDestroy(Node->dt);
+        pool->blocks[pool->blockNo++] = calloc(astBlockSize, sizeof(ast));
+    }
 
-    free(Node->literal);
-    free(Node);
+    ast* Node = astPoolGet(pool, pool->length);
+    Node->index = pool->length++;
+    return Node;
+}
+
+/*==== Nodes ====*/
+
+ast* astCreate (astTag tag, tokenLocation location) {
+    ast* Node = astCurrentPool ? astPoolNew(astCurrentPool) : calloc(1, sizeof(ast));
+    Node->tag = tag;
+    Node->location = location;
+    return Node;
 }
 
 ast* astCreateInvalid (tokenLocation location) {
@@ -177,7 +225,6 @@ void astAddChild (ast* Parent, ast* Child) {
         Parent->lastChild = Child;
 
     } else {
-        Child->prevSibling = Parent->lastChild;
         Parent->lastChild->nextSibling = Child;
         Parent->lastChild = Child;
     }
@@ -185,6 +232,13 @@ void astAddChild (ast* Parent, ast* Child) {
     Parent->children++;
 }
 
+void astGetChildren (const ast* Node, ast** children) {
+    int n = 0;
+
+    for (ast* Current = Node->firstChild; Current; Current = Current->nextSibling)
+        children[n++] = Current;
+}
+
 bool astIsValueTag (astTag tag) {
     return    tag == astBOP || tag == astUOP || tag == astTOP
            || tag == astCall || tag == astIndex || tag == astCast
@@ -212,6 +266,9 @@ const char* astTagGetStr (astTag tag) {
     else if (tag == astBranch) return "astBranch";
     else if (tag == astLoop) return "astLoop";
     else if (tag == astIter) return "astIter";
+    else if (tag == astSwitch) return "astSwitch";
+    else if (tag == astCase) return "astCase";
+    else if (tag == astDefault) return "astDefault";
     else if (tag == astReturn) return "astReturn";
     else if (tag == astBreak) return "astBreak";
     else if (tag == astContinue) return "astContinue";
@@ -0,0 +1,128 @@
+#include "../inc/buffer.h"
+
+#include "stdlib.h"
+#include "string.h"
+
+buffer* bufferInit (buffer* buf, int capacity, FILE* file) {
+    buf->str = malloc(capacity);
+    buf->length = 0;
+    buf->capacity = capacity;
+    buf->file = file;
+    return buf;
+}
+
+void bufferFree (buffer* buf) {
+    bufferFlush(buf);
+    free(buf->str);
+    buf->str = 0;
+}
+
+char* bufferTake (buffer* buf) {
+    bufferChar(buf, 0);
+    char* str = buf->str;
+    buf->str = 0;
+    return str;
+}
+
+void bufferFlush (buffer* buf) {
+    if (buf->file && buf->length != 0) {
+        fwrite(buf->str, 1, (size_t) buf->length, buf->file);
+        buf->length = 0;
+    }
+}
+
+/*Unsigned, as the length never exceeds the capacity, so that no overflow
+  is assumed away*/
+static bool bufferFits (const buffer* buf, int n) {
+    return (size_t) n <= (size_t) buf->capacity - (size_t) buf->length;
+}
+
+/*Make room for n more characters, returning where they go*/
+static char* bufferReserve (buffer* buf, int n) {
+    if (!bufferFits(buf, n)) {
+        bufferFlush(buf);
+
+        /*Still too small, or there's nowhere to flush to*/
+        if (!bufferFits(buf, n)) {
+            buf->capacity = max(2*buf->capacity, buf->length + n);
+            buf->str = realloc(buf->str, buf->capacity);
+        }
+    }
+
+    return buf->str + buf->length;
+}
+
+void bufferChar (buffer* buf, char c) {
+    *bufferReserve(buf, 1) = c;
+    buf->length++;
+}
+
+void bufferChars (buffer* buf, char c, int n) {
+    if (n <= 0)
+        return;
+
+    memset(bufferReserve(buf, n), c, (size_t) n);
+    buf->length += n;
+}
+
+void bufferStr (buffer* buf, const char* str) {
+    bufferStrN(buf, str, (int) strlen(str));
+}
+
+void bufferStrN (buffer* buf, const char* str, int length) {
+    memcpy(bufferReserve(buf, length), str, (size_t) length);
+    buf->length += length;
+}
+
+/*Written backwards into scratch space, then copied out at once*/
+static void bufferDigits (buffer* buf, intmax_t n, bool sign) {
+    char digits[24];
+    int i = sizeof(digits);
+
+    /*Negated unsigned, so the most negative survives*/
+    uintmax_t magnitude = n < 0 ? -(uintmax_t) n : (uintmax_t) n;
+
+    do {
+        digits[--i] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (n < 0)
+        digits[--i] = '-';
+
+    else if (sign)
+        digits[--i] = '+';
+
+    bufferStrN(buf, digits+i, (int) sizeof(digits) - i);
+}
+
+void bufferInt (buffer* buf, intmax_t n) {
+    bufferDigits(buf, n, false);
+}
+
+void bufferSignedInt (buffer* buf, intmax_t n) {
+    bufferDigits(buf, n, true);
+}
+
+void bufferFormat (buffer* buf, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    bufferVarFormat(buf, format, args);
+    va_end(args);
+}
+
+void bufferVarFormat (buffer* buf, const char* format, va_list args) {
+    va_list retry;
+    va_copy(retry, args);
+
+    /*Try in the space left, then again with as much as it needs*/
+    int length = vsnprintf(buf->str + buf->length, (size_t) (buf->capacity - buf->length), format, args);
+
+    if (length >= buf->capacity - buf->length)
+        vsnprintf(bufferReserve(buf, length+1), (size_t) length+1, format, retry);
+
+    va_end(retry);
+
+    if (length > 0)
+        buf->length += length;
+}
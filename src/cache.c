@@ -0,0 +1,273 @@
+#include "../inc/cache.h"
+
+#include "../inc/debug.h"
+#include "../inc/architecture.h"
+#include "../inc/compiler.h"
+#include "../inc/assembler.h"
+
+#include "stdlib.h"
+#include "stdio.h"
+#include "string.h"
+#include "unistd.h"
+#include "sys/stat.h"
+#include "threads.h"
+
+enum {
+    ///Change whenever the entries, or the meaning of anything in them, do
+    cacheFormat = 2
+};
+
+/*==== Hashing ====*/
+
+uint64_t cacheHashBytes (uint64_t hash, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+uint64_t cacheHashFile (uint64_t hash, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+
+    if (!file)
+        return 0;
+
+    char buffer[4096];
+    size_t length;
+
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) != 0)
+        hash = cacheHashBytes(hash, buffer, length);
+
+    fclose(file);
+
+    /*Zero means none*/
+    return hash ? hash : 1;
+}
+
+static uint64_t cacheBuild;
+static once_flag cacheBuildOnce = ONCE_FLAG_INIT;
+
+static void cacheBuildInit (void) {
+    cacheBuild = cacheHashBytes(cacheHashInit, compilerVersion, strlen(compilerVersion));
+
+    /*Only the version, where the executable can't be read*/
+    uint64_t executable = cacheHashFile(cacheBuild, "/proc/self/exe");
+
+    if (executable)
+        cacheBuild = executable;
+}
+
+uint64_t cacheHashBuild (uint64_t hash) {
+    call_once(&cacheBuildOnce, cacheBuildInit);
+    return cacheHashBytes(hash, &cacheBuild, sizeof(cacheBuild));
+}
+
+/*Everything that decides the output besides the modules imported*/
+static uint64_t cacheInputKey (const compilerCtx* comp, const char* input, const char* output) {
+    uint64_t hash = cacheHashInit;
+
+    int format = cacheFormat;
+    hash = cacheHashBuild(hash);
+    hash = cacheHashBytes(hash, &format, sizeof(format));
+    hash = cacheHashBytes(hash, &comp->arch->os, sizeof(comp->arch->os));
+    hash = cacheHashBytes(hash, &comp->arch->wordsize, sizeof(comp->arch->wordsize));
+    hash = cacheHashBytes(hash, &comp->preprocess, sizeof(comp->preprocess));
+
+    /*The search paths decide which modules the input's imports find*/
+    for (int i = 0; i < comp->searchPaths->length; i++) {
+        const char* path = vectorGet(comp->searchPaths, i);
+        hash = cacheHashBytes(hash, path, strlen(path)+1);
+    }
+
+    /*The output is named in the assembly*/
+    hash = cacheHashBytes(hash, input, strlen(input)+1);
+    hash = cacheHashBytes(hash, output, strlen(output)+1);
+
+    return cacheHashFile(hash, input);
+}
+
+static uint64_t cacheHashDependency (uint64_t hash, const char* fullname, uint64_t content) {
+    hash = cacheHashBytes(hash, fullname, strlen(fullname)+1);
+    hash = cacheHashBytes(hash, &content, sizeof(content));
+    return hash ? hash : 1;
+}
+
+static char* cacheFilename (const compilerCtx* comp, uint64_t key, const char* extension) {
+    char* filename = malloc(strlen(comp->compileCache) + 1 + 16 + 1 + strlen(extension) + 1);
+    sprintf(filename, "%s/%016llx.%s", comp->compileCache, (unsigned long long) key, extension);
+    return filename;
+}
+
+/*==== Entries ====*/
+
+/**
+ * Check each module listed in an entry against what it was, returning the
+ * key of the assembly, or zero if any changed
+ */
+static uint64_t cacheReadEntry (FILE* entry, uint64_t key) {
+    uint64_t hash = key;
+
+    unsigned long long recorded;
+    char fullname[4096];
+
+    while (   fscanf(entry, "%16llx ", &recorded) == 1
+           && fgets(fullname, sizeof(fullname), entry)) {
+        fullname[strcspn(fullname, "\n")] = 0;
+
+        uint64_t content = cacheHashFile(cacheHashInit, fullname);
+
+        if (content != recorded)
+            return 0;
+
+        hash = cacheHashDependency(hash, fullname, content);
+    }
+
+    return hash == key ? 0 : hash;
+}
+
+/**
+ * List the modules imported and headers included, giving the key of the
+ * assembly, zero if any of them can't be read
+ */
+static uint64_t cacheWriteEntry (const compilerCtx* comp, FILE* entry, uint64_t key) {
+    uint64_t hash = key;
+
+    for (int i = 0; i < comp->loaded.length + comp->included.length; i++) {
+        const char* fullname =   i < comp->loaded.length
+                               ? vectorGet(&comp->loaded, i)
+                               : vectorGet(&comp->included, i - comp->loaded.length);
+        uint64_t content = cacheHashFile(cacheHashInit, fullname);
+
+        if (!content || strchr(fullname, '\n'))
+            return 0;
+
+        fprintf(entry, "%016llx %s\n", (unsigned long long) content, fullname);
+        hash = cacheHashDependency(hash, fullname, content);
+    }
+
+    return hash == key ? 0 : hash;
+}
+
+/*Copy the assembly into the output file, or the assembler*/
+static bool cacheDeliver (const char* cached, const char* output, const char* assembler) {
+    FILE* in = fopen(cached, "rb");
+    FILE* out = assembler ? popen(assembler, "w") : fopen(output, "wb");
+    bool fail = !in || !out;
+
+    if (in && out) {
+        char buffer[4096];
+        size_t length;
+
+        while ((length = fread(buffer, 1, sizeof(buffer), in)) != 0)
+            fwrite(buffer, 1, length, out);
+    }
+
+    if (in)
+        fclose(in);
+
+    if (out)
+        fail |= (assembler ? pclose(out) : fclose(out)) != 0;
+
+    return fail;
+}
+
+bool cacheLookup (compilerCtx* comp, const char* input, const char* output, const char* assembler,
+                  const char* object, bool* fail) {
+    if (!comp->compileCache || !comp->fresh)
+        return false;
+
+    uint64_t key = cacheInputKey(comp, input, output);
+
+    /*Let the compiler report it*/
+    if (!key)
+        return false;
+
+    char* entryname = cacheFilename(comp, key, "dep");
+    FILE* entry = fopen(entryname, "r");
+    free(entryname);
+
+    uint64_t outputKey = 0;
+
+    if (entry) {
+        outputKey = cacheReadEntry(entry, key);
+        fclose(entry);
+    }
+
+    char* cached = outputKey ? cacheFilename(comp, outputKey, "s") : 0;
+    bool hit = cached && fexists(cached);
+
+    if (hit) {
+        debugMsg("%s reused from %s", input, cached);
+        *fail =   object
+                ? assemble(comp->arch, cached, object)
+                : cacheDeliver(cached, output, assembler);
+        comp->cacheHits++;
+
+    } else
+        comp->cacheMisses++;
+
+    free(cached);
+    return hit;
+}
+
+/*Copy the assembly into the cache under a temporary name, then move it
+  into place, then the entry naming it. So an entry is never seen before
+  its assembly, nor either half written.*/
+static void cacheKeep (compilerCtx* comp, const char* input, const char* output) {
+    uint64_t key = cacheInputKey(comp, input, output);
+
+    if (!key)
+        return;
+
+    /*Make the directory on first use, if need be*/
+    mkdir(comp->compileCache, 0777);
+
+    char* tmpcached = malloc(strlen(comp->compileCache) + 32);
+    char* tmpentry = malloc(strlen(comp->compileCache) + 32);
+    sprintf(tmpcached, "%s/%d.s.tmp", comp->compileCache, (int) getpid());
+    sprintf(tmpentry, "%s/%d.dep.tmp", comp->compileCache, (int) getpid());
+
+    FILE* entry = fopen(tmpentry, "w");
+    uint64_t outputKey = 0;
+
+    if (entry) {
+        outputKey = cacheWriteEntry(comp, entry, key);
+        outputKey = fclose(entry) == 0 ? outputKey : 0;
+    }
+
+    if (outputKey && !cacheDeliver(output, tmpcached, 0)) {
+        char* cached = cacheFilename(comp, outputKey, "s");
+        char* entryname = cacheFilename(comp, key, "dep");
+
+        if (rename(tmpcached, cached) == 0)
+            rename(tmpentry, entryname);
+
+        free(cached);
+        free(entryname);
+    }
+
+    remove(tmpcached);
+    remove(tmpentry);
+    free(tmpcached);
+    free(tmpentry);
+}
+
+bool cacheStore (compilerCtx* comp, const char* input, const char* output, const char* assembler,
+                 const char* object, bool clean) {
+    /*Pass it on as it would have been*/
+    bool fail =    (assembler && cacheDeliver(output, 0, assembler))
+                || (object && assemble(comp->arch, output, object));
+
+    /*Don't keep anything the assembler rejected*/
+    if (clean && !fail)
+        cacheKeep(comp, input, output);
+
+    if (assembler || object)
+        remove(output);
+
+    return fail;
+}
@@ -12,11 +12,33 @@
 #include "../inc/parser.h"
 #include "../inc/analyzer.h"
 #include "../inc/emitter.h"
+#include "../inc/assembler.h"
+#include "../inc/interface.h"
+#include "../inc/cache.h"
+#include "../inc/preprocessor.h"
 
 #include "stdlib.h"
+#include "string.h"
 
+/*A module kept in a resident context*/
+typedef struct compilerModule {
+    ///Owned by compilerCtx::modules
+    char* fullname;
+    parserResult* result;
+    ///Of its contents when parsed, see cacheHashFile
+    uint64_t hash;
+    ///Compiled as an input, or with any diagnostics, so never kept
+    bool discard;
+} compilerModule;
+
+enum {
+    ///Dropped modules to leave in the symbol table before starting afresh
+    compilerDroppedMax = 256
+};
 
 static void compilerInitSymbols (compilerCtx* ctx);
+static void compilerFreeModules (compilerCtx* ctx);
+static void compilerKeep (compilerCtx* ctx, const ast* tree, bool clean);
 
 static void compilerInitSymbols (compilerCtx* ctx) {
     /*Initialize symbol "table",
@@ -43,18 +65,49 @@ static void compilerInitSymbols (compilerCtx* ctx) {
 
 void compilerInit (compilerCtx* ctx, const architecture* arch, const vector/*<char*>*/* searchPaths) {
     hashmapInit(&ctx->modules, 1024);
+    vectorInit(&ctx->loaded, 16);
+    ctx->fresh = true;
+
+    pathsInit(&ctx->paths);
+
+    ctx->preprocess = false;
+    hashmapInit(&ctx->headers, 64);
+    vectorInit(&ctx->included, 16);
+
+    ctx->resident = false;
+    vectorInit(&ctx->residents, 64);
+    vectorInit(&ctx->dropped, 64);
+
+    ctx->moduleCache = 0;
+    ctx->compileCache = 0;
+    ctx->cacheHits = 0;
+    ctx->cacheMisses = 0;
 
     ctx->arch = arch;
     ctx->searchPaths = searchPaths;
 
     ctx->errors = 0;
     ctx->warnings = 0;
+    ctx->internalErrors = 0;
+    ctx->threads = 1;
 
     compilerInitSymbols(ctx);
 }
 
-void compilerEnd (compilerCtx* ctx) {
+static void compilerFreeModules (compilerCtx* ctx) {
     hashmapFreeObjs(&ctx->modules, (hashmapKeyDtor) free, (hashmapValueDtor) parserResultDestroy);
+    vectorFreeObjs(&ctx->residents, free);
+    vectorFreeObjs(&ctx->dropped, (vectorDtor) parserResultDestroy);
+
+    /*After the modules, whose locations may be in them*/
+    hashmapFreeObjs(&ctx->headers, 0, (hashmapValueDtor) ppFileDestroy);
+}
+
+void compilerEnd (compilerCtx* ctx) {
+    compilerFreeModules(ctx);
+    vectorFree(&ctx->loaded);
+    vectorFree(&ctx->included);
+    pathsEnd(&ctx->paths);
 
     symEnd(ctx->global);
     ctx->global = 0;
@@ -63,11 +116,186 @@ void compilerEnd (compilerCtx* ctx) {
     ctx->types = 0;
 }
 
-void compiler (compilerCtx* ctx, const char* input, const char* output) {
+void compilerReset (compilerCtx* ctx) {
+    compilerFreeModules(ctx);
+    hashmapInit(&ctx->modules, 1024);
+    vectorInit(&ctx->residents, 64);
+    vectorInit(&ctx->dropped, 64);
+    hashmapInit(&ctx->headers, 64);
+
+    ctx->loaded.length = 0;
+    ctx->included.length = 0;
+    ctx->fresh = true;
+
+    symEnd(ctx->global);
+    free(ctx->types);
+    compilerInitSymbols(ctx);
+}
+
+/*==== Resident contexts ====*/
+
+static bool compilerIsWithin (const sym* Symbol, const sym* scope) {
+    for (; Symbol; Symbol = Symbol->parent)
+        if (Symbol == scope)
+            return true;
+
+    return false;
+}
+
+/*Has a symbol been moved out of the module by a redeclaration elsewhere?*/
+static bool compilerIsTainted (const sym* scope) {
+    for (int i = 0; i < scope->children.length; i++) {
+        const sym* Symbol = vectorGet(&scope->children, i);
+
+        if (   Symbol->tag == symLink
+            && !compilerIsWithin(vectorGet(&Symbol->children, 0), scope))
+            return true;
+    }
+
+    return false;
+}
+
+/*Do all the modules imported by one remain?*/
+static bool compilerImportsKept (const sym* scope, const intset/*<const sym*>*/* kept) {
+    for (int i = 0; i < scope->children.length; i++) {
+        const sym* Symbol = vectorGet(&scope->children, i);
+
+        if (   Symbol->tag == symModuleLink
+            && !intsetTest(kept, (intptr_t) vectorGet(&Symbol->children, 0)))
+            return false;
+    }
+
+    return true;
+}
+
+void compilerRefresh (compilerCtx* ctx, const char* input) {
+    char* fullname = parserFindFile(ctx, input, "");
+
+    /*First by their own contents*/
+
+    intset/*<const sym*>*/ kept;
+    intsetInit(&kept, ctx->residents.length+1);
+
+    for (int i = 0; i < ctx->residents.length; i++) {
+        compilerModule* module = vectorGet(&ctx->residents, i);
+
+        if (   !module->discard
+            && !(fullname && !strcmp(fullname, module->fullname))
+            && cacheHashFile(cacheHashInit, module->fullname) == module->hash
+            && !compilerIsTainted(module->result->scope))
+            intsetAdd(&kept, (intptr_t) module->result->scope);
+    }
+
+    free(fullname);
+
+    /*Then by those they import, until none change*/
+
+    intset/*<const sym*>*/ next;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        intsetInit(&next, ctx->residents.length+1);
+
+        for (int i = 0; i < ctx->residents.length; i++) {
+            compilerModule* module = vectorGet(&ctx->residents, i);
+            const sym* scope = module->result->scope;
+
+            if (intsetTest(&kept, (intptr_t) scope)) {
+                if (compilerImportsKept(scope, &kept))
+                    intsetAdd(&next, (intptr_t) scope);
+
+                else
+                    changed = true;
+            }
+        }
+
+        intsetFree(&kept);
+        kept = next;
+    }
+
+    /*Rebuild the modules from those kept*/
+
+    hashmapFree(&ctx->modules);
+    hashmapInit(&ctx->modules, 1024);
+
+    int residentNo = 0;
+
+    for (int i = 0; i < ctx->residents.length; i++) {
+        compilerModule* module = vectorGet(&ctx->residents, i);
+
+        if (intsetTest(&kept, (intptr_t) module->result->scope)) {
+            hashmapAdd(&ctx->modules, module->fullname, module->result);
+            vectorSet(&ctx->residents, residentNo++, module);
+
+        } else {
+            debugMsg("Dropped %s", module->fullname);
+            vectorPush(&ctx->dropped, module->result);
+            free(module->fullname);
+            free(module);
+        }
+    }
+
+    ctx->residents.length = residentNo;
+    intsetFree(&kept);
+
+    if (ctx->dropped.length > compilerDroppedMax)
+        compilerReset(ctx);
+}
+
+/*Record the modules first imported by a compilation, and the input*/
+static void compilerKeep (compilerCtx* ctx, const ast* tree, bool clean) {
+    for (int i = 0; i < ctx->loaded.length; i++) {
+        compilerModule* module = malloc(sizeof(compilerModule));
+        module->fullname = vectorGet(&ctx->loaded, i);
+        module->result = hashmapMap(&ctx->modules, module->fullname);
+        module->hash = cacheHashFile(cacheHashInit, module->fullname);
+        module->discard = !clean || module->result->tree == tree;
+        vectorPush(&ctx->residents, module);
+    }
+}
+
+/*==== Compilation ====*/
+
+bool compiler (compilerCtx* ctx, const char* input, const char* output, const char* assembler, const char* object) {
+    /*Files may have come and gone since the last*/
+    pathsClear(&ctx->paths);
+
+    /*The headers included by the modules kept aren't checked for changes,
+      so preprocessing starts afresh*/
+    if (ctx->resident && ctx->preprocess)
+        compilerReset(ctx);
+
+    else if (ctx->resident)
+        compilerRefresh(ctx, input);
+
+    bool fail = false;
+
+    /*Reuse an earlier compilation of the same sources, if there is one*/
+    if (cacheLookup(ctx, input, output, assembler, object, &fail))
+        return fail;
+
+    /*Otherwise it may be cached, if compiled in a fresh context*/
+    bool cached = ctx->compileCache && ctx->fresh;
+    ctx->fresh = false;
+
+    /*The debug counter is shared by everything on this thread, only
+      count what this compilation raises*/
+    int internalErrorsBefore = internalErrors;
+    int errorsBefore = ctx->errors, warningsBefore = ctx->warnings;
+
     /*Parse the module*/
 
     ast* tree = 0; {
-        parserResult res = parser(input, "", ctx);
+        parserResult res = parser(input, "", false, ctx);
+
+        /*Imported by an input before, so only its declarations were
+          parsed or loaded. Start again to have its definitions.*/
+        if (!res.firsttime && !res.notfound) {
+            compilerReset(ctx);
+            ctx->fresh = false;
+            res = parser(input, "", false, ctx);
+        }
+
         ctx->errors += res.errors;
         ctx->warnings += res.warnings;
         tree = res.tree;
@@ -86,6 +314,51 @@ void compiler (compilerCtx* ctx, const char* input, const char* output) {
 
     /*Emit the assembly*/
 
-    if (ctx->errors == 0 && internalErrors == 0)
-        emitter(tree, output, ctx->arch);
+    ctx->internalErrors += internalErrors - internalErrorsBefore;
+    internalErrorsBefore = internalErrors;
+
+    if (ctx->errors == 0 && ctx->internalErrors == 0) {
+        /*Written out in full, rather than piped, so that it can be kept*/
+        if (cached) {
+            emitter(tree, output, 0, ctx->arch, ctx->threads);
+            ctx->internalErrors += internalErrors - internalErrorsBefore;
+
+            bool clean = ctx->warnings == warningsBefore && ctx->internalErrors == 0;
+            fail = cacheStore(ctx, input, output, assembler, object, clean);
+
+        /*Kept in memory and assembled in process, never written*/
+        } else if (object) {
+            char* text = emitterBuffer(tree, ctx->arch, ctx->threads);
+            ctx->internalErrors += internalErrors - internalErrorsBefore;
+
+            fail = assembleText(ctx->arch, output, text, object);
+            free(text);
+
+        } else {
+            fail = emitter(tree, output, assembler, ctx->arch, ctx->threads);
+            ctx->internalErrors += internalErrors - internalErrorsBefore;
+        }
+    }
+
+    /*Save the interfaces of the modules parsed, now that they're known
+      to be correct and have been laid out*/
+
+    if (!fail && ctx->errors == 0 && ctx->internalErrors == 0) {
+        for (int i = 0; i < ctx->loaded.length; i++) {
+            const char* fullname = vectorGet(&ctx->loaded, i);
+            interfaceSave(ctx, fullname, hashmapMap(&ctx->modules, fullname));
+        }
+    }
+
+    if (ctx->resident) {
+        /*Nor are those preprocessed kept for later*/
+        bool clean =    ctx->errors == errorsBefore && ctx->warnings == warningsBefore && ctx->internalErrors == 0
+                     && !ctx->preprocess;
+        compilerKeep(ctx, tree, clean);
+    }
+
+    ctx->loaded.length = 0;
+    ctx->included.length = 0;
+
+    return fail;
 }
@@ -12,18 +12,23 @@
 #include "stdarg.h"
 #include "stdio.h"
 
-FILE* logFile;
-debugMode mode;
+/*Per thread, so that separate compilations may run concurrently*/
+_Thread_local FILE* logFile;
+_Thread_local debugMode mode;
 //Indentation level of debug output
-int depth;
+_Thread_local int depth;
 
-int internalErrors;
+_Thread_local int internalErrors;
 
 void debugInit (FILE* nlog) {
     logFile = nlog;
     debugSetMode(debugMinimal);
 }
 
+FILE* debugGetLog () {
+    return logFile;
+}
+
 debugMode debugSetMode (debugMode nmode) {
     debugMode old = mode;
     mode = nmode;
@@ -251,12 +256,12 @@ void reportNode (const ast* Node) {
     debugOut("\n");
 }
 
-void reportRegs () {
+void reportRegs (const reg* regs) {
     debugOut("[ ");
 
     for (regIndex r = 0; r < regMax; r++)
-        if (regIsUsed(r))
-            debugOut("%s ", regGetStr(regGet(r)));
+        if (regIsUsed(regs, r))
+            debugOut("%s ", regGetStr(regGet(regs, r)));
 
     debugOut(" ]\n");
 }
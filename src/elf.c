@@ -0,0 +1,412 @@
+#include "../inc/elf.h"
+
+#include "../inc/debug.h"
+#include "../inc/object.h"
+
+#include "stdlib.h"
+#include "string.h"
+#include "stdio.h"
+
+/*ELF constants, so as to not depend on the host's elf.h*/
+enum {
+    elfClass32 = 1, elfClass64 = 2,
+    elfDataLSB = 1,
+    elfTypeRel = 1,
+    elfMachine386 = 3, elfMachineX86_64 = 62,
+
+    elfSectionProgbits = 1, elfSectionSymtab = 2, elfSectionStrtab = 3,
+    elfSectionRela = 4, elfSectionNobits = 8, elfSectionRel = 9,
+    elfSectionInfoLink = 0x40,
+
+    elfBindLocal = 0, elfBindGlobal = 1,
+    elfSymbolSection = 3,
+
+    elfR386_32 = 1, elfR386_PC32 = 2,
+    elfRX86_64_64 = 1, elfRX86_64_PC32 = 2, elfRX86_64_PLT32 = 4,
+    elfRX86_64_32 = 10, elfRX86_64_32S = 11
+};
+
+/**
+ * Growable output buffer
+ */
+typedef struct elfBuffer {
+    char* data;
+    int length, capacity;
+} elfBuffer;
+
+typedef struct elfCtx {
+    objFile* obj;
+    bool is64;
+    int wordsize;
+
+    elfBuffer out;
+    ///.shstrtab and .strtab
+    elfBuffer shstrtab, strtab;
+} elfCtx;
+
+/*==== Buffers ====*/
+
+static void elfBufferInit (elfBuffer* buffer) {
+    buffer->capacity = 1024;
+    buffer->data = calloc(buffer->capacity, 1);
+    buffer->length = 0;
+}
+
+static void elfBufferFree (elfBuffer* buffer) {
+    free(buffer->data);
+}
+
+static void elfPutBytes (elfBuffer* buffer, const void* bytes, int n) {
+    if (buffer->length + n > buffer->capacity) {
+        buffer->capacity = max(buffer->capacity*2, buffer->length + n);
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+
+    memcpy(buffer->data + buffer->length, bytes, n);
+    buffer->length += n;
+}
+
+static void elfPut (elfBuffer* buffer, uint64_t value, int size) {
+    char bytes[8];
+
+    for (int i = 0; i < size; i++)
+        bytes[i] = (char) (value >> 8*i);
+
+    elfPutBytes(buffer, bytes, size);
+}
+
+static void elfPatch (elfBuffer* buffer, int offset, uint64_t value, int size) {
+    for (int i = 0; i < size; i++)
+        buffer->data[offset+i] = (char) (value >> 8*i);
+}
+
+static void elfPadTo (elfBuffer* buffer, int align) {
+    while (buffer->length % align != 0)
+        elfPut(buffer, 0, 1);
+}
+
+/**
+ * Add a null terminated string to a string table, returning its offset
+ */
+static int elfString (elfBuffer* table, const char* str) {
+    int offset = table->length;
+    elfPutBytes(table, str, strlen(str)+1);
+    return offset;
+}
+
+/*Word sized fields, whose width depends on the class*/
+static void elfPutWord (elfCtx* ctx, uint64_t value) {
+    elfPut(&ctx->out, value, ctx->wordsize);
+}
+
+/*==== Sections ====*/
+
+typedef struct elfSection {
+    int name, type, flags;
+    int offset, size;
+    int link, info, align, entsize;
+} elfSection;
+
+static void elfSectionHeader (elfCtx* ctx, const elfSection* section) {
+    elfPut(&ctx->out, section->name, 4);
+    elfPut(&ctx->out, section->type, 4);
+    elfPutWord(ctx, section->flags);
+    elfPutWord(ctx, 0);
+    elfPutWord(ctx, section->offset);
+    elfPutWord(ctx, section->size);
+    elfPut(&ctx->out, section->link, 4);
+    elfPut(&ctx->out, section->info, 4);
+    elfPutWord(ctx, section->align);
+    elfPutWord(ctx, section->entsize);
+}
+
+/*==== Symbols ====*/
+
+static void elfSymbol (elfCtx* ctx, elfBuffer* symtab, int name, uint64_t value, int bind, int symbolType, int shndx) {
+    int info = bind << 4 | symbolType;
+
+    if (ctx->is64) {
+        elfPut(symtab, name, 4);
+        elfPut(symtab, info, 1);
+        elfPut(symtab, 0, 1);
+        elfPut(symtab, shndx, 2);
+        elfPut(symtab, value, 8);
+        elfPut(symtab, 0, 8);
+
+    } else {
+        elfPut(symtab, name, 4);
+        elfPut(symtab, value, 4);
+        elfPut(symtab, 0, 4);
+        elfPut(symtab, info, 1);
+        elfPut(symtab, 0, 1);
+        elfPut(symtab, shndx, 2);
+    }
+}
+
+static bool elfSymbolIsLocal (const objSymbol* symbol) {
+    return symbol->section && !symbol->global;
+}
+
+/*==== Relocations ====*/
+
+static int elfRelocType (elfCtx* ctx, objRelocTag tag) {
+    if (ctx->is64) {
+        if (tag == relocAbs32)
+            return elfRX86_64_32;
+
+        else if (tag == relocAbs32Signed)
+            return elfRX86_64_32S;
+
+        else if (tag == relocAbs64)
+            return elfRX86_64_64;
+
+        else if (tag == relocPC32)
+            return elfRX86_64_PC32;
+
+        else if (tag == relocBranch32)
+            return elfRX86_64_PLT32;
+
+    } else {
+        if (tag == relocAbs32 || tag == relocAbs32Signed)
+            return elfR386_32;
+
+        else if (tag == relocPC32 || tag == relocBranch32)
+            return elfR386_PC32;
+    }
+
+    debugErrorUnhandled("elfRelocType", "relocation tag", "unknown");
+    return 0;
+}
+
+/**
+ * Write the relocation entries of a section. References to local symbols
+ * are made against their section instead, as only globals go in the table.
+ *
+ * ELF32 uses REL, where the addend lives in the section data, so this has
+ * to happen before the section is copied out.
+ */
+static void elfRelocs (elfCtx* ctx, objSection* section, elfBuffer* rel) {
+    for (int i = 0; i < section->relocs.length; i++) {
+        objReloc* reloc = vectorGet(&section->relocs, i);
+
+        int symbolIndex = reloc->symbol->index;
+        intptr_t addend = reloc->addend;
+
+        if (elfSymbolIsLocal(reloc->symbol)) {
+            symbolIndex = reloc->symbol->section->index;
+            addend += reloc->symbol->value;
+        }
+
+        int relocType = elfRelocType(ctx, reloc->tag);
+
+        if (ctx->is64) {
+            elfPut(rel, reloc->offset, 8);
+            elfPut(rel, (uint64_t) symbolIndex << 32 | relocType, 8);
+            elfPut(rel, (uint64_t) (int64_t) addend, 8);
+
+        } else {
+            elfPut(rel, reloc->offset, 4);
+            elfPut(rel, (uint64_t) symbolIndex << 8 | relocType, 4);
+            objPatchInt(section, reloc->offset, addend, 4);
+        }
+    }
+}
+
+/*==== Object ====*/
+
+bool elfWrite (objFile* obj, const char* filename) {
+    elfCtx ctx = {
+        .obj = obj,
+        .is64 = obj->wordsize == 8,
+        .wordsize = obj->wordsize
+    };
+
+    elfBufferInit(&ctx.out);
+    elfBufferInit(&ctx.shstrtab);
+    elfBufferInit(&ctx.strtab);
+
+    elfString(&ctx.shstrtab, "");
+    elfString(&ctx.strtab, "");
+
+    /*Section indices: null, the object's sections, .note.GNU-stack
+      (non-executable stack), relocation sections, .symtab, .strtab, .shstrtab*/
+
+    int sectionNo = obj->sections.length;
+
+    for (int i = 0; i < sectionNo; i++) {
+        objSection* section = vectorGet(&obj->sections, i);
+        section->index = 1+i;
+    }
+
+    int noteIndex = 1+sectionNo;
+    int nextIndex = noteIndex+1;
+
+    int* relIndices = calloc(max(sectionNo, 1), sizeof(int));
+
+    for (int i = 0; i < sectionNo; i++) {
+        objSection* section = vectorGet(&obj->sections, i);
+
+        if (section->relocs.length != 0)
+            relIndices[i] = nextIndex++;
+    }
+
+    int symtabIndex = nextIndex++;
+    int strtabIndex = nextIndex++;
+    int shstrtabIndex = nextIndex++;
+    int headerNo = nextIndex;
+
+    /*Symbol table: null, section symbols, then the globals and undefined*/
+
+    elfBuffer symtab;
+    elfBufferInit(&symtab);
+
+    elfSymbol(&ctx, &symtab, 0, 0, elfBindLocal, 0, 0);
+
+    for (int i = 0; i < sectionNo; i++) {
+        objSection* section = vectorGet(&obj->sections, i);
+        elfSymbol(&ctx, &symtab, 0, 0, elfBindLocal, elfSymbolSection, section->index);
+    }
+
+    int firstGlobal = 1+sectionNo;
+    int symbolNo = firstGlobal;
+
+    for (int i = 0; i < obj->symbols.length; i++) {
+        objSymbol* symbol = vectorGet(&obj->symbols, i);
+
+        if (!elfSymbolIsLocal(symbol)) {
+            symbol->index = symbolNo++;
+            elfSymbol(&ctx, &symtab, elfString(&ctx.strtab, symbol->name),
+                      symbol->section ? symbol->value : 0, elfBindGlobal, 0,
+                      symbol->section ? symbol->section->index : 0);
+        }
+    }
+
+    /*Relocations*/
+
+    elfBuffer* rels = calloc(max(sectionNo, 1), sizeof(elfBuffer));
+
+    for (int i = 0; i < sectionNo; i++) {
+        objSection* section = vectorGet(&obj->sections, i);
+        elfBufferInit(&rels[i]);
+        elfRelocs(&ctx, section, &rels[i]);
+    }
+
+    /*Header, patched later with the section header offset*/
+
+    const char ident[] = {0x7f, 'E', 'L', 'F', ctx.is64 ? elfClass64 : elfClass32, elfDataLSB, 1, 0};
+    elfPutBytes(&ctx.out, ident, sizeof(ident));
+    elfPut(&ctx.out, 0, 8);
+    elfPut(&ctx.out, elfTypeRel, 2);
+    elfPut(&ctx.out, ctx.is64 ? elfMachineX86_64 : elfMachine386, 2);
+    elfPut(&ctx.out, 1, 4);
+    elfPutWord(&ctx, 0);
+    elfPutWord(&ctx, 0);
+    int shoffAt = ctx.out.length;
+    elfPutWord(&ctx, 0);
+    elfPut(&ctx.out, 0, 4);
+    elfPut(&ctx.out, ctx.is64 ? 64 : 52, 2);
+    elfPut(&ctx.out, 0, 2);
+    elfPut(&ctx.out, 0, 2);
+    elfPut(&ctx.out, ctx.is64 ? 64 : 40, 2);
+    elfPut(&ctx.out, headerNo, 2);
+    elfPut(&ctx.out, shstrtabIndex, 2);
+
+    /*Section contents*/
+
+    elfSection* headers = calloc(headerNo, sizeof(elfSection));
+
+    for (int i = 0; i < sectionNo; i++) {
+        objSection* section = vectorGet(&obj->sections, i);
+
+        elfPadTo(&ctx.out, section->align);
+        headers[section->index] = (elfSection) {
+            .name = elfString(&ctx.shstrtab, section->name),
+            .type = section->nobits ? elfSectionNobits : elfSectionProgbits,
+            .flags = section->flags, .offset = ctx.out.length, .size = section->length,
+            .align = section->align, .entsize = section->entsize
+        };
+
+        if (!section->nobits)
+            elfPutBytes(&ctx.out, section->data, section->length);
+    }
+
+    headers[noteIndex] = (elfSection) {
+        .name = elfString(&ctx.shstrtab, ".note.GNU-stack"), .type = elfSectionProgbits,
+        .offset = ctx.out.length, .align = 1
+    };
+
+    for (int i = 0; i < sectionNo; i++) {
+        if (!relIndices[i])
+            continue;
+
+        objSection* section = vectorGet(&obj->sections, i);
+
+        char* name = malloc(strlen(section->name) + 6);
+        sprintf(name, "%s%s", ctx.is64 ? ".rela" : ".rel", section->name);
+
+        elfPadTo(&ctx.out, ctx.wordsize);
+        headers[relIndices[i]] = (elfSection) {
+            .name = elfString(&ctx.shstrtab, name),
+            .type = ctx.is64 ? elfSectionRela : elfSectionRel, .flags = elfSectionInfoLink,
+            .offset = ctx.out.length, .size = rels[i].length,
+            .link = symtabIndex, .info = section->index,
+            .align = ctx.wordsize, .entsize = ctx.is64 ? 24 : 8
+        };
+        elfPutBytes(&ctx.out, rels[i].data, rels[i].length);
+
+        free(name);
+    }
+
+    elfPadTo(&ctx.out, ctx.wordsize);
+    headers[symtabIndex] = (elfSection) {
+        .name = elfString(&ctx.shstrtab, ".symtab"), .type = elfSectionSymtab,
+        .offset = ctx.out.length, .size = symtab.length,
+        .link = strtabIndex, .info = firstGlobal,
+        .align = ctx.wordsize, .entsize = ctx.is64 ? 24 : 16
+    };
+    elfPutBytes(&ctx.out, symtab.data, symtab.length);
+
+    headers[strtabIndex] = (elfSection) {
+        .name = elfString(&ctx.shstrtab, ".strtab"), .type = elfSectionStrtab,
+        .offset = ctx.out.length, .size = ctx.strtab.length, .align = 1
+    };
+    elfPutBytes(&ctx.out, ctx.strtab.data, ctx.strtab.length);
+
+    int shstrtabName = elfString(&ctx.shstrtab, ".shstrtab");
+    headers[shstrtabIndex] = (elfSection) {
+        .name = shstrtabName, .type = elfSectionStrtab,
+        .offset = ctx.out.length, .size = ctx.shstrtab.length, .align = 1
+    };
+    elfPutBytes(&ctx.out, ctx.shstrtab.data, ctx.shstrtab.length);
+
+    /*Section headers*/
+
+    elfPadTo(&ctx.out, ctx.wordsize);
+    elfPatch(&ctx.out, shoffAt, ctx.out.length, ctx.wordsize);
+
+    for (int i = 0; i < headerNo; i++)
+        elfSectionHeader(&ctx, &headers[i]);
+
+    /*Write it out*/
+
+    FILE* file = fopen(filename, "wb");
+    bool fail = !file;
+
+    if (file) {
+        fail = fwrite(ctx.out.data, 1, ctx.out.length, file) != (size_t) ctx.out.length;
+        fclose(file);
+    }
+
+    for (int i = 0; i < sectionNo; i++)
+        elfBufferFree(&rels[i]);
+
+    free(rels);
+    free(relIndices);
+    free(headers);
+    elfBufferFree(&symtab);
+    elfBufferFree(&ctx.out);
+    elfBufferFree(&ctx.shstrtab);
+    elfBufferFree(&ctx.strtab);
+
+    return fail;
+}
@@ -8,10 +8,21 @@
 #include "../inc/sym.h"
 #include "../inc/architecture.h"
 #include "../inc/ir.h"
+#include "../inc/reg.h"
+#include "../inc/asm-amd64.h"
 
 #include "../inc/eval.h"
 
 #include "assert.h"
+#include "stdlib.h"
+
+/*Heuristics for initializing automatic variables from a .rodata template*/
+enum {
+    /*Smaller than this (in bytes), immediate stores are cheaper than a copy*/
+    emitterTemplateMinSize = 32,
+    /*At least one in this many words must be non-zero*/
+    emitterTemplateMinDensity = 4
+};
 
 static void emitterDeclBasic (emitterCtx* ctx, ast* Node);
 static void emitterStructOrUnion (emitterCtx* ctx, sym* record, int nextOffset);
@@ -19,6 +30,7 @@ static void emitterEnum (emitterCtx* ctx, sym* Symbol);
 
 static void emitterDeclNode (emitterCtx* ctx, irBlock** block, const ast* Node);
 static void emitterDeclAssignBOP (emitterCtx* ctx, irBlock** block, const ast* Node);
+static bool emitterDeclTemplateInit (emitterCtx* ctx, irBlock* block, const ast* Node, operand L);
 static void emitterDeclCall (emitterCtx* ctx, irBlock** block, const ast* Node);
 static void emitterDeclName (emitterCtx* ctx, const ast* Node);
 
@@ -38,11 +50,17 @@ void emitterDecl (emitterCtx* ctx, irBlock** block, const ast* Node) {
 static void emitterDeclBasic (emitterCtx* ctx, ast* Node) {
     debugEnter(astTagGetStr(Node->tag));
 
-    if (Node->tag == astStruct || Node->tag == astUnion)
-        emitterStructOrUnion(ctx, Node->symbol, 0);
+    /*Records and enums are laid out by the first declaration to mention
+      them. Afterwards they are shared by functions that may be emitted
+      concurrently (see emitterFns), so are left alone.*/
+    if (Node->tag == astStruct || Node->tag == astUnion) {
+        if (Node->symbol->size == 0)
+            emitterStructOrUnion(ctx, Node->symbol, 0);
 
-    else if (Node->tag == astEnum)
-        emitterEnum(ctx, Node->symbol);
+    } else if (Node->tag == astEnum) {
+        if (Node->symbol->size == 0)
+            emitterEnum(ctx, Node->symbol);
+    }
 
     else if (Node->tag == astConst)
         emitterDeclBasic(ctx, Node->r);
@@ -156,20 +174,39 @@ static void emitterDeclNode (emitterCtx* ctx, irBlock** block, const ast* Node)
 static void emitterDeclAssignBOP (emitterCtx* ctx, irBlock** block, const ast* Node) {
     emitterDeclNode(ctx, block, Node->l);
 
-    if (   Node->symbol->storage == storageStatic
-        || Node->symbol->storage == storageExtern) {
-        if (Node->r->tag == astLiteral && Node->r->litTag == literalInit)
-            debugError("emitterDeclAssignBOP", "compound initializers for static objects unsupported");
+    bool stored =    Node->symbol->storage == storageStatic
+                  || Node->symbol->storage == storageExtern;
 
-        else
+    /*Defined by the module's own object*/
+    if (stored && ctx->imported)
+        ;
+
+    else if (stored) {
+        const type* DT = Node->symbol->dt;
+        int size = typeGetSize(ctx->arch, DT);
+
+        /*Compound initializer or address: serialize it, with relocations*/
+        if (   (Node->r->tag == astLiteral && Node->r->litTag == literalInit)
+            || !eval(ctx->arch, Node->r).known) {
+            char* data = calloc(size, 1);
+            vector refs;
+            vectorInit(&refs, 4);
+            emitterInitData(ctx, Node->r, data, size, &refs);
+
+            bool ro = DT->qual.isConst || (typeIsArray(DT) && typeGetBase(DT)->qual.isConst);
+            irStaticBytes(ctx->ir, Node->symbol->label, Node->symbol->storage == storageExtern, ro, size, data, &refs);
+
+        } else
             irStaticValue(ctx->ir, Node->symbol->label, Node->symbol->storage == storageExtern,
-                          typeGetSize(ctx->arch, Node->symbol->dt), eval(ctx->arch, Node->r).value);
+                          size, eval(ctx->arch, Node->r).value);
 
     } else if (Node->symbol->storage == storageAuto) {
         operand L = emitterSymbol(ctx, Node->symbol);
 
-        if (Node->r->tag == astLiteral && Node->r->litTag == literalInit)
-            emitterCompoundInit(ctx, block, Node->r, L);
+        if (Node->r->tag == astLiteral && Node->r->litTag == literalInit) {
+            if (!emitterDeclTemplateInit(ctx, *block, Node->r, L))
+                emitterCompoundInit(ctx, block, Node->r, L);
+        }
 
         else
             emitterValueSuggest(ctx, block, Node->r, &L);
@@ -178,6 +215,54 @@ static void emitterDeclAssignBOP (emitterCtx* ctx, irBlock** block, const ast* N
         debugErrorUnhandled("emitterDeclAssignBOP", "storage tag", storageTagGetStr(Node->symbol->storage));
 }
 
+/*Initialize a large constant compound initializer by block copying an
+  image of it, instead of a store per element*/
+static bool emitterDeclTemplateInit (emitterCtx* ctx, irBlock* block, const ast* Node, operand L) {
+    int size = typeGetSize(ctx->arch, Node->dt);
+    int wordsize = ctx->arch->wordsize;
+
+    /*Small initializers are better off as immediate stores*/
+    if (size < emitterTemplateMinSize || !evalIsConstantInit(Node))
+        return false;
+
+    char* data = calloc(size, 1);
+    vector refs;
+    vectorInit(&refs, 4);
+    emitterInitData(ctx, Node, data, size, &refs);
+
+    /*Mostly zero? Zeroing and storing the rest is cheaper, and saves the space*/
+
+    int nonzeroWords = refs.length;
+
+    for (int i = 0; i < size; i += wordsize) {
+        for (int j = i; j < i+wordsize && j < size; j++) {
+            if (data[j] != 0) {
+                nonzeroWords++;
+                break;
+            }
+        }
+    }
+
+    if (nonzeroWords*emitterTemplateMinDensity < (size+wordsize-1)/wordsize) {
+        free(data);
+        vectorFreeObjs(&refs, free);
+        return false;
+    }
+
+    /*Copy from the template*/
+
+    operand template = operandCreateReg(regAlloc(ctx->ir->regs, wordsize));
+    asmMove(ctx->ir, block, template, irROBytes(ctx->ir, size, data, &refs));
+
+    L.size = size;
+    L.array = false;
+    asmMove(ctx->ir, block, L, operandCreateMem(template.base, 0, size));
+
+    operandFree(template);
+
+    return true;
+}
+
 static void emitterDeclCall (emitterCtx* ctx, irBlock** block, const ast* Node) {
     for (ast* param = Node->firstChild;
          param;
@@ -207,7 +292,8 @@ static void emitterDeclName (emitterCtx* ctx, const ast* Node) {
     /*Static declaration without an explicit initializer?*/
     if (   Node->symbol->tag == symId
         && Node->storage == storageStatic
-        && !Node->symbol->impl)
+        && !Node->symbol->impl
+        && !ctx->imported)
         /*Emit, and initialize to zero*/
         irStaticValue(ctx->ir, Node->symbol->label, Node->symbol->storage == storageExtern,
                       typeGetSize(ctx->arch, Node->symbol->dt), 0);
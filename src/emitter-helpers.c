@@ -43,7 +43,8 @@ static int emitterScopeAssignOffsets (const architecture* arch, sym* Scope, int
         if (Symbol->tag == symScope)
             offset = emitterScopeAssignOffsets(arch, Symbol, offset);
 
-        else if (Symbol->tag == symId) {
+        /*Statics have a label instead*/
+        else if (Symbol->tag == symId && Symbol->storage == storageAuto) {
             offset -= typeGetSize(arch, Symbol->dt);
             Symbol->offset = offset;
             reportSymbol(Symbol);
@@ -85,23 +86,23 @@ operand emitterGetInReg (emitterCtx* ctx,  irBlock* block, operand src, int size
     if (src.tag == operandReg)
         return src;
 
-    operand dest = operandCreateReg(regAlloc(size));
+    operand dest = operandCreateReg(regAlloc(ctx->ir->regs, size));
     asmMove(ctx->ir, block, dest, src);
     operandFree(src);
     return dest;
 }
 
 operand emitterTakeReg (emitterCtx* ctx, irBlock* block, regIndex r, int* oldSize, int newSize) {
-    if (regIsUsed(r))
+    if (regIsUsed(ctx->ir->regs, r))
         asmSaveReg(ctx->ir, block, r);
 
-    *oldSize = regs[r].allocatedAs;
-    regs[r].allocatedAs = newSize;
-    return operandCreateReg(&regs[r]);
+    *oldSize = ctx->ir->regs[r].allocatedAs;
+    ctx->ir->regs[r].allocatedAs = newSize;
+    return operandCreateReg(&ctx->ir->regs[r]);
 }
 
 void emitterGiveBackReg (emitterCtx* ctx, irBlock* block, regIndex r, int oldSize) {
-    regs[r].allocatedAs = oldSize;
+    ctx->ir->regs[r].allocatedAs = oldSize;
 
     if (oldSize)
         asmRestoreReg(ctx->ir, block, r);
@@ -112,6 +113,21 @@ void emitterBranchOnValue (emitterCtx* ctx, irBlock* block, const ast* value,
     if (value->tag == astEmpty)
         irJump(block, ifTrue);
 
+    /*Short circuit straight to the targets, never materializing a bool*/
+    else if (value->tag == astBOP && opIsLogical(value->o)) {
+        irBlock* rhs = irBlockCreate(ctx->ir, ctx->curFn);
+
+        if (value->o == opLogicalAnd)
+            emitterBranchOnValue(ctx, block, value->l, rhs, ifFalse);
+
+        else
+            emitterBranchOnValue(ctx, block, value->l, ifTrue, rhs);
+
+        emitterBranchOnValue(ctx, rhs, value->r, ifTrue, ifFalse);
+
+    } else if (value->tag == astUOP && value->o == opLogicalNot)
+        emitterBranchOnValue(ctx, block, value->r, ifFalse, ifTrue);
+
     else {
         operand cond = emitterValue(ctx, &block, value, requestFlags);
         irBranch(block, cond, ifTrue, ifFalse);
@@ -124,21 +140,30 @@ operand emitterWiden (emitterCtx* ctx, irBlock* block, operand R, int size) {
     if (R.tag == operandLiteral)
         return R;
 
-    char* RStr = operandToStr(R);
-
     operand L;
+    int from = 0;
 
+    /*Widened in place, so the register is named below at both sizes*/
     if (R.tag == operandReg) {
+        from = R.base->allocatedAs;
         R.base->allocatedAs = size;
         L = R;
 
     } else
-        L = operandCreateReg(regAlloc(size));
+        L = operandCreateReg(regAlloc(ctx->ir->regs, size));
+
+    buffer* out = irBlockBeginLn(block);
+    bufferStrN(out, "movsx ", 6);
+    operandWrite(out, L);
+    bufferStrN(out, ", ", 2);
 
-    char* LStr = operandToStr(L);
-    irBlockOut(block, "movsx %s, %s", LStr, RStr);
-    free(LStr);
-    free(RStr);
+    if (R.tag == operandReg)
+        bufferStr(out, regIndexGetName(R.base->index, from));
+
+    else
+        operandWrite(out, R);
+
+    irBlockEndLn(block);
 
     if (R.tag != operandReg)
         operandFree(R);
@@ -160,11 +185,12 @@ void emitterZeroMem (emitterCtx* ctx, irBlock* block, operand L) {
 
     operand zero = operandCreateLiteral(0);
 
-    int regPressure =   (regIsUsed(regRAX) ? 1 : 0)
-                      + (regIsUsed(regRCX) ? 1 : 0)
-                      + (regIsUsed(regRDI) ? 1 : 0);
+    int regPressure =   (regIsUsed(ctx->ir->regs, regRAX) ? 1 : 0)
+                      + (regIsUsed(ctx->ir->regs, regRCX) ? 1 : 0)
+                      + (regIsUsed(ctx->ir->regs, regRDI) ? 1 : 0);
 
-    if (size >= ctx->arch->wordsize*10*(1+regPressure)) {
+    /*Large: rep stos, unless it would mean saving too many registers*/
+    if (size >= 256*(1+regPressure)) {
         int raxOldSize, rcxOldSize, rdxOldSize;
         operand RAX = emitterTakeReg(ctx, block, regRAX, &raxOldSize, ctx->arch->wordsize);
         operand RCX = emitterTakeReg(ctx, block, regRCX, &rcxOldSize, ctx->arch->wordsize);
@@ -174,24 +200,13 @@ void emitterZeroMem (emitterCtx* ctx, irBlock* block, operand L) {
         asmRepStos(ctx->ir, block, RAX, RCX, RDI, L, size-excess, zero);
 
         if (excess != 0)
-            asmMove(ctx->ir, block, operandCreateMem(RDI.base, 0, excess), zero);
+            asmBlockZero(ctx->ir, block, operandCreateMem(RDI.base, 0, excess), excess);
 
         emitterGiveBackReg(ctx, block, regRAX, raxOldSize);
         emitterGiveBackReg(ctx, block, regRCX, rcxOldSize);
         emitterGiveBackReg(ctx, block, regRDI, rdxOldSize);
 
-    } else {
-        int chunk = ctx->arch->wordsize;
-        L.size = chunk;
-
-        for (int i = 0;
-             i+chunk <= size;
-             i += chunk, L.offset += chunk)
-            asmMove(ctx->ir, block, L, zero);
-
-        if (size % chunk != 0) {
-            L.size = size % chunk;
-            asmMove(ctx->ir, block, L, zero);
-        }
-    }
+    /*Otherwise word or vector stores*/
+    } else
+        asmBlockZero(ctx->ir, block, L, size);
 }
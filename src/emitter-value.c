@@ -14,6 +14,8 @@
 #include "../inc/asm-amd64.h"
 #include "../inc/reg.h"
 
+#include "../inc/eval.h"
+
 #include "stdio.h"
 #include "stdlib.h"
 #include "assert.h"
@@ -39,6 +41,8 @@ static operand emitterCompoundLiteral (emitterCtx* ctx, irBlock** block, const a
 static void emitterStructInit (emitterCtx* ctx, irBlock** block, const ast* Node, operand base);
 static void emitterArrayInit (emitterCtx* ctx, irBlock** block, const ast* Node, operand base);
 static void emitterElementInit (emitterCtx* ctx, irBlock** block, const ast* Node, operand L);
+static void emitterCompoundInitData (emitterCtx* ctx, const ast* Node, char* data, int offset, vector* refs);
+static void emitterElementInitData (emitterCtx* ctx, const ast* Node, char* data, int offset, int size, vector* refs);
 static operand emitterLambda (emitterCtx* ctx, irBlock** block, const ast* Node);
 
 static operand emitterVAStart (emitterCtx* ctx, irBlock** block, const ast* Node);
@@ -131,7 +135,7 @@ static operand emitterValueImpl (emitterCtx* ctx, irBlock** block, const ast* No
 
     /*Allow an array to decay to a pointer unless being used as an array*/
     if (Value.array && request != requestArray) {
-        operand address = operandCreateReg(regAlloc(ctx->arch->wordsize));
+        operand address = operandCreateReg(regAlloc(ctx->ir->regs, ctx->arch->wordsize));
         asmEvalAddress(ctx->ir, *block, address, Value);
         operandFree(Value);
         Value = address;
@@ -184,7 +188,7 @@ static operand emitterValueImpl (emitterCtx* ctx, irBlock** block, const ast* No
             reportOperand(ctx->arch, &Value);
 
         } else if (Value.tag != operandMem) {
-            operand base = operandCreateReg(regAlloc(ctx->arch->wordsize));
+            operand base = operandCreateReg(regAlloc(ctx->ir->regs, ctx->arch->wordsize));
             asmEvalAddress(ctx->ir, *block, base, Value);
             operandFree(Value);
             Dest = operandCreateMem(base.base, 0, typeGetSize(ctx->arch, Node->dt));
@@ -209,10 +213,10 @@ static operand emitterValueImpl (emitterCtx* ctx, irBlock** block, const ast* No
 
         /*Larger than word size ret => copy into caller allocated temporary pushed after args*/
         if (retInTemp) {
-            operand tempRef = operandCreateReg(regAlloc(ctx->arch->wordsize));
+            operand tempRef = operandCreateReg(regAlloc(ctx->ir->regs, ctx->arch->wordsize));
 
             /*Dereference the temporary*/
-            asmMove(ctx->ir, *block, tempRef, operandCreateMem(&regs[regRBP], 2*ctx->arch->wordsize, ctx->arch->wordsize));
+            asmMove(ctx->ir, *block, tempRef, operandCreateMem(&ctx->ir->regs[regRBP], 2*ctx->arch->wordsize, ctx->arch->wordsize));
             /*Copy over the value*/
             asmMove(ctx->ir, *block, operandCreateMem(tempRef.base, 0, retSize), Value);
             operandFree(Value);
@@ -221,14 +225,14 @@ static operand emitterValueImpl (emitterCtx* ctx, irBlock** block, const ast* No
             Value = tempRef;
         }
 
-        reg* rax = regRequest(regRAX, retInTemp ? ctx->arch->wordsize : retSize);
+        reg* rax = regRequest(ctx->ir->regs, regRAX, retInTemp ? ctx->arch->wordsize : retSize);
 
         /*Return in RAX either the return value itself or a reference to it*/
         if (rax != 0) {
             asmMove(ctx->ir, *block, operandCreateReg(rax), Value);
             regFree(rax);
 
-        } else if (Value.base != regGet(regRAX))
+        } else if (Value.base != regGet(ctx->ir->regs, regRAX))
             debugError("emitterValueImpl", "unable to allocate RAX for return");
 
         operandFree(Value);
@@ -377,7 +381,7 @@ static operand emitterDivisionBOP (emitterCtx* ctx, irBlock** block, const ast*
 
     /*If the result reg was used before, move it to a new reg*/
     if ((isModulo ? rdxOldSize : raxOldSize) != 0) {
-        Value = operandCreateReg(regAlloc(typeGetSize(ctx->arch, Node->dt)));
+        Value = operandCreateReg(regAlloc(ctx->ir->regs, typeGetSize(ctx->arch, Node->dt)));
         asmMove(ctx->ir, *block, Value, isModulo ? RDX : RAX);
 
         /*Restore regs*/
@@ -454,11 +458,8 @@ static operand emitterLogicalBOP (emitterCtx* ctx, irBlock** block, const ast* N
       return the condition as flags in R*/
     operand R = emitterLogicalBOPImpl(ctx, block, Node, continuation, &Value);
 
-    if (Node->o == opLogicalOr)
-        R.condition = conditionNegate(R.condition);
-
-    /*Move final value*/
-    asmConditionalMove(ctx->ir, *block, R, Value, operandCreateLiteral(Node->o == opLogicalOr ? 0 : 1));
+    /*Not shorted: the value is the RHS condition, set from the flags*/
+    asmMove(ctx->ir, *block, Value, R);
 
     /*Continue*/
     irJump(*block, continuation);
@@ -487,7 +488,7 @@ static operand emitterLogicalBOPImpl (emitterCtx* ctx, irBlock** block, const as
         L = emitterValue(ctx, block, Node->l, requestFlags);
 
         /*Set up the short circuit value*/
-        *Value = operandCreateReg(regAlloc(typeGetSize(ctx->arch, Node->dt)));
+        *Value = operandCreateReg(regAlloc(ctx->ir->regs, typeGetSize(ctx->arch, Node->dt)));
         asmMove(ctx->ir, *block, *Value, operandCreateLiteral(Node->o == opLogicalAnd ? 0 : 1));
     }
 
@@ -522,7 +523,7 @@ static operand emitterUOP (emitterCtx* ctx, irBlock** block, const ast* Node) {
 
         /*Post ops: save a copy before inc/dec*/
         if (post) {
-            Value = operandCreateReg(regAlloc(operandGetSize(ctx->arch, R)));
+            Value = operandCreateReg(regAlloc(ctx->ir->regs, operandGetSize(ctx->arch, R)));
             asmMove(ctx->ir, *block, Value, R);
 
         } else
@@ -563,7 +564,7 @@ static operand emitterUOP (emitterCtx* ctx, irBlock** block, const ast* Node) {
     } else if (Node->o == opAddressOf) {
         R = emitterValue(ctx, block, Node->r, requestMem);
 
-        Value = operandCreateReg(regAlloc(ctx->arch->wordsize));
+        Value = operandCreateReg(regAlloc(ctx->ir->regs, ctx->arch->wordsize));
 
         asmEvalAddress(ctx->ir, *block, Value, R);
         operandFree(R);
@@ -576,7 +577,55 @@ static operand emitterUOP (emitterCtx* ctx, irBlock** block, const ast* Node) {
     return Value;
 }
 
+/*Can this be evaluated regardless of the condition? No side effects, can't fault*/
+static bool emitterTOPOperandIsSimple (const ast* Node) {
+    if (Node->tag != astLiteral)
+        return false;
+
+    else if (   Node->litTag == literalInt || Node->litTag == literalChar
+             || Node->litTag == literalBool)
+        return true;
+
+    else if (Node->litTag == literalIdent) {
+        const sym* Symbol = Node->symbol;
+
+        return    Symbol->tag == symEnumConstant
+               || (   (Symbol->tag == symId || Symbol->tag == symParam)
+                   && !typeIsArray(Symbol->dt) && !typeIsFunction(Symbol->dt));
+
+    } else
+        return false;
+}
+
+static bool emitterTOPIsSimple (emitterCtx* ctx, const ast* Node) {
+    int size = typeGetSize(ctx->arch, Node->dt);
+
+    /*cmov doesn't do bytes. A logical condition would be better off branching.*/
+    return    typeIsOrdinal(Node->dt)
+           && size > 1 && size <= ctx->arch->wordsize
+           && typeGetSize(ctx->arch, Node->l->dt) == size
+           && typeGetSize(ctx->arch, Node->r->dt) == size
+           && emitterTOPOperandIsSimple(Node->l)
+           && emitterTOPOperandIsSimple(Node->r)
+           && !(Node->firstChild->tag == astBOP && opIsLogical(Node->firstChild->o));
+}
+
 static operand emitterTOP (emitterCtx* ctx, irBlock** block, const ast* Node, const operand* suggestion) {
+    /*Simple operands, e.g. min/max: load both and cmov, no branches*/
+    if (emitterTOPIsSimple(ctx, Node)) {
+        /*Loading the operands doesn't touch the flags, so the condition
+          can go first, preserving the order of evaluation*/
+        operand Cond = emitterValue(ctx, block, Node->firstChild, requestFlags);
+
+        operand Value = emitterValueImpl(ctx, block, Node->r, requestReg, suggestion);
+        operand L = emitterValue(ctx, block, Node->l, requestRegOrMem);
+
+        asmConditionalMove(ctx->ir, *block, Cond, Value, L);
+        operandFree(L);
+
+        return Value;
+    }
+
     irBlock *ifTrue = irBlockCreate(ctx->ir, ctx->curFn),
             *ifFalse = irBlockCreate(ctx->ir, ctx->curFn),
             *continuation = irBlockCreate(ctx->ir, ctx->curFn);
@@ -628,7 +677,7 @@ static operand emitterIndex (emitterCtx* ctx, irBlock** block, const ast* Node)
 
             /*Evaluate the address of L, use the result as base of new operand*/
             } else {
-                Value = operandCreateMem(regAlloc(ctx->arch->wordsize), 0, size);
+                Value = operandCreateMem(regAlloc(ctx->ir->regs, ctx->arch->wordsize), 0, size);
                 asmEvalAddress(ctx->ir, *block, operandCreateReg(Value.base), L);
                 operandFree(L);
             }
@@ -685,7 +734,7 @@ static operand emitterCall (emitterCtx* ctx, irBlock** block, const ast* Node) {
     for (int i = 0; i < ctx->arch->scratchRegs.length; i++) {
         regIndex r = (regIndex) vectorGet(&ctx->arch->scratchRegs, i);
 
-        if (regIsUsed(r))
+        if (regIsUsed(ctx->ir->regs, r))
             asmSaveReg(ctx->ir, *block, r);
     }
 
@@ -703,18 +752,21 @@ static operand emitterCall (emitterCtx* ctx, irBlock** block, const ast* Node) {
     }
 
     /*Push the args on backwards (cdecl)*/
-    for (ast* Current = Node->lastChild;
-         Current;
-         Current = Current->prevSibling) {
-        operand Arg = emitterValue(ctx, block, Current, requestStack);
+    ast** args = malloc(sizeof(ast*)*max(Node->children, 1));
+    astGetChildren(Node, args);
+
+    for (int i = Node->children-1; i >= 0; i--) {
+        operand Arg = emitterValue(ctx, block, args[i], requestStack);
         argSize += Arg.size;
     }
 
+    free(args);
+
     /*Pass on the reference to the temporary return space
       Last, so that a varargs fn can still locate it*/
     if (retInTemp) {
-        operand intermediate = operandCreateReg(regAlloc(ctx->arch->wordsize));
-        asmEvalAddress(ctx->ir, *block, intermediate, operandCreateMem(&regs[regRSP], argSize, ctx->arch->wordsize));
+        operand intermediate = operandCreateReg(regAlloc(ctx->ir->regs, ctx->arch->wordsize));
+        asmEvalAddress(ctx->ir, *block, intermediate, operandCreateMem(&ctx->ir->regs[regRSP], argSize, ctx->arch->wordsize));
         asmPush(ctx->ir, *block, intermediate);
         operandFree(intermediate);
     }
@@ -740,15 +792,15 @@ static operand emitterCall (emitterCtx* ctx, irBlock** block, const ast* Node) {
 
         /*If RAX is already in use (currently backed up to the stack), relocate the
           return value to another free reg before RAX's value is restored.*/
-        if (regIsUsed(regRAX)) {
-            Value = operandCreateReg(regAlloc(size));
-            int tmp = regs[regRAX].allocatedAs;
-            regs[regRAX].allocatedAs = size;
-            asmMove(ctx->ir, *block, Value, operandCreateReg(&regs[regRAX]));
-            regs[regRAX].allocatedAs = tmp;
+        if (regIsUsed(ctx->ir->regs, regRAX)) {
+            Value = operandCreateReg(regAlloc(ctx->ir->regs, size));
+            int tmp = ctx->ir->regs[regRAX].allocatedAs;
+            ctx->ir->regs[regRAX].allocatedAs = size;
+            asmMove(ctx->ir, *block, Value, operandCreateReg(&ctx->ir->regs[regRAX]));
+            ctx->ir->regs[regRAX].allocatedAs = tmp;
 
         } else
-            Value = operandCreateReg(regRequest(regRAX, size));
+            Value = operandCreateReg(regRequest(ctx->ir->regs, regRAX, size));
 
         /*The temporary's pointer is returned to us*/
         if (retInTemp)
@@ -764,7 +816,7 @@ static operand emitterCall (emitterCtx* ctx, irBlock** block, const ast* Node) {
     for (int i = ctx->arch->scratchRegs.length-1; i >= 0; i--) {
         regIndex r = (regIndex) vectorGet(&ctx->arch->scratchRegs, i);
 
-        if (regIsUsed(r) && regGet(r) != Value.base)
+        if (regIsUsed(ctx->ir->regs, r) && regGet(ctx->ir->regs, r) != Value.base)
             asmRestoreReg(ctx->ir, *block, r);
     }
 
@@ -805,7 +857,7 @@ operand emitterSymbol (emitterCtx* ctx, const sym* Symbol) {
 
         if (   Symbol->tag == symParam
             || Symbol->storage == storageAuto)
-            Value = operandCreateMem(&regs[regRBP], Symbol->offset, size);
+            Value = operandCreateMem(&ctx->ir->regs[regRBP], Symbol->offset, size);
 
         else if (   Symbol->storage == storageStatic
                  || Symbol->storage == storageExtern) {
@@ -999,6 +1051,95 @@ static void emitterElementInit (emitterCtx* ctx, irBlock** block, const ast* Nod
         emitterValueSuggest(ctx, block, Node, &L);
 }
 
+void emitterInitData (emitterCtx* ctx, const ast* Node, char* data, int size, vector/*<irStaticRef*>*/* refs) {
+    emitterElementInitData(ctx, Node, data, 0, size, refs);
+}
+
+static void emitterCompoundInitData (emitterCtx* ctx, const ast* Node, char* data, int offset, vector* refs) {
+    if (typeIsStruct(Node->dt)) {
+        const sym* record = typeGetBasic(Node->dt);
+        int index = 0;
+
+        for (ast* current = Node->firstChild;
+             current;
+             current = current->nextSibling, index++) {
+            ast* value = current;
+            sym* field = vectorGet(&record->children, index);
+
+            if (current->tag == astMarker && current->marker == markerStructDesignatedInit) {
+                field = current->l->symbol;
+                value = current->r;
+
+                index = field->nthChild;
+            }
+
+            emitterElementInitData(ctx, value, data, offset + field->offset,
+                                   typeGetSize(ctx->arch, field->dt), refs);
+        }
+
+    } else if (typeIsArray(Node->dt)) {
+        int elementSize = typeGetSize(ctx->arch, typeGetBase(Node->dt));
+        int index = 0;
+
+        for (ast* current = Node->firstChild;
+             current;
+             current = current->nextSibling, index++) {
+            ast* value = current;
+
+            if (current->tag == astMarker && current->marker == markerArrayDesignatedInit) {
+                index = current->l->constant;
+                value = current->r;
+            }
+
+            emitterElementInitData(ctx, value, data, offset + index*elementSize, elementSize, refs);
+        }
+
+    /*Scalar*/
+    } else
+        emitterElementInitData(ctx, Node->firstChild, data, offset, typeGetSize(ctx->arch, Node->dt), refs);
+}
+
+static void emitterElementInitData (emitterCtx* ctx, const ast* Node, char* data, int offset, int size, vector* refs) {
+    /*A later initializer of the same element replaces any address there*/
+    for (int i = 0; i < refs->length; i++) {
+        irStaticRef* ref = vectorGet(refs, i);
+
+        if (ref->offset >= offset && ref->offset < offset+size) {
+            vectorRemoveReorder(refs, i--);
+            free(ref);
+        }
+    }
+
+    /*Skipped init, left zero*/
+    if (Node->tag == astEmpty)
+        ;
+
+    else if (Node->tag == astLiteral && Node->litTag == literalInit)
+        emitterCompoundInitData(ctx, Node, data, offset, refs);
+
+    /*Address, left zero to be relocated*/
+    else if (!eval(ctx->arch, Node).known) {
+        const ast* target = evalStaticAddress(Node);
+        irStaticRef* ref = malloc(sizeof(irStaticRef));
+        ref->offset = offset;
+
+        if (target->litTag == literalStr)
+            ref->label = irStringConstant(ctx->ir, (char*) target->literal).label;
+
+        else
+            ref->label = target->symbol->label;
+
+        vectorPush(refs, ref);
+
+    /*Scalar, little endian*/
+    } else {
+        long long value = eval(ctx->arch, Node).value;
+
+        for (int i = 0; i < size && i < (int) sizeof(value); i++)
+            data[offset+i] = (char) (value >> 8*i);
+    }
+}
+
 static operand emitterLambda (emitterCtx* ctx, irBlock** block, const ast* Node) {
     (void) block;
 
@@ -1037,7 +1178,7 @@ static operand emitterVAStart (emitterCtx* ctx, irBlock** block, const ast* Node
 
     operand args = emitterValue(ctx, block, Node->l, requestMem);
 
-    operand tmp = operandCreateReg(regAlloc(ctx->arch->wordsize));
+    operand tmp = operandCreateReg(regAlloc(ctx->ir->regs, ctx->arch->wordsize));
 
     /*Get the address of the given parameter*/
     operand lastParam = emitterValue(ctx, block, Node->r, requestMem);
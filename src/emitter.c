@@ -13,11 +13,32 @@
 #include "../inc/asm.h"
 #include "../inc/asm-amd64.h"
 #include "../inc/reg.h"
+#include "../inc/pool.h"
 
 #include "string.h"
 #include "stdlib.h"
 
-static void emitterModule (emitterCtx* ctx, const ast* Node);
+/*A function to be emitted in a fragment of its own, see emitterFns*/
+typedef struct emitterFnJob {
+    const ast* node;
+    irCtx ir;
+    ///Internal errors raised on its behalf
+    int internalErrors;
+} emitterFnJob;
+
+typedef struct emitterFnsCtx {
+    emitterFnJob* jobs;
+    const architecture* arch;
+    ///Given to the threads started, see debugInit
+    FILE* log;
+} emitterFnsCtx;
+
+static void emitterInit (emitterCtx* ctx, irCtx* ir, const architecture* arch);
+static void emitterFree (emitterCtx* ctx);
+static void emitterGenerate (irCtx* ir, const ast* Tree, const architecture* arch, int threads);
+
+static void emitterModule (emitterCtx* ctx, const ast* Node, vector/*<const ast*>*/* fns);
+static void emitterFns (emitterCtx* ctx, const vector/*<const ast*>*/* fns, int threads);
 static void emitterFnImpl (emitterCtx* ctx, const ast* Node);
 
 static irBlock* emitterLine (emitterCtx* ctx, irBlock* block, const ast* Node);
@@ -27,50 +48,97 @@ static void emitterReturn (emitterCtx* ctx, irBlock* block, const ast* Node);
 static irBlock* emitterBranch (emitterCtx* ctx, irBlock* block, const ast* Node);
 static irBlock* emitterLoop (emitterCtx* ctx, irBlock* block, const ast* Node);
 static irBlock* emitterIter (emitterCtx* ctx, irBlock* block, const ast* Node);
-
-static emitterCtx* emitterInit (const char* output, const architecture* arch) {
-    emitterCtx* ctx = malloc(sizeof(emitterCtx));
-    ctx->ir = malloc(sizeof(irCtx));
-    irInit(ctx->ir, output, arch);
+static irBlock* emitterSwitch (emitterCtx* ctx, irBlock* block, const ast* Node);
+
+/*Heuristics for lowering a switch*/
+enum {
+    /*Jump tables need this many cases, making up at least this percentage
+      of the table entries*/
+    emitterJumpTableMinCases = 4,
+    emitterJumpTableMinDensity = 40,
+    /*Bit tests take one mask per distinct target, tested against a range
+      that fits in the mask*/
+    emitterBitTestMaxTargets = 3,
+    emitterBitTestMaxRange = 32,
+    /*Compare trees test linearly once down to this many cases*/
+    emitterCompareTreeLeafSize = 3
+};
+
+enum {
+    emitterFnNo = 64
+};
+
+static void emitterInit (emitterCtx* ctx, irCtx* ir, const architecture* arch) {
+    ctx->ir = ir;
     ctx->arch = arch;
+    ctx->curFn = 0;
     ctx->returnTo = 0;
     ctx->breakTo = 0;
     ctx->continueTo = 0;
-    return ctx;
+    ctx->imported = false;
+    intmapInit(&ctx->labels, 16);
 }
 
-static void emitterEnd (emitterCtx* ctx) {
-    irFree(ctx->ir);
-
-    free(ctx->ir);
-    free(ctx);
+static void emitterFree (emitterCtx* ctx) {
+    intmapFree(&ctx->labels);
 }
 
-void emitter (const ast* Tree, const char* output, const architecture* arch) {
-    emitterCtx* ctx = emitterInit(output, arch);
+static void emitterGenerate (irCtx* ir, const ast* Tree, const architecture* arch, int threads) {
+    emitterCtx ctx;
+    emitterInit(&ctx, ir, arch);
+
+    /*Declarations are emitted as they come, the functions afterwards*/
+    vector/*<const ast*>*/ fns;
+    vectorInit(&fns, emitterFnNo);
+
+    emitterModule(&ctx, Tree, &fns);
+    emitterFns(&ctx, &fns, threads);
 
-    emitterModule(ctx, Tree);
+    vectorFree(&fns);
+    emitterFree(&ctx);
 
-    irBlockLevelAnalysis(ctx->ir);
-    irEmit(ctx->ir);
+    irBlockLevelAnalysis(ir);
+    irEmit(ir);
+}
+
+bool emitter (const ast* Tree, const char* output, const char* assembler, const architecture* arch, int threads) {
+    irCtx ir;
+    irInit(&ir, output, assembler, arch);
+    emitterGenerate(&ir, Tree, arch, threads);
+    return irFree(&ir);
+}
 
-    emitterEnd(ctx);
+char* emitterBuffer (const ast* Tree, const architecture* arch, int threads) {
+    irCtx ir;
+    irInit(&ir, 0, 0, arch);
+    emitterGenerate(&ir, Tree, arch, threads);
+    return irFreeBuffer(&ir);
 }
 
-static void emitterModule (emitterCtx* ctx, const ast* Node) {
+static void emitterModule (emitterCtx* ctx, const ast* Node, vector/*<const ast*>*/* fns) {
     debugEnter("Module");
 
     for (ast* Current = Node->firstChild;
          Current;
          Current = Current->nextSibling) {
+        /*Imported modules are laid out and named, but not generated.
+          Each is compiled as an input of its own.*/
         if (Current->tag == astUsing) {
-            if (Current->r)
-                emitterModule(ctx, Current->r);
+            if (Current->r) {
+                bool imported = ctx->imported;
+                ctx->imported = true;
+                emitterModule(ctx, Current->r, fns);
+                ctx->imported = imported;
+            }
+
+        /*Declared now, so that the label is ready for the others to call*/
+        } else if (Current->tag == astFnImpl) {
+            emitterDecl(ctx, 0, Current->l);
 
-        } else if (Current->tag == astFnImpl)
-            emitterFnImpl(ctx, Current);
+            if (!ctx->imported)
+                vectorPush(fns, Current);
 
-        else if (Current->tag == astDecl)
+        } else if (Current->tag == astDecl)
             emitterDecl(ctx, 0, Current);
 
         else if (Current->tag == astEmpty)
@@ -83,11 +151,56 @@ static void emitterModule (emitterCtx* ctx, const ast* Node) {
     debugLeave();
 }
 
+/*==== Functions ====*/
+
+static void emitterFnThreadInit (void* arg) {
+    emitterFnsCtx* fns = arg;
+    debugInit(fns->log);
+}
+
+/*Emit, optimize and render one function, entirely within its fragment*/
+static void emitterFnTask (void* arg, int n) {
+    emitterFnsCtx* fns = arg;
+    emitterFnJob* job = &fns->jobs[n];
+
+    int internalErrorsBefore = internalErrors;
+
+    irInitFragment(&job->ir, n, fns->arch);
+
+    emitterCtx ctx;
+    emitterInit(&ctx, &job->ir, fns->arch);
+    emitterFnImpl(&ctx, job->node);
+    emitterFree(&ctx);
+
+    irBlockLevelAnalysis(&job->ir);
+    irEmitFns(&job->ir);
+
+    /*Handed back to the calling thread by emitterFns*/
+    job->internalErrors = internalErrors - internalErrorsBefore;
+    internalErrors = internalErrorsBefore;
+}
+
+static void emitterFns (emitterCtx* ctx, const vector/*<const ast*>*/* fns, int threads) {
+    emitterFnsCtx shared = {calloc(max(fns->length, 1), sizeof(emitterFnJob)), ctx->arch, debugGetLog()};
+
+    for (int i = 0; i < fns->length; i++)
+        shared.jobs[i].node = vectorGet(fns, i);
+
+    poolRun(threads, fns->length, emitterFnThreadInit, emitterFnTask, &shared);
+
+    /*Merge in source order, so the output doesn't depend on how the work
+      was shared out*/
+    for (int i = 0; i < fns->length; i++) {
+        irMerge(ctx->ir, &shared.jobs[i].ir);
+        internalErrors += shared.jobs[i].internalErrors;
+    }
+
+    free(shared.jobs);
+}
+
 static void emitterFnImpl (emitterCtx* ctx, const ast* Node) {
     debugEnter("FnImpl");
 
-    emitterDecl(ctx, 0, Node->l);
-
     int stacksize = emitterFnAllocateStack(ctx->arch, Node->symbol);
 
     /* */
@@ -124,7 +237,22 @@ static irBlock* emitterLine (emitterCtx* ctx, irBlock* block, const ast* Node) {
     else if (Node->tag == astIter)
         block = emitterIter(ctx, block, Node);
 
-    else if (Node->tag == astCode)
+    else if (Node->tag == astSwitch)
+        block = emitterSwitch(ctx, block, Node);
+
+    /*Fall through into the block allocated by the switch, unless already
+      there from an enclosing label, then on to the statement labelled*/
+    else if (Node->tag == astCase || Node->tag == astDefault) {
+        irBlock* label = intmapMap(&ctx->labels, (intptr_t) Node);
+
+        if (block != label) {
+            irJump(block, label);
+            block = label;
+        }
+
+        block = emitterLine(ctx, block, Node->l);
+
+    } else if (Node->tag == astCode)
         block = emitterCode(ctx, block, Node, irBlockCreate(ctx->ir, ctx->curFn));
 
     else if (Node->tag == astReturn)
@@ -255,3 +383,265 @@ static irBlock* emitterIter (emitterCtx* ctx, irBlock* block, const ast* Node) {
 
     return continuation;
 }
+
+/**
+ * Allocate blocks for the labels of a switch, not including those of any
+ * nested switches. The labels of one statement, as in case 1: case 2:,
+ * share a block.
+ */
+static void emitterSwitchLabels (emitterCtx* ctx, const ast* Node,
+                                 vector/*<const ast*>*/* cases, irBlock** defaultTo) {
+    if (Node->tag == astCode) {
+        for (ast* Current = Node->firstChild;
+             Current;
+             Current = Current->nextSibling)
+            emitterSwitchLabels(ctx, Current, cases, defaultTo);
+
+    } else if (Node->tag == astCase || Node->tag == astDefault) {
+        irBlock* label = irBlockCreate(ctx->ir, ctx->curFn);
+        const ast* Current = Node;
+
+        for (; Current->tag == astCase || Current->tag == astDefault; Current = Current->l) {
+            intmapAdd(&ctx->labels, (intptr_t) Current, label);
+
+            if (Current->tag == astCase)
+                vectorPush(cases, (void*) Current);
+
+            else
+                *defaultTo = label;
+        }
+
+        /*Then any labels within the statement*/
+        emitterSwitchLabels(ctx, Current, cases, defaultTo);
+
+    } else if (Node->tag == astBranch) {
+        emitterSwitchLabels(ctx, Node->l, cases, defaultTo);
+
+        if (Node->r)
+            emitterSwitchLabels(ctx, Node->r, cases, defaultTo);
+
+    } else if (Node->tag == astLoop)
+        emitterSwitchLabels(ctx, Node->l->tag == astCode ? Node->l : Node->r, cases, defaultTo);
+
+    else if (Node->tag == astIter)
+        emitterSwitchLabels(ctx, Node->l, cases, defaultTo);
+}
+
+static int emitterCaseCmp (const void* l, const void* r) {
+    intptr_t L = (*(const ast**) l)->constant,
+             R = (*(const ast**) r)->constant;
+    return (L > R) - (L < R);
+}
+
+static irBlock* emitterCaseTarget (emitterCtx* ctx, const ast* Node) {
+    return intmapMap(&ctx->labels, (intptr_t) Node);
+}
+
+/**
+ * Rebase the value on min, leaving it in [0, max-min] or branching to the
+ * default. One unsigned comparison catches both ends, as anything below min
+ * wraps around.
+ */
+static irBlock* emitterSwitchRangeCheck (emitterCtx* ctx, irBlock* block, operand value,
+                                         int min, int max, irBlock* defaultTo) {
+    irBlock* inRange = irBlockCreate(ctx->ir, ctx->curFn);
+
+    if (min != 0)
+        asmBOP(ctx->ir, block, bopSub, value, operandCreateLiteral(min));
+
+    asmCompare(ctx->ir, block, value, operandCreateLiteral(max-min));
+    irBranch(block, operandCreateFlags(conditionAbove), defaultTo, inRange);
+
+    return inRange;
+}
+
+static void emitterSwitchJumpTable (emitterCtx* ctx, irBlock* block, operand value,
+                                    const vector/*<const ast*>*/* cases, irBlock* defaultTo) {
+    const ast *first = vectorGet(cases, 0),
+              *last = vectorGet(cases, cases->length-1);
+    int min = first->constant,
+        range = last->constant - min + 1;
+
+    block = emitterSwitchRangeCheck(ctx, block, value, min, last->constant, defaultTo);
+
+    /*Gaps in the table go to the default*/
+
+    vector/*<irBlock*>*/ table;
+    vectorInit(&table, range);
+
+    for (int i = 0, n = 0; i < range; i++) {
+        const ast* Current = vectorGet(cases, n);
+
+        if (Current->constant - min == i) {
+            vectorPush(&table, emitterCaseTarget(ctx, Current));
+            n++;
+
+        } else
+            vectorPush(&table, defaultTo);
+    }
+
+    irJumpTable(ctx->ir, block, value, &table);
+
+    vectorFree(&table);
+}
+
+static void emitterSwitchBitTests (emitterCtx* ctx, irBlock* block, operand value,
+                                   const vector/*<const ast*>*/* cases, irBlock* defaultTo) {
+    const ast *first = vectorGet(cases, 0),
+              *last = vectorGet(cases, cases->length-1);
+    int min = first->constant;
+
+    block = emitterSwitchRangeCheck(ctx, block, value, min, last->constant, defaultTo);
+
+    /*Build a mask of the (rebased) values leading to each target*/
+
+    irBlock* targets[emitterBitTestMaxTargets];
+    unsigned int masks[emitterBitTestMaxTargets];
+    int targetNo = 0;
+
+    for (int i = 0; i < cases->length; i++) {
+        const ast* Current = vectorGet(cases, i);
+        irBlock* target = emitterCaseTarget(ctx, Current);
+
+        int n = 0;
+
+        while (n < targetNo && targets[n] != target)
+            n++;
+
+        if (n == targetNo) {
+            targets[targetNo++] = target;
+            masks[n] = 0;
+        }
+
+        masks[n] |= 1u << (Current->constant - min);
+    }
+
+    /*Test the value's bit in each mask*/
+
+    operand mask = operandCreateReg(regAlloc(ctx->ir->regs, ctx->arch->wordsize));
+
+    for (int n = 0; n < targetNo; n++) {
+        irBlock* next = n == targetNo-1 ? defaultTo : irBlockCreate(ctx->ir, ctx->curFn);
+
+        asmMove(ctx->ir, block, mask, operandCreateLiteral((int) masks[n]));
+        asmBitTest(ctx->ir, block, mask, value);
+        irBranch(block, operandCreateFlags(conditionBelow), targets[n], next);
+
+        block = next;
+    }
+
+    operandFree(mask);
+}
+
+/**
+ * Binary search over the cases in [lo, hi)
+ */
+static void emitterSwitchCompareTree (emitterCtx* ctx, irBlock* block, operand value,
+                                      const vector/*<const ast*>*/* cases, int lo, int hi,
+                                      irBlock* defaultTo) {
+    if (hi-lo <= emitterCompareTreeLeafSize) {
+        for (int i = lo; i < hi; i++) {
+            const ast* Current = vectorGet(cases, i);
+            irBlock* next = i == hi-1 ? defaultTo : irBlockCreate(ctx->ir, ctx->curFn);
+
+            asmCompare(ctx->ir, block, value, operandCreateLiteral(Current->constant));
+            irBranch(block, operandCreateFlags(conditionEqual), emitterCaseTarget(ctx, Current), next);
+
+            block = next;
+        }
+
+    /*Test the median, then reuse the flags to pick a half to search*/
+    } else {
+        int mid = lo + (hi-lo)/2;
+        const ast* median = vectorGet(cases, mid);
+
+        irBlock *notEqual = irBlockCreate(ctx->ir, ctx->curFn),
+                *less = irBlockCreate(ctx->ir, ctx->curFn),
+                *greater = irBlockCreate(ctx->ir, ctx->curFn);
+
+        asmCompare(ctx->ir, block, value, operandCreateLiteral(median->constant));
+        irBranch(block, operandCreateFlags(conditionEqual), emitterCaseTarget(ctx, median), notEqual);
+        irBranch(notEqual, operandCreateFlags(conditionLess), less, greater);
+
+        emitterSwitchCompareTree(ctx, less, value, cases, lo, mid, defaultTo);
+        emitterSwitchCompareTree(ctx, greater, value, cases, mid+1, hi, defaultTo);
+    }
+}
+
+/**
+ * Choose a lowering based on the density of the (sorted) cases:
+ *   - Bit tests for a small range with few targets
+ *   - A jump table for dense cases
+ *   - Otherwise a compare tree
+ */
+static void emitterSwitchDispatch (emitterCtx* ctx, irBlock* block, operand value,
+                                   const vector/*<const ast*>*/* cases, irBlock* defaultTo) {
+    if (cases->length == 0) {
+        irJump(block, defaultTo);
+        return;
+    }
+
+    const ast *first = vectorGet(cases, 0),
+              *last = vectorGet(cases, cases->length-1);
+
+    /*Might not fit in an int*/
+    int64_t range = (int64_t) last->constant - first->constant + 1;
+
+    intset/*<irBlock*>*/ targets;
+    intsetInit(&targets, cases->length*2);
+
+    for (int i = 0; i < cases->length; i++)
+        intsetAdd(&targets, (intptr_t) emitterCaseTarget(ctx, vectorGet(cases, i)));
+
+    int targetNo = targets.elements;
+    intsetFree(&targets);
+
+    /*Each bit test costs about as much as two compares*/
+    if (   range <= emitterBitTestMaxRange
+        && targetNo <= emitterBitTestMaxTargets
+        && cases->length > 2*targetNo)
+        emitterSwitchBitTests(ctx, block, value, cases, defaultTo);
+
+    else if (   cases->length >= emitterJumpTableMinCases
+             && cases->length*100 >= range*emitterJumpTableMinDensity)
+        emitterSwitchJumpTable(ctx, block, value, cases, defaultTo);
+
+    else
+        emitterSwitchCompareTree(ctx, block, value, cases, 0, cases->length, defaultTo);
+}
+
+static irBlock* emitterSwitch (emitterCtx* ctx, irBlock* block, const ast* Node) {
+    irBlock *body = irBlockCreate(ctx->ir, ctx->curFn),
+            *continuation = irBlockCreate(ctx->ir, ctx->curFn),
+            *defaultTo = continuation;
+
+    /*Labels, sorted by value*/
+
+    vector/*<const ast*>*/ cases;
+    vectorInit(&cases, 8);
+
+    emitterSwitchLabels(ctx, Node->r, &cases, &defaultTo);
+    qsort(cases.buffer, cases.length, sizeof(void*), emitterCaseCmp);
+
+    /*Condition, widened to a word so that it can index tables and bit test*/
+
+    operand value = emitterValue(ctx, &block, Node->l, requestReg);
+
+    if (operandGetSize(ctx->arch, value) < ctx->arch->wordsize)
+        value = emitterWiden(ctx, block, value, ctx->arch->wordsize);
+
+    emitterSwitchDispatch(ctx, block, value, &cases, defaultTo);
+
+    operandFree(value);
+    vectorFree(&cases);
+
+    /*Body, entered only through the labels*/
+
+    irBlock* oldBreakTo = emitterSetBreakTo(ctx, continuation);
+
+    emitterCode(ctx, body, Node->r, continuation);
+
+    ctx->breakTo = oldBreakTo;
+
+    return continuation;
+}
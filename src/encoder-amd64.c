@@ -0,0 +1,539 @@
+#include "../inc/encoder-amd64.h"
+
+#include "../inc/object.h"
+
+#include "string.h"
+
+/*Opcodes above a byte are two byte, 0F xx, opcodes*/
+enum {
+    encTwoByte = 0x0F00,
+    encSizePrefix = 0x66,
+    encRepPrefix = 0xF3
+};
+
+typedef struct encMnemonic {
+    const char* str;
+    int code;
+    int size;
+} encMnemonic;
+
+/*Instructions without operands, with their operand size*/
+static const encMnemonic encNullaries[] = {
+    {"ret", 0xC3, 4}, {"leave", 0xC9, 4}, {"nop", 0x90, 4},
+    {"cdq", 0x99, 4}, {"cqo", 0x99, 8},
+    {"movsb", 0xA4, 1}, {"movsw", 0xA5, 2}, {"movsd", 0xA5, 4}, {"movsq", 0xA5, 8},
+    {"stosb", 0xAA, 1}, {"stosw", 0xAB, 2}, {"stosd", 0xAB, 4}, {"stosq", 0xAB, 8},
+    {0, 0, 0}
+};
+
+/*Arithmetic group: 00-3F, and 80/81/83 with the code as the ModRM reg field*/
+static const encMnemonic encALUs[] = {
+    {"add", 0, 0}, {"or", 1, 0}, {"adc", 2, 0}, {"sbb", 3, 0},
+    {"and", 4, 0}, {"sub", 5, 0}, {"xor", 6, 0}, {"cmp", 7, 0},
+    {0, 0, 0}
+};
+
+/*Unary group 3: F6/F7 /code*/
+static const encMnemonic encUnaries[] = {
+    {"not", 2, 0}, {"neg", 3, 0}, {"mul", 4, 0}, {"div", 6, 0}, {"idiv", 7, 0},
+    {0, 0, 0}
+};
+
+/*Shift group 2: C0/C1, D0/D1, D2/D3 /code*/
+static const encMnemonic encShifts[] = {
+    {"rol", 0, 0}, {"ror", 1, 0}, {"shl", 4, 0}, {"sal", 4, 0},
+    {"shr", 5, 0}, {"sar", 7, 0},
+    {0, 0, 0}
+};
+
+/*Condition code suffixes of jcc, setcc and cmovcc*/
+static const encMnemonic encConditions[] = {
+    {"o", 0, 0}, {"no", 1, 0}, {"b", 2, 0}, {"c", 2, 0}, {"nae", 2, 0},
+    {"ae", 3, 0}, {"nb", 3, 0}, {"nc", 3, 0}, {"e", 4, 0}, {"z", 4, 0},
+    {"ne", 5, 0}, {"nz", 5, 0}, {"be", 6, 0}, {"na", 6, 0}, {"a", 7, 0},
+    {"nbe", 7, 0}, {"s", 8, 0}, {"ns", 9, 0}, {"p", 10, 0}, {"pe", 10, 0},
+    {"np", 11, 0}, {"po", 11, 0}, {"l", 12, 0}, {"nge", 12, 0}, {"ge", 13, 0},
+    {"nl", 13, 0}, {"le", 14, 0}, {"ng", 14, 0}, {"g", 15, 0}, {"nle", 15, 0},
+    {0, 0, 0}
+};
+
+static const encMnemonic* encLookup (const encMnemonic* table, const char* str) {
+    for (int i = 0; table[i].str; i++)
+        if (!strcmp(table[i].str, str))
+            return &table[i];
+
+    return 0;
+}
+
+static bool encIsReg (const encOperand* operand) {
+    return operand && operand->tag == encReg;
+}
+
+static bool encIsRM (const encOperand* operand) {
+    return operand && (operand->tag == encReg || operand->tag == encMem);
+}
+
+static bool encIsImm (const encOperand* operand) {
+    return operand && operand->tag == encImm;
+}
+
+static bool encIsImm8 (const encOperand* operand) {
+    return    encIsImm(operand) && !operand->symbol
+           && operand->disp >= -128 && operand->disp <= 127;
+}
+
+/*==== Prefixes, ModRM and SIB ====*/
+
+static void encOpcode (encCtx* ctx, int opcode) {
+    if (opcode > 0xFF)
+        objEmitByte(ctx->section, opcode >> 8);
+
+    objEmitByte(ctx->section, opcode & 0xFF);
+}
+
+/**
+ * Emit the operand size prefix and REX byte (if needed) for an
+ * instruction whose ModRM reg field is reg and r/m operand rm
+ */
+static void encPrefixes (encCtx* ctx, int size, int reg, const encOperand* rm) {
+    if (size == 2)
+        objEmitByte(ctx->section, encSizePrefix);
+
+    if (ctx->wordsize != 8)
+        return;
+
+    int rex = 0x40 | (size == 8) << 3 | (reg >> 3 & 1) << 2;
+
+    if (rm && rm->tag == encReg)
+        rex |= rm->reg >> 3 & 1;
+
+    else if (rm && rm->tag == encMem) {
+        if (rm->index >= 0)
+            rex |= (rm->index >> 3 & 1) << 1;
+
+        if (rm->reg >= 0)
+            rex |= rm->reg >> 3 & 1;
+    }
+
+    if (rex != 0x40)
+        objEmitByte(ctx->section, rex);
+}
+
+/**
+ * Address of symbols or literals, possibly needing relocation
+ */
+static void encAddress (encCtx* ctx, const encOperand* operand, int size) {
+    if (operand->symbol)
+        objEmitReloc(ctx->section,
+                     size == 8 ? relocAbs64 : ctx->wordsize == 8 ? relocAbs32Signed : relocAbs32,
+                     operand->symbol, operand->disp, size);
+
+    else
+        objEmitInt(ctx->section, operand->disp, size);
+}
+
+static void encModRM (encCtx* ctx, int reg, const encOperand* rm) {
+    reg &= 7;
+
+    if (rm->tag == encReg)
+        objEmitByte(ctx->section, 0xC0 | reg << 3 | (rm->reg & 7));
+
+    /*Absolute: in long mode the plain disp32 form is RIP relative,
+      so go through an empty SIB*/
+    else if (rm->reg < 0 && rm->index < 0) {
+        if (ctx->wordsize == 8) {
+            objEmitByte(ctx->section, reg << 3 | 4);
+            objEmitByte(ctx->section, 0x25);
+
+        } else
+            objEmitByte(ctx->section, reg << 3 | 5);
+
+        encAddress(ctx, rm, 4);
+
+    } else {
+        bool needsSIB = rm->index >= 0 || (rm->reg & 7) == 4;
+        bool noBase = rm->reg < 0;
+
+        int mod;
+
+        if (noBase)
+            mod = 0;
+
+        else if (rm->symbol || rm->disp < -128 || rm->disp > 127)
+            mod = 2;
+
+        /*[ebp] and [r13] can only be encoded with a displacement*/
+        else if (rm->disp != 0 || (rm->reg & 7) == 5)
+            mod = 1;
+
+        else
+            mod = 0;
+
+        objEmitByte(ctx->section, mod << 6 | reg << 3 | (needsSIB ? 4 : rm->reg & 7));
+
+        if (needsSIB) {
+            int scale = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+            int index = rm->index >= 0 ? rm->index & 7 : 4;
+            int base = noBase ? 5 : rm->reg & 7;
+            objEmitByte(ctx->section, scale << 6 | index << 3 | base);
+        }
+
+        if (mod == 1)
+            objEmitInt(ctx->section, rm->disp, 1);
+
+        else if (mod == 2 || noBase)
+            encAddress(ctx, rm, 4);
+    }
+}
+
+/**
+ * An instruction of the form [prefixes] opcode ModRM [SIB] [disp]
+ */
+static void encInstrRM (encCtx* ctx, int mandatory, int size, int opcode, int reg, const encOperand* rm) {
+    if (mandatory)
+        objEmitByte(ctx->section, mandatory);
+
+    encPrefixes(ctx, size, reg, rm);
+    encOpcode(ctx, opcode);
+    encModRM(ctx, reg, rm);
+}
+
+/**
+ * Immediate of an operand size, at most 32 bits (sign extended for qwords)
+ */
+static void encImmediate (encCtx* ctx, const encOperand* imm, int size) {
+    encAddress(ctx, imm, size > 4 ? 4 : size);
+}
+
+/**
+ * Operand size implied by a pair of operands
+ */
+static int encSize (const encOperand* L, const encOperand* R) {
+    if (L && L->size)
+        return L->size;
+
+    else if (R && R->size)
+        return R->size;
+
+    else
+        return 4;
+}
+
+/*==== Instruction classes ====*/
+
+static bool encBranch (encCtx* ctx, int opcode, const encOperand* target) {
+    /*Direct, to a label or the offset of one*/
+    if (!target->symbol || (target->tag != encLabel && target->tag != encImm))
+        return false;
+
+    encOpcode(ctx, opcode);
+    /*Relative to the end of the instruction*/
+    objEmitReloc(ctx->section, relocBranch32, target->symbol, target->disp - 4, 4);
+    return true;
+}
+
+static bool encALU (encCtx* ctx, int code, const encOperand* L, const encOperand* R) {
+    int size = encSize(L, R);
+    int wide = size != 1;
+
+    if (encIsRM(L) && encIsReg(R))
+        encInstrRM(ctx, 0, size, code << 3 | wide, R->reg, L);
+
+    else if (encIsReg(L) && encIsRM(R))
+        encInstrRM(ctx, 0, size, code << 3 | 2 | wide, L->reg, R);
+
+    else if (encIsRM(L) && encIsImm(R)) {
+        if (size == 1) {
+            encInstrRM(ctx, 0, size, 0x80, code, L);
+            encImmediate(ctx, R, 1);
+
+        } else if (encIsImm8(R)) {
+            encInstrRM(ctx, 0, size, 0x83, code, L);
+            encImmediate(ctx, R, 1);
+
+        /*Short form for the accumulator*/
+        } else if (encIsReg(L) && L->reg == 0) {
+            encPrefixes(ctx, size, 0, 0);
+            encOpcode(ctx, code << 3 | 5);
+            encImmediate(ctx, R, size);
+
+        } else {
+            encInstrRM(ctx, 0, size, 0x81, code, L);
+            encImmediate(ctx, R, size);
+        }
+
+    } else
+        return false;
+
+    return true;
+}
+
+static bool encMov (encCtx* ctx, const encOperand* L, const encOperand* R) {
+    int size = encSize(L, R);
+    int wide = size != 1;
+
+    if (encIsRM(L) && encIsReg(R))
+        encInstrRM(ctx, 0, size, 0x88 | wide, R->reg, L);
+
+    else if (encIsReg(L) && encIsRM(R))
+        encInstrRM(ctx, 0, size, 0x8A | wide, L->reg, R);
+
+    /*B0+r/B8+r, the short form, except for qwords where that'd need
+      a 64 bit immediate*/
+    else if (encIsReg(L) && encIsImm(R) && size != 8) {
+        encPrefixes(ctx, size, 0, L);
+        encOpcode(ctx, (wide ? 0xB8 : 0xB0) + (L->reg & 7));
+        encImmediate(ctx, R, size);
+
+    } else if (encIsRM(L) && encIsImm(R)) {
+        encInstrRM(ctx, 0, size, 0xC6 | wide, 0, L);
+        encImmediate(ctx, R, size);
+
+    } else
+        return false;
+
+    return true;
+}
+
+static bool encExtend (encCtx* ctx, bool sign, const encOperand* L, const encOperand* R) {
+    if (!encIsReg(L) || !encIsRM(R))
+        return false;
+
+    else if (R->size == 1 || R->size == 2)
+        encInstrRM(ctx, 0, L->size, (sign ? 0x0FBE : 0x0FB6) | (R->size == 2), L->reg, R);
+
+    /*movsxd*/
+    else if (sign && R->size == 4 && L->size == 8)
+        encInstrRM(ctx, 0, 8, 0x63, L->reg, R);
+
+    else
+        return false;
+
+    return true;
+}
+
+static bool encPush (encCtx* ctx, const encOperand* R) {
+    /*Push and pop default to the word size in long mode, so no REX.W*/
+
+    if (encIsReg(R)) {
+        encPrefixes(ctx, 4, 0, R);
+        encOpcode(ctx, 0x50 + (R->reg & 7));
+
+    } else if (R->tag == encMem)
+        encInstrRM(ctx, 0, R->size == 2 ? 2 : 4, 0xFF, 6, R);
+
+    else if (encIsImm8(R)) {
+        encOpcode(ctx, 0x6A);
+        encImmediate(ctx, R, 1);
+
+    } else if (encIsImm(R)) {
+        encOpcode(ctx, 0x68);
+        encImmediate(ctx, R, 4);
+
+    } else
+        return false;
+
+    return true;
+}
+
+static bool encPop (encCtx* ctx, const encOperand* R) {
+    if (encIsReg(R)) {
+        encPrefixes(ctx, 4, 0, R);
+        encOpcode(ctx, 0x58 + (R->reg & 7));
+
+    } else if (R->tag == encMem)
+        encInstrRM(ctx, 0, R->size == 2 ? 2 : 4, 0x8F, 0, R);
+
+    else
+        return false;
+
+    return true;
+}
+
+static bool encIMul (encCtx* ctx, const encOperand* L, const encOperand* R, const encOperand* Imm) {
+    if (!encIsReg(L))
+        return false;
+
+    /*imul reg, imm is imul reg, reg, imm*/
+    if (!Imm && encIsImm(R))
+        Imm = R, R = L;
+
+    if (!encIsRM(R))
+        return false;
+
+    else if (!Imm)
+        encInstrRM(ctx, 0, L->size, encTwoByte | 0xAF, L->reg, R);
+
+    else if (encIsImm8(Imm)) {
+        encInstrRM(ctx, 0, L->size, 0x6B, L->reg, R);
+        encImmediate(ctx, Imm, 1);
+
+    } else if (encIsImm(Imm)) {
+        encInstrRM(ctx, 0, L->size, 0x69, L->reg, R);
+        encImmediate(ctx, Imm, L->size);
+
+    } else
+        return false;
+
+    return true;
+}
+
+static bool encShift (encCtx* ctx, int code, const encOperand* L, const encOperand* R) {
+    if (!encIsRM(L))
+        return false;
+
+    int wide = L->size != 1;
+
+    if (encIsImm(R) && !R->symbol && R->disp == 1)
+        encInstrRM(ctx, 0, L->size, 0xD0 | wide, code, L);
+
+    else if (encIsImm8(R)) {
+        encInstrRM(ctx, 0, L->size, 0xC0 | wide, code, L);
+        encImmediate(ctx, R, 1);
+
+    /*By cl*/
+    } else if (encIsReg(R) && R->size == 1 && R->reg == 1)
+        encInstrRM(ctx, 0, L->size, 0xD2 | wide, code, L);
+
+    else
+        return false;
+
+    return true;
+}
+
+static bool encBitTest (encCtx* ctx, const encOperand* L, const encOperand* R) {
+    if (encIsRM(L) && encIsReg(R))
+        encInstrRM(ctx, 0, encSize(L, R), encTwoByte | 0xA3, R->reg, L);
+
+    else if (encIsRM(L) && encIsImm8(R)) {
+        encInstrRM(ctx, 0, encSize(L, R), encTwoByte | 0xBA, 4, L);
+        encImmediate(ctx, R, 1);
+
+    } else
+        return false;
+
+    return true;
+}
+
+static bool encVector (encCtx* ctx, const char* mnemonic, const encOperand* L, const encOperand* R) {
+    bool LVector = encIsReg(L) && L->size == 16;
+    bool RVector = encIsReg(R) && R->size == 16;
+
+    if (!strcmp(mnemonic, "movdqu") && LVector && encIsRM(R))
+        encInstrRM(ctx, encRepPrefix, 0, encTwoByte | 0x6F, L->reg, R);
+
+    else if (!strcmp(mnemonic, "movdqu") && encIsRM(L) && RVector)
+        encInstrRM(ctx, encRepPrefix, 0, encTwoByte | 0x7F, R->reg, L);
+
+    else if (!strcmp(mnemonic, "pxor") && LVector && encIsRM(R))
+        encInstrRM(ctx, encSizePrefix, 0, encTwoByte | 0xEF, L->reg, R);
+
+    else
+        return false;
+
+    return true;
+}
+
+/*==== Dispatch ====*/
+
+bool encodeInstruction (encCtx* ctx, const char* mnemonic, const encOperand* operands, int operandNo) {
+    const encOperand* L = operandNo >= 1 ? &operands[0] : 0;
+    const encOperand* R = operandNo >= 2 ? &operands[1] : 0;
+    const encOperand* third = operandNo >= 3 ? &operands[2] : 0;
+
+    const encMnemonic* entry;
+
+    if (operandNo == 0 && (entry = encLookup(encNullaries, mnemonic))) {
+        encPrefixes(ctx, entry->size, 0, 0);
+        encOpcode(ctx, entry->code);
+        return true;
+
+    } else if (operandNo == 2 && (entry = encLookup(encALUs, mnemonic)))
+        return encALU(ctx, entry->code, L, R);
+
+    else if (operandNo == 1 && (entry = encLookup(encUnaries, mnemonic)) && encIsRM(L)) {
+        encInstrRM(ctx, 0, L->size, 0xF6 | (L->size != 1), entry->code, L);
+        return true;
+
+    } else if (operandNo == 2 && (entry = encLookup(encShifts, mnemonic)))
+        return encShift(ctx, entry->code, L, R);
+
+    else if (operandNo == 2 && !strcmp(mnemonic, "mov"))
+        return encMov(ctx, L, R);
+
+    else if (operandNo == 2 && (!strcmp(mnemonic, "movzx") || !strcmp(mnemonic, "movsx")))
+        return encExtend(ctx, mnemonic[3] == 's', L, R);
+
+    else if (operandNo == 2 && !strcmp(mnemonic, "lea")) {
+        if (!encIsReg(L) || R->tag != encMem)
+            return false;
+
+        encInstrRM(ctx, 0, L->size, 0x8D, L->reg, R);
+        return true;
+
+    } else if (operandNo == 2 && !strcmp(mnemonic, "test")) {
+        if (encIsRM(L) && encIsReg(R))
+            encInstrRM(ctx, 0, encSize(L, R), 0x84 | (encSize(L, R) != 1), R->reg, L);
+
+        else if (encIsRM(L) && encIsImm(R)) {
+            encInstrRM(ctx, 0, L->size, 0xF6 | (L->size != 1), 0, L);
+            encImmediate(ctx, R, L->size);
+
+        } else
+            return false;
+
+        return true;
+
+    } else if (operandNo == 1 && (!strcmp(mnemonic, "inc") || !strcmp(mnemonic, "dec")) && encIsRM(L)) {
+        encInstrRM(ctx, 0, L->size, 0xFE | (L->size != 1), mnemonic[0] == 'd', L);
+        return true;
+
+    } else if (operandNo == 1 && !strcmp(mnemonic, "push"))
+        return encPush(ctx, L);
+
+    else if (operandNo == 1 && !strcmp(mnemonic, "pop"))
+        return encPop(ctx, L);
+
+    else if ((operandNo == 2 || operandNo == 3) && !strcmp(mnemonic, "imul"))
+        return encIMul(ctx, L, R, third);
+
+    else if (operandNo == 2 && !strcmp(mnemonic, "bt"))
+        return encBitTest(ctx, L, R);
+
+    else if (operandNo == 2 && (!strcmp(mnemonic, "movdqu") || !strcmp(mnemonic, "pxor")))
+        return encVector(ctx, mnemonic, L, R);
+
+    /*Branches: direct are always rel32, indirect through FF /2 or /4*/
+    else if (operandNo == 1 && (!strcmp(mnemonic, "call") || !strcmp(mnemonic, "jmp"))) {
+        bool call = mnemonic[0] == 'c';
+
+        if (L->tag == encLabel || (encIsImm(L) && L->symbol))
+            return encBranch(ctx, call ? 0xE8 : 0xE9, L);
+
+        else if (encIsRM(L)) {
+            encInstrRM(ctx, 0, 4, 0xFF, call ? 2 : 4, L);
+            return true;
+
+        } else
+            return false;
+
+    } else if (operandNo == 1 && mnemonic[0] == 'j' && (entry = encLookup(encConditions, mnemonic+1)))
+        return encBranch(ctx, encTwoByte | (0x80 + entry->code), L);
+
+    else if (operandNo == 1 && strprefix(mnemonic, "set") && (entry = encLookup(encConditions, mnemonic+3))) {
+        if (!encIsRM(L) || L->size != 1)
+            return false;
+
+        encInstrRM(ctx, 0, 1, encTwoByte | (0x90 + entry->code), 0, L);
+        return true;
+
+    } else if (operandNo == 2 && strprefix(mnemonic, "cmov") && (entry = encLookup(encConditions, mnemonic+4))) {
+        if (!encIsReg(L) || !encIsRM(R))
+            return false;
+
+        encInstrRM(ctx, 0, L->size, encTwoByte | (0x40 + entry->code), L->reg, R);
+        return true;
+
+    } else
+        return false;
+}
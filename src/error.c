@@ -8,6 +8,7 @@
 #include "../inc/lexer.h"
 #include "../inc/parser-internal.h"
 #include "../inc/analyzer-internal.h"
+#include "../inc/preprocessor-internal.h"
 
 #include "stdarg.h"
 #include "stdio.h"
@@ -18,7 +19,8 @@ static void tokenLocationMsg (tokenLocation loc);
 static void verrorf (const char* format, va_list args);
 
 static void tokenLocationMsg (tokenLocation loc) {
-    printf("%s:%d:%d: ", loc.filename, loc.line, loc.lineChar);
+    sourcePosition pos = sourceGetPosition(loc);
+    printf("%s:%d:%d: ", pos.filename, pos.line, pos.lineChar);
 }
 
 void errorf (const char* format, ...) {
@@ -149,7 +151,9 @@ static void verrorf (const char* format, va_list args) {
 }
 
 void errorParser (parserCtx* ctx, const char* format, ...) {
-    if (ctx->location.line == ctx->lastErrorLine)
+    int line = sourceGetPosition(ctx->location).line;
+
+    if (line == ctx->lastErrorLine)
         return;
 
     tokenLocationMsg(ctx->location);
@@ -163,7 +167,7 @@ void errorParser (parserCtx* ctx, const char* format, ...) {
     putchar('\n');
 
     ctx->errors++;
-    ctx->lastErrorLine = ctx->location.line;
+    ctx->lastErrorLine = line;
     debugWait();
 }
 
@@ -182,6 +186,36 @@ void errorAnalyzer (analyzerCtx* ctx, const ast* Node, const char* format, ...)
     debugWait();
 }
 
+void errorPreprocessor (ppCtx* ctx, const char* format, ...) {
+    tokenLocationMsg(ctx->location);
+    errorf("$r: ", "error");
+
+    va_list args;
+    va_start(args, format);
+    verrorf(format, args);
+    va_end(args);
+
+    putchar('\n');
+
+    ctx->errors++;
+    debugWait();
+}
+
+void warningPreprocessor (ppCtx* ctx, const char* format, ...) {
+    tokenLocationMsg(ctx->location);
+    errorf("$r: ", "warning");
+
+    va_list args;
+    va_start(args, format);
+    verrorf(format, args);
+    va_end(args);
+
+    putchar('\n');
+
+    ctx->warnings++;
+    debugWait();
+}
+
 /*==== Parser errors ====*/
 
 void errorExpected (parserCtx* ctx, const char* expected) {
@@ -205,12 +239,14 @@ void errorIllegalOutside (parserCtx* ctx, const char* what, const char* where) {
 }
 
 void errorRedeclaredSymAs (parserCtx* ctx, const sym* Symbol, symTag tag) {
-    const ast* first = (const ast*) vectorGet(&Symbol->decls, 0);
-
     errorParser(ctx, "$h redeclared as $s", Symbol->ident, tag != symId ? symTagGetStr(tag) : "different symbol type");
 
-    tokenLocationMsg(first->location);
-    errorf("first declaration here as $c\n", Symbol);
+    /*Symbols loaded from a module interface have no declarations to show*/
+    if (Symbol->decls.length != 0) {
+        const ast* first = (const ast*) vectorGet(&Symbol->decls, 0);
+        tokenLocationMsg(first->location);
+        errorf("first declaration here as $c\n", Symbol);
+    }
 }
 
 void errorReimplementedSym (parserCtx* ctx, const sym* Symbol) {
@@ -224,6 +260,53 @@ void errorFileNotFound (parserCtx* ctx, const char* name) {
     errorParser(ctx, "file not found, '$h'", name);
 }
 
+/*==== Preprocessor errors ====*/
+
+void errorDirectiveExpected (ppCtx* ctx, const char* expected, const char* directive) {
+    errorPreprocessor(ctx, "expected $s in $h", expected, directive);
+}
+
+void errorUnknownDirective (ppCtx* ctx, const char* directive) {
+    errorPreprocessor(ctx, "unknown preprocessor directive '#$h'", directive);
+}
+
+void errorUnmatchedDirective (ppCtx* ctx, const char* directive) {
+    errorPreprocessor(ctx, "$h without $h", directive, "#if");
+}
+
+void errorUnterminatedConditional (ppCtx* ctx) {
+    errorPreprocessor(ctx, "unterminated conditional, expected $h", "#endif");
+}
+
+void errorIncludeNotFound (ppCtx* ctx, const char* name) {
+    errorPreprocessor(ctx, "file not found, '$h'", name);
+}
+
+void errorIncludeDepth (ppCtx* ctx, const char* name) {
+    errorPreprocessor(ctx, "includes nested too deeply, at '$h'", name);
+}
+
+void errorMacroDegree (ppCtx* ctx, const char* macro, int expected, int found) {
+    errorPreprocessor(ctx, "too $s arguments given to macro $h: expected $d, given $d",
+                      expected > found ? "few" : "many", macro, expected, found);
+}
+
+void errorUnterminatedCall (ppCtx* ctx, const char* macro) {
+    errorPreprocessor(ctx, "unterminated call to macro $h", macro);
+}
+
+void errorInvalidPaste (ppCtx* ctx, const char* l, const char* r) {
+    errorPreprocessor(ctx, "pasting '$h' and '$h' does not give a valid token", l, r);
+}
+
+void errorConditionExpected (ppCtx* ctx, const char* expected, const char* found) {
+    errorPreprocessor(ctx, "expected $s in $h, found '$h'", expected, "#if", found);
+}
+
+void errorConditionDivision (ppCtx* ctx) {
+    errorPreprocessor(ctx, "division by zero in $h", "#if");
+}
+
 /*==== Analyzer errors ====*/
 
 void errorTypeExpected (analyzerCtx* ctx, const ast* Node, const char* where, const char* expected) {
@@ -342,10 +425,12 @@ void errorConflictingDeclarations (analyzerCtx* ctx, const ast* Node,
                                    const sym* Symbol, const type* found) {
     errorAnalyzer(ctx, Node, "$n redeclared as conflicting type $t", Symbol, found);
 
+    int line = sourceGetPosition(Node->location).line;
+
     for (int n = 0; n < Symbol->decls.length; n++) {
         const ast* Current = (const ast*) vectorGet(&Symbol->decls, n);
 
-        if (Current->location.line != Node->location.line) {
+        if (sourceGetPosition(Current->location).line != line) {
             tokenLocationMsg(Current->location);
             printf("also declared here\n");
         }
@@ -355,11 +440,13 @@ void errorConflictingDeclarations (analyzerCtx* ctx, const ast* Node,
 void errorRedeclared (analyzerCtx* ctx, const ast* Node, const sym* Symbol) {
     errorAnalyzer(ctx, Node, "$n redeclared", Symbol);
 
+    int line = sourceGetPosition(Node->location).line;
+
     for (int n = 0; n < Symbol->decls.length; n++) {
         const ast* Current = (const ast*) vectorGet(&Symbol->decls, n);
 
-        if (   Current->location.line != Node->location.line
-            || Current->location.filename != Node->location.filename) {
+        if (   sourceGetPosition(Current->location).line != line
+            || !sourceIsSameFile(Current->location, Node->location)) {
             tokenLocationMsg(Current->location);
             printf("also declared here\n");
         }
@@ -396,6 +483,21 @@ void errorStaticCompileTimeKnown (analyzerCtx* ctx, const ast* Node, const sym*
     errorAnalyzer(ctx, Node, "initialization of static variable $h needed a compile-time known value", Symbol->ident);
 }
 
+void errorCaseCompileTimeKnown (analyzerCtx* ctx, const ast* Node) {
+    errorAnalyzer(ctx, Node, "case label needed a compile-time known value");
+}
+
+void errorDuplicateLabel (analyzerCtx* ctx, const ast* Node, const ast* first) {
+    if (Node->tag == astCase)
+        errorAnalyzer(ctx, Node, "duplicate case value $d in switch", (int) Node->constant);
+
+    else
+        errorAnalyzer(ctx, Node, "multiple default labels in switch");
+
+    tokenLocationMsg(first->location);
+    puts("first label here");
+}
+
 void errorIllegalArraySize (analyzerCtx* ctx, const ast* Node,
                             const sym* Symbol, int size) {
     errorAnalyzer(ctx, Node, "declaration of array $s expected positive size, found $d", Symbol, size);
@@ -212,5 +212,30 @@ bool evalIsConstantInit (const ast* Node) {
         return true;
 
     } else
-        return eval(&(architecture) {}, Node).known;
+        return eval(&(architecture) {}, Node).known || evalStaticAddress(Node);
+}
+
+const ast* evalStaticAddress (const ast* Node) {
+    /*Casts don't change an address*/
+    while (Node->tag == astCast)
+        Node = Node->r;
+
+    if (Node->tag == astLiteral && Node->litTag == literalStr)
+        return Node;
+
+    bool addressOf = Node->tag == astUOP && Node->o == opAddressOf;
+    const ast* name = addressOf ? Node->r : Node;
+
+    if (   name->tag != astLiteral || name->litTag != literalIdent
+        || !name->symbol || name->symbol->tag != symId
+        || (   name->symbol->storage != storageStatic
+            && name->symbol->storage != storageExtern))
+        return 0;
+
+    /*Arrays and functions decay into their address without the &*/
+    else if (addressOf || typeIsArray(name->symbol->dt) || typeIsFunction(name->symbol->dt))
+        return name;
+
+    else
+        return 0;
 }
@@ -142,7 +142,11 @@ static void generalmapFreeObjs (generalmap* map, generalmapKeyDtor keyDtor, gene
 }
 
 static bool generalmapIsMatch (const generalmap* map, int index, const char* key, int hash, generalmapCmp cmp) {
-    if (cmp)
+    /*Empty slots have no key to compare*/
+    if (map->values[index] == 0)
+        return false;
+
+    else if (cmp)
         return    map->hashes[index] == hash
                && !cmp(map->keysStr[index], key);
 
@@ -0,0 +1,681 @@
+#include "../inc/interface.h"
+
+#include "../inc/debug.h"
+#include "../inc/sym.h"
+#include "../inc/type.h"
+#include "../inc/ast.h"
+#include "../inc/hashmap.h"
+#include "../inc/architecture.h"
+#include "../inc/compiler.h"
+#include "../inc/parser.h"
+#include "../inc/cache.h"
+
+#include "stdlib.h"
+#include "stdio.h"
+#include "string.h"
+#include "unistd.h"
+#include "fcntl.h"
+#include "sys/stat.h"
+#include "sys/mman.h"
+
+/*File layout: a header, then arrays of each of the records below, then
+  the strings they refer to, by offset. Host byte order, as the cache is
+  local to the machine.*/
+
+enum {
+    ///Change whenever the layout, or the meaning of anything in it, does
+    interfaceFormat = 1,
+    interfaceNone = 0xFFFFFFFF
+};
+
+static const char interfaceMagic[4] = {'F', 'C', 'C', 'I'};
+
+typedef struct interfaceHeader {
+    char magic[4];
+    uint32_t format;
+    uint64_t key;
+    ///See parserResult::hash
+    uint64_t hash;
+    uint32_t imports, syms, types, params, strings;
+    uint32_t padding;
+} interfaceHeader;
+
+typedef struct interfaceImport {
+    ///Expected hash of the module imported
+    uint64_t hash;
+    ///As written in the using
+    uint32_t name;
+    uint32_t padding;
+} interfaceImport;
+
+/*Symbols are in preorder, so a parent always comes before its children*/
+typedef struct interfaceSym {
+    uint8_t tag, storage, complete, hasConstFields;
+    ///Index of the parent, or interfaceNone if the module scope
+    uint32_t parent;
+    uint32_t ident;
+    ///symId symParam symTypedef symEnumConstant: index of the type
+    uint32_t dt;
+    ///symStruct symUnion symEnum
+    int32_t size;
+    uint32_t typeMask;
+    ///Field and param offsets, enum constant values
+    int32_t value;
+} interfaceSym;
+
+typedef enum interfaceRef {
+    ///Index of a symbol in this interface
+    refOwn,
+    ///Name of a builtin type in the global scope
+    refBuiltin,
+    ///Name of a symbol found through the imports
+    refImport
+} interfaceRef;
+
+/*Types are trees: each symbol has its own, as each symbol owns its type*/
+typedef struct interfaceType {
+    uint8_t tag, isConst, variadic, ref;
+    ///typeBasic: a symbol, see ref
+    ///typePtr typeArray: base type, typeFunction: return type
+    uint32_t base;
+    ///typeArray: size, typeFunction: number of params
+    int32_t array;
+    ///typeFunction: index of the first in the params array
+    uint32_t params;
+} interfaceType;
+
+/*==== Hashing ====*/
+
+uint64_t interfaceKey (const compilerCtx* comp, const char* fullname) {
+    /*A module preprocessed depends on the headers it included, too*/
+    if (!comp->moduleCache || comp->preprocess)
+        return 0;
+
+    uint64_t hash = cacheHashInit;
+
+    int format = interfaceFormat;
+    hash = cacheHashBuild(hash);
+    hash = cacheHashBytes(hash, &format, sizeof(format));
+    hash = cacheHashBytes(hash, &comp->arch->wordsize, sizeof(comp->arch->wordsize));
+
+    return cacheHashFile(hash, fullname);
+}
+
+uint64_t interfaceHashImport (uint64_t hash, uint64_t imported) {
+    /*Can't vouch for a module importing one that can't be hashed*/
+    if (!hash || !imported)
+        return 0;
+
+    hash = cacheHashBytes(hash, &imported, sizeof(imported));
+    return hash ? hash : 1;
+}
+
+static char* interfaceFilename (const compilerCtx* comp, uint64_t key) {
+    char* filename = malloc(strlen(comp->moduleCache) + 1 + 16 + 5);
+    sprintf(filename, "%s/%016llx.fmi", comp->moduleCache, (unsigned long long) key);
+    return filename;
+}
+
+/*Look up a name through the modules imported by a scope, but not in the
+  scope itself*/
+static const sym* interfaceFindImport (const sym* scope, const char* ident) {
+    for (int i = 0; i < scope->children.length; i++) {
+        const sym* link = vectorGet(&scope->children, i);
+
+        if (link->tag == symModuleLink) {
+            const sym* found = symChild(vectorGet(&link->children, 0), ident);
+
+            if (found)
+                return found;
+        }
+    }
+
+    return 0;
+}
+
+static bool interfaceSymHasType (symTag tag) {
+    return    tag == symId || tag == symParam
+           || tag == symTypedef || tag == symEnumConstant;
+}
+
+static bool interfaceSymIsRecord (symTag tag) {
+    return    tag == symStruct || tag == symUnion || tag == symEnum;
+}
+
+/*==== Saving ====*/
+
+typedef struct interfaceWriter {
+    const compilerCtx* comp;
+    const sym* scope;
+    ///Any location in the module's file
+    tokenLocation source;
+
+    ///Symbols in preorder, and from each to its index plus one
+    vector/*<const sym*>*/ symbols;
+    intmap/*<const sym*, int>*/ indices;
+
+    interfaceSym* syms;
+    interfaceType* types;
+    uint32_t* params;
+    char* strings;
+    int typeNo, typeCapacity, paramNo, paramCapacity, stringLength, stringCapacity;
+} interfaceWriter;
+
+static uint32_t interfaceWriteString (interfaceWriter* writer, const char* str) {
+    int length = (int) strlen(str) + 1;
+
+    if (writer->stringLength + length > writer->stringCapacity) {
+        writer->stringCapacity = 2*writer->stringCapacity + length;
+        writer->strings = realloc(writer->strings, writer->stringCapacity);
+    }
+
+    memcpy(writer->strings + writer->stringLength, str, length);
+    writer->stringLength += length;
+
+    return (uint32_t) (writer->stringLength - length);
+}
+
+static bool interfaceIsWithin (const sym* Symbol, const sym* scope) {
+    for (; Symbol; Symbol = Symbol->parent)
+        if (Symbol == scope)
+            return true;
+
+    return false;
+}
+
+/*Collect the symbols under a parent, failing on anything that an interface
+  can't represent*/
+static bool interfaceCollect (interfaceWriter* writer, const sym* parent) {
+    for (int i = 0; i < parent->children.length; i++) {
+        const sym* Symbol = vectorGet(&parent->children, i);
+
+        /*Only the modules imported at the top level are understood, and
+          they are recorded separately*/
+        if (Symbol->tag == symModuleLink) {
+            if (parent != writer->scope)
+                return false;
+
+            continue;
+
+        /*Redeclarations within the module are fine, those moved in from or
+          out to another aren't*/
+        } else if (Symbol->tag == symLink) {
+            if (!interfaceIsWithin(vectorGet(&Symbol->children, 0), writer->scope))
+                return false;
+
+            continue;
+        }
+
+        for (int j = 0; j < Symbol->decls.length; j++) {
+            const ast* decl = vectorGet(&Symbol->decls, j);
+
+            if (!sourceIsSameFile(decl->location, writer->source))
+                return false;
+        }
+
+        /*Only declarations: nothing that needs code or data emitted*/
+        if (   Symbol->tag == symId && parent == writer->scope
+            && (Symbol->storage != storageExtern || Symbol->impl))
+            return false;
+
+        vectorPush(&writer->symbols, (void*) Symbol);
+        intmapAdd(&writer->indices, (intptr_t) Symbol, (void*) (intptr_t) writer->symbols.length);
+
+        if (!interfaceCollect(writer, Symbol))
+            return false;
+    }
+
+    return true;
+}
+
+static uint32_t interfaceWriteType (interfaceWriter* writer, const type* DT, bool* fail) {
+    if (writer->typeNo == writer->typeCapacity) {
+        writer->typeCapacity = 2*writer->typeCapacity + 16;
+        writer->types = realloc(writer->types, sizeof(interfaceType)*writer->typeCapacity);
+    }
+
+    uint32_t index = (uint32_t) writer->typeNo++;
+    interfaceType record = {(uint8_t) DT->tag, DT->qual.isConst, false, refOwn, interfaceNone, 0, 0};
+
+    if (DT->tag == typeBasic) {
+        const sym* basic = DT->basic;
+        intptr_t own = basic ? (intptr_t) intmapMap(&writer->indices, (intptr_t) basic) : 0;
+
+        if (own) {
+            record.base = (uint32_t) (own-1);
+
+        } else if (   basic && basic->tag == symType
+                   && basic->parent == writer->comp->global) {
+            record.ref = refBuiltin;
+            record.base = interfaceWriteString(writer, basic->ident);
+
+        } else if (   basic && basic->ident && basic->ident[0]
+                   && interfaceFindImport(writer->scope, basic->ident) == basic) {
+            record.ref = refImport;
+            record.base = interfaceWriteString(writer, basic->ident);
+
+        } else
+            *fail = true;
+
+    } else if (DT->tag == typePtr || DT->tag == typeArray) {
+        record.base = interfaceWriteType(writer, DT->base, fail);
+        record.array = DT->array;
+
+    } else if (DT->tag == typeFunction) {
+        record.base = interfaceWriteType(writer, DT->returnType, fail);
+        record.variadic = DT->variadic;
+        record.array = DT->params;
+
+        /*Reserve the params' slots before their types add any more*/
+        record.params = (uint32_t) writer->paramNo;
+
+        if (writer->paramNo + DT->params > writer->paramCapacity) {
+            writer->paramCapacity = 2*writer->paramCapacity + DT->params;
+            writer->params = realloc(writer->params, sizeof(uint32_t)*writer->paramCapacity);
+        }
+
+        writer->paramNo += DT->params;
+
+        for (int i = 0; i < DT->params; i++) {
+            uint32_t param = interfaceWriteType(writer, DT->paramTypes[i], fail);
+            writer->params[record.params + i] = param;
+        }
+
+    } else
+        *fail = true;
+
+    writer->types[index] = record;
+    return index;
+}
+
+static bool interfaceWriteFile (const char* filename, const interfaceHeader* header,
+                                const interfaceImport* imports, const interfaceWriter* writer) {
+    /*Written aside then renamed into place, so that concurrent compilers
+      never see half a file*/
+    char* tmpname = malloc(strlen(filename) + 32);
+    sprintf(tmpname, "%s.%d", filename, (int) getpid());
+
+    FILE* file = fopen(tmpname, "wb");
+    bool fail = !file;
+
+    if (file) {
+        fwrite(header, sizeof(*header), 1, file);
+        fwrite(imports, sizeof(interfaceImport), header->imports, file);
+        fwrite(writer->syms, sizeof(interfaceSym), header->syms, file);
+        fwrite(writer->types, sizeof(interfaceType), header->types, file);
+        fwrite(writer->params, sizeof(uint32_t), header->params, file);
+        fwrite(writer->strings, 1, header->strings, file);
+
+        fail = ferror(file) != 0;
+        fail |= fclose(file) != 0;
+        fail = fail || rename(tmpname, filename) != 0;
+
+        if (fail)
+            remove(tmpname);
+    }
+
+    free(tmpname);
+    return fail;
+}
+
+void interfaceSave (compilerCtx* comp, const char* fullname, const parserResult* module) {
+    if (module->cached || !module->hash || !module->scope)
+        return;
+
+    debugEnter("InterfaceSave");
+
+    interfaceWriter writer = {0};
+    writer.comp = comp;
+    writer.scope = module->scope;
+    writer.source = module->tree->location;
+    vectorInit(&writer.symbols, 64);
+    intmapInit(&writer.indices, 64);
+
+    bool fail = !interfaceCollect(&writer, module->scope);
+
+    /*Imports*/
+
+    vector/*<ast*>*/ usings;
+    vectorInit(&usings, 8);
+
+    for (ast* Current = module->tree->firstChild; Current; Current = Current->nextSibling)
+        if (Current->tag == astUsing && ((char*) Current->literal)[0])
+            vectorPush(&usings, Current);
+
+    interfaceImport* imports = calloc(max(usings.length, 1), sizeof(interfaceImport));
+    char* path = fgetpath(fullname, malloc);
+
+    for (int i = 0; i < usings.length && !fail; i++) {
+        const ast* Using = vectorGet(&usings, i);
+        /*Already parsed, so this just looks it up*/
+        parserResult imported = parser(Using->literal, path, true, comp);
+
+        fail = imported.notfound || imported.firsttime || !imported.hash;
+        imports[i] = (interfaceImport) {imported.hash, interfaceWriteString(&writer, Using->literal), 0};
+    }
+
+    free(path);
+
+    /*Symbols, then their types*/
+
+    writer.syms = calloc(max(writer.symbols.length, 1), sizeof(interfaceSym));
+
+    for (int i = 0; i < writer.symbols.length && !fail; i++) {
+        const sym* Symbol = vectorGet(&writer.symbols, i);
+        intptr_t parent = (intptr_t) intmapMap(&writer.indices, (intptr_t) Symbol->parent);
+
+        interfaceSym record = {(uint8_t) Symbol->tag, 0, false, false,
+                               parent ? (uint32_t) (parent-1) : interfaceNone,
+                               interfaceWriteString(&writer, Symbol->ident ? Symbol->ident : ""),
+                               interfaceNone, 0, 0, 0};
+
+        if (interfaceSymHasType(Symbol->tag)) {
+            record.storage = (uint8_t) Symbol->storage;
+
+            if (Symbol->dt)
+                record.dt = interfaceWriteType(&writer, Symbol->dt, &fail);
+
+            if (Symbol->tag == symEnumConstant)
+                record.value = Symbol->constValue;
+
+            else if (Symbol->storage == storageAuto || Symbol->tag == symParam)
+                record.value = Symbol->offset;
+
+        } else if (interfaceSymIsRecord(Symbol->tag)) {
+            record.size = Symbol->size;
+            record.typeMask = Symbol->typeMask;
+            record.complete = Symbol->complete;
+
+            if (Symbol->tag == symStruct)
+                record.hasConstFields = Symbol->hasConstFields;
+        }
+
+        writer.syms[i] = record;
+    }
+
+    if (!fail) {
+        interfaceHeader header = {{0}, interfaceFormat, interfaceKey(comp, fullname), module->hash,
+                                  (uint32_t) usings.length, (uint32_t) writer.symbols.length,
+                                  (uint32_t) writer.typeNo, (uint32_t) writer.paramNo,
+                                  (uint32_t) writer.stringLength, 0};
+        memcpy(header.magic, interfaceMagic, sizeof(interfaceMagic));
+
+        /*Make the directory on first use, if need be*/
+        mkdir(comp->moduleCache, 0777);
+
+        char* filename = interfaceFilename(comp, header.key);
+        fail = interfaceWriteFile(filename, &header, imports, &writer);
+        debugMsg("%s %s", fail ? "failed to write" : "wrote", filename);
+        free(filename);
+
+    } else
+        debugMsg("%s can't be saved as an interface", fullname);
+
+    free(imports);
+    vectorFree(&usings);
+
+    free(writer.syms);
+    free(writer.types);
+    free(writer.params);
+    free(writer.strings);
+    vectorFree(&writer.symbols);
+    intmapFree(&writer.indices);
+
+    debugLeave();
+}
+
+/*==== Loading ====*/
+
+typedef struct interfaceReader {
+    compilerCtx* comp;
+    sym* scope;
+
+    const interfaceHeader* header;
+    const interfaceType* types;
+    const uint32_t* params;
+    const char* strings;
+
+    ///The symbols created, by index
+    sym** symbols;
+} interfaceReader;
+
+static const char* interfaceReadString (const interfaceReader* reader, uint32_t offset) {
+    /*The strings are checked to end in a null*/
+    return offset < reader->header->strings ? reader->strings + offset : "";
+}
+
+static type* interfaceReadType (interfaceReader* reader, uint32_t index, int depth, bool* fail) {
+    /*Indices only ever point forward, so this can't loop, but the file
+      may still be corrupt*/
+    if (index >= reader->header->types || depth > (int) reader->header->types) {
+        *fail = true;
+        return typeCreateInvalid();
+    }
+
+    const interfaceType* record = &reader->types[index];
+    type* DT;
+
+    if (record->tag == typeBasic) {
+        const sym* basic = 0;
+
+        if (record->ref == refOwn)
+            basic = record->base < reader->header->syms ? reader->symbols[record->base] : 0;
+
+        else if (record->ref == refBuiltin)
+            basic = symChild(reader->comp->global, interfaceReadString(reader, record->base));
+
+        else if (record->ref == refImport)
+            basic = interfaceFindImport(reader->scope, interfaceReadString(reader, record->base));
+
+        if (!basic) {
+            *fail = true;
+            return typeCreateInvalid();
+        }
+
+        DT = typeCreateBasic(basic);
+
+    } else if (record->tag == typePtr)
+        DT = typeCreatePtr(interfaceReadType(reader, record->base, depth+1, fail));
+
+    else if (record->tag == typeArray)
+        DT = typeCreateArray(interfaceReadType(reader, record->base, depth+1, fail), record->array);
+
+    else if (   record->tag == typeFunction && record->array >= 0
+             && record->params + (uint32_t) record->array <= reader->header->params) {
+        type* returnType = interfaceReadType(reader, record->base, depth+1, fail);
+        type** paramTypes = calloc(max(record->array, 1), sizeof(type*));
+
+        for (int i = 0; i < record->array; i++)
+            paramTypes[i] = interfaceReadType(reader, reader->params[record->params + i], depth+1, fail);
+
+        DT = typeCreateFunction(returnType, paramTypes, record->array, record->variadic);
+
+    } else {
+        *fail = true;
+        return typeCreateInvalid();
+    }
+
+    DT->qual.isConst = record->isConst;
+    return DT;
+}
+
+static bool interfaceCheckHeader (const interfaceHeader* header, uint64_t key, size_t size) {
+    if (   size < sizeof(interfaceHeader)
+        || memcmp(header->magic, interfaceMagic, sizeof(interfaceMagic))
+        || header->format != interfaceFormat
+        || header->key != key)
+        return false;
+
+    uint64_t expected =   (uint64_t) sizeof(interfaceHeader)
+                        + (uint64_t) header->imports*sizeof(interfaceImport)
+                        + (uint64_t) header->syms*sizeof(interfaceSym)
+                        + (uint64_t) header->types*sizeof(interfaceType)
+                        + (uint64_t) header->params*sizeof(uint32_t)
+                        + header->strings;
+
+    const char* strings = (const char*) header + size - header->strings;
+
+    return    expected == size
+           && (header->strings == 0 || strings[header->strings-1] == 0);
+}
+
+bool interfaceLoad (compilerCtx* comp, const char* filename, const char* fullname, parserResult* result) {
+    uint64_t key = interfaceKey(comp, fullname);
+
+    if (!key)
+        return false;
+
+    char* cachename = interfaceFilename(comp, key);
+    int fd = open(cachename, O_RDONLY);
+    free(cachename);
+
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void* map = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        map = mmap(0, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    size_t size = (size_t) info.st_size;
+    const interfaceHeader* header = map;
+
+    if (!interfaceCheckHeader(header, key, size)) {
+        munmap(map, size);
+        return false;
+    }
+
+    debugEnter("InterfaceLoad");
+
+    const interfaceImport* imports = (const interfaceImport*) (header+1);
+    const interfaceSym* syms = (const interfaceSym*) (imports + header->imports);
+
+    interfaceReader reader = {comp, 0, header,
+                              (const interfaceType*) (syms + header->syms), 0,
+                              (const char*) map + size - header->strings, 0};
+    reader.params = (const uint32_t*) (reader.types + header->types);
+
+    /*The imports must be exactly as they were*/
+
+    /*Known by name only, having no text*/
+    char* stripped = fstripname(filename, malloc);
+    tokenLocation loc = sourceAdd(stripped, 0, 0);
+
+    astPool* nodes = astPoolCreate();
+    astPool* outer = astPoolSwitch(nodes);
+
+    ast* Module = astCreate(astModule, loc);
+    int errors = 0, warnings = 0;
+    bool fail = false;
+
+    char* path = fgetpath(fullname, malloc);
+    vector/*<const sym*>*/ importScopes;
+    vectorInit(&importScopes, max(header->imports, 1));
+
+    for (uint32_t i = 0; i < header->imports && !fail; i++) {
+        const char* name = interfaceReadString(&reader, imports[i].name);
+        parserResult imported = parser(name, path, true, comp);
+
+        fail = imported.notfound || imported.hash != imports[i].hash;
+
+        ast* Using = astCreateUsing(loc, strdup(name));
+        astAddChild(Module, Using);
+        vectorPush(&importScopes, (void*) imported.scope);
+
+        /*As parserUsing would*/
+        if (imported.firsttime) {
+            errors += imported.errors;
+            warnings += imported.warnings;
+            Using->r = imported.tree;
+        }
+    }
+
+    free(path);
+    astPoolSwitch(outer);
+
+    /*Recreate the symbols, then their types*/
+
+    if (!fail) {
+        reader.scope = symCreateScope(comp->global);
+        Module->symbol = reader.scope;
+
+        for (int i = 0; i < importScopes.length; i++)
+            symCreateModuleLink(reader.scope, vectorGet(&importScopes, i));
+
+        reader.symbols = calloc(max(header->syms, 1), sizeof(sym*));
+
+        for (uint32_t i = 0; i < header->syms && !fail; i++) {
+            const interfaceSym* record = &syms[i];
+
+            /*Parents come first*/
+            if (record->parent != interfaceNone && record->parent >= i) {
+                fail = true;
+                break;
+            }
+
+            sym* parent = record->parent == interfaceNone ? reader.scope : reader.symbols[record->parent];
+            sym* Symbol = record->tag == symScope
+                ? symCreateScope(parent)
+                : symCreateNamed((symTag) record->tag, parent, interfaceReadString(&reader, record->ident));
+            reader.symbols[i] = Symbol;
+
+            if (interfaceSymHasType(Symbol->tag)) {
+                Symbol->storage = (storageTag) record->storage;
+
+                if (Symbol->tag == symEnumConstant)
+                    Symbol->constValue = record->value;
+
+                else if (Symbol->storage == storageAuto || Symbol->tag == symParam)
+                    Symbol->offset = record->value;
+
+            } else if (interfaceSymIsRecord(Symbol->tag)) {
+                Symbol->size = record->size;
+                Symbol->typeMask = (symTypeMask) record->typeMask;
+                Symbol->complete = record->complete;
+
+                if (Symbol->tag == symStruct)
+                    Symbol->hasConstFields = record->hasConstFields;
+            }
+        }
+
+        for (uint32_t i = 0; i < header->syms && !fail; i++) {
+            sym* Symbol = reader.symbols[i];
+
+            if (interfaceSymHasType(Symbol->tag) && syms[i].dt != interfaceNone)
+                Symbol->dt = interfaceReadType(&reader, syms[i].dt, 0, &fail);
+
+            /*Normally done when the emitter meets the declaration*/
+            if (   Symbol->tag == symId && Symbol->parent == reader.scope
+                && Symbol->storage == storageExtern)
+                comp->arch->symbolMangler(Symbol);
+        }
+
+        free(reader.symbols);
+    }
+
+    uint64_t hash = header->hash;
+
+    vectorFree(&importScopes);
+    munmap(map, size);
+
+    if (fail) {
+        /*Any symbols created are left in a scope nothing links to*/
+        debugMsg("%s doesn't match its interface", fullname);
+        sourceRelease(loc);
+        astPoolDestroy(nodes);
+        free(stripped);
+
+    } else {
+        *result = (parserResult) {Module, nodes, reader.scope, stripped, errors, warnings, true, false, hash, true};
+    }
+
+    debugLeave();
+
+    return !fail;
+}
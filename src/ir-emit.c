@@ -10,47 +10,100 @@
 
 #include "stdlib.h"
 #include "stdarg.h"
+#include "string.h"
+#include "ctype.h"
 
-static void irEmitStaticData (irCtx* ctx, FILE* file, const irStaticData* data);
+static bool irStaticDataIsZero (const irStaticData* data);
+static void irEmitStaticZero (irCtx* ctx, const irStaticData* data);
+static void irEmitStaticData (irCtx* ctx, const irStaticData* data);
+static void irEmitStrings (irCtx* ctx);
 
-static void irEmitFn (irCtx* ctx, FILE* file, const irFn* fn);
-static void irEmitBlock (irCtx* ctx, FILE* file,
-                         const irBlock* prevblock, const irBlock* block, const irBlock* nextblock);
-static void irEmitTerm (irCtx* ctx, FILE* file, const irTerm* term, const irBlock* nextblock);
+static void irEmitFn (irCtx* ctx, const irFn* fn);
+static void irEmitBlock (irCtx* ctx, const irBlock* prevblock, const irBlock* block, const irBlock* nextblock);
+static void irEmitTerm (irCtx* ctx, const irTerm* term, const irBlock* nextblock);
 
 void irEmit (irCtx* ctx) {
-    FILE* file = ctx->asm->file;
-
     asmFilePrologue(ctx->asm);
 
-    for (int i = 0; i < ctx->fns.length; i++) {
-        irFn* fn = vectorGet(&ctx->fns, i);
-        irEmitFn(ctx, file, fn);
-    }
+    irEmitFns(ctx);
+
+    for (int i = 0; i < ctx->rendered.length; i++)
+        bufferStr(&ctx->asm->out, vectorGet(&ctx->rendered, i));
 
     asmDataSection(ctx->asm);
 
     for (int i = 0; i < ctx->data.length; i++) {
         irStaticData* data = vectorGet(&ctx->data, i);
-        irEmitStaticData(ctx, file, data);
+
+        if (!irStaticDataIsZero(data))
+            irEmitStaticData(ctx, data);
+    }
+
+    /*Zero filled data takes no space in the object*/
+    asmBSSSection(ctx->asm);
+
+    for (int i = 0; i < ctx->data.length; i++) {
+        irStaticData* data = vectorGet(&ctx->data, i);
+
+        if (irStaticDataIsZero(data))
+            irEmitStaticZero(ctx, data);
     }
 
     asmRODataSection(ctx->asm);
 
     for (int i = 0; i < ctx->rodata.length; i++) {
         irStaticData* data = vectorGet(&ctx->rodata, i);
-        irEmitStaticData(ctx, file, data);
+        irEmitStaticData(ctx, data);
     }
 
+    irEmitStrings(ctx);
+
     asmFileEpilogue(ctx->asm);
 }
 
-static void irEmitStaticData (irCtx* ctx, FILE* file, const irStaticData* data) {
-    (void) file;
+void irEmitFns (irCtx* ctx) {
+    for (int i = 0; i < ctx->fns.length; i++) {
+        irFn* fn = vectorGet(&ctx->fns, i);
+        irEmitFn(ctx, fn);
+    }
+}
+
+static bool irStaticDataIsZero (const irStaticData* data) {
+    if (data->tag == dataRegular)
+        return data->initial == 0;
+
+    else if (data->tag == dataBytes) {
+        if (data->refs.length != 0)
+            return false;
+
+        for (int i = 0; i < data->bytesno; i++)
+            if (data->bytes[i] != 0)
+                return false;
+
+        return true;
 
+    } else
+        return false;
+}
+
+static void irEmitStaticZero (irCtx* ctx, const irStaticData* data) {
+    if (data->tag == dataRegular)
+        asmStaticZero(ctx->asm, data->label, data->global, data->size);
+
+    else if (data->tag == dataBytes)
+        asmStaticZero(ctx->asm, data->byteslabel, data->bytesglobal, data->bytesno);
+
+    else
+        debugErrorUnhandledInt("irEmitStaticZero", "static data tag", data->tag);
+}
+
+static void irEmitStaticData (irCtx* ctx, const irStaticData* data) {
     if (data->tag == dataRegular)
         asmStaticData(ctx->asm, data->label, data->global, data->size, data->initial);
 
+    else if (data->tag == dataBytes)
+        asmStaticBytes(ctx->asm, data->byteslabel, data->bytesglobal, data->bytesno, data->bytes, &data->refs);
+
     else if (data->tag == dataStringConstant)
         asmStringConstant(ctx->asm, data->strlabel, data->str);
 
@@ -58,87 +111,182 @@ static void irEmitStaticData (irCtx* ctx, FILE* file, const irStaticData* data)
         debugErrorUnhandledInt("irEmitStaticData", "static data tag", data->tag);
 }
 
-static void irEmitBlockChain (irCtx* ctx, FILE* file,
-                              intset/*<irBlock*>*/* done, vector/*<irBlock*>*/* priority,
-                              const irBlock* block) {
-    /*Already put in the priority list, leave*/
-    if (intsetAdd(done, (intptr_t) block))
+/*==== String constants ====*/
+
+/*Length in bytes once assembled of the first n characters of an escaped
+  string, or -1 if they end in the middle of an escape sequence*/
+static int irStrAssembledLength (const char* str, int n) {
+    int length = 0, i = 0;
+
+    while (i < n) {
+        /*Hex: any number of digits*/
+        if (str[i] == '\\' && str[i+1] == 'x') {
+            i += 2;
+
+            while (isxdigit(str[i]))
+                i++;
+
+        /*Octal: up to three*/
+        } else if (str[i] == '\\' && str[i+1] >= '0' && str[i+1] <= '7') {
+            i++;
+
+            for (int digits = 0; digits < 3 && str[i] >= '0' && str[i] <= '7'; digits++)
+                i++;
+
+        } else if (str[i] == '\\')
+            i += 2;
+
+        else
+            i++;
+
+        length++;
+    }
+
+    return i == n ? length : -1;
+}
+
+/*Order by the strings reversed, so that a string comes immediately before
+  those it is a suffix of*/
+static int irStrCmpReversed (const void* l, const void* r) {
+    const char *L = (*(const irStaticData**) l)->str,
+               *R = (*(const irStaticData**) r)->str;
+
+    int i = (int) strlen(L), j = (int) strlen(R);
+
+    while (i > 0 && j > 0 && L[i-1] == R[j-1])
+        i--, j--;
+
+    if (i == 0 || j == 0)
+        return i - j;
+
+    else
+        return (unsigned char) L[i-1] - (unsigned char) R[j-1];
+}
+
+static void irEmitStrings (irCtx* ctx) {
+    int n = ctx->strings.length;
+
+    if (n == 0)
         return;
 
-    /*Add all the predecessors and their predecessors to the list*/
-    for (int j = 0; j < block->preds.length; j++) {
-        irBlock* pred = vectorGet(&block->preds, j);
-        irEmitBlockChain(ctx, file, done, priority, pred);
+    irStaticData** sorted = malloc(sizeof(irStaticData*)*n);
+    memcpy(sorted, ctx->strings.buffer, sizeof(irStaticData*)*n);
+    qsort(sorted, n, sizeof(irStaticData*), irStrCmpReversed);
+
+    /*For each string, the one it lives in the tail of, and where.
+      Resolved from the back, so the longer strings are done first.*/
+    int* root = malloc(sizeof(int)*n);
+    int* offset = malloc(sizeof(int)*n);
+
+    for (int k = 0; k < n; k++) {
+        int i = n-1 - k;
+        const char* str = sorted[i]->str;
+        int length = (int) strlen(str);
+
+        root[i] = i;
+        offset[i] = 0;
+
+        /*Of those it is a suffix of, pick the furthest that it can be
+          split from on a character boundary*/
+        for (int j = i+1; j < n; j++) {
+            const char* outer = sorted[j]->str;
+            int outerLength = (int) strlen(outer);
+
+            if (outerLength < length || strcmp(outer + outerLength - length, str) != 0)
+                break;
+
+            int prefix = irStrAssembledLength(outer, outerLength - length);
+
+            if (prefix >= 0) {
+                root[i] = root[j];
+                offset[i] = offset[j] + prefix;
+            }
+        }
     }
 
-    /*Followed by this block*/
-    vectorPush(priority, (void*) block);
+    asmStringSection(ctx->asm);
+
+    for (int i = 0; i < n; i++)
+        if (root[i] == i)
+            asmStringConstant(ctx->asm, sorted[i]->strlabel, sorted[i]->str);
+
+    for (int i = 0; i < n; i++)
+        if (root[i] != i)
+            asmStringConstantSuffix(ctx->asm, sorted[i]->strlabel, sorted[root[i]]->strlabel, offset[i]);
+
+    free(sorted);
+    free(root);
+    free(offset);
 }
 
-static void irEmitFn (irCtx* ctx, FILE* file, const irFn* fn) {
+static void irEmitFn (irCtx* ctx, const irFn* fn) {
     debugEnter(fn->name);
 
-    intset/*<irBlock*>*/ done;
-    intsetInit(&done, fn->blocks.length*2);
+    vector/*<irBlock*>*/ order;
+    vectorInit(&order, fn->blocks.length);
 
-    vector/*<irBlock*>*/ priority;
-    vectorInit(&priority, fn->blocks.length);
-
-    /*Decide an order to emit the blocks in to minimize unnecessary jumps*/
-    irEmitBlockChain(ctx, file, &done, &priority, fn->epilogue);
+    /*Decide an order to emit the blocks in to minimize taken jumps*/
+    irLayoutFn(fn, &order);
 
     /*Emit*/
 
-    asmFnLinkageBegin(file, fn->name);
+    asmFnLinkageBegin(ctx->asm, fn->name);
 
-    for (int j = 0; j < priority.length; j++) {
-        irBlock *prevblock = vectorGet(&priority, j-1),
-                *block = vectorGet(&priority, j),
-                *nextblock = vectorGet(&priority, j+1);
-        irEmitBlock(ctx, file, prevblock, block, nextblock);
+    for (int j = 0; j < order.length; j++) {
+        irBlock *prevblock = vectorGet(&order, j-1),
+                *block = vectorGet(&order, j),
+                *nextblock = vectorGet(&order, j+1);
+        irEmitBlock(ctx, prevblock, block, nextblock);
     }
 
-    asmFnLinkageEnd(file, fn->name);
+    asmFnLinkageEnd(ctx->asm, fn->name);
 
     /*Cleanup*/
-    vectorFree(&priority);
-    intsetFree(&done);
+    vectorFree(&order);
 
     debugLeave();
 }
 
-static void irEmitBlock (irCtx* ctx, FILE* file,
-                         const irBlock* prevblock, const irBlock* block, const irBlock* nextblock) {
-    debugEnter(block->label);
+static void irEmitBlock (irCtx* ctx, const irBlock* prevblock, const irBlock* block, const irBlock* nextblock) {
+    char label[irLabelMax];
+    debugEnter(irBlockGetLabel(ctx, block, label));
 
     /*Don't emit the label if no preds / single pred emitted directly before
       Doesn't use irBlockGetPredNo as that gets the *logical* pred no (special
-      handling for prologue).*/
+      handling for prologue). Jump table targets are always referred to by
+      label.*/
+    const irBlock* pred = vectorGet(&block->preds, 0);
+
     if (!(   block->preds.length <= 1
-          && (block->preds.length == 1 ? vectorGet(&block->preds, 0) == prevblock
+          && (block->preds.length == 1 ?    pred == prevblock
+                                         && pred->term->tag != termJumpTable
                                         : true)))
-        asmLabel(ctx->asm, block->label);
+        asmLabel(ctx->asm, label);
 
-    fputs(block->str, file);
-    debugMsg(block->str);
+    const irFn* fn = block->fn;
+
+    for (int i = block->firstSpan; i >= 0; i = fn->spans[i].next) {
+        const irSpan* span = &fn->spans[i];
+        bufferStrN(&ctx->asm->out, fn->out.str + span->start, span->length);
+        debugMsg("%.*s", span->length, fn->out.str + span->start);
+    }
 
     if (block->term)
-        irEmitTerm(ctx, file, block->term, nextblock);
+        irEmitTerm(ctx, block->term, nextblock);
 
     else
-        debugError("irEmitBlock", "unterminated block %s", block->label);
+        debugError("irEmitBlock", "unterminated block %s", label);
 
-    fputs("\n", file);
+    bufferChar(&ctx->asm->out, '\n');
 
     debugLeave();
 }
 
-static void irEmitTerm (irCtx* ctx, FILE* file, const irTerm* term, const irBlock* nextblock) {
-    (void) file;
-
+static void irEmitTerm (irCtx* ctx, const irTerm* term, const irBlock* nextblock) {
     /*Some of the terminals end in a jump
       Use this to unify the jump logic*/
     irBlock* jumpTo = 0;
+    char label[irLabelMax];
 
     if (term->tag == termJump)
         jumpTo = term->to;
@@ -146,11 +294,11 @@ static void irEmitTerm (irCtx* ctx, FILE* file, const irTerm* term, const irBloc
     else if (term->tag == termBranch) {
         if (term->ifTrue == nextblock) {
             operand cond = operandCreateFlags(conditionNegate(term->cond.condition));
-            asmBranch(ctx->asm, cond, term->ifFalse->label);
+            asmBranch(ctx->asm, cond, irBlockGetLabel(ctx, term->ifFalse, label));
             jumpTo = term->ifTrue;
 
         } else {
-            asmBranch(ctx->asm, term->cond, term->ifTrue->label);
+            asmBranch(ctx->asm, term->cond, irBlockGetLabel(ctx, term->ifTrue, label));
             jumpTo = term->ifFalse;
         }
 
@@ -163,6 +311,10 @@ static void irEmitTerm (irCtx* ctx, FILE* file, const irTerm* term, const irBloc
         //asmCallIndirect(ctx->asm, term->toAsOperand);
         jumpTo = term->ret;
 
+    } else if (term->tag == termJumpTable) {
+        /*The jump itself was emitted by irJumpTable, follow it with the table*/
+        asmJumpTableData(ctx, term->tableLabel, &term->table);
+
     } else if (term->tag == termReturn)
         asmReturn(ctx->asm);
 
@@ -171,5 +323,5 @@ static void irEmitTerm (irCtx* ctx, FILE* file, const irTerm* term, const irBloc
 
     /*Perform the jump if not redundant*/
     if (jumpTo && jumpTo != nextblock)
-        asmJump(ctx->asm, jumpTo->label);
+        asmJump(ctx->asm, irBlockGetLabel(ctx, jumpTo, label));
 }
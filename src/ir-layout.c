@@ -0,0 +1,450 @@
+#include "../inc/ir.h"
+
+#include "../inc/vector.h"
+
+#include "stdlib.h"
+
+/*Block layout decides the order to emit a function's blocks in, so that
+  the likely path falls through and taken branches are rare:
+
+    1. Branch probabilities are estimated using static heuristics, after
+       Ball & Larus. Block frequencies are estimated from loop depth.
+    2. Chains are grown bottom up, after Pettis & Hansen. Edges are taken
+       from most to least frequent, joining two chains whenever the edge
+       runs from the tail of one to the head of the other.
+    3. The chains are placed in depth first order, starting with the
+       prologue's. Cold chains (unlikely returns) go at the end.
+
+  The emitter places a copy of the loop condition at the bottom of a loop,
+  so once the body is chained the back edge is a conditional branch that is
+  usually taken, with the loop exit falling through.*/
+
+typedef struct layoutCtx {
+    const irFn* fn;
+
+    /*Indexed by nthChild*/
+
+    ///DFS pre and postorder numbers, -1 for blocks unreachable from the prologue
+    int *pre, *post;
+    int* loopDepth;
+    ///Percent chance of taking the ifTrue of a termBranch
+    int* prob;
+    ///The successor of a termBranch predicted to be an unlikely return
+    const irBlock** unlikelyReturn;
+    bool* cold;
+
+    ///Chains: the block following in the chain, and a union-find over the
+    ///blocks whose leaders know the head and tail of their chain
+    irBlock** next;
+    int* leader;
+    irBlock **head, **tail;
+} layoutCtx;
+
+typedef struct layoutEdge {
+    irBlock *from, *to;
+    int weight;
+    ///DFS numbers of the ends, to break ties deterministically
+    int fromPre, toPre;
+} layoutEdge;
+
+typedef struct layoutHead {
+    irBlock* block;
+    bool cold;
+    int pre;
+} layoutHead;
+
+/*Heuristic branch probabilities, in percent*/
+enum {
+    layoutProbBackEdge = 88,
+    layoutProbLoopExit = 10,
+    layoutProbReturn = 20,
+    layoutProbEqual = 40,
+    /*Block frequency multiplies by this much per level of loop nesting,
+      up to a limit to keep the weights in an int*/
+    layoutLoopScaleShift = 3,
+    layoutLoopMaxDepth = 6
+};
+
+static int layoutIndex (const irBlock* block) {
+    return block->nthChild;
+}
+
+static bool layoutIsReachable (const layoutCtx* ctx, const irBlock* block) {
+    return ctx->pre[layoutIndex(block)] >= 0;
+}
+
+/**
+ * from -> to is a back edge iff to is an ancestor of from in the DFS tree
+ */
+static bool layoutIsBackEdge (const layoutCtx* ctx, const irBlock* from, const irBlock* to) {
+    int f = layoutIndex(from), t = layoutIndex(to);
+    return ctx->pre[t] <= ctx->pre[f] && ctx->post[t] >= ctx->post[f];
+}
+
+/**
+ * Does the block lead straight to the epilogue?
+ */
+static bool layoutIsReturn (const layoutCtx* ctx, const irBlock* block) {
+    return    block->term->tag == termJump
+           && block->term->to == ctx->fn->epilogue;
+}
+
+/*==== Analysis ====*/
+
+/**
+ * Number the blocks in depth first order, from the prologue. Iterative, as
+ * large functions have deep CFGs.
+ */
+static void layoutNumber (layoutCtx* ctx, int blockNo) {
+    int preNo = 0, postNo = 0;
+
+    vector/*<irBlock*>*/ stack;
+    vectorInit(&stack, blockNo);
+
+    /*The next successor of each block on the stack to visit*/
+    int* nextSucc = calloc(blockNo, sizeof(int));
+
+    vectorPush(&stack, ctx->fn->prologue);
+    ctx->pre[layoutIndex(ctx->fn->prologue)] = preNo++;
+
+    while (stack.length != 0) {
+        irBlock* block = vectorGet(&stack, stack.length-1);
+        int i = layoutIndex(block);
+
+        if (nextSucc[i] < block->succs.length) {
+            irBlock* succ = vectorGet(&block->succs, nextSucc[i]++);
+
+            if (ctx->pre[layoutIndex(succ)] < 0) {
+                ctx->pre[layoutIndex(succ)] = preNo++;
+                vectorPush(&stack, succ);
+            }
+
+        } else {
+            ctx->post[i] = postNo++;
+            vectorPop(&stack);
+        }
+    }
+
+    free(nextSucc);
+    vectorFree(&stack);
+}
+
+/**
+ * Increment the loop depth of every block in the natural loop of each back
+ * edge: the header, and every block reaching the source without passing
+ * through the header.
+ */
+static void layoutLoops (layoutCtx* ctx, int blockNo) {
+    int* visited = calloc(blockNo, sizeof(int));
+    int loopNo = 0;
+
+    vector/*<irBlock*>*/ worklist;
+    vectorInit(&worklist, 8);
+
+    for (int i = 0; i < ctx->fn->blocks.length; i++) {
+        irBlock* block = vectorGet(&ctx->fn->blocks, i);
+
+        if (!layoutIsReachable(ctx, block))
+            continue;
+
+        for (int j = 0; j < block->succs.length; j++) {
+            irBlock* header = vectorGet(&block->succs, j);
+
+            if (!layoutIsBackEdge(ctx, block, header))
+                continue;
+
+            /*Mark with a new generation number for this loop*/
+            loopNo++;
+            visited[layoutIndex(header)] = loopNo;
+            ctx->loopDepth[layoutIndex(header)]++;
+
+            vectorPush(&worklist, block);
+
+            while (worklist.length != 0) {
+                irBlock* current = vectorPop(&worklist);
+
+                if (visited[layoutIndex(current)] == loopNo)
+                    continue;
+
+                visited[layoutIndex(current)] = loopNo;
+                ctx->loopDepth[layoutIndex(current)]++;
+
+                for (int k = 0; k < current->preds.length; k++)
+                    vectorPush(&worklist, vectorGet(&current->preds, k));
+            }
+        }
+    }
+
+    vectorFree(&worklist);
+    free(visited);
+}
+
+/**
+ * Estimate the chance of a conditional branch being taken. The first
+ * heuristic that applies is used.
+ */
+static int layoutBranchProb (layoutCtx* ctx, const irBlock* block) {
+    const irTerm* term = block->term;
+    irBlock *ifTrue = term->ifTrue, *ifFalse = term->ifFalse;
+
+    int depth = ctx->loopDepth[layoutIndex(block)];
+
+    /*Loop branch: back edges are likely*/
+
+    if (layoutIsBackEdge(ctx, block, ifTrue))
+        return layoutProbBackEdge;
+
+    else if (layoutIsBackEdge(ctx, block, ifFalse))
+        return 100-layoutProbBackEdge;
+
+    /*Loop exit: leaving a loop is unlikely*/
+
+    bool exitTrue = ctx->loopDepth[layoutIndex(ifTrue)] < depth,
+         exitFalse = ctx->loopDepth[layoutIndex(ifFalse)] < depth;
+
+    if (exitTrue && !exitFalse)
+        return layoutProbLoopExit;
+
+    else if (exitFalse && !exitTrue)
+        return 100-layoutProbLoopExit;
+
+    /*Return: returning early is unlikely, usually an error path*/
+
+    bool returnTrue = layoutIsReturn(ctx, ifTrue),
+         returnFalse = layoutIsReturn(ctx, ifFalse);
+
+    if (returnTrue && !returnFalse) {
+        ctx->unlikelyReturn[layoutIndex(block)] = ifTrue;
+        return layoutProbReturn;
+
+    } else if (returnFalse && !returnTrue) {
+        ctx->unlikelyReturn[layoutIndex(block)] = ifFalse;
+        return 100-layoutProbReturn;
+    }
+
+    /*Equality: a value rarely equals one particular other*/
+
+    if (term->cond.condition == conditionEqual)
+        return layoutProbEqual;
+
+    else if (term->cond.condition == conditionNotEqual)
+        return 100-layoutProbEqual;
+
+    return 50;
+}
+
+static void layoutProbs (layoutCtx* ctx) {
+    for (int i = 0; i < ctx->fn->blocks.length; i++) {
+        irBlock* block = vectorGet(&ctx->fn->blocks, i);
+
+        if (layoutIsReachable(ctx, block) && block->term->tag == termBranch)
+            ctx->prob[i] = layoutBranchProb(ctx, block);
+    }
+
+    /*Cold if every way into the block was predicted an unlikely return*/
+    for (int i = 0; i < ctx->fn->blocks.length; i++) {
+        irBlock* block = vectorGet(&ctx->fn->blocks, i);
+
+        if (!layoutIsReachable(ctx, block) || block == ctx->fn->epilogue)
+            continue;
+
+        bool cold = false;
+
+        for (int j = 0; j < block->preds.length; j++) {
+            irBlock* pred = vectorGet(&block->preds, j);
+
+            if (!layoutIsReachable(ctx, pred))
+                continue;
+
+            else if (ctx->unlikelyReturn[layoutIndex(pred)] == block)
+                cold = true;
+
+            else {
+                cold = false;
+                break;
+            }
+        }
+
+        ctx->cold[i] = cold;
+    }
+}
+
+/*==== Chains ====*/
+
+static int layoutFind (layoutCtx* ctx, int i) {
+    while (ctx->leader[i] != i) {
+        ctx->leader[i] = ctx->leader[ctx->leader[i]];
+        i = ctx->leader[i];
+    }
+
+    return i;
+}
+
+static void layoutAddEdge (layoutCtx* ctx, vector/*<layoutEdge*>*/* edges,
+                           irBlock* from, irBlock* to, int prob) {
+    /*Cold blocks are chained only amongst themselves.
+      Back edges are left as branches, rotating the loop so that its exit
+      falls through instead.*/
+    if (   ctx->cold[layoutIndex(from)] != ctx->cold[layoutIndex(to)]
+        || layoutIsBackEdge(ctx, from, to))
+        return;
+
+    int depth = ctx->loopDepth[layoutIndex(from)];
+
+    if (depth > layoutLoopMaxDepth)
+        depth = layoutLoopMaxDepth;
+
+    layoutEdge* edge = malloc(sizeof(layoutEdge));
+    edge->from = from;
+    edge->to = to;
+    edge->weight = prob << (layoutLoopScaleShift*depth);
+    edge->fromPre = ctx->pre[layoutIndex(from)];
+    edge->toPre = ctx->pre[layoutIndex(to)];
+    vectorPush(edges, edge);
+}
+
+/**
+ * Collect the edges that could become fall throughs
+ */
+static void layoutEdges (layoutCtx* ctx, vector/*<layoutEdge*>*/* edges) {
+    for (int i = 0; i < ctx->fn->blocks.length; i++) {
+        irBlock* block = vectorGet(&ctx->fn->blocks, i);
+
+        if (!layoutIsReachable(ctx, block))
+            continue;
+
+        irTerm* term = block->term;
+
+        if (term->tag == termJump)
+            layoutAddEdge(ctx, edges, block, term->to, 100);
+
+        else if (term->tag == termBranch) {
+            layoutAddEdge(ctx, edges, block, term->ifTrue, ctx->prob[i]);
+            layoutAddEdge(ctx, edges, block, term->ifFalse, 100-ctx->prob[i]);
+
+        } else if (term->tag == termCall || term->tag == termCallIndirect)
+            layoutAddEdge(ctx, edges, block, term->ret, 100);
+    }
+}
+
+static int layoutEdgeCmp (const void* l, const void* r) {
+    const layoutEdge *L = *(const layoutEdge**) l,
+                     *R = *(const layoutEdge**) r;
+
+    /*Heaviest first, then in DFS order*/
+    if (L->weight != R->weight)
+        return L->weight > R->weight ? -1 : 1;
+
+    else if (L->fromPre != R->fromPre)
+        return L->fromPre - R->fromPre;
+
+    else
+        return L->toPre - R->toPre;
+}
+
+static void layoutChains (layoutCtx* ctx) {
+    vector/*<layoutEdge*>*/ edges;
+    vectorInit(&edges, ctx->fn->blocks.length*2);
+
+    layoutEdges(ctx, &edges);
+
+    qsort(edges.buffer, edges.length, sizeof(void*), layoutEdgeCmp);
+
+    for (int i = 0; i < edges.length; i++) {
+        layoutEdge* edge = vectorGet(&edges, i);
+
+        int from = layoutFind(ctx, layoutIndex(edge->from)),
+            to = layoutFind(ctx, layoutIndex(edge->to));
+
+        /*Join if the edge goes tail to head of different chains.
+          Nothing falls into the prologue.*/
+        if (   from != to
+            && ctx->tail[from] == edge->from
+            && ctx->head[to] == edge->to
+            && edge->to != ctx->fn->prologue) {
+            ctx->next[layoutIndex(edge->from)] = edge->to;
+            ctx->leader[to] = from;
+            ctx->tail[from] = ctx->tail[to];
+        }
+    }
+
+    vectorFreeObjs(&edges, free);
+}
+
+static int layoutHeadCmp (const void* l, const void* r) {
+    const layoutHead *L = l, *R = r;
+
+    /*Cold last, then in DFS order, which puts the prologue first*/
+    if (L->cold != R->cold)
+        return L->cold ? 1 : -1;
+
+    else
+        return L->pre - R->pre;
+}
+
+/*==== ====*/
+
+void irLayoutFn (const irFn* fn, vector/*<irBlock*>*/* order) {
+    int blockNo = fn->blocks.length;
+
+    layoutCtx ctx = {
+        .fn = fn,
+        .pre = malloc(blockNo*sizeof(int)),
+        .post = malloc(blockNo*sizeof(int)),
+        .loopDepth = calloc(blockNo, sizeof(int)),
+        .prob = calloc(blockNo, sizeof(int)),
+        .unlikelyReturn = calloc(blockNo, sizeof(irBlock*)),
+        .cold = calloc(blockNo, sizeof(bool)),
+        .next = calloc(blockNo, sizeof(irBlock*)),
+        .leader = malloc(blockNo*sizeof(int)),
+        .head = malloc(blockNo*sizeof(irBlock*)),
+        .tail = malloc(blockNo*sizeof(irBlock*))
+    };
+
+    for (int i = 0; i < blockNo; i++) {
+        irBlock* block = vectorGet(&fn->blocks, i);
+        ctx.pre[i] = ctx.post[i] = -1;
+        ctx.leader[i] = i;
+        ctx.head[i] = ctx.tail[i] = block;
+    }
+
+    layoutNumber(&ctx, blockNo);
+    layoutLoops(&ctx, blockNo);
+    layoutProbs(&ctx);
+    layoutChains(&ctx);
+
+    /*Order the chains by their heads*/
+
+    layoutHead* heads = malloc(blockNo*sizeof(layoutHead));
+    int headNo = 0;
+
+    for (int i = 0; i < blockNo; i++) {
+        irBlock* block = vectorGet(&fn->blocks, i);
+
+        if (layoutIsReachable(&ctx, block) && ctx.head[layoutFind(&ctx, i)] == block)
+            heads[headNo++] = (layoutHead) {block, ctx.cold[i], ctx.pre[i]};
+    }
+
+    qsort(heads, headNo, sizeof(layoutHead), layoutHeadCmp);
+
+    /*Emit each chain in turn*/
+
+    for (int i = 0; i < headNo; i++)
+        for (irBlock* block = heads[i].block;
+             block;
+             block = ctx.next[layoutIndex(block)])
+            vectorPush(order, block);
+
+    free(heads);
+
+    free(ctx.pre);
+    free(ctx.post);
+    free(ctx.loopDepth);
+    free(ctx.prob);
+    free(ctx.unlikelyReturn);
+    free(ctx.cold);
+    free(ctx.next);
+    free(ctx.leader);
+    free(ctx.head);
+    free(ctx.tail);
+}
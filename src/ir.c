@@ -1,6 +1,7 @@
 #include "../inc/ir.h"
 
 #include "../inc/vector.h"
+#include "../inc/hashmap.h"
 #include "../inc/debug.h"
 #include "../inc/operand.h"
 #include "../inc/asm.h"
@@ -18,6 +19,7 @@ static void irAddROData (irCtx* ctx, irStaticData* data);
 
 static irStaticData* irStaticDataCreate (irCtx* ctx, bool ro, irStaticDataTag tag);
 static void irStaticDataDestroy (irStaticData* data);
+static void irStaticDataSetRefs (irStaticData* data, vector* refs);
 
 /*==== ====*/
 
@@ -54,32 +56,77 @@ static void irReturn (irBlock* block);
 enum {
     irCtxFnNo = 8,
     irCtxDataNo = 8,
-    irCtxRODataNo = 64,
+    irCtxRODataNo = 8,
+    irCtxStringNo = 64,
+    irCtxRenderedNo = 8,
     irFnBlockNo = 8,
     irBlockInstrNo = 8,
-    irBlockStrSize = 1024,
+    irFnStrSize = 4096,
+    irFnSpanNo = 64,
     irBlockPredNo = 2,
     irBlockSuccNo = 2
 };
 
 /*==== IR context ====*/
 
-void irInit (irCtx* ctx, const char* output, const architecture* arch) {
+void irInit (irCtx* ctx, const char* output, const char* assembler, const architecture* arch) {
     vectorInit(&ctx->fns, irCtxFnNo);
     vectorInit(&ctx->data, irCtxDataNo);
     vectorInit(&ctx->rodata, irCtxRODataNo);
+    vectorInit(&ctx->strings, irCtxStringNo);
+    hashmapInit(&ctx->stringPool, irCtxStringNo);
 
     ctx->labelNo = 0;
+    ctx->fragment = -1;
+    vectorInit(&ctx->rendered, irCtxRenderedNo);
 
-    ctx->asm = asmInit(output, arch);
+    regsInit(ctx->regs);
+    ctx->asm = asmInit(output, assembler, arch, ctx->regs);
     ctx->arch = arch;
 }
 
-void irFree (irCtx* ctx) {
+void irInitFragment (irCtx* ctx, int n, const architecture* arch) {
+    irInit(ctx, 0, 0, arch);
+    ctx->fragment = n;
+}
+
+static void irFreeContents (irCtx* ctx) {
     vectorFreeObjs(&ctx->fns, (vectorDtor) irFnDestroy);
     vectorFreeObjs(&ctx->data, (vectorDtor) irStaticDataDestroy);
     vectorFreeObjs(&ctx->rodata, (vectorDtor) irStaticDataDestroy);
-    asmEnd(ctx->asm);
+    /*Keys are owned by the string constants*/
+    hashmapFree(&ctx->stringPool);
+    vectorFreeObjs(&ctx->strings, (vectorDtor) irStaticDataDestroy);
+    vectorFreeObjs(&ctx->rendered, free);
+}
+
+bool irFree (irCtx* ctx) {
+    irFreeContents(ctx);
+    return asmEnd(ctx->asm);
+}
+
+char* irFreeBuffer (irCtx* ctx) {
+    irFreeContents(ctx);
+    return asmEndBuffer(ctx->asm);
+}
+
+void irMerge (irCtx* ctx, irCtx* fragment) {
+    vectorPushFromVector(&ctx->data, &fragment->data);
+    vectorPushFromVector(&ctx->rodata, &fragment->rodata);
+    fragment->data.length = 0;
+    fragment->rodata.length = 0;
+
+    /*Pooled again, so the same content might now appear under several
+      labels. irEmitStrings lays those over each other.*/
+    vectorPushFromVector(&ctx->strings, &fragment->strings);
+    fragment->strings.length = 0;
+
+    char* text = asmEndBuffer(fragment->asm);
+
+    if (text)
+        vectorPush(&ctx->rendered, text);
+
+    irFreeContents(fragment);
 }
 
 static void irAddFn (irCtx* ctx, irFn* fn) {
@@ -94,12 +141,36 @@ static void irAddROData (irCtx* ctx, irStaticData* data) {
     vectorPush(&ctx->rodata, data);
 }
 
-static char* irCreateLabel (irCtx* ctx) {
-    char* label = malloc(10);
-    sprintf(label, ".%04X", ctx->labelNo++);
+/*As ".%04X", returning the end*/
+static char* irLabelWriteNo (char* label, unsigned int n) {
+    unsigned int digits = 4;
+
+    while (digits < 8 && n >> 4*digits)
+        digits++;
+
+    *label++ = '.';
+
+    for (unsigned int shift = 4*digits; shift != 0; shift -= 4)
+        *label++ = "0123456789ABCDEF"[(n >> (shift-4)) & 0xF];
+
+    return label;
+}
+
+/*Formatted by hand, as block labels are each written out several times*/
+static char* irLabelGetStr (const irCtx* ctx, int labelNo, char* label) {
+    char* end = label;
+
+    if (ctx->fragment >= 0)
+        end = irLabelWriteNo(end, (unsigned int) ctx->fragment);
+
+    *irLabelWriteNo(end, (unsigned int) labelNo) = 0;
     return label;
 }
 
+char* irCreateLabel (irCtx* ctx) {
+    return irLabelGetStr(ctx, ctx->labelNo++, malloc(irLabelMax));
+}
+
 /*==== Function internals ====*/
 
 irFn* irFnCreate (irCtx* ctx, const char* name, int stacksize) {
@@ -107,6 +178,12 @@ irFn* irFnCreate (irCtx* ctx, const char* name, int stacksize) {
     fn->name = name ? strdup(name) : irCreateLabel(ctx);
     vectorInit(&fn->blocks, irFnBlockNo);
 
+    bufferInit(&fn->out, irFnStrSize, 0);
+    fn->lineStart = 0;
+    fn->spans = malloc(sizeof(irSpan)*irFnSpanNo);
+    fn->spanNo = 0;
+    fn->spanCapacity = irFnSpanNo;
+
     /*These will get added to fn->blocks, which now owns them*/
     fn->prologue = irBlockCreate(ctx, fn);
     fn->entryPoint = irBlockCreate(ctx, fn);
@@ -125,6 +202,8 @@ irFn* irFnCreate (irCtx* ctx, const char* name, int stacksize) {
 
 static void irFnDestroy (irFn* fn) {
     vectorFreeObjs(&fn->blocks, (vectorDtor) irBlockDestroy);
+    bufferFree(&fn->out);
+    free(fn->spans);
     free(fn->name);
     free(fn);
 }
@@ -139,11 +218,11 @@ irBlock* irBlockCreate (irCtx* ctx, irFn* fn) {
     irBlock* block = malloc(sizeof(irBlock));
     vectorInit(&block->instrs, irBlockInstrNo);
     block->term = 0;
-    block->label = irCreateLabel(ctx);
+    block->fn = fn;
+    block->label = ctx->labelNo++;
 
-    block->str = calloc(irBlockStrSize, sizeof(char*));
-    block->length = 0;
-    block->capacity = irBlockStrSize;
+    block->firstSpan = -1;
+    block->lastSpan = -1;
 
     vectorInit(&block->preds, irBlockPredNo);
     vectorInit(&block->succs, irBlockSuccNo);
@@ -160,8 +239,6 @@ static void irBlockDestroy (irBlock* block) {
     vectorFreeObjs(&block->instrs, (vectorDtor) irInstrDestroy);
     irTermDestroy(block->term);
 
-    free(block->label);
-    free(block->str);
     free(block);
 }
 
@@ -173,28 +250,59 @@ int irBlockGetSuccNo (irBlock* block) {
     return block->succs.length + (block->term->tag == termCall || block->term->tag == termCallIndirect ? 1 : 0);
 }
 
+const char* irBlockGetLabel (const irCtx* ctx, const irBlock* block, char* label) {
+    return irLabelGetStr(ctx, block->label, label);
+}
+
 void irBlockOut (irBlock* block, const char* format, ...) {
-    va_list args[2];
-    va_start(args[0], format);
-    va_copy(args[1], args[0]);
-    debugVarMsg(format, args[1]);
-    va_end(args[1]);
-
-    int length = vsnprintf(block->str+block->length, block->capacity-block->length, format, args[0]);
-    va_end(args[0]);
-
-    if (length < 0 || block->length+length >= block->capacity) {
-        block->capacity *= 2;
-        block->capacity += length+2;
-        block->str = realloc(block->str, block->capacity);
-
-        va_start(args[0], format);
-        vsnprintf(block->str+block->length, block->capacity, format, args[0]);
-        va_end(args[0]);
+    va_list args;
+    va_start(args, format);
+    bufferVarFormat(irBlockBeginLn(block), format, args);
+    va_end(args);
+
+    irBlockEndLn(block);
+}
+
+buffer* irBlockBeginLn (irBlock* block) {
+    block->fn->lineStart = block->fn->out.length;
+    return &block->fn->out;
+}
+
+void irBlockEndLn (irBlock* block) {
+    irFn* fn = block->fn;
+
+    #ifdef FCC_DEBUGMODE
+    debugMsg("%.*s", fn->out.length - fn->lineStart, fn->out.str + fn->lineStart);
+    #endif
+
+    bufferChar(&fn->out, '\n');
+
+    /*Continuing the block's last span, unless another block wrote since*/
+    irSpan* last = block->lastSpan < 0 ? 0 : &fn->spans[block->lastSpan];
+
+    if (last && last->start + last->length == fn->lineStart) {
+        last->length = fn->out.length - last->start;
+        return;
+    }
+
+    if (fn->spanNo == fn->spanCapacity) {
+        fn->spanCapacity *= 2;
+        fn->spans = realloc(fn->spans, sizeof(irSpan)*fn->spanCapacity);
+        last = block->lastSpan < 0 ? 0 : &fn->spans[block->lastSpan];
     }
 
-    block->length += length;
-    block->str[block->length++] = '\n';
+    int n = fn->spanNo++;
+    fn->spans[n].start = fn->lineStart;
+    fn->spans[n].length = fn->out.length - fn->lineStart;
+    fn->spans[n].next = -1;
+
+    if (last)
+        last->next = n;
+
+    else
+        block->firstSpan = n;
+
+    block->lastSpan = n;
 }
 
 static void irAddInstr (irBlock* block, irInstr* instr) {
@@ -227,7 +335,12 @@ static irStaticData* irStaticDataCreate (irCtx* ctx, bool ro, irStaticDataTag ta
 }
 
 static void irStaticDataDestroy (irStaticData* data) {
-    if (data->tag == dataStringConstant) {
+    if (data->tag == dataBytes) {
+        free(data->byteslabel);
+        free(data->bytes);
+        vectorFreeObjs(&data->refs, free);
+
+    } else if (data->tag == dataStringConstant) {
         free(data->strlabel);
         free(data->str);
     }
@@ -235,6 +348,17 @@ static void irStaticDataDestroy (irStaticData* data) {
     free(data);
 }
 
+static int irStaticRefCmp (const void* l, const void* r) {
+    return   (*(const irStaticRef**) l)->offset
+           - (*(const irStaticRef**) r)->offset;
+}
+
+/*Takes ownership of refs, in order of offset*/
+static void irStaticDataSetRefs (irStaticData* data, vector* refs) {
+    data->refs = *refs;
+    qsort(data->refs.buffer, data->refs.length, sizeof(irStaticRef*), irStaticRefCmp);
+}
+
 /*==== Static data ====*/
 
 void irStaticValue (irCtx* ctx, const char* label, bool global, int size, intptr_t initial) {
@@ -245,12 +369,41 @@ void irStaticValue (irCtx* ctx, const char* label, bool global, int size, intptr
     data->initial = initial;
 }
 
+void irStaticBytes (irCtx* ctx, const char* label, bool global, bool ro, int size, char* bytes,
+                    vector/*<irStaticRef*>*/* refs) {
+    irStaticData* data = irStaticDataCreate(ctx, ro, dataBytes);
+    data->byteslabel = strdup(label);
+    data->bytesglobal = global;
+    data->bytesno = size;
+    data->bytes = bytes;
+    irStaticDataSetRefs(data, refs);
+}
+
+operand irROBytes (irCtx* ctx, int size, char* bytes, vector/*<irStaticRef*>*/* refs) {
+    irStaticData* data = irStaticDataCreate(ctx, true, dataBytes);
+    data->byteslabel = irCreateLabel(ctx);
+    data->bytesglobal = false;
+    data->bytesno = size;
+    data->bytes = bytes;
+    irStaticDataSetRefs(data, refs);
+
+    return operandCreateLabelOffset(data->byteslabel);
+}
+
 operand irStringConstant (irCtx* ctx, const char* str) {
-    irStaticData* data = irStaticDataCreate(ctx, true, dataStringConstant);
-    data->strlabel = irCreateLabel(ctx);
-    data->str = (void*) strdup(str);
+    irStaticData* data = hashmapMap(&ctx->stringPool, str);
+
+    if (!data) {
+        data = malloc(sizeof(irStaticData));
+        data->tag = dataStringConstant;
+        data->strlabel = irCreateLabel(ctx);
+        data->str = strdup(str);
+
+        vectorPush(&ctx->strings, data);
+        hashmapAdd(&ctx->stringPool, data->str, data);
+    }
 
-    return operandCreateLabelOffset(data->label);
+    return operandCreateLabelOffset(data->strlabel);
 }
 
 /*==== Instruction internals ====*/
@@ -294,6 +447,11 @@ static irTerm* irTermCreate (irTermTag tag, irBlock* block) {
 }
 
 static void irTermDestroy (irTerm* term) {
+    if (term && term->tag == termJumpTable) {
+        free(term->tableLabel);
+        vectorFree(&term->table);
+    }
+
     free(term);
 }
 
@@ -336,6 +494,21 @@ void irCallIndirect (irBlock* block, operand to, irBlock* ret) {
     asmCallIndirect(block, to);
 }
 
+void irJumpTable (irCtx* ctx, irBlock* block, operand index, const vector/*<irBlock*>*/* table) {
+    irTerm* term = irTermCreate(termJumpTable, block);
+    term->tableLabel = irCreateLabel(ctx);
+    vectorInit(&term->table, table->length);
+    vectorPushFromVector(&term->table, table);
+
+    /*Link every entry, not just every distinct target, so that each
+      target keeps a label and the links unwind symmetrically on deletion*/
+    for (int i = 0; i < table->length; i++)
+        irBlockLink(block, vectorGet(table, i));
+
+    /*As with irCallIndirect, emit the jump now while the index is valid*/
+    asmJumpTable(ctx, block, term->tableLabel, index);
+}
+
 static void irReturn (irBlock* block) {
     irTermCreate(termReturn, block);
 }
@@ -378,19 +551,17 @@ void irBlocksCombine (irFn* fn, irBlock* pred, irBlock* succ) {
     pred->term = succ->term;
     succ->term = 0;
 
-    /*Cat the strings*/
-
-    int totalLength = pred->length + succ->length-1;
+    /*Link up the assembly, no copying needed*/
+    if (succ->firstSpan < 0)
+        ;
 
-    if (pred->capacity >= totalLength) {
-        strncat(pred->str, succ->str, pred->capacity);
-        pred->length = totalLength;
+    else if (pred->lastSpan < 0) {
+        pred->firstSpan = succ->firstSpan;
+        pred->lastSpan = succ->lastSpan;
 
     } else {
-        char* str = malloc(totalLength);
-        snprintf(str, totalLength, "%s%s", pred->str, succ->str);
-        free(pred->str);
-        pred->str = str;
+        fn->spans[pred->lastSpan].next = succ->firstSpan;
+        pred->lastSpan = succ->lastSpan;
     }
 
     /*Link to the succs of the succ*/
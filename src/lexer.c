@@ -4,96 +4,258 @@
 #include "../inc/debug.h"
 
 #include "../inc/stream.h"
+#include "../inc/scan.h"
+#include "../inc/pool.h"
 
 #include "stdlib.h"
 #include "string.h"
-#include "ctype.h"
 
-static void lexerSkipInsignificants (lexerCtx* ctx);
-static void lexerEat (lexerCtx* ctx, char c);
-static void lexerEatNext (lexerCtx* ctx);
-static bool lexerTryEatNext (lexerCtx* ctx, char c);
-
-static void lexerPunct (lexerCtx* ctx);
+/*What to make of a #*/
+typedef enum lexerMode {
+    ///A line to skip, as a comment
+    lexerPlain,
+    ///A directive, at the start of a line, otherwise a punctuator
+    lexerDirectives,
+    ///Always a punctuator, within a directive
+    lexerLine
+} lexerMode;
+
+static void lexerSkipInsignificants (streamCtx* stream, lexerMode mode);
+static punctTag lexerPunct (streamCtx* stream);
 static keywordTag lookKeyword (const char* str, int length);
 
-lexerCtx* lexerInit (const char* filename) {
-    lexerCtx* ctx = malloc(sizeof(lexerCtx));
-    ctx->stream = streamInit(filename);
-    ctx->line = 1;
-    ctx->lineChar = 1;
+/*==== Tables ====*/
+
+/*Character classes, as bits. Unlike ctype.h, unaffected by locale.*/
+enum {
+    classIdent = 1,
+    classDigit = 2
+};
+
+static const unsigned char lexerClasses[256] = {
+    ['0'] = classDigit, ['1'] = classDigit, ['2'] = classDigit, ['3'] = classDigit, ['4'] = classDigit,
+    ['5'] = classDigit, ['6'] = classDigit, ['7'] = classDigit, ['8'] = classDigit, ['9'] = classDigit,
+
+    ['A'] = classIdent, ['B'] = classIdent, ['C'] = classIdent, ['D'] = classIdent, ['E'] = classIdent,
+    ['F'] = classIdent, ['G'] = classIdent, ['H'] = classIdent, ['I'] = classIdent, ['J'] = classIdent,
+    ['K'] = classIdent, ['L'] = classIdent, ['M'] = classIdent, ['N'] = classIdent, ['O'] = classIdent,
+    ['P'] = classIdent, ['Q'] = classIdent, ['R'] = classIdent, ['S'] = classIdent, ['T'] = classIdent,
+    ['U'] = classIdent, ['V'] = classIdent, ['W'] = classIdent, ['X'] = classIdent, ['Y'] = classIdent,
+    ['Z'] = classIdent,
+
+    ['a'] = classIdent, ['b'] = classIdent, ['c'] = classIdent, ['d'] = classIdent, ['e'] = classIdent,
+    ['f'] = classIdent, ['g'] = classIdent, ['h'] = classIdent, ['i'] = classIdent, ['j'] = classIdent,
+    ['k'] = classIdent, ['l'] = classIdent, ['m'] = classIdent, ['n'] = classIdent, ['o'] = classIdent,
+    ['p'] = classIdent, ['q'] = classIdent, ['r'] = classIdent, ['s'] = classIdent, ['t'] = classIdent,
+    ['u'] = classIdent, ['v'] = classIdent, ['w'] = classIdent, ['x'] = classIdent, ['y'] = classIdent,
+    ['z'] = classIdent,
+
+    ['_'] = classIdent
+};
+
+/*The punctuator a character begins, if any*/
+static const unsigned char lexerPuncts[256] = {
+    ['{'] = punctLBrace, ['}'] = punctRBrace,
+    ['('] = punctLParen, [')'] = punctRParen,
+    ['['] = punctLBracket, [']'] = punctRBracket,
+    [';'] = punctSemicolon, ['.'] = punctPeriod, [','] = punctComma,
+    ['='] = punctAssign, ['!'] = punctLogicalNot,
+    ['>'] = punctGreater, ['<'] = punctLess,
+    ['?'] = punctQuestion, [':'] = punctColon,
+    ['&'] = punctBitwiseAnd, ['|'] = punctBitwiseOr,
+    ['^'] = punctBitwiseXor, ['~'] = punctBitwiseNot,
+    ['+'] = punctPlus, ['-'] = punctMinus,
+    ['*'] = punctTimes, ['/'] = punctDivide, ['%'] = punctModulo,
+    ['#'] = punctHash
+};
+
+/*The characters that may continue a punctuator*/
+enum {
+    followNone,
+    followEqual, followGreater, followLess, followAnd, followOr, followPlus, followMinus,
+    followHash,
+    followNo
+};
+
+static const unsigned char lexerFollows[256] = {
+    ['='] = followEqual, ['>'] = followGreater, ['<'] = followLess,
+    ['&'] = followAnd, ['|'] = followOr, ['+'] = followPlus, ['-'] = followMinus,
+    ['#'] = followHash
+};
+
+/*The longer punctuator made by following one with a character, if any.
+  Periods are handled separately, as ".." isn't one.*/
+static const unsigned char lexerPunctAfter[punctMax][followNo] = {
+    [punctAssign] = {[followEqual] = punctEqual},
+    [punctLogicalNot] = {[followEqual] = punctNotEqual},
+    [punctGreater] = {[followEqual] = punctGreaterEqual, [followGreater] = punctShr},
+    [punctShr] = {[followEqual] = punctShrAssign},
+    [punctLess] = {[followEqual] = punctLessEqual, [followLess] = punctShl},
+    [punctShl] = {[followEqual] = punctShlAssign},
+    [punctBitwiseAnd] = {[followEqual] = punctBitwiseAndAssign, [followAnd] = punctLogicalAnd},
+    [punctBitwiseOr] = {[followEqual] = punctBitwiseOrAssign, [followOr] = punctLogicalOr},
+    [punctBitwiseXor] = {[followEqual] = punctBitwiseXorAssign},
+    [punctPlus] = {[followEqual] = punctPlusAssign, [followPlus] = punctPlusPlus},
+    [punctMinus] = {[followEqual] = punctMinusAssign, [followMinus] = punctMinusMinus,
+                    [followGreater] = punctArrow},
+    [punctTimes] = {[followEqual] = punctTimesAssign},
+    [punctDivide] = {[followEqual] = punctDivideAssign},
+    [punctModulo] = {[followEqual] = punctModuloAssign},
+    [punctHash] = {[followHash] = punctHashHash}
+};
+
+/*The spelling of each keyword. makekeywords.sh generates the hash table
+  of lookKeyword from these, so each must be on a line of its own.*/
+static const char* const keywordStrs[] = {
+    [keywordUsing] = "using",
+    [keywordIf] = "if",
+    [keywordElse] = "else",
+    [keywordWhile] = "while",
+    [keywordDo] = "do",
+    [keywordFor] = "for",
+    [keywordSwitch] = "switch",
+    [keywordCase] = "case",
+    [keywordDefault] = "default",
+    [keywordReturn] = "return",
+    [keywordBreak] = "break",
+    [keywordContinue] = "continue",
+    [keywordSizeof] = "sizeof",
+    [keywordConst] = "const",
+    [keywordAuto] = "auto",
+    [keywordStatic] = "static",
+    [keywordExtern] = "extern",
+    [keywordTypedef] = "typedef",
+    [keywordStruct] = "struct",
+    [keywordUnion] = "union",
+    [keywordEnum] = "enum",
+    [keywordVoid] = "void",
+    [keywordBool] = "bool",
+    [keywordChar] = "char",
+    [keywordInt] = "int",
+    [keywordTrue] = "true",
+    [keywordFalse] = "false",
+    [keywordVAStart] = "va_start",
+    [keywordVAEnd] = "va_end",
+    [keywordVAArg] = "va_arg",
+    [keywordVACopy] = "va_copy",
+    [keywordAssert] = "assert",
+};
+
+#include "../keywords.h"
+
+/*==== Token arrays ====*/
+
+enum {
+    ///The least of a file worth lexing on a thread of its own
+    lexerPartMin = 1 << 18
+};
+
+void lexerTokensInit (lexerTokens* tokens, int capacity) {
+    tokens->tags = malloc(capacity);
+    tokens->subtags = malloc(capacity);
+    tokens->starts = malloc(sizeof(uint32_t)*capacity);
+    tokens->lengths = malloc(sizeof(uint32_t)*capacity);
+    tokens->length = 0;
+    tokens->capacity = capacity;
+    tokens->text = 0;
+    tokens->locations = 0;
+}
 
-    ctx->token = tokenUndefined;
-    ctx->keyword = keywordUndefined;
-    ctx->punct = punctUndefined;
+void lexerTokensFree (lexerTokens* tokens) {
+    free(tokens->tags);
+    free(tokens->subtags);
+    free(tokens->starts);
+    free(tokens->lengths);
+    free(tokens->text);
+    free(tokens->locations);
+}
 
-    ctx->bufferSize = 64;
-    ctx->buffer = malloc(sizeof(char)*ctx->bufferSize);
-    return ctx;
+static void lexerTokensReserve (lexerTokens* tokens, int n) {
+    if (tokens->length + n <= tokens->capacity)
+        return;
+
+    tokens->capacity = max(2*tokens->capacity, tokens->length + n);
+    tokens->tags = realloc(tokens->tags, tokens->capacity);
+    tokens->subtags = realloc(tokens->subtags, tokens->capacity);
+    tokens->starts = realloc(tokens->starts, sizeof(uint32_t)*tokens->capacity);
+    tokens->lengths = realloc(tokens->lengths, sizeof(uint32_t)*tokens->capacity);
 }
 
-void lexerEnd (lexerCtx* ctx) {
-    streamEnd(ctx->stream);
-    free(ctx->buffer);
-    free(ctx);
+void lexerTokensPush (lexerTokens* tokens, tokenTag tag, int subtag, int start, int length) {
+    lexerTokensReserve(tokens, 1);
+
+    int i = tokens->length++;
+    tokens->tags[i] = (unsigned char) tag;
+    tokens->subtags[i] = (unsigned char) subtag;
+    tokens->starts[i] = (uint32_t) start;
+    tokens->lengths[i] = (uint32_t) length;
 }
 
+static void lexerTokensAppend (lexerTokens* tokens, const lexerTokens* from) {
+    lexerTokensReserve(tokens, from->length);
+
+    int i = tokens->length;
+    memcpy(tokens->tags + i, from->tags, from->length);
+    memcpy(tokens->subtags + i, from->subtags, from->length);
+    memcpy(tokens->starts + i, from->starts, sizeof(uint32_t)*from->length);
+    memcpy(tokens->lengths + i, from->lengths, sizeof(uint32_t)*from->length);
+    tokens->length += from->length;
+}
+
+/*==== Lexing ====*/
+
 /*Eat as many insignificants (comments, whitespace etc) as possible*/
-static void lexerSkipInsignificants (lexerCtx* ctx) {
+static void lexerSkipInsignificants (streamCtx* stream, lexerMode mode) {
     while (true) {
-        switch (ctx->stream->current) {
+        switch (stream->current) {
         /*Whitespace*/
         case ' ':
         case '\t':
         case '\n':
         case '\r':
-            streamNext(ctx->stream);
+            streamSkipWhile(stream, " \t\n\r");
             break;
 
         /*C preprocessor is treated as a comment*/
         case '#':
+            /*Unless it's wanted*/
+            if (mode != lexerPlain)
+                return;
+
             /*Eat until a new line*/
-            while (   ctx->stream->current != '\n'
-                   && ctx->stream->current != 0)
-                streamNext(ctx->stream);
+            streamSkipUntil(stream, "\n", 0);
 
-            streamNext(ctx->stream);
+            streamNext(stream);
             break;
 
         /*Comment?*/
         case '/':
-            streamNext(ctx->stream);
+            streamNext(stream);
 
             /*C comment*/
-            if (ctx->stream->current == '*') {
-                streamNext(ctx->stream);
+            if (stream->current == '*') {
+                streamNext(stream);
 
                 do {
-                    while (   ctx->stream->current != '*'
-                           && ctx->stream->current != 0)
-                        streamNext(ctx->stream);
+                    streamSkipUntil(stream, "*", 0);
 
-                    if (ctx->stream->current == 0)
+                    if (stream->current == 0)
                         break;
 
-                    streamNext(ctx->stream);
-                } while (   ctx->stream->current != '/'
-                         && ctx->stream->current != 0);
+                    streamNext(stream);
+                } while (   stream->current != '/'
+                         && stream->current != 0);
 
-                streamNext(ctx->stream);
+                streamNext(stream);
 
             /*C++ Comment*/
-            } else if (ctx->stream->current == '/') {
-                streamNext(ctx->stream);
-
-                while (   ctx->stream->current != '\n'
-                       && ctx->stream->current != '\r'
-                       && ctx->stream->current != 0)
-                    streamNext(ctx->stream);
+            } else if (stream->current == '/') {
+                streamNext(stream);
+                streamSkipUntil(stream, "\n\r", 0);
 
             /*Fuck, we just ate an important character. Backtrack!*/
             } else {
-                streamPrev(ctx->stream);
+                streamPrev(stream);
                 return;
             }
 
@@ -106,285 +268,377 @@ static void lexerSkipInsignificants (lexerCtx* ctx) {
     }
 }
 
-static void lexerEat (lexerCtx* ctx, char c) {
-    /*Buffer full? Double the size*/
-    if (ctx->length+1 == ctx->bufferSize)
-        ctx->buffer = realloc(ctx->buffer, ctx->bufferSize *= 2);
+/*Whether only spaces and tabs come before the current character on its line*/
+static bool lexerAtLineStart (const streamCtx* stream) {
+    int pos = stream->pos;
 
-    ctx->buffer[ctx->length++] = c;
-}
+    while (pos > 0 && (stream->str[pos-1] == ' ' || stream->str[pos-1] == '\t'))
+        pos--;
 
-static void lexerEatNext (lexerCtx* ctx) {
-    lexerEat(ctx, streamNext(ctx->stream));
+    return pos == 0 || stream->str[pos-1] == '\n';
 }
 
-static bool lexerTryEatNext (lexerCtx* ctx, char c) {
-    if (ctx->stream->current == c) {
-        lexerEatNext(ctx);
-        return true;
+/*Skip to the end of a preprocessor line, and of any lines it continues
+  onto with a backslash*/
+static void lexerSkipDirective (streamCtx* stream) {
+    while (true) {
+        streamSkipUntil(stream, "\n", 0);
 
-    } else
-        return false;
+        int last = stream->pos-1;
+
+        if (last >= 0 && stream->str[last] == '\r')
+            last--;
+
+        if (stream->current == 0 || last < 0 || stream->str[last] != '\\')
+            break;
+
+        streamNext(stream);
+    }
 }
 
-void lexerNext (lexerCtx* ctx) {
-    if (ctx->token == tokenEOF)
-        return;
+/*Lex the token at the front of the stream into the array, unless it
+  starts at or after the end given, or the stream has ended. Returns
+  whether it did.*/
+static bool lexerScan (streamCtx* stream, lexerTokens* tokens, int end, lexerMode mode) {
+    lexerSkipInsignificants(stream, mode);
 
-    lexerSkipInsignificants(ctx);
+    int start = stream->pos;
 
-    ctx->line = ctx->stream->line;
-    ctx->lineChar = ctx->stream->lineChar;
+    if (stream->current == 0 || start >= end)
+        return false;
 
-    ctx->length = 0;
-    ctx->keyword = keywordUndefined;
-    ctx->punct = punctUndefined;
+    tokenTag token;
+    int subtag = 0;
 
-    /*End of stream. Do not increment pos, as we could segfault.
-      Continued calls to this function will prepare more EOF tokens.*/
-    if (ctx->stream->current == 0)
-        ctx->token = tokenEOF;
+    /*A preprocessor line, as a whole*/
+    if (   mode == lexerDirectives && stream->current == '#'
+        && lexerAtLineStart(stream)) {
+        lexerSkipDirective(stream);
+        token = tokenDirective;
 
     /*Ident or keyword*/
-    else if (   isalpha(ctx->stream->current)
-             || ctx->stream->current == '_') {
-        lexerEatNext(ctx);
+    } else if (lexerClasses[(unsigned char) stream->current] & classIdent) {
+        do {
+            streamNext(stream);
+        } while (lexerClasses[(unsigned char) stream->current] & (classIdent | classDigit));
 
-        while (   isalnum(ctx->stream->current)
-               || ctx->stream->current == '_')
-            lexerEatNext(ctx);
+        keywordTag keyword = lookKeyword(stream->str + start, stream->pos - start);
+        token = keyword != keywordUndefined ? tokenKeyword : tokenIdent;
+        subtag = keyword;
 
-        lexerEat(ctx, 0);
+    /*Number*/
+    } else if (lexerClasses[(unsigned char) stream->current] & classDigit) {
+        token = tokenInt;
+
+        while (lexerClasses[(unsigned char) stream->current] & classDigit)
+            streamNext(stream);
+
+    /*String/character, its text being what's between the quotes*/
+    } else if (   stream->current == '"'
+               || stream->current == '\'') {
+        token = stream->current == '"' ? tokenStr : tokenChar;
+        char ends[] = {streamNext(stream), '\\', 0};
+
+        while (   stream->current != ends[0]
+               && stream->current != 0) {
+            /*Everything up to the close or an escape at once*/
+            streamSkipUntil(stream, ends, 0);
+
+            if (stream->current == '\\') {
+                streamNext(stream);
+                streamNext(stream);
+            }
+        }
 
-        ctx->keyword = lookKeyword(ctx->buffer, ctx->length);
-        ctx->token =   ctx->keyword != keywordUndefined
-                     ? tokenKeyword
-                     : tokenIdent;
+        lexerTokensPush(tokens, token, 0, start, stream->pos - (start+1));
+        streamNext(stream);
+        return true;
 
-    /*Number*/
-    } else if (isdigit(ctx->stream->current)) {
-        ctx->token = tokenInt;
+    /*Punctuation or an unrecognised character*/
+    } else {
+        punctTag punct = lexerPunct(stream);
+        token = punct != punctUndefined ? tokenPunct : tokenOther;
+        subtag = punct;
+    }
 
-        while (isdigit(ctx->stream->current))
-            lexerEatNext(ctx);
+    lexerTokensPush(tokens, token, subtag, start, stream->pos - start);
+    return true;
+}
 
-    /*String/character*/
-    } else if (   ctx->stream->current == '"'
-               || ctx->stream->current == '\'') {
-        ctx->token = ctx->stream->current == '"' ? tokenStr : tokenChar;
-        streamNext(ctx->stream);
+static punctTag lexerPunct (streamCtx* stream) {
+    punctTag punct = lexerPuncts[(unsigned char) streamNext(stream)];
 
-        while (   ctx->stream->current != (ctx->token == tokenStr ? '"' : '\'')
-               && ctx->stream->current != 0) {
-            if (ctx->stream->current == '\\')
-                lexerEatNext(ctx);
+    /*Oops, actually an unrecognised character*/
+    if (punct == punctUndefined)
+        return punct;
 
-            lexerEatNext(ctx);
-        }
+    if (punct == punctPeriod) {
+        if (stream->current == '.') {
+            streamNext(stream);
 
-        streamNext(ctx->stream);
+            if (stream->current == '.') {
+                punct = punctEllipsis;
+                streamNext(stream);
 
-    /*Punctuation or an unrecognised character*/
+            /*Oops, it's just two dots, backtrack*/
+            } else
+                streamPrev(stream);
+        }
+
+    /*Take the longest punctuator possible*/
     } else {
-        lexerEatNext(ctx);
+        punctTag longer;
 
-        /*Assume punctuation*/
-        lexerPunct(ctx);
+        while ((longer = lexerPunctAfter[punct][lexerFollows[(unsigned char) stream->current]]) != punctUndefined) {
+            streamNext(stream);
+            punct = longer;
+        }
     }
 
-    lexerEat(ctx, 0);
-
-    //printf("token(%d:%d): '%s'.\n", ctx->stream->line, ctx->stream->lineChar, ctx->buffer);
+    return punct;
 }
 
-static void lexerPunct (lexerCtx* ctx) {
-    ctx->token = tokenPunct;
+/*==== Splitting ====*/
+
+/*Find where to split a file to lex it in parts. Each split is at a new
+  line outside any comment, string or preprocessor line, so that lexing
+  from there finds the same tokens as lexing from the start would. It is
+  the first such at or after an even share of the file, or the end if
+  there is none.*/
+static void lexerFindSplits (const streamCtx* stream, int* splits, int parts, lexerMode mode) {
+    streamCtx scan = *stream;
+    int part = 1;
+
+    while (part < parts) {
+        /*Up to anything that might start a comment or string, then see if
+          any new line skipped over will do for the splits still wanted*/
+        const char* from = scan.str + scan.pos;
+        streamSkipUntil(&scan, "/\"'#", 0);
+        const char* to = scan.str + scan.pos;
+
+        while (part < parts) {
+            const char* target = max(from, scan.str + (int) ((int64_t) stream->length*part/parts));
+            const char* newline = target < to ? scanFind(target, to, "\n\n\n\n", false) : to;
+
+            if (newline == to)
+                break;
+
+            splits[part++] = (int) (newline - scan.str);
+            from = newline+1;
+        }
 
-    switch (ctx->buffer[0]) {
-    case '{': ctx->punct = punctLBrace; break;
-    case '}': ctx->punct = punctRBrace; break;
-    case '(': ctx->punct = punctLParen; break;
-    case ')': ctx->punct = punctRParen; break;
-    case '[': ctx->punct = punctLBracket; break;
-    case ']': ctx->punct = punctRBracket; break;
-    case ';': ctx->punct = punctSemicolon; break;
-    case '.':
-        ctx->punct = punctPeriod;
+        if (scan.current == 0)
+            break;
 
-        if (ctx->stream->current == '.') {
-            lexerEatNext(ctx);
+        char c = streamNext(&scan);
 
-            if (ctx->stream->current == '.') {
-                ctx->punct = punctEllipsis;
-                lexerEatNext(ctx);
+        /*Comments, as lexerSkipInsignificants would*/
+        if (c == '/' && scan.current == '*') {
+            streamNext(&scan);
 
-            /*Oops, it's just two dots, backtrack*/
-            } else {
-                streamPrev(ctx->stream);
-                ctx->length--;
+            do {
+                streamSkipUntil(&scan, "*", 0);
+
+                if (scan.current == 0)
+                    break;
+
+                streamNext(&scan);
+            } while (scan.current != '/' && scan.current != 0);
+
+            streamNext(&scan);
+
+        } else if (c == '/' && scan.current == '/')
+            streamSkipUntil(&scan, "\n\r", 0);
+
+        /*Lines continued only count when kept as directives, otherwise
+          what follows is lexed as code*/
+        else if (c == '#' && mode == lexerDirectives)
+            lexerSkipDirective(&scan);
+
+        else if (c == '#')
+            streamSkipUntil(&scan, "\n", 0);
+
+        /*Strings and characters, as lexerScan would*/
+        else if (c == '"' || c == '\'') {
+            char ends[] = {c, '\\', 0};
+
+            while (scan.current != c && scan.current != 0) {
+                streamSkipUntil(&scan, ends, 0);
+
+                if (scan.current == '\\') {
+                    streamNext(&scan);
+                    streamNext(&scan);
+                }
             }
+
+            streamNext(&scan);
         }
+    }
 
-        break;
-
-    case ',': ctx->punct = punctComma; break;
-
-    case '=': ctx->punct = lexerTryEatNext(ctx, '=') ? punctEqual : punctAssign; break;
-    case '!': ctx->punct = lexerTryEatNext(ctx, '=') ? punctNotEqual : punctLogicalNot; break;
-    case '>': ctx->punct =   lexerTryEatNext(ctx, '=') ? punctGreaterEqual
-                           : lexerTryEatNext(ctx, '>')
-                             ? (lexerTryEatNext(ctx, '=') ? punctShrAssign : punctShr)
-                             : punctGreater; break;
-    case '<': ctx->punct =   lexerTryEatNext(ctx, '=') ? punctLessEqual
-                           : lexerTryEatNext(ctx, '<')
-                             ? (lexerTryEatNext(ctx, '=') ? punctShlAssign : punctShl)
-                             : punctLess; break;
-
-    case '?': ctx->punct = punctQuestion; break;
-    case ':': ctx->punct = punctColon; break;
-
-    case '&': ctx->punct =   lexerTryEatNext(ctx, '=') ? punctBitwiseAndAssign
-                           : lexerTryEatNext(ctx, '&') ? punctLogicalAnd : punctBitwiseAnd; break;
-    case '|': ctx->punct =   lexerTryEatNext(ctx, '=') ? punctBitwiseOrAssign
-                           : lexerTryEatNext(ctx, '|') ? punctLogicalOr : punctBitwiseOr; break;
-    case '^': ctx->punct = lexerTryEatNext(ctx, '=') ? punctBitwiseXorAssign : punctBitwiseXor; break;
-    case '~': ctx->punct = punctBitwiseNot; break;
-
-    case '+': ctx->punct =   lexerTryEatNext(ctx, '=') ? punctPlusAssign
-                           : lexerTryEatNext(ctx, '+') ? punctPlusPlus : punctPlus; break;
-    case '-': ctx->punct =   lexerTryEatNext(ctx, '=') ? punctMinusAssign
-                           : lexerTryEatNext(ctx, '-') ? punctMinusMinus
-                           : lexerTryEatNext(ctx, '>') ? punctArrow : punctMinus; break;
-    case '*': ctx->punct = lexerTryEatNext(ctx, '=') ? punctTimesAssign : punctTimes; break;
-    case '/': ctx->punct = lexerTryEatNext(ctx, '=') ? punctDivideAssign : punctDivide; break;
-    case '%': ctx->punct = lexerTryEatNext(ctx, '=') ? punctModuloAssign : punctModulo; break;
+    splits[0] = 0;
 
-    /*Oops, actually an unrecognised character*/
-    default: ctx->token = tokenOther;
-    }
+    for (; part <= parts; part++)
+        splits[part] = stream->length;
 }
 
-static keywordTag keywordMatch (const char* str, int n, const char* look, keywordTag kw) {
-    return !strcmp(str+n+1, look+n+1) ? kw : keywordUndefined;
-}
+typedef struct lexerPartsCtx {
+    const streamCtx* stream;
+    const int* splits;
+    lexerTokens* parts;
+    lexerMode mode;
+} lexerPartsCtx;
+
+static void lexerPartTask (void* shared, int n) {
+    lexerPartsCtx* ctx = shared;
 
-static keywordTag keywordMatch2 (const char* str, int n, const char* look, keywordTag kw,
-                                 const char* look2, keywordTag kw2) {
-    return   !strcmp(str+n+1, look+n+1) ? kw
-           : !strcmp(str+n+1, look2+n+1) ? kw2 : keywordUndefined;
+    streamCtx stream = *ctx->stream;
+    stream.pos = ctx->splits[n];
+    stream.current = stream.str[stream.pos];
+
+    lexerTokens* tokens = &ctx->parts[n];
+    lexerTokensInit(tokens, (ctx->splits[n+1] - ctx->splits[n])/4 + 16);
+
+    while (lexerScan(&stream, tokens, ctx->splits[n+1], ctx->mode))
+        ;
 }
 
-static keywordTag lookKeyword (const char* str, int length) {
-    int longest = strlen("continue")+1;
+/*Lex the whole file, in parts over threads if it's large enough*/
+static void lexerScanAll (lexerCtx* ctx, int threads, lexerMode mode) {
+    streamCtx* stream = ctx->stream;
+    int parts = max(1, min(threads, stream->length / lexerPartMin));
 
-    if (length > longest)
-        return keywordUndefined;
+    if (parts == 1) {
+        lexerTokensInit(&ctx->tokens, stream->length/4 + 16);
 
-    /*Manual trie
-      Yeah it's ugly, but it's fast. And lexing is the slowest part of compilation.*/
-
-    switch (str[0]) {
-    case 'd': return keywordMatch(str, 0, "do", keywordDo);
-    case 'r': return keywordMatch(str, 0, "return", keywordReturn);
-    case 'w': return keywordMatch(str, 0, "while", keywordWhile);
-
-    case 'a': return keywordMatch2(str, 0, "assert", keywordAssert,
-                                           "auto", keywordAuto);
-    case 'b': return keywordMatch2(str, 0, "bool", keywordBool,
-                                           "break", keywordBreak);
-    case 't': return keywordMatch2(str, 0, "true", keywordTrue,
-                                           "typedef", keywordTypedef);
-    case 'u': return keywordMatch2(str, 0, "union", keywordUnion,
-                                           "using", keywordUsing);
-
-    case 'c':
-        switch (str[1]) {
-        case 'h': return keywordMatch(str, 1, "char", keywordChar);
-        case 'o':
-            if (str[2] != 'n')
-                return keywordUndefined;
-
-            return keywordMatch2(str, 2, "const", keywordConst,
-                                         "continue", keywordContinue);
-
-        default: return keywordUndefined;
-        }
+        while (lexerScan(stream, &ctx->tokens, stream->length, mode))
+            ;
 
-    case 'e':
-        switch (str[1]) {
-        case 'l': return keywordMatch(str, 1, "else", keywordElse);
-        case 'n': return keywordMatch(str, 1, "enum", keywordEnum);
-        case 'x': return keywordMatch(str, 1, "extern", keywordExtern);
-        default: return keywordUndefined;
-        }
+    } else {
+        int* splits = malloc(sizeof(int)*(parts+1));
+        lexerFindSplits(stream, splits, parts, mode);
 
-    case 'f': return keywordMatch2(str, 0, "false", keywordFalse,
-                                           "for", keywordFor);
+        lexerPartsCtx shared = {stream, splits, calloc(parts, sizeof(lexerTokens)), mode};
+        poolRun(threads, parts, 0, lexerPartTask, &shared);
 
-    case 'i': return keywordMatch2(str, 0, "if", keywordIf,
-                                           "int", keywordInt);
+        /*Joined in order*/
+        lexerTokensInit(&ctx->tokens, 16);
 
-    case 's':
-        switch (str[1]) {
-        case 'i': return keywordMatch(str, 1, "sizeof", keywordSizeof);
-        case 't': return keywordMatch2(str, 1, "static", keywordStatic,
-                                               "struct", keywordStruct);
-        default: return keywordUndefined;
+        for (int i = 0; i < parts; i++) {
+            lexerTokensAppend(&ctx->tokens, &shared.parts[i]);
+            lexerTokensFree(&shared.parts[i]);
         }
 
-    case 'v':
-        switch (str[1]) {
-        case 'a':
-            if (str[2] == '_') {
-                switch (str[3]) {
-                    case 'a': return keywordMatch(str, 3, "va_arg", keywordVAArg);
-                    case 'c': return keywordMatch(str, 3, "va_copy", keywordVACopy);
-                    case 'e': return keywordMatch(str, 3, "va_end", keywordVAEnd);
-                    case 's': return keywordMatch(str, 3, "va_start", keywordVAStart);
-                    default: return keywordUndefined;
-                }
+        free(shared.parts);
+        free(splits);
+    }
 
-            } else
-                return keywordUndefined;
+    lexerTokensPush(&ctx->tokens, tokenEOF, 0, stream->length, 0);
+}
 
-        case 'o': return keywordMatch(str, 1, "void", keywordVoid);
-        default: return keywordUndefined;
-        }
+void lexerScanText (const char* text, int length, lexerTokens* tokens) {
+    streamCtx stream = {(char*) text, length, 0, sourceNone, text[0]};
+
+    while (lexerScan(&stream, tokens, length, lexerLine))
+        ;
+}
+
+/*==== Interface ====*/
+
+lexerCtx* lexerInit (const char* fullname, const char* filename, int threads, bool directives) {
+    lexerCtx* ctx = malloc(sizeof(lexerCtx));
+    ctx->stream = streamInit(fullname, filename);
+
+    lexerScanAll(ctx, threads, directives ? lexerDirectives : lexerPlain);
+    ctx->index = -1;
+
+    ctx->location = ctx->stream->base;
+    ctx->token = tokenUndefined;
+    ctx->keyword = keywordUndefined;
+    ctx->punct = punctUndefined;
+
+    ctx->bufferSize = 64;
+    ctx->buffer = malloc(sizeof(char)*ctx->bufferSize);
+    ctx->length = 0;
+    return ctx;
+}
+
+void lexerEnd (lexerCtx* ctx) {
+    lexerTokensFree(&ctx->tokens);
+    streamEnd(ctx->stream);
+    free(ctx->buffer);
+    free(ctx);
+}
+
+void lexerNext (lexerCtx* ctx) {
+    if (ctx->token == tokenEOF)
+        return;
+
+    int i = ++ctx->index;
+    const lexerTokens* tokens = &ctx->tokens;
+
+    ctx->token = tokens->tags[i];
+    ctx->keyword = ctx->token == tokenKeyword ? (keywordTag) tokens->subtags[i] : keywordUndefined;
+    ctx->punct = ctx->token == tokenPunct ? (punctTag) tokens->subtags[i] : punctUndefined;
+
+    /*Without a base, there are no locations left to give*/
+    if (tokens->locations)
+        ctx->location = tokens->locations[i];
+
+    else
+        ctx->location =   ctx->stream->base == sourceNone
+                        ? sourceNone
+                        : ctx->stream->base + tokens->starts[i];
 
-    default: return keywordUndefined;
+    /*Copy out the text, skipping any opening quote*/
+    const char* text = tokens->text ? tokens->text : ctx->stream->str;
+    int start = (int) tokens->starts[i] + (ctx->token == tokenStr || ctx->token == tokenChar);
+    int length = (int) tokens->lengths[i];
+
+    if (length >= ctx->bufferSize) {
+        ctx->bufferSize = max(2*ctx->bufferSize, length+1);
+        ctx->buffer = realloc(ctx->buffer, ctx->bufferSize);
     }
+
+    memcpy(ctx->buffer, text + start, (size_t) length);
+    ctx->buffer[length] = 0;
+    ctx->length = length+1;
+
+    //printf("token(%u): '%s'.\n", ctx->location, ctx->buffer);
+}
+
+tokenTag lexerPeek (const lexerCtx* ctx, int n, int* subtag) {
+    int i = min(ctx->index + n, ctx->tokens.length-1);
+
+    if (subtag)
+        *subtag = ctx->tokens.subtags[i];
+
+    return ctx->tokens.tags[i];
+}
+
+static keywordTag lookKeyword (const char* str, int length) {
+    if (length > keywordLongest)
+        return keywordUndefined;
+
+    /*Only one keyword could be this, see makekeywords.sh*/
+    int hash = (  (unsigned char) str[0]*keywordHashA
+                + (unsigned char) str[length-1]*keywordHashB + length) % keywordHashSize;
+    keywordTag keyword = keywordHashTable[hash];
+
+    if (   keyword != keywordUndefined
+        && !strncmp(keywordStrs[keyword], str, length)
+        && keywordStrs[keyword][length] == 0)
+        return keyword;
+
+    else
+        return keywordUndefined;
 }
 
 const char* keywordTagGetStr (keywordTag tag) {
     if (tag == keywordUndefined) return "<undefined>";
-    else if (tag == keywordUsing) return "using";
-    else if (tag == keywordIf) return "if";
-    else if (tag == keywordElse) return "else";
-    else if (tag == keywordWhile) return "while";
-    else if (tag == keywordDo) return "do";
-    else if (tag == keywordFor) return "for";
-    else if (tag == keywordReturn) return "return";
-    else if (tag == keywordBreak) return "break";
-    else if (tag == keywordContinue) return "continue";
-    else if (tag == keywordSizeof) return "sizeof";
-    else if (tag == keywordConst) return "const";
-    else if (tag == keywordAuto) return "auto";
-    else if (tag == keywordStatic) return "static";
-    else if (tag == keywordExtern) return "extern";
-    else if (tag == keywordTypedef) return "typedef";
-    else if (tag == keywordStruct) return "struct";
-    else if (tag == keywordUnion) return "union";
-    else if (tag == keywordEnum) return "enum";
-    else if (tag == keywordVoid) return "void";
-    else if (tag == keywordBool) return "bool";
-    else if (tag == keywordChar) return "char";
-    else if (tag == keywordInt) return "int";
-    else if (tag == keywordTrue) return "true";
-    else if (tag == keywordFalse) return "false";
-    else if (tag == keywordVAStart) return "va_start";
-    else if (tag == keywordVAEnd) return "va_end";
-    else if (tag == keywordVAArg) return "va_arg";
-    else if (tag == keywordVACopy) return "va_copy";
+
+    else if (tag > keywordUndefined && tag <= keywordAssert)
+        return keywordStrs[tag];
+
     else {
         char* str = malloc(logi(tag, 10)+2);
         sprintf(str, "%d", tag);
@@ -442,6 +696,8 @@ const char* punctTagGetStr (punctTag tag) {
     else if (tag == punctDivideAssign) return "/=";
     else if (tag == punctModulo) return "%";
     else if (tag == punctModuloAssign) return "%=";
+    else if (tag == punctHash) return "#";
+    else if (tag == punctHashHash) return "##";
     else {
         char* str = malloc(logi(tag, 10)+2);
         sprintf(str, "%d", tag);
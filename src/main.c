@@ -4,50 +4,430 @@
 #include "../inc/architecture.h"
 #include "../inc/options.h"
 #include "../inc/compiler.h"
+#include "../inc/assembler.h"
+#include "../inc/server.h"
 #include "../inc/sym.h"
 #include "../inc/reg.h"
 
 #include "string.h"
 #include "stdlib.h"
 #include "stdio.h"
+#include "unistd.h"
+#include "sys/types.h"
+#include "sys/wait.h"
 
-static bool driver (config conf);
+/**
+ * Outcome of compiling one input in a worker process
+ */
+typedef struct driverResult {
+    int errors, warnings, internalErrors;
+    bool fail;
+    int cacheHits, cacheMisses;
+} driverResult;
+
+/**
+ * State kept by a compile server between requests
+ */
+typedef struct driverServer {
+    ///The request the context was made for, whose settings it refers to
+    config conf;
+    compilerCtx comp;
+    ///Working directory of that request, which the module names are relative to
+    char* cwd;
+    bool ready;
+} driverServer;
+
+typedef struct driverJob {
+    pid_t pid;
+    ///Captured stdout and stderr of the worker
+    FILE* log;
+    ///Read end of the pipe the driverResult comes back through
+    int result;
+    bool done;
+} driverJob;
+
+static char* driverObjectName (config conf, const char* intermediate);
+static char* driverAssembler (config conf, const char* object);
+static bool driverLink (config conf, vector/*<char*>*/* objects);
+static void driverRemove (vector/*<char*>*/* files);
+static bool driverIntegrated (config conf);
+
+static driverResult driverWorker (config conf, int n, const char* object);
+static void driverJobStart (config conf, driverJob* job, int n, const char* object);
+static void driverJobReport (config conf, driverJob* job, int n, driverResult* total);
+static bool driverParallel (config conf);
+
+static bool driver (config conf, compilerCtx* resident);
+static bool driverCommand (config conf, compilerCtx* resident);
+
+static bool driverSamePaths (const vector/*<char*>*/* l, const vector/*<char*>*/* r);
+static int driverServe (void* ctx, int argc, char** argv);
+static bool driverConnect (int argc, char** argv, int* status);
 
 static const char* plural (int n) {
     return n == 1 ? "" : "s";
 }
 
-static bool driver (config conf) {
+static void driverCacheStats (config conf, int hits, int misses) {
+    if (!conf.cacheStats)
+        return;
+
+    else if (!conf.compileCache)
+        puts("fcc: No compile cache given (see --compile-cache)");
+
+    else
+        printf("fcc: Compile cache: %d hit%s, %d miss%s\n",
+               hits, plural(hits), misses, misses == 1 ? "" : "es");
+}
+
+/**
+ * Like cc -c, objects go in the working directory, unless linking when
+ * they are just temporaries
+ */
+static char* driverObjectName (config conf, const char* intermediate) {
+    if (conf.mode == modeNoLink) {
+        char* name = fgetname(intermediate, malloc);
+        char* object = filext(name, "o", malloc);
+        free(name);
+        return object;
+
+    } else
+        return filext(intermediate, "o", malloc);
+}
+
+/**
+ * Command to pipe a module's assembly into, to produce an object
+ */
+static char* driverAssembler (config conf, const char* object) {
+    const char* format = "cc %s -c -x assembler - -o %s";
+    char* assembler = malloc(strlen(format) + strlen(conf.arch.asflags) + strlen(object));
+    sprintf(assembler, format, conf.arch.asflags, object);
+    return assembler;
+}
+
+static bool driverLink (config conf, vector/*<char*>*/* objects) {
+    char* objectList = strjoinwith((char**) objects->buffer, objects->length, " ", malloc);
+    bool fail = systemf("cc %s %s -o %s", conf.arch.ldflags, objectList, conf.output) != 0;
+    free(objectList);
+    return fail;
+}
+
+/**
+ * Delete temporaries, those that exist, without spawning rm
+ */
+static void driverRemove (vector/*<char*>*/* files) {
+    for (int i = 0; i < files->length; i++)
+        remove(vectorGet(files, i));
+}
+
+/**
+ * Assemble the intermediates kept in process, using the system compiler
+ * only to link the objects
+ */
+static bool driverIntegrated (config conf) {
     bool fail = false;
 
+    vector/*<char*>*/ objects;
+    vectorInit(&objects, conf.intermediates.length);
+
+    for (int i = 0; i < conf.intermediates.length; i++) {
+        const char* intermediate = vectorGet(&conf.intermediates, i);
+        char* object = driverObjectName(conf, intermediate);
+        fail |= assemble(&conf.arch, intermediate, object);
+        vectorPush(&objects, object);
+    }
+
+    if (conf.mode != modeNoLink) {
+        if (!fail)
+            fail |= driverLink(conf, &objects);
+
+        driverRemove(&objects);
+    }
+
+    vectorFreeObjs(&objects, free);
+
+    return fail;
+}
+
+/*==== Parallel compilation ====*/
+
+/**
+ * Compile, and assemble if need be, one input with its own compiler context
+ */
+static driverResult driverWorker (config conf, int n, const char* object) {
+    const char* input = vectorGet(&conf.inputs, n);
+    const char* intermediate = vectorGet(&conf.intermediates, n);
+
+    /*See driver*/
+    bool direct = conf.mode != modeNoAssemble && conf.deleteAsm;
+    bool fail;
+
     compilerCtx comp;
     compilerInit(&comp, &conf.arch, &conf.includeSearchPaths);
+    comp.moduleCache = conf.moduleCache;
+    comp.compileCache = conf.compileCache;
+    comp.preprocess = conf.preprocess;
+
+    if (direct && conf.integratedAs)
+        fail = compiler(&comp, input, intermediate, 0, object);
+
+    else if (direct) {
+        char* assembler = driverAssembler(conf, object);
+        fail = compiler(&comp, input, intermediate, assembler, 0);
+        free(assembler);
+
+    } else
+        fail = compiler(&comp, input, intermediate, 0, 0);
+
+    compilerEnd(&comp);
+
+    /*Otherwise assemble the assembly kept, as soon as it is ready*/
+    if (   !direct && conf.mode != modeNoAssemble
+        && comp.errors == 0 && comp.warnings == 0 && comp.internalErrors == 0) {
+        if (conf.integratedAs)
+            fail |= assemble(&conf.arch, intermediate, object);
+
+        else
+            fail |= systemf("cc %s -c %s -o %s", conf.arch.asflags, intermediate, object) != 0;
+    }
+
+    return (driverResult) {comp.errors, comp.warnings, comp.internalErrors, fail,
+                           comp.cacheHits, comp.cacheMisses};
+}
+
+static void driverJobStart (config conf, driverJob* job, int n, const char* object) {
+    int result[2];
+
+    job->log = tmpfile();
+    job->done = false;
+
+    /*Otherwise the worker would inherit, and repeat, anything buffered*/
+    fflush(stdout);
+
+    if (!job->log || pipe(result) != 0) {
+        job->pid = -1;
+        job->result = -1;
+        job->done = true;
+        return;
+    }
+
+    job->pid = fork();
+
+    if (job->pid == 0) {
+        close(result[0]);
+        dup2(fileno(job->log), 1);
+        dup2(fileno(job->log), 2);
+
+        driverResult res = driverWorker(conf, n, object);
+
+        fflush(stdout);
+        fflush(stderr);
+        bool sent = write(result[1], &res, sizeof(res)) == (ssize_t) sizeof(res);
+        _exit(sent ? 0 : 1);
+    }
+
+    close(result[1]);
+    job->result = result[0];
+
+    if (job->pid < 0)
+        job->done = true;
+}
+
+/**
+ * Replay a finished worker's output and add its counts to the total
+ */
+static void driverJobReport (config conf, driverJob* job, int n, driverResult* total) {
+    if (job->log) {
+        rewind(job->log);
+
+        char buffer[4096];
+        size_t length;
+
+        while ((length = fread(buffer, 1, sizeof(buffer), job->log)) != 0)
+            fwrite(buffer, 1, length, stdout);
+
+        fclose(job->log);
+    }
+
+    driverResult res;
+
+    if (job->result < 0 || read(job->result, &res, sizeof(res)) != (ssize_t) sizeof(res)) {
+        printf("fcc: Compilation of '%s' terminated abnormally\n", (char*) vectorGet(&conf.inputs, n));
+        res = (driverResult) {0, 0, 0, true, 0, 0};
+    }
+
+    if (job->result >= 0)
+        close(job->result);
+
+    total->errors += res.errors;
+    total->warnings += res.warnings;
+    total->internalErrors += res.internalErrors;
+    total->fail |= res.fail;
+    total->cacheHits += res.cacheHits;
+    total->cacheMisses += res.cacheMisses;
+}
+
+/**
+ * Compile the inputs in up to conf.jobs worker processes at a time, each
+ * assembling its own object. Diagnostics are replayed in input order, so
+ * the output is the same whatever order they finish in.
+ */
+static bool driverParallel (config conf) {
+    int inputNo = conf.inputs.length;
+
+    vector/*<char*>*/ objects;
+    vectorInit(&objects, inputNo);
+
+    for (int i = 0; i < inputNo; i++)
+        vectorPush(&objects, driverObjectName(conf, vectorGet(&conf.intermediates, i)));
+
+    driverJob* jobs = calloc(inputNo, sizeof(driverJob));
+    driverResult total = {0, 0, 0, false, 0, 0};
+
+    for (int started = 0, running = 0, reported = 0; reported < inputNo;) {
+        for (; started < inputNo && running < conf.jobs; started++) {
+            driverJobStart(conf, &jobs[started], started, vectorGet(&objects, started));
+            running += !jobs[started].done;
+        }
+
+        /*Wait for any worker*/
+        if (running != 0) {
+            int status;
+            pid_t pid = wait(&status);
+
+            for (int i = 0; i < started; i++) {
+                if (!jobs[i].done && (jobs[i].pid == pid || pid < 0)) {
+                    jobs[i].done = true;
+                    running--;
+                }
+            }
+        }
+
+        /*Report those finished, in order*/
+        for (; reported < started && jobs[reported].done; reported++)
+            driverJobReport(conf, &jobs[reported], reported, &total);
+    }
+
+    if (total.errors != 0 || total.warnings != 0)
+        printf("Compilation complete with %d error%s and %d warning%s\n",
+               total.errors, plural(total.errors),
+               total.warnings, plural(total.warnings));
+
+    else if (total.internalErrors)
+        printf("Compilation complete with %d internal error%s\n",
+               total.internalErrors, plural(total.internalErrors));
+
+    else if (conf.mode == modeDefault && !total.fail)
+        total.fail |= driverLink(conf, &objects);
+
+    driverCacheStats(conf, total.cacheHits, total.cacheMisses);
+
+    if (conf.mode == modeDefault)
+        driverRemove(&objects);
+
+    free(jobs);
+    vectorFreeObjs(&objects, free);
+
+    return total.fail || total.errors != 0 || total.internalErrors != 0;
+}
+
+/*==== Driver ====*/
+
+/**
+ * Compile the inputs one after another in a shared context, or in the
+ * resident context of a server if given, keeping its modules
+ */
+static bool driver (config conf, compilerCtx* resident) {
+    bool fail = false;
+
+    /*Unless the assembly is to be kept, stream it straight into the
+      assembler, which then runs alongside the compiler, rather than
+      through a temporary file. The integrated assembler is given it in
+      memory instead.*/
+    bool direct = conf.mode != modeNoAssemble && conf.deleteAsm;
+
+    vector/*<char*>*/ objects;
+    vectorInit(&objects, conf.inputs.length);
+
+    compilerCtx local;
+    compilerCtx* comp = resident;
+
+    if (resident) {
+        /*Only the modules are kept, the counts are for this request*/
+        comp->errors = 0;
+        comp->warnings = 0;
+        comp->internalErrors = 0;
+        comp->cacheHits = 0;
+        comp->cacheMisses = 0;
+
+    } else {
+        comp = &local;
+        compilerInit(comp, &conf.arch, &conf.includeSearchPaths);
+    }
+
+    /*Inputs are only compiled one at a time here, so any jobs asked for
+      go to generating each one's functions (see driverParallel otherwise)*/
+    comp->threads = conf.jobs;
+    comp->moduleCache = conf.moduleCache;
+    comp->compileCache = conf.compileCache;
+    comp->preprocess = conf.preprocess;
 
     /*Compile each of the inputs to assembly*/
     for (int i = 0; i < conf.inputs.length; i++) {
-        compiler(&comp,
-                 vectorGet(&conf.inputs, i),
-                 vectorGet(&conf.intermediates, i));
+        const char* input = vectorGet(&conf.inputs, i);
+        const char* intermediate = vectorGet(&conf.intermediates, i);
+
+        /*What is cached can't depend on the inputs compiled before, so
+          then each gets a fresh context, as in driverParallel. Not so a
+          resident one, which would lose what it is there to keep.*/
+        if (comp->compileCache && !comp->fresh && !resident)
+            compilerReset(comp);
+
+        if (direct) {
+            char* object = driverObjectName(conf, intermediate);
+            vectorPush(&objects, object);
+
+            if (conf.integratedAs)
+                fail |= compiler(comp, input, intermediate, 0, object);
+
+            else {
+                char* assembler = driverAssembler(conf, object);
+                fail |= compiler(comp, input, intermediate, assembler, 0);
+                free(assembler);
+            }
+
+        } else
+            compiler(comp, input, intermediate, 0, 0);
     }
 
-    compilerEnd(&comp);
+    if (!resident)
+        compilerEnd(comp);
 
-    if (comp.errors != 0 || comp.warnings != 0)
+    driverCacheStats(conf, comp->cacheHits, comp->cacheMisses);
+
+    if (comp->errors != 0 || comp->warnings != 0)
         printf("Compilation complete with %d error%s and %d warning%s\n",
-               comp.errors, plural(comp.errors),
-               comp.warnings, plural(comp.warnings));
+               comp->errors, plural(comp->errors),
+               comp->warnings, plural(comp->warnings));
 
-    else if (internalErrors)
+    else if (comp->internalErrors)
         printf("Compilation complete with %d internal error%s\n",
-               internalErrors, plural(internalErrors));
+               comp->internalErrors, plural(comp->internalErrors));
 
     /*Assemble/link*/
-    else if (conf.mode != modeNoAssemble) {
+    else if (direct) {
+        if (conf.mode != modeNoLink && !fail)
+            fail |= driverLink(conf, &objects);
+
+    } else if (conf.mode != modeNoAssemble) {
         /*Produce a string list of all the intermediates*/
         char* intermediates = strjoinwith((char**) conf.intermediates.buffer, conf.intermediates.length,
                                           " ", malloc);
 
-        if (conf.mode == modeNoLink)
+        if (conf.integratedAs)
+            fail |= driverIntegrated(conf);
+
+        else if (conf.mode == modeNoLink)
             fail |= systemf("cc %s -c %s", conf.arch.asflags, intermediates) != 0;
 
         else {
@@ -60,27 +440,25 @@ static bool driver (config conf) {
         free(intermediates);
     }
 
-    return fail || comp.errors != 0 || internalErrors != 0;
-}
-
-int main (int argc, char** argv) {
-    debugInit(stdout);
+    /*Even those of a failed build*/
+    if (direct && conf.mode != modeNoLink)
+        driverRemove(&objects);
 
-    bool fail = false;
+    vectorFreeObjs(&objects, free);
 
-    /*Parse the command line options into a config*/
-    config conf = configCreate();
-    optionsParse(&conf, argc, argv);
-
-    /*Initialize the arch with defaults from <fcc>/defaults.h, which is generated
-      by <fcc>/makedefaults.sh and included (with -include) by the makefile.*/
-    archSetup(&conf.arch, defaultOS, defaultWordsize);
+    return fail || comp->errors != 0 || comp->internalErrors != 0;
+}
 
+/**
+ * Do what the command line asked, given a server's resident context if
+ * it came as a request
+ */
+static bool driverCommand (config conf, compilerCtx* resident) {
     if (conf.fail)
-        fail = true;
+        return true;
 
     else if (conf.mode == modeVersion) {
-        puts("Fedjmike's C Compiler (fcc) v0.01b");
+        puts("Fedjmike's C Compiler (fcc) " compilerVersion);
         puts("Copyright 2014 Sam Nipps.");
         puts("This is free software; see the source for copying conditions.  There is NO");
         puts("warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.");
@@ -93,11 +471,141 @@ int main (int argc, char** argv) {
         puts("  -S         Compile only, do not assemble or link");
         puts("  -s         Keep temporary assembly output after compilation");
         puts("  -o <file>  Output into a specific file");
+        puts("  -j <n>     Compile up to n files, or a file's functions, at once");
+        puts("  --integrated-as  Assemble without the system assembler");
+        puts("  --preprocess  Expand #include, #define and #if as a C preprocessor would");
+        puts("  --module-cache <dir>  Save and reuse the interfaces of imported modules");
+        puts("  --compile-cache <dir>  Reuse the output of unchanged inputs");
+        puts("  --cache-stats  Report how often the compile cache was used");
+        puts("  --server <socket>  Keep modules in memory, compiling for --connect");
+        puts("  --connect <socket>  Compile with a server, if there is one");
         puts("  --help     Display command line information");
         puts("  --version  Display version information");
 
-    } else
-        fail = driver(conf);
+    } else if (conf.mode == modeServer) {
+        if (resident) {
+            puts("fcc: Already a server");
+            return true;
+        }
+
+        driverServer server = {0};
+        server.ready = false;
+
+        return serverRun(conf.socket, driverServe, &server);
+
+    /*A server compiles the inputs serially to keep their modules*/
+    } else if (conf.jobs > 1 && conf.inputs.length > 1 && !resident)
+        return driverParallel(conf);
+
+    else
+        return driver(conf, resident);
+
+    return false;
+}
+
+/*==== Compile server ====*/
+
+static bool driverSamePaths (const vector/*<char*>*/* l, const vector/*<char*>*/* r) {
+    if (l->length != r->length)
+        return false;
+
+    for (int i = 0; i < l->length; i++)
+        if (strcmp(vectorGet(l, i), vectorGet(r, i)))
+            return false;
+
+    return true;
+}
+
+/**
+ * Handle a request from driverConnect, see serverRun
+ */
+static int driverServe (void* ctx, int argc, char** argv) {
+    driverServer* server = ctx;
+
+    config conf = configCreate();
+    optionsParse(&conf, argc, argv);
+    archSetup(&conf.arch, defaultOS, defaultWordsize);
+
+    char cwd[4096];
+
+    if (!getcwd(cwd, sizeof(cwd)))
+        cwd[0] = 0;
+
+    /*The modules are found, and named, relative to these. Should they
+      differ, start again with this request's.*/
+    bool restart =    !conf.fail
+                   && (   !server->ready || strcmp(server->cwd, cwd)
+                       || !driverSamePaths(&server->conf.includeSearchPaths, &conf.includeSearchPaths));
+
+    if (restart) {
+        if (server->ready) {
+            compilerEnd(&server->comp);
+            configDestroy(server->conf);
+            free(server->cwd);
+        }
+
+        server->conf = conf;
+        server->cwd = strdup(cwd);
+        server->ready = true;
+
+        compilerInit(&server->comp, &server->conf.arch, &server->conf.includeSearchPaths);
+        server->comp.resident = true;
+    }
+
+    bool fail = driverCommand(conf, server->ready ? &server->comp : 0);
+
+    if (!restart)
+        configDestroy(conf);
+
+    return fail ? 1 : 0;
+}
+
+/**
+ * If asked to with --connect, have a server run the command line instead.
+ * Returns whether one did, setting the exit status.
+ */
+static bool driverConnect (int argc, char** argv, int* status) {
+    const char* socket = 0;
+
+    /*Forward everything but the option itself*/
+
+    char** forwarded = malloc(sizeof(char*)*argc);
+    int forwardedNo = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (i != 0 && !strcmp(argv[i], "--connect") && i+1 < argc)
+            socket = argv[++i];
+
+        else
+            forwarded[forwardedNo++] = argv[i];
+    }
+
+    bool served = socket && serverRequest(socket, forwardedNo, forwarded, status);
+
+    if (socket && !served)
+        printf("fcc: No server on socket '%s', compiling alone\n", socket);
+
+    free(forwarded);
+    return served;
+}
+
+int main (int argc, char** argv) {
+    debugInit(stdout);
+
+    int status;
+
+    if (driverConnect(argc, argv, &status))
+        return status;
+
+    /*Parse the command line options into a config*/
+    config conf = configCreate();
+    optionsParse(&conf, argc, argv);
+
+    /*Initialize the arch with defaults from <fcc>/defaults.h, which is generated
+      by <fcc>/makedefaults.sh and included (with -include) by the makefile.*/
+    archSetup(&conf.arch, defaultOS, defaultWordsize);
+
+    bool fail = driverCommand(conf, 0);
 
     configDestroy(conf);
 
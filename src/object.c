@@ -0,0 +1,218 @@
+#include "../inc/object.h"
+
+#include "../inc/debug.h"
+
+#include "stdlib.h"
+#include "string.h"
+
+static objSection* objSectionCreate (const char* name);
+static void objSectionDestroy (objSection* section);
+
+static objSymbol* objSymbolCreate (const char* name);
+static void objSymbolDestroy (objSymbol* symbol);
+
+/*Initial sizes*/
+enum {
+    objSectionNo = 8,
+    objSymbolNo = 64,
+    objSectionSize = 256
+};
+
+/*==== Object file ====*/
+
+void objInit (objFile* obj, int wordsize) {
+    obj->wordsize = wordsize;
+    vectorInit(&obj->sections, objSectionNo);
+    vectorInit(&obj->symbols, objSymbolNo);
+    hashmapInit(&obj->symbolMap, objSymbolNo);
+}
+
+void objFree (objFile* obj) {
+    /*Keys are owned by the symbols*/
+    hashmapFree(&obj->symbolMap);
+    vectorFreeObjs(&obj->symbols, (vectorDtor) objSymbolDestroy);
+    vectorFreeObjs(&obj->sections, (vectorDtor) objSectionDestroy);
+}
+
+/*==== Sections ====*/
+
+static objSection* objSectionCreate (const char* name) {
+    objSection* section = malloc(sizeof(objSection));
+    section->name = strdup(name);
+    section->entsize = 0;
+    section->align = 1;
+    section->nobits = strprefix(name, ".bss");
+
+    if (!strcmp(name, ".text"))
+        section->flags = sectionAlloc | sectionExec;
+
+    else if (strprefix(name, ".rodata.str"))
+        section->flags = sectionAlloc | sectionMerge | sectionStrings, section->entsize = 1;
+
+    else if (strprefix(name, ".rodata"))
+        section->flags = sectionAlloc;
+
+    else if (strprefix(name, ".note"))
+        section->flags = 0;
+
+    else
+        section->flags = sectionAlloc | sectionWrite;
+
+    section->capacity = objSectionSize;
+    section->data = malloc(section->capacity);
+    section->length = 0;
+
+    vectorInit(&section->relocs, objSectionSize/16);
+
+    section->index = 0;
+
+    return section;
+}
+
+static void objSectionDestroy (objSection* section) {
+    free(section->name);
+    free(section->data);
+    vectorFreeObjs(&section->relocs, free);
+    free(section);
+}
+
+objSection* objSectionGet (objFile* obj, const char* name) {
+    for (int i = 0; i < obj->sections.length; i++) {
+        objSection* section = vectorGet(&obj->sections, i);
+
+        if (!strcmp(section->name, name))
+            return section;
+    }
+
+    objSection* section = objSectionCreate(name);
+    vectorPush(&obj->sections, section);
+    return section;
+}
+
+/*==== Symbols ====*/
+
+static objSymbol* objSymbolCreate (const char* name) {
+    objSymbol* symbol = malloc(sizeof(objSymbol));
+    symbol->name = strdup(name);
+    symbol->section = 0;
+    symbol->value = 0;
+    symbol->global = false;
+    symbol->alias = 0;
+    symbol->aliasOffset = 0;
+    symbol->index = 0;
+    return symbol;
+}
+
+static void objSymbolDestroy (objSymbol* symbol) {
+    free(symbol->name);
+    free(symbol);
+}
+
+objSymbol* objSymbolGet (objFile* obj, const char* name) {
+    objSymbol* symbol = hashmapMap(&obj->symbolMap, name);
+
+    if (!symbol) {
+        symbol = objSymbolCreate(name);
+        vectorPush(&obj->symbols, symbol);
+        hashmapAdd(&obj->symbolMap, symbol->name, symbol);
+    }
+
+    return symbol;
+}
+
+/*==== Emission ====*/
+
+void objEmitBytes (objSection* section, const void* bytes, int n) {
+    if (section->length + n > section->capacity) {
+        section->capacity = max(section->capacity*2, section->length + n);
+        section->data = realloc(section->data, section->capacity);
+    }
+
+    memcpy(section->data + section->length, bytes, n);
+    section->length += n;
+}
+
+void objEmitByte (objSection* section, int byte) {
+    char c = (char) byte;
+    objEmitBytes(section, &c, 1);
+}
+
+void objEmitInt (objSection* section, intptr_t value, int size) {
+    char bytes[8];
+    int64_t wide = value;
+
+    for (int i = 0; i < size && i < 8; i++)
+        bytes[i] = (char) (wide >> 8*i);
+
+    objEmitBytes(section, bytes, size);
+}
+
+void objPatchInt (objSection* section, int offset, intptr_t value, int size) {
+    int64_t wide = value;
+
+    for (int i = 0; i < size && i < 8; i++)
+        section->data[offset+i] = (char) (wide >> 8*i);
+}
+
+void objAlign (objSection* section, int align) {
+    if (align > section->align)
+        section->align = align;
+
+    while (section->length % align != 0)
+        objEmitByte(section, section->flags & sectionExec ? 0x90 : 0);
+}
+
+void objEmitReloc (objSection* section, objRelocTag tag, objSymbol* symbol, intptr_t addend, int size) {
+    objReloc* reloc = malloc(sizeof(objReloc));
+    reloc->tag = tag;
+    reloc->offset = section->length;
+    reloc->symbol = symbol;
+    reloc->addend = addend;
+    vectorPush(&section->relocs, reloc);
+
+    objEmitInt(section, 0, size);
+}
+
+/*==== Resolution ====*/
+
+/*Follows at most as many aliases as remain, in case of a cycle*/
+static void objResolveAlias (objSymbol* symbol, unsigned remaining) {
+    if (!symbol->alias || remaining == 0)
+        return;
+
+    objResolveAlias(symbol->alias, remaining-1);
+
+    if (symbol->alias->section) {
+        symbol->section = symbol->alias->section;
+        symbol->value = symbol->alias->value + symbol->aliasOffset;
+        symbol->alias = 0;
+    }
+}
+
+void objResolve (objFile* obj) {
+    for (int i = 0; i < obj->symbols.length; i++)
+        objResolveAlias(vectorGet(&obj->symbols, i), 64);
+
+    /*PC relative references to the same section are known now*/
+    for (int i = 0; i < obj->sections.length; i++) {
+        objSection* section = vectorGet(&obj->sections, i);
+
+        vector/*<objReloc*>*/ remaining;
+        vectorInit(&remaining, section->relocs.length+1);
+
+        for (int j = 0; j < section->relocs.length; j++) {
+            objReloc* reloc = vectorGet(&section->relocs, j);
+
+            if (   (reloc->tag == relocPC32 || reloc->tag == relocBranch32)
+                && reloc->symbol->section == section) {
+                objPatchInt(section, reloc->offset, reloc->symbol->value + reloc->addend - reloc->offset, 4);
+                free(reloc);
+
+            } else
+                vectorPush(&remaining, reloc);
+        }
+
+        vectorFree(&section->relocs);
+        section->relocs = remaining;
+    }
+}
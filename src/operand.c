@@ -8,6 +8,7 @@
 #include "../inc/ast.h"
 #include "../inc/architecture.h"
 #include "../inc/reg.h"
+#include "../inc/buffer.h"
 
 #include "assert.h"
 
@@ -87,7 +88,7 @@ void operandFree (operand Value) {
         Value.base = 0;
 
     } else if (Value.tag == operandMem) {
-        if (Value.base != 0 && Value.base != regGet(regRBP)) {
+        if (Value.base != 0 && Value.base->index != regRBP) {
             regFree(Value.base);
             Value.base = 0;
         }
@@ -126,7 +127,10 @@ bool operandIsEqual (operand L, operand R) {
     else if (L.tag == operandLiteral)
         return L.literal == R.literal;
 
-    else if (L.tag == operandLabel || L.tag == operandLabelMem || L.tag == operandLabelOffset)
+    else if (L.tag == operandLabelMem)
+        return L.label == R.label && L.size == R.size && L.offset == R.offset;
+
+    else if (L.tag == operandLabel || L.tag == operandLabelOffset)
         return L.label == R.label;
 
     else {
@@ -160,91 +164,85 @@ int operandGetSize (const architecture* arch, operand Value) {
     return 0;
 }
 
-char* operandToStr (operand Value) {
+static const char* operandSizeGetStr (int size) {
+    if (size == 1)
+        return "byte";
+    else if (size == 2)
+        return "word";
+    else if (size == 4)
+        return "dword";
+    else if (size == 8)
+        return "qword";
+    else if (size == 16)
+        return "oword";
+    else
+        return "dword";
+}
+
+void operandWrite (buffer* out, operand Value) {
     if (Value.tag == operandUndefined)
-        return strdup("<undefined>");
+        bufferStr(out, "<undefined>");
 
     else if (Value.tag == operandInvalid)
-        return strdup("<invalid>");
+        bufferStr(out, "<invalid>");
 
     else if (Value.tag == operandVoid)
-        return strdup("<void>");
+        bufferStr(out, "<void>");
 
-    else if (Value.tag == operandFlags) {
-        const char* conditions[7] = {"condition", "e", "ne", "g", "ge", "l", "le"};
-        return strdup(conditions[Value.condition]);
+    else if (Value.tag == operandFlags)
+        bufferStr(out, conditionGetStr(Value.condition));
 
-    } else if (Value.tag == operandReg)
-        return strdup(regGetStr(Value.base));
+    else if (Value.tag == operandReg)
+        bufferStr(out, regGetStr(Value.base));
 
+    /*size ptr [base+factor*index+offset], parts left out where unused*/
     else if (Value.tag == operandMem || Value.tag == operandLabelMem) {
-        const char* sizeStr;
-
-        if (Value.size == 1)
-            sizeStr = "byte";
-        else if (Value.size == 2)
-            sizeStr = "word";
-        else if (Value.size == 4)
-            sizeStr = "dword";
-        else if (Value.size == 8)
-            sizeStr = "qword";
-        else if (Value.size == 16)
-            sizeStr = "oword";
-        else
-            sizeStr = "dword";
-
-        if (Value.tag == operandLabelMem) {
-            char* ret = malloc(  strlen(sizeStr)
-                               + strlen(Value.label) + 9);
-            sprintf(ret, "%s ptr [%s]", sizeStr, Value.label);
-            return ret;
-
-        } else if (Value.index == regUndefined || Value.factor == 0) {
-            if (Value.offset == 0) {
-                const char* regStr = regGetStr(Value.base);
-                char* ret = malloc(  strlen(sizeStr)
-                                   + strlen(regStr) + 9);
-                sprintf(ret, "%s ptr [%s]", sizeStr, regStr);
-                return ret;
-
-            } else {
-                const char* regStr = regGetStr(Value.base);
-                char* ret = malloc(  strlen(sizeStr)
-                                   + strlen(regStr)
-                                   + logi(Value.offset, 10) + 3 + 10);
-                sprintf(ret, "%s ptr [%s%+d]", sizeStr, regStr, Value.offset);
-                return ret;
-            }
+        bufferStr(out, operandSizeGetStr(Value.size));
+        bufferStrN(out, " ptr [", 6);
+
+        if (Value.tag == operandLabelMem)
+            bufferStr(out, Value.label);
+
+        else {
+            bufferStr(out, regGetStr(Value.base));
 
-        } else {
-            const char* regStr = regGetStr(Value.base);
-            const char* indexStr = regGetStr(Value.index);
-            char* ret = malloc(  strlen(sizeStr)
-                               + strlen(regStr)
-                               + logi(Value.factor, 10) + 3
-                               + strlen(indexStr)
-                               + logi(Value.offset, 10) + 3 + 10);
-            sprintf(ret, "%s ptr [%s%+d*%s%+d]",
-                     sizeStr, regStr, Value.factor, indexStr, Value.offset);
-            return ret;
+            if (Value.index != regUndefined && Value.factor != 0) {
+                bufferSignedInt(out, Value.factor);
+                bufferChar(out, '*');
+                bufferStr(out, regGetStr(Value.index));
+
+                /*Always given with an index*/
+                bufferSignedInt(out, Value.offset);
+                bufferChar(out, ']');
+                return;
+            }
         }
 
-    } else if (Value.tag == operandLiteral) {
-        char* ret = malloc(logi(Value.literal, 10)+3);
-        sprintf(ret, "%d", Value.literal);
-        return ret;
+        if (Value.offset != 0)
+            bufferSignedInt(out, Value.offset);
+
+        bufferChar(out, ']');
 
-    } else if (Value.tag == operandLabel || Value.tag == operandLabelOffset) {
-        char* ret = malloc(strlen(Value.label)+8);
-        sprintf(ret, "offset %s", Value.label);
-        return ret;
+    } else if (Value.tag == operandLiteral)
+        bufferInt(out, Value.literal);
+
+    else if (Value.tag == operandLabel || Value.tag == operandLabelOffset) {
+        bufferStrN(out, "offset ", 7);
+        bufferStr(out, Value.label);
 
     } else {
-        debugErrorUnhandled("operandToStr", "operand tag", operandTagGetStr(Value.tag));
-        return strdup("<unhandled>");
+        debugErrorUnhandled("operandWrite", "operand tag", operandTagGetStr(Value.tag));
+        bufferStr(out, "<unhandled>");
     }
 }
 
+char* operandToStr (operand Value) {
+    buffer str;
+    bufferInit(&str, 32, 0);
+    operandWrite(&str, Value);
+    return bufferTake(&str);
+}
+
 const char* operandTagGetStr (operandTag tag) {
     if (tag == operandUndefined) return "operandUndefined";
     else if (tag == operandInvalid) return "operandInvalid";
@@ -278,6 +276,12 @@ conditionTag conditionFromOp (opTag cond) {
     else return conditionUndefined;
 }
 
+const char* conditionGetStr (conditionTag cond) {
+    const char* conditions[11] = {"condition", "e", "ne", "g", "ge", "l", "le",
+                                  "a", "ae", "b", "be"};
+    return conditions[cond];
+}
+
 conditionTag conditionNegate (conditionTag cond) {
     if (cond == conditionEqual) return conditionNotEqual;
     else if (cond == conditionNotEqual) return conditionEqual;
@@ -285,5 +289,9 @@ conditionTag conditionNegate (conditionTag cond) {
     else if (cond == conditionGreaterEqual) return conditionLess;
     else if (cond == conditionLess) return conditionGreaterEqual;
     else if (cond == conditionLessEqual) return conditionGreater;
+    else if (cond == conditionAbove) return conditionBelowEqual;
+    else if (cond == conditionAboveEqual) return conditionBelow;
+    else if (cond == conditionBelow) return conditionAboveEqual;
+    else if (cond == conditionBelowEqual) return conditionAbove;
     else return conditionUndefined;
 }
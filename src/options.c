@@ -10,6 +10,11 @@ typedef enum expectTag {
     expectNothing,
     expectOutput,
     expectIncludeSearchPath,
+    expectJobs,
+    expectModuleCache,
+    expectCompileCache,
+    expectServer,
+    expectConnect,
     expectTheUnexpected
 } expectTag;
 
@@ -30,6 +35,14 @@ config configCreate () {
     conf.fail = false;
     conf.mode = modeDefault;
     conf.deleteAsm = true;
+    conf.integratedAs = false;
+    conf.preprocess = false;
+    conf.jobs = 1;
+    conf.moduleCache = 0;
+    conf.compileCache = 0;
+    conf.cacheStats = false;
+    conf.socket = 0;
+    conf.connect = 0;
 
     archInit(&conf.arch);
 
@@ -53,6 +66,18 @@ void configDestroy (config conf) {
 
     free(conf.output);
     conf.output = 0;
+
+    free(conf.moduleCache);
+    conf.moduleCache = 0;
+
+    free(conf.compileCache);
+    conf.compileCache = 0;
+
+    free(conf.socket);
+    conf.socket = 0;
+
+    free(conf.connect);
+    conf.connect = 0;
 }
 
 static void configSetMode (config* conf, configMode mode, const char* option) {
@@ -74,14 +99,34 @@ static void stateSetExpect (optionsState* state, expectTag expect, const char* o
 /*==== Options parser ====*/
 
 static void optionsParseMacro (config* conf, optionsState* state, const char* option) {
-    (void) state;
-
     if (!strcmp(option, "--version"))
         configSetMode(conf, modeVersion, option);
 
     else if (!strcmp(option, "--help"))
         configSetMode(conf, modeHelp, option);
 
+    else if (!strcmp(option, "--integrated-as"))
+        conf->integratedAs = true;
+
+    else if (!strcmp(option, "--preprocess"))
+        conf->preprocess = true;
+
+    else if (!strcmp(option, "--module-cache"))
+        stateSetExpect(state, expectModuleCache, option);
+
+    else if (!strcmp(option, "--compile-cache"))
+        stateSetExpect(state, expectCompileCache, option);
+
+    else if (!strcmp(option, "--cache-stats"))
+        conf->cacheStats = true;
+
+    else if (!strcmp(option, "--server")) {
+        configSetMode(conf, modeServer, option);
+        stateSetExpect(state, expectServer, option);
+
+    } else if (!strcmp(option, "--connect"))
+        stateSetExpect(state, expectConnect, option);
+
     else
         printf("fcc: Unknown option '%s'\n", option);
 }
@@ -106,6 +151,9 @@ static void optionsParseMicro (config* conf, optionsState* state, const char* op
         else if (suboption == 'I')
             stateSetExpect(state, expectIncludeSearchPath, asStr);
 
+        else if (suboption == 'j')
+            stateSetExpect(state, expectJobs, asStr);
+
         else
             printf("fcc: Unknown option '%c' in '%s'\n", suboption, option);
     }
@@ -119,7 +167,11 @@ void optionsParse (config* conf, int argc, char** argv) {
 
         if (strprefix(option, "-")) {
             if (state.expect != expectNothing) {
-                const char* noun = state.expect == expectOutput ? "output file" : "include search path";
+                const char* noun = state.expect == expectOutput ? "output file" :
+                                   state.expect == expectJobs ? "job count" :
+                                   state.expect == expectModuleCache ? "module cache directory" :
+                                   state.expect == expectCompileCache ? "compile cache directory" :
+                                   state.expect == expectServer || state.expect == expectConnect ? "socket" : "include search path";
                 printf("fcc: Expected %s for preceding option, found option '%s'\n", noun, option);
                 state.expect = expectNothing;
             }
@@ -144,6 +196,36 @@ void optionsParse (config* conf, int argc, char** argv) {
                 vectorPush(&conf->includeSearchPaths, strdup(option));
                 state.expect = expectNothing;
 
+            } else if (state.expect == expectJobs) {
+                conf->jobs = atoi(option);
+
+                if (conf->jobs < 1) {
+                    printf("fcc: Invalid job count '%s'\n", option);
+                    conf->jobs = 1;
+                }
+
+                state.expect = expectNothing;
+
+            } else if (state.expect == expectModuleCache) {
+                free(conf->moduleCache);
+                conf->moduleCache = strdup(option);
+                state.expect = expectNothing;
+
+            } else if (state.expect == expectCompileCache) {
+                free(conf->compileCache);
+                conf->compileCache = strdup(option);
+                state.expect = expectNothing;
+
+            } else if (state.expect == expectServer) {
+                free(conf->socket);
+                conf->socket = strdup(option);
+                state.expect = expectNothing;
+
+            } else if (state.expect == expectConnect) {
+                free(conf->connect);
+                conf->connect = strdup(option);
+                state.expect = expectNothing;
+
             } else {
                 if (fexists(option)) {
                     vectorPush(&conf->inputs, strdup(option));
@@ -155,8 +237,14 @@ void optionsParse (config* conf, int argc, char** argv) {
         }
     }
 
-    if (   conf->mode != modeVersion
-        && conf->mode != modeHelp) {
+    if (conf->mode == modeServer) {
+        if (!conf->socket) {
+            puts("fcc: No socket given to serve on");
+            conf->fail = true;
+        }
+
+    } else if (   conf->mode != modeVersion
+               && conf->mode != modeHelp) {
         if (conf->inputs.length == 0) {
             puts("fcc: No input files given");
             conf->fail = true;
@@ -194,6 +194,9 @@ static ast* parserStorage (parserCtx* ctx, symTag* tag) {
 
 /**
  * FnImpl = Code
+ *
+ * The body is skipped for an importer, which needs only the prototype,
+ * and left null.
  */
 static ast* parserFnImpl (parserCtx* ctx, ast* decl) {
     debugEnter("FnImpl");
@@ -216,9 +219,14 @@ static ast* parserFnImpl (parserCtx* ctx, ast* decl) {
 
     /*Body*/
 
-    sym* OldScope = scopeSet(ctx, fn);
-    Node->r = parserCode(ctx);
-    ctx->scope = OldScope;
+    if (ctx->imported)
+        tokenSkipBlock(ctx);
+
+    else {
+        sym* OldScope = scopeSet(ctx, fn);
+        Node->r = parserCode(ctx);
+        ctx->scope = OldScope;
+    }
 
     debugLeave();
 
@@ -62,9 +62,7 @@ bool tokenIsDecl (const parserCtx* ctx) {
 
 void tokenNext (parserCtx* ctx) {
     lexerNext(ctx->lexer);
-    ctx->location = (tokenLocation) {ctx->filename,
-                                     ctx->lexer->line,
-                                     ctx->lexer->lineChar};
+    ctx->location = ctx->lexer->location;
 }
 
 void tokenSkipMaybe (parserCtx* ctx) {
@@ -72,8 +70,31 @@ void tokenSkipMaybe (parserCtx* ctx) {
         tokenNext(ctx);
 }
 
+void tokenSkipBlock (parserCtx* ctx) {
+    int depth = 0;
+
+    do {
+        if (tokenIsPunct(ctx, punctLBrace))
+            depth++;
+
+        else if (tokenIsPunct(ctx, punctRBrace))
+            depth--;
+
+        tokenNext(ctx);
+    } while (depth != 0 && ctx->lexer->token != tokenEOF);
+
+    /*Unterminated, report it as parserCode would*/
+    if (depth != 0)
+        tokenMatchPunct(ctx, punctRBrace);
+}
+
 void tokenMatch (parserCtx* ctx) {
-    debugMsg("matched:%d:%d: '%s'", ctx->location.line, ctx->location.lineChar, ctx->lexer->buffer);
+    /*Resolving the location is too slow to do for nothing*/
+    #ifdef FCC_DEBUGMODE
+    sourcePosition pos = sourceGetPosition(ctx->location);
+    debugMsg("matched:%d:%d: '%s'", pos.line, pos.lineChar, ctx->lexer->buffer);
+    #endif
+
     tokenNext(ctx);
 }
 
@@ -97,6 +118,7 @@ static char* tokenTagGetStr (tokenTag tag) {
     else if (tag == tokenInt) return "integer";
     else if (tag == tokenStr) return "string";
     else if (tag == tokenChar) return "character";
+    else if (tag == tokenDirective) return "preprocessor directive";
     else {
         char* str = malloc(logi(tag, 10)+2);
         sprintf(str, "%d", tag);
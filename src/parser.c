@@ -8,6 +8,8 @@
 
 #include "../inc/compiler.h"
 #include "../inc/lexer.h"
+#include "../inc/interface.h"
+#include "../inc/preprocessor.h"
 
 #include "stdlib.h"
 #include "string.h"
@@ -21,10 +23,12 @@ static ast* parserIf (parserCtx* ctx);
 static ast* parserWhile (parserCtx* ctx);
 static ast* parserDoWhile (parserCtx* ctx);
 static ast* parserFor (parserCtx* ctx);
+static ast* parserSwitch (parserCtx* ctx);
+static ast* parserLabel (parserCtx* ctx);
 
-static void parserInit (parserCtx* ctx, sym* scope, char* filename, char* fullname, compilerCtx* comp) {
-    ctx->lexer = lexerInit(fullname);
-    ctx->location = (tokenLocation) {0, 0, 0};
+static void parserInit (parserCtx* ctx, sym* scope, char* filename, char* fullname, bool imported, compilerCtx* comp) {
+    ctx->lexer = lexerInit(fullname, filename, comp->threads, comp->preprocess);
+    ctx->location = sourceNone;
 
     ctx->filename = filename;
     ctx->fullname = fullname;
@@ -36,12 +40,20 @@ static void parserInit (parserCtx* ctx, sym* scope, char* filename, char* fullna
     ctx->scope = scope;
 
     ctx->breakLevel = 0;
+    ctx->loopLevel = 0;
+    ctx->switchLevel = 0;
 
     ctx->errors = 0;
     ctx->warnings = 0;
 
+    ctx->hash = interfaceKey(comp, fullname);
+    ctx->imported = imported;
+
     ctx->lastErrorLine = 0;
 
+    if (comp->preprocess)
+        preprocess(comp, ctx->lexer, fullname, &ctx->errors, &ctx->warnings);
+
     /*Load the first token*/
     tokenNext(ctx);
 }
@@ -54,60 +66,50 @@ static void parserEnd (parserCtx* ctx) {
     ctx->lexer = 0;
 }
 
-static char* parserFindFile (const char* filename, const char* initialPath, const vector/*<char*>*/* searchPaths) {
-    int filenameLength = strlen(filename);
-
-    if (initialPath && initialPath[0]) {
-        char* fullname = malloc(strlen(initialPath)+1+filenameLength+1);
-        sprintf(fullname, "%s/%s", initialPath, filename);
-
-        if (fexists(fullname))
-            return fullname;
-
-        else
-            free(fullname);
-    }
-
-    for (int i = searchPaths->length-1; i >= 0; i--) {
-        const char* path = vectorGet(searchPaths, i);
-        char* fullname;
-
-        if (path[0]) {
-            fullname = malloc(strlen(path)+1+filenameLength+1);
-            sprintf(fullname, "%s/%s", path, filename);
-
-        } else
-            fullname = strdup(filename);
-
-        if (fexists(fullname))
-            return fullname;
-
-        else
-            free(fullname);
-    }
-
-    return 0;
+char* parserFindFile (compilerCtx* comp, const char* filename, const char* initialPath) {
+    return pathsFind(&comp->paths, filename, initialPath, comp->searchPaths);
 }
 
-parserResult parser (const char* filename, const char* initialPath, compilerCtx* comp) {
-    char* fullname = parserFindFile(filename, initialPath, comp->searchPaths);
+parserResult parser (const char* filename, const char* initialPath, bool imported, compilerCtx* comp) {
+    char* fullname = parserFindFile(comp, filename, initialPath);
 
     if (fullname) {
         parserResult* module = hashmapMap(&comp->modules, fullname);
 
         if (!module) {
+            /*Use the module's interface if it's been saved*/
+            parserResult cached;
+
+            if (comp->moduleCache && interfaceLoad(comp, filename, fullname, &cached)) {
+                module = malloc(sizeof(parserResult));
+                hashmapAdd(&comp->modules, fullname, module);
+                vectorPush(&comp->loaded, fullname);
+
+                *module = cached;
+                module->firsttime = false;
+                return cached;
+            }
+
             sym* scope = symCreateScope(comp->global);
 
+            /*Imports are parsed in the middle of this, into their own pools*/
+            astPool* nodes = astPoolCreate();
+            astPool* outer = astPoolSwitch(nodes);
+
             parserCtx ctx;
-            parserInit(&ctx, scope, fstripname(filename, malloc), fullname, comp);
+            parserInit(&ctx, scope, fstripname(filename, malloc), fullname, imported, comp);
             ast* Module = parserModule(&ctx);
             parserEnd(&ctx);
 
+            astPoolSwitch(outer);
+
             module = malloc(sizeof(parserResult));
             hashmapAdd(&comp->modules, fullname, module);
 
-            *module = (parserResult) {Module, scope, ctx.filename, ctx.errors, ctx.warnings, false, false};
-            return    (parserResult) {Module, scope, ctx.filename, ctx.errors, ctx.warnings, true, false};
+            vectorPush(&comp->loaded, fullname);
+
+            *module = (parserResult) {Module, nodes, scope, ctx.filename, ctx.errors, ctx.warnings, false, false, ctx.hash, false};
+            return    (parserResult) {Module, nodes, scope, ctx.filename, ctx.errors, ctx.warnings, true, false, ctx.hash, false};
 
         } else {
             free(fullname);
@@ -115,12 +117,14 @@ parserResult parser (const char* filename, const char* initialPath, compilerCtx*
         }
 
     } else
-        return (parserResult) {astCreateInvalid((tokenLocation) {0, 0, 0}), 0,
-                               0, 0, 0, false, true};
+        return (parserResult) {astCreateInvalid(sourceNone), 0, 0,
+                               0, 0, 0, false, true, 0, false};
 }
 
 void parserResultDestroy (parserResult* result) {
-    astDestroy(result->tree);
+    /*The module's location is in its file, whose name is about to go*/
+    sourceRelease(result->tree->location);
+    astPoolDestroy(result->nodes);
 
     free(result->filename);
     free(result);
@@ -132,7 +136,9 @@ void parserResultDestroy (parserResult* result) {
 static ast* parserModule (parserCtx* ctx) {
     debugEnter("Module");
 
-    ast* Module = astCreate(astModule, ctx->location);
+    /*At the start of the file, the first token possibly being from a
+      header included. The file is released by this location.*/
+    ast* Module = astCreate(astModule, ctx->lexer->stream->base);
     Module->symbol = ctx->scope;
 
     while (ctx->lexer->token != tokenEOF) {
@@ -164,13 +170,14 @@ static ast* parserUsing (parserCtx* ctx) {
     ast* Node = astCreateUsing(loc, name);
 
     if (name[0]) {
-        parserResult res = parser(name, ctx->path, ctx->comp);
+        parserResult res = parser(name, ctx->path, true, ctx->comp);
 
         if (res.notfound)
             errorFileNotFound(ctx, name);
 
         else {
             symCreateModuleLink(ctx->scope, res.scope);
+            ctx->hash = interfaceHashImport(ctx->hash, res.hash);
 
             if (res.firsttime) {
                 ctx->errors += res.errors;
@@ -213,7 +220,7 @@ ast* parserCode (parserCtx* ctx) {
 }
 
 /**
- * Line = If | While | DoWhile | For | Code | Decl# | ( [ ( "return" Value ) | "break" | "continue" | Value ] ";" )
+ * Line = If | While | DoWhile | For | Switch | Label | Code | Decl# | ( [ ( "return" Value ) | "break" | "continue" | Value ] ";" )
  */
 static ast* parserLine (parserCtx* ctx) {
     debugEnter("Line");
@@ -232,6 +239,12 @@ static ast* parserLine (parserCtx* ctx) {
     else if (tokenIsKeyword(ctx, keywordFor))
         Node = parserFor(ctx);
 
+    else if (tokenIsKeyword(ctx, keywordSwitch))
+        Node = parserSwitch(ctx);
+
+    else if (tokenIsKeyword(ctx, keywordCase) || tokenIsKeyword(ctx, keywordDefault))
+        Node = parserLabel(ctx);
+
     else if (tokenIsPunct(ctx, punctLBrace))
         Node = parserCode(ctx);
 
@@ -250,13 +263,13 @@ static ast* parserLine (parserCtx* ctx) {
 
         } else if (tokenIsKeyword(ctx, keywordBreak)) {
             if (ctx->breakLevel == 0)
-                errorIllegalOutside(ctx, "break", "a loop");
+                errorIllegalOutside(ctx, "break", "a loop or switch");
 
             tokenMatch(ctx);
             Node = astCreate(astBreak, loc);
 
         } else if (tokenIsKeyword(ctx, keywordContinue)) {
-            if (ctx->breakLevel == 0)
+            if (ctx->loopLevel == 0)
                 errorIllegalOutside(ctx, "continue", "a loop");
 
             tokenMatch(ctx);
@@ -314,8 +327,10 @@ static ast* parserWhile (parserCtx* ctx) {
     tokenMatchPunct(ctx, punctRParen);
 
     ctx->breakLevel++;
+    ctx->loopLevel++;
     Node->r = parserCode(ctx);
     ctx->breakLevel--;
+    ctx->loopLevel--;
 
     debugLeave();
 
@@ -333,8 +348,10 @@ static ast* parserDoWhile (parserCtx* ctx) {
     tokenMatchKeyword(ctx, keywordDo);
 
     ctx->breakLevel++;
+    ctx->loopLevel++;
     Node->l = parserCode(ctx);
     ctx->breakLevel--;
+    ctx->loopLevel--;
 
     tokenMatchKeyword(ctx, keywordWhile);
     tokenMatchPunct(ctx, punctLParen);
@@ -394,8 +411,10 @@ static ast* parserFor (parserCtx* ctx) {
     tokenMatchPunct(ctx, punctRParen);
 
     ctx->breakLevel++;
+    ctx->loopLevel++;
     Node->l = parserCode(ctx);
     ctx->breakLevel--;
+    ctx->loopLevel--;
 
     ctx->scope = OldScope;
 
@@ -403,3 +422,68 @@ static ast* parserFor (parserCtx* ctx) {
 
     return Node;
 }
+
+/**
+ * Switch = "switch" "(" Value ")" Code
+ */
+static ast* parserSwitch (parserCtx* ctx) {
+    debugEnter("Switch");
+
+    ast* Node = astCreate(astSwitch, ctx->location);
+
+    tokenMatchKeyword(ctx, keywordSwitch);
+    tokenMatchPunct(ctx, punctLParen);
+    Node->l = parserValue(ctx);
+    tokenMatchPunct(ctx, punctRParen);
+
+    ctx->breakLevel++;
+    ctx->switchLevel++;
+    Node->r = parserCode(ctx);
+    ctx->breakLevel--;
+    ctx->switchLevel--;
+
+    debugLeave();
+
+    return Node;
+}
+
+/**
+ * Label = ( ( "case" Value ) | "default" ) ":" Line
+ */
+static ast* parserLabel (parserCtx* ctx) {
+    debugEnter("Label");
+
+    ast* Node;
+    tokenLocation loc = ctx->location;
+
+    if (tokenIsKeyword(ctx, keywordCase)) {
+        if (ctx->switchLevel == 0)
+            errorIllegalOutside(ctx, "case", "a switch");
+
+        tokenMatch(ctx);
+        Node = astCreate(astCase, loc);
+        Node->r = parserValue(ctx);
+
+    } else {
+        if (ctx->switchLevel == 0)
+            errorIllegalOutside(ctx, "default", "a switch");
+
+        tokenMatchKeyword(ctx, keywordDefault);
+        Node = astCreate(astDefault, loc);
+    }
+
+    tokenMatchPunct(ctx, punctColon);
+
+    /*The statement labelled, which needn't be in braces. There must be
+      one, but the end of the block is left for it to match.*/
+    if (tokenIsPunct(ctx, punctRBrace)) {
+        errorExpected(ctx, "statement");
+        Node->l = astCreateEmpty(ctx->location);
+
+    } else
+        Node->l = parserLine(ctx);
+
+    debugLeave();
+
+    return Node;
+}
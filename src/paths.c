@@ -0,0 +1,171 @@
+#include "../inc/paths.h"
+
+#include "../inc/vector.h"
+
+#include "stdlib.h"
+#include "string.h"
+#include "stdio.h"
+#include "dirent.h"
+
+typedef struct pathsDir {
+    ///Couldn't be read, so each file is checked on its own
+    bool unlisted;
+    hashset entries;
+} pathsDir;
+
+typedef struct pathsFound {
+    ///Null if not found
+    char* fullname;
+} pathsFound;
+
+static void pathsEntryDestroy (char* entry) {
+    free(entry);
+}
+
+static void pathsKeyDestroy (char* key, const void* value) {
+    (void) value;
+    free(key);
+}
+
+static void pathsDirDestroy (void* value) {
+    pathsDir* dir = value;
+    hashsetFreeObjs(&dir->entries, pathsEntryDestroy);
+    free(dir);
+}
+
+static void pathsFoundDestroy (void* value) {
+    pathsFound* found = value;
+    free(found->fullname);
+    free(found);
+}
+
+void pathsInit (pathsCtx* ctx) {
+    hashmapInit(&ctx->dirs, 64);
+    hashmapInit(&ctx->found, 256);
+}
+
+void pathsEnd (pathsCtx* ctx) {
+    hashmapFreeObjs(&ctx->dirs, pathsKeyDestroy, pathsDirDestroy);
+    hashmapFreeObjs(&ctx->found, pathsKeyDestroy, pathsFoundDestroy);
+}
+
+void pathsClear (pathsCtx* ctx) {
+    pathsEnd(ctx);
+    pathsInit(ctx);
+}
+
+/*The listing of a directory, read the first time it is asked for*/
+static const pathsDir* pathsList (pathsCtx* ctx, const char* dirname) {
+    pathsDir* dir = hashmapMap(&ctx->dirs, dirname);
+
+    if (dir)
+        return dir;
+
+    dir = malloc(sizeof(pathsDir));
+    hashsetInit(&dir->entries, 64);
+
+    DIR* listing = opendir(dirname);
+    dir->unlisted = !listing;
+
+    if (listing) {
+        struct dirent* entry;
+
+        while ((entry = readdir(listing)))
+            hashsetAdd(&dir->entries, strdup(entry->d_name));
+
+        closedir(listing);
+    }
+
+    hashmapAdd(&ctx->dirs, strdup(dirname), dir);
+    return dir;
+}
+
+bool pathsExists (pathsCtx* ctx, const char* fullname) {
+    const char* slash = strrchr(fullname, '/');
+    const char* name = slash ? slash+1 : fullname;
+
+    /*Names with nothing after the last slash, or . and .., are left to the
+      file system*/
+    if (!name[0] || !strcmp(name, ".") || !strcmp(name, ".."))
+        return fexists(fullname);
+
+    char* dirname;
+
+    if (!slash)
+        dirname = strdup(".");
+
+    else if (slash == fullname)
+        dirname = strdup("/");
+
+    else {
+        int length = (int) (slash - fullname);
+        dirname = malloc((size_t) length+1);
+        memcpy(dirname, fullname, (size_t) length);
+        dirname[length] = 0;
+    }
+
+    const pathsDir* dir = pathsList(ctx, dirname);
+    free(dirname);
+
+    return dir->unlisted ? fexists(fullname) : hashsetTest(&dir->entries, name);
+}
+
+/*Try each path in turn, as parserFindFile always has*/
+static char* pathsSearch (pathsCtx* ctx, const char* filename, const char* initialPath,
+                          const vector/*<char*>*/* searchPaths) {
+    int filenameLength = strlen(filename);
+
+    if (initialPath && initialPath[0]) {
+        char* fullname = malloc(strlen(initialPath)+1+filenameLength+1);
+        sprintf(fullname, "%s/%s", initialPath, filename);
+
+        if (pathsExists(ctx, fullname))
+            return fullname;
+
+        else
+            free(fullname);
+    }
+
+    /*The last given first*/
+    for (int i = 0; i < searchPaths->length; i++) {
+        const char* path = vectorGet(searchPaths, searchPaths->length-1 - i);
+        char* fullname;
+
+        if (path[0]) {
+            fullname = malloc(strlen(path)+1+filenameLength+1);
+            sprintf(fullname, "%s/%s", path, filename);
+
+        } else
+            fullname = strdup(filename);
+
+        if (pathsExists(ctx, fullname))
+            return fullname;
+
+        else
+            free(fullname);
+    }
+
+    return 0;
+}
+
+char* pathsFind (pathsCtx* ctx, const char* filename, const char* initialPath,
+                 const vector/*<char*>*/* searchPaths) {
+    /*Keyed by the initial path and the name, joined by a new line, which
+      no name looked for has*/
+    const char* path = initialPath ? initialPath : "";
+    char* key = malloc(strlen(path)+1+strlen(filename)+1);
+    sprintf(key, "%s\n%s", path, filename);
+
+    pathsFound* found = hashmapMap(&ctx->found, key);
+
+    if (found)
+        free(key);
+
+    else {
+        found = malloc(sizeof(pathsFound));
+        found->fullname = pathsSearch(ctx, filename, initialPath, searchPaths);
+        hashmapAdd(&ctx->found, key, found);
+    }
+
+    return found->fullname ? strdup(found->fullname) : 0;
+}
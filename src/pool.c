@@ -0,0 +1,124 @@
+#include "../inc/pool.h"
+
+#include "stdlib.h"
+#include "threads.h"
+
+typedef struct poolQueue {
+    mtx_t lock;
+    ///Tasks still to run are [front, back)
+    int front, back;
+} poolQueue;
+
+typedef struct pool {
+    poolQueue* queues;
+    int threads;
+
+    poolInitFn init;
+    poolTaskFn task;
+    void* ctx;
+} pool;
+
+typedef struct poolWorker {
+    pool* p;
+    int index;
+} poolWorker;
+
+/*Take from the front of our own queue, in order*/
+static bool poolTakeOwn (poolQueue* queue, int* n) {
+    mtx_lock(&queue->lock);
+
+    bool found = queue->front < queue->back;
+
+    if (found)
+        *n = queue->front++;
+
+    mtx_unlock(&queue->lock);
+    return found;
+}
+
+/*Steal from the back of someone else's, away from where they work*/
+static bool poolSteal (pool* p, int thief, int* n) {
+    for (int i = 1; i < p->threads; i++) {
+        poolQueue* victim = &p->queues[(thief+i) % p->threads];
+
+        mtx_lock(&victim->lock);
+
+        bool found = victim->front < victim->back;
+
+        if (found)
+            *n = --victim->back;
+
+        mtx_unlock(&victim->lock);
+
+        if (found)
+            return true;
+    }
+
+    return false;
+}
+
+static int poolWork (void* arg) {
+    poolWorker* worker = arg;
+    pool* p = worker->p;
+    int n;
+
+    while (   poolTakeOwn(&p->queues[worker->index], &n)
+           || poolSteal(p, worker->index, &n))
+        p->task(p->ctx, n);
+
+    return 0;
+}
+
+static int poolThread (void* arg) {
+    poolWorker* worker = arg;
+
+    if (worker->p->init)
+        worker->p->init(worker->p->ctx);
+
+    return poolWork(worker);
+}
+
+void poolRun (int threads, int count, poolInitFn init, poolTaskFn task, void* ctx) {
+    threads = max(1, min(threads, count));
+
+    /*Nothing to share, don't bother with the machinery*/
+    if (threads == 1) {
+        for (int n = 0; n < count; n++)
+            task(ctx, n);
+
+        return;
+    }
+
+    pool p = {malloc(sizeof(poolQueue)*threads), threads, init, task, ctx};
+    poolWorker* workers = malloc(sizeof(poolWorker)*threads);
+    thrd_t* handles = malloc(sizeof(thrd_t)*threads);
+
+    for (int i = 0; i < threads; i++) {
+        mtx_init(&p.queues[i].lock, mtx_plain);
+        p.queues[i].front = (int) ((long long) count*i / threads);
+        p.queues[i].back = (int) ((long long) count*(i+1) / threads);
+        workers[i] = (poolWorker) {&p, i};
+    }
+
+    /*The calling thread is worker 0, and is already set up. Should a
+      thread fail to start, its share is left to be stolen.*/
+
+    bool* started = calloc(threads, sizeof(bool));
+
+    for (int i = 1; i < threads; i++)
+        started[i] = thrd_create(&handles[i], poolThread, &workers[i]) == thrd_success;
+
+    poolWork(&workers[0]);
+
+    for (int i = 1; i < threads; i++)
+        if (started[i])
+            thrd_join(handles[i], 0);
+
+    for (int i = 0; i < threads; i++)
+        mtx_destroy(&p.queues[i].lock);
+
+    free(p.queues);
+    free(workers);
+    free(handles);
+    free(started);
+}
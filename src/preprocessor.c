@@ -0,0 +1,1458 @@
+#include "../inc/preprocessor.h"
+#include "../inc/preprocessor-internal.h"
+
+#include "../inc/debug.h"
+#include "../inc/error.h"
+
+#include "../inc/compiler.h"
+#include "../inc/parser.h"
+#include "../inc/source.h"
+
+#include "stdlib.h"
+#include "string.h"
+#include "stdio.h"
+#include "inttypes.h"
+
+enum {
+    ppBlockSize = 1 << 16,
+    ///Deeper than any real header nesting, so probably recursion
+    ppIncludeMax = 200
+};
+
+static ppToken ppGet (ppCtx* ctx);
+static ppToken ppNext (ppCtx* ctx);
+static bool ppExpand (ppCtx* ctx, const ppMacro* macro, const ppToken* t);
+static ppList ppExpandList (ppCtx* ctx, const ppList* in);
+static void ppDirective (ppCtx* ctx, const ppToken* directive);
+static void ppSkip (ppCtx* ctx);
+static bool ppCondition (ppCtx* ctx, const ppToken* directive, int from);
+
+/*==== Helpers ====*/
+
+/*Memory that lasts until the module is done*/
+static void* ppAlloc (ppCtx* ctx, int size) {
+    size = (size + 7) & ~7;
+
+    if (ctx->blockUsed + size > ctx->blockSize) {
+        ctx->blockSize = max((int) ppBlockSize, size);
+        ctx->blockUsed = 0;
+        vectorPush(&ctx->blocks, malloc(ctx->blockSize));
+    }
+
+    char* block = vectorGet(&ctx->blocks, ctx->blocks.length-1);
+    void* memory = block + ctx->blockUsed;
+    ctx->blockUsed += size;
+    return memory;
+}
+
+static bool ppIsSpace (char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool ppIsIdentChar (char c) {
+    return    (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+           || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool ppIs (const char* text, int length, const char* str) {
+    return (int) strlen(str) == length && !strncmp(text, str, (size_t) length);
+}
+
+static bool ppIsPunct (const ppToken* t, punctTag punct) {
+    return t->tag == tokenPunct && t->subtag == (int) punct;
+}
+
+/*Could it name a macro? Keywords can be redefined*/
+static bool ppIsName (const ppToken* t) {
+    return t->tag == tokenIdent || t->tag == tokenKeyword;
+}
+
+/*The length of its spelling, quotes and all*/
+static int ppSpelling (const ppToken* t) {
+    return t->tag == tokenStr || t->tag == tokenChar ? t->length+2 : t->length;
+}
+
+/*Copy some text out, null terminated. Only lasts until the next call.*/
+static const char* ppName (ppCtx* ctx, const char* text, int length) {
+    if (length >= ctx->nameCapacity) {
+        ctx->nameCapacity = max(2*ctx->nameCapacity, length+1);
+        ctx->name = realloc(ctx->name, (size_t) ctx->nameCapacity);
+    }
+
+    memcpy(ctx->name, text, (size_t) length);
+    ctx->name[length] = 0;
+    return ctx->name;
+}
+
+static const char* ppTokenName (ppCtx* ctx, const ppToken* t) {
+    return ppName(ctx, t->text, ppSpelling(t));
+}
+
+static void ppListPush (ppList* list, const ppToken* t) {
+    /*It may be one of the list's own*/
+    ppToken copy = *t;
+
+    if (list->length == list->capacity) {
+        list->capacity = list->capacity ? 2*list->capacity : 16;
+        list->tokens = realloc(list->tokens, sizeof(ppToken)*list->capacity);
+    }
+
+    list->tokens[list->length++] = copy;
+}
+
+static void ppListFree (ppList* list) {
+    free(list->tokens);
+}
+
+/*To be read again by ppNext*/
+static void ppUnget (ppCtx* ctx, const ppToken* t) {
+    ppListPush(&ctx->pending, t);
+}
+
+/*A list to be read again in order, so pushed from its end*/
+static void ppUngetList (ppCtx* ctx, const ppList* list) {
+    for (int i = 0; i < list->length; i++)
+        ppUnget(ctx, &list->tokens[list->length-1 - i]);
+}
+
+/*==== Hide sets ====*/
+
+static bool ppHideHas (const ppHide* hide, const ppMacro* macro) {
+    for (; hide; hide = hide->next)
+        if (hide->macro == macro)
+            return true;
+
+    return false;
+}
+
+static const ppHide* ppHideAdd (ppCtx* ctx, const ppHide* hide, const ppMacro* macro) {
+    if (ppHideHas(hide, macro))
+        return hide;
+
+    ppHide* added = ppAlloc(ctx, sizeof(ppHide));
+    added->macro = macro;
+    added->next = hide;
+    return added;
+}
+
+static const ppHide* ppHideUnion (ppCtx* ctx, const ppHide* l, const ppHide* r) {
+    for (; l; l = l->next)
+        r = ppHideAdd(ctx, r, l->macro);
+
+    return r;
+}
+
+static const ppHide* ppHideIntersect (ppCtx* ctx, const ppHide* l, const ppHide* r) {
+    const ppHide* both = 0;
+
+    for (; l; l = l->next)
+        if (ppHideHas(r, l->macro))
+            both = ppHideAdd(ctx, both, l->macro);
+
+    return both;
+}
+
+/*==== Macros ====*/
+
+static ppMacro* ppFindMacro (ppCtx* ctx, const ppToken* t) {
+    if (   !ppIsName(t)
+        || !(ctx->names[(unsigned char) t->text[0]] & ((uint64_t) 1 << (t->length & 63))))
+        return 0;
+
+    ppMacro* macro = hashmapMap(&ctx->macros, ppName(ctx, t->text, t->length));
+    return macro && macro->defined ? macro : 0;
+}
+
+static bool ppIsDefined (const ppCtx* ctx, const char* name) {
+    const ppMacro* macro = hashmapMap(&ctx->macros, name);
+    return macro && macro->defined;
+}
+
+/*Define a macro with no parameters or body yet, replacing any before*/
+static ppMacro* ppMacroAdd (ppCtx* ctx, const char* name, int length) {
+    ppMacro* macro = hashmapMap(&ctx->macros, ppName(ctx, name, length));
+
+    if (macro) {
+        free(macro->body);
+        free(macro->bodyParams);
+
+    } else {
+        macro = malloc(sizeof(ppMacro));
+        macro->name = strdup(ctx->name);
+        hashmapAdd(&ctx->macros, macro->name, macro);
+
+        ctx->names[(unsigned char) name[0]] |= (uint64_t) 1 << (length & 63);
+    }
+
+    macro->defined = true;
+    macro->builtin = ppBuiltinNone;
+    macro->function = false;
+    macro->variadic = false;
+    macro->params = 0;
+    macro->body = 0;
+    macro->bodyParams = 0;
+    macro->length = 0;
+    return macro;
+}
+
+static void ppMacroDestroy (ppMacro* macro) {
+    free(macro->name);
+    free(macro->body);
+    free(macro->bodyParams);
+    free(macro);
+}
+
+static int ppFindParam (const ppList* params, const ppToken* t) {
+    if (!ppIsName(t))
+        return -1;
+
+    for (int i = 0; i < params->length; i++) {
+        const ppToken* param = &params->tokens[i];
+
+        if (param->length == t->length && !memcmp(param->text, t->text, (size_t) t->length))
+            return i;
+    }
+
+    return -1;
+}
+
+/*==== Files ====*/
+
+/*The name of a directive, after the # and any spaces, giving its length
+  and where it starts*/
+static int ppDirectiveName (const char* text, int length, int* start) {
+    int i = 1;
+
+    while (i < length && (text[i] == ' ' || text[i] == '\t'))
+        i++;
+
+    *start = i;
+
+    while (i < length && ppIsIdentChar(text[i]))
+        i++;
+
+    return i - *start;
+}
+
+/*The macro tested by an #ifndef around the whole of a file, if the file
+  is so guarded: nothing is outside of it, and it has no #else or #elif*/
+static char* ppFindGuard (const lexerCtx* lexer) {
+    const lexerTokens* tokens = &lexer->tokens;
+    const char* text = lexer->stream->str;
+
+    /*Before the end of file*/
+    int last = tokens->length-2;
+
+    if (last < 1 || tokens->tags[0] != tokenDirective)
+        return 0;
+
+    int depth = 0;
+
+    for (int i = 0; i <= last; i++) {
+        if (tokens->tags[i] != tokenDirective) {
+            if (depth == 0)
+                return 0;
+
+            continue;
+        }
+
+        const char* directive = text + tokens->starts[i];
+        int start, length = ppDirectiveName(directive, (int) tokens->lengths[i], &start);
+        const char* name = directive + start;
+
+        if (i == 0 && !ppIs(name, length, "ifndef"))
+            return 0;
+
+        if (ppIs(name, length, "if") || ppIs(name, length, "ifdef") || ppIs(name, length, "ifndef")) {
+            if (depth == 0 && i != 0)
+                return 0;
+
+            depth++;
+
+        } else if (ppIs(name, length, "endif")) {
+            if (--depth == 0 && i != last)
+                return 0;
+
+        } else if (   (ppIs(name, length, "else") || ppIs(name, length, "elif"))
+                   && depth == 1)
+            return 0;
+    }
+
+    /*The name the #ifndef tests*/
+    const char* directive = text + tokens->starts[0];
+    int directiveLength = (int) tokens->lengths[0];
+    int start, i = ppDirectiveName(directive, directiveLength, &start) + start;
+
+    while (i < directiveLength && (directive[i] == ' ' || directive[i] == '\t'))
+        i++;
+
+    int from = i;
+
+    while (i < directiveLength && ppIsIdentChar(directive[i]))
+        i++;
+
+    if (i == from)
+        return 0;
+
+    char* guard = malloc((size_t) (i-from+1));
+    memcpy(guard, directive + from, (size_t) (i-from));
+    guard[i-from] = 0;
+    return guard;
+}
+
+/*The header of a full name, taking ownership of it, lexed the first time
+  it is asked for in the compilation*/
+static ppFile* ppOpen (ppCtx* ctx, char* fullname) {
+    compilerCtx* comp = ctx->comp;
+    ppFile* file = hashmapMap(&comp->headers, fullname);
+
+    if (file) {
+        free(fullname);
+        return file;
+    }
+
+    file = malloc(sizeof(ppFile));
+    file->fullname = fullname;
+    file->lexer = lexerInit(fullname, fullname, comp->threads, true);
+    file->guard = ppFindGuard(file->lexer);
+    file->once = false;
+
+    hashmapAdd(&comp->headers, file->fullname, file);
+    vectorPush(&comp->included, file->fullname);
+    return file;
+}
+
+void ppFileDestroy (ppFile* file) {
+    tokenLocation base = file->lexer->stream->base;
+    lexerEnd(file->lexer);
+    sourceRelease(base);
+
+    free(file->fullname);
+    free(file->guard);
+    free(file);
+}
+
+static void ppEnter (ppCtx* ctx, const lexerTokens* tokens, const char* text, tokenLocation base,
+                     ppFile* file, const char* fullname) {
+    if (ctx->frameNo == ctx->frameCapacity) {
+        ctx->frameCapacity = ctx->frameCapacity ? 2*ctx->frameCapacity : 16;
+        ctx->frames = realloc(ctx->frames, sizeof(ppFrame)*ctx->frameCapacity);
+    }
+
+    ctx->frames[ctx->frameNo++] = (ppFrame) {tokens, text, base, 0, file, fullname, ctx->conditionalNo};
+}
+
+/*Leave an included file at its end, closing what it left open*/
+static void ppLeave (ppCtx* ctx) {
+    const ppFrame* frame = &ctx->frames[ctx->frameNo-1];
+
+    for (; ctx->conditionalNo > frame->conditionals; ctx->conditionalNo--) {
+        ctx->location = ctx->conditionals[ctx->conditionalNo-1].location;
+        errorUnterminatedConditional(ctx);
+    }
+
+    ctx->frameNo--;
+}
+
+static ppToken ppFromFrame (const ppFrame* frame, int i) {
+    const lexerTokens* tokens = frame->tokens;
+    const char* text = frame->text + tokens->starts[i];
+
+    return (ppToken) {
+        (tokenTag) tokens->tags[i], tokens->subtags[i], text, (int) tokens->lengths[i],
+        frame->base == sourceNone ? sourceNone : frame->base + tokens->starts[i],
+        tokens->starts[i] != 0 && ppIsSpace(text[-1]),
+        0
+    };
+}
+
+/*==== Reading ====*/
+
+/*The next token, before expansion, following any directives on the way*/
+static ppToken ppNext (ppCtx* ctx) {
+    if (ctx->pending.length != 0)
+        return ctx->pending.tokens[--ctx->pending.length];
+
+    while (true) {
+        ppFrame* frame = &ctx->frames[ctx->frameNo-1];
+        ppToken t = ppFromFrame(frame, frame->index);
+
+        if (t.tag == tokenDirective) {
+            frame->index++;
+            ppDirective(ctx, &t);
+
+        } else if (t.tag == tokenEOF) {
+            /*The module's own end is the end of everything*/
+            if (ctx->frameNo == 1)
+                return t;
+
+            ppLeave(ctx);
+
+        } else {
+            frame->index++;
+            return t;
+        }
+    }
+}
+
+/*The next token, after expansion*/
+static ppToken ppGet (ppCtx* ctx) {
+    while (true) {
+        ppToken t = ppNext(ctx);
+        const ppMacro* macro = ppFindMacro(ctx, &t);
+
+        if (!macro || ppHideHas(t.hide, macro) || !ppExpand(ctx, macro, &t))
+            return t;
+    }
+}
+
+/*==== Expansion ====*/
+
+static ppToken ppStringize (ppCtx* ctx, const ppList* arg, const ppToken* hash) {
+    /*Each character may need escaping, and a space between each*/
+    int capacity = 3;
+
+    for (int i = 0; i < arg->length; i++)
+        capacity += 2*ppSpelling(&arg->tokens[i]) + 1;
+
+    char* str = ppAlloc(ctx, capacity);
+    int length = 0;
+
+    str[length++] = '"';
+
+    for (int i = 0; i < arg->length; i++) {
+        const ppToken* t = &arg->tokens[i];
+        bool escape = t->tag == tokenStr || t->tag == tokenChar;
+
+        if (i != 0 && t->space)
+            str[length++] = ' ';
+
+        for (int j = 0; j < ppSpelling(t); j++) {
+            if (escape && (t->text[j] == '"' || t->text[j] == '\\'))
+                str[length++] = '\\';
+
+            str[length++] = t->text[j];
+        }
+    }
+
+    str[length++] = '"';
+    str[length] = 0;
+
+    return (ppToken) {tokenStr, 0, str, length-2, hash->location, hash->space, 0};
+}
+
+/*Join two tokens' spellings, which must lex to a single token*/
+static ppToken ppPaste (ppCtx* ctx, const ppToken* l, const ppToken* r) {
+    int llength = ppSpelling(l), rlength = ppSpelling(r);
+
+    char* text = ppAlloc(ctx, llength+rlength+1);
+    memcpy(text, l->text, (size_t) llength);
+    memcpy(text+llength, r->text, (size_t) rlength);
+    text[llength+rlength] = 0;
+
+    ctx->scratch.length = 0;
+    lexerScanText(text, llength+rlength, &ctx->scratch);
+
+    ppToken pasted = {
+        (tokenTag) ctx->scratch.tags[0], ctx->scratch.subtags[0], text, (int) ctx->scratch.lengths[0],
+        l->location, l->space, l->hide
+    };
+
+    if (ctx->scratch.length != 1 || ppSpelling(&pasted) != llength+rlength) {
+        ctx->location = l->location;
+        errorInvalidPaste(ctx, ppName(ctx, l->text, llength), text+llength);
+        return *l;
+    }
+
+    return pasted;
+}
+
+/*An argument, fully expanded, the first time it is needed*/
+static const ppList* ppExpandedArg (ppCtx* ctx, const ppList* args, ppList* expanded, bool* done, int n) {
+    if (!done[n]) {
+        expanded[n] = ppExpandList(ctx, &args[n]);
+        done[n] = true;
+    }
+
+    return &expanded[n];
+}
+
+static void ppPushList (ppList* list, const ppList* from) {
+    for (int i = 0; i < from->length; i++)
+        ppListPush(list, &from->tokens[i]);
+}
+
+/*Replace a macro's name (and arguments) with its body, to be read again*/
+static void ppSubstitute (ppCtx* ctx, const ppMacro* macro, const ppList* args,
+                          const ppToken* site, const ppHide* hide) {
+    ppList out = {0};
+
+    int params = max(macro->params, 1);
+    ppList* expanded = calloc((size_t) params, sizeof(ppList));
+    bool* done = calloc((size_t) params, sizeof(bool));
+
+    for (int i = 0; i < macro->length; i++) {
+        const ppToken* t = &macro->body[i];
+        int param = macro->bodyParams[i];
+        bool pasteNext = i+1 < macro->length && ppIsPunct(&macro->body[i+1], punctHashHash);
+
+        /*Stringizing*/
+        if (   macro->function && ppIsPunct(t, punctHash)
+            && i+1 < macro->length && macro->bodyParams[i+1] >= 0) {
+            ppToken str = ppStringize(ctx, &args[macro->bodyParams[i+1]], t);
+            ppListPush(&out, &str);
+            i++;
+
+        /*Pasting onto the last*/
+        } else if (ppIsPunct(t, punctHashHash) && out.length != 0 && i+1 < macro->length) {
+            const ppToken* r = &macro->body[++i];
+            int rparam = macro->bodyParams[i];
+
+            if (rparam < 0)
+                out.tokens[out.length-1] = ppPaste(ctx, &out.tokens[out.length-1], r);
+
+            else if (args[rparam].length != 0) {
+                out.tokens[out.length-1] = ppPaste(ctx, &out.tokens[out.length-1], &args[rparam].tokens[0]);
+
+                for (int j = 1; j < args[rparam].length; j++)
+                    ppListPush(&out, &args[rparam].tokens[j]);
+            }
+
+        /*An empty argument pasted onto: just the right side*/
+        } else if (param >= 0 && pasteNext && args[param].length == 0) {
+            i += 2;
+
+            if (i < macro->length) {
+                int rparam = macro->bodyParams[i];
+
+                if (rparam >= 0)
+                    ppPushList(&out, &args[rparam]);
+
+                else
+                    ppListPush(&out, &macro->body[i]);
+            }
+
+        /*An argument, as given if pasted, otherwise expanded*/
+        } else if (param >= 0) {
+            const ppList* arg = pasteNext ? &args[param] : ppExpandedArg(ctx, args, expanded, done, param);
+            int from = out.length;
+
+            ppPushList(&out, arg);
+
+            if (out.length != from)
+                out.tokens[from].space = t->space;
+
+        } else
+            ppListPush(&out, t);
+    }
+
+    for (int i = 0; i < params; i++)
+        ppListFree(&expanded[i]);
+
+    free(expanded);
+    free(done);
+
+    /*All at the site of the macro, and not to be expanded by it again*/
+    for (int i = 0; i < out.length; i++) {
+        out.tokens[i].location = site->location;
+        out.tokens[i].hide = ppHideUnion(ctx, out.tokens[i].hide, hide);
+    }
+
+    if (out.length != 0)
+        out.tokens[0].space = site->space;
+
+    ppUngetList(ctx, &out);
+
+    ppListFree(&out);
+}
+
+static ppToken ppBuiltinToken (ppCtx* ctx, const ppMacro* macro, const ppToken* site) {
+    sourcePosition pos = sourceGetPosition(site->location);
+
+    if (macro->builtin == ppBuiltinLine) {
+        char* text = ppAlloc(ctx, 16);
+        int length = sprintf(text, "%d", pos.line);
+        return (ppToken) {tokenInt, 0, text, length, site->location, site->space, 0};
+
+    } else {
+        const char* filename = pos.filename ? pos.filename : "";
+        char* text = ppAlloc(ctx, 2*(int) strlen(filename) + 3);
+        int length = 0;
+
+        text[length++] = '"';
+
+        for (int i = 0; filename[i]; i++) {
+            if (filename[i] == '"' || filename[i] == '\\')
+                text[length++] = '\\';
+
+            text[length++] = filename[i];
+        }
+
+        text[length++] = '"';
+        text[length] = 0;
+
+        return (ppToken) {tokenStr, 0, text, length-2, site->location, site->space, 0};
+    }
+}
+
+/*Expand a macro named by a token, pushing the result to be read again.
+  Returns false if it isn't an invocation after all: the name of a
+  function-like macro without arguments.*/
+static bool ppExpand (ppCtx* ctx, const ppMacro* macro, const ppToken* t) {
+    if (macro->builtin != ppBuiltinNone) {
+        ppToken made = ppBuiltinToken(ctx, macro, t);
+        ppUnget(ctx, &made);
+        return true;
+    }
+
+    if (!macro->function) {
+        ppSubstitute(ctx, macro, 0, t, ppHideAdd(ctx, t->hide, macro));
+        return true;
+    }
+
+    ppToken lparen = ppNext(ctx);
+
+    if (!ppIsPunct(&lparen, punctLParen)) {
+        ppUnget(ctx, &lparen);
+        return false;
+    }
+
+    /*Collect the arguments, split by commas outside parentheses, the
+      variadic argument taking all that remain*/
+    ppList* args = calloc((size_t) max(macro->params, 1), sizeof(ppList));
+    int commas = 0, depth = 0;
+    bool empty = true;
+    ppToken rparen;
+
+    while (true) {
+        ppToken arg = ppNext(ctx);
+
+        if (arg.tag == tokenEOF) {
+            ctx->location = t->location;
+            errorUnterminatedCall(ctx, macro->name);
+            ppUnget(ctx, &arg);
+
+            for (int i = 0; i < max(macro->params, 1); i++)
+                ppListFree(&args[i]);
+
+            free(args);
+            return true;
+
+        } else if (ppIsPunct(&arg, punctRParen) && depth == 0) {
+            rparen = arg;
+            break;
+
+        } else if (ppIsPunct(&arg, punctLParen))
+            depth++;
+
+        else if (ppIsPunct(&arg, punctRParen))
+            depth--;
+
+        else if (   ppIsPunct(&arg, punctComma) && depth == 0
+                 && !(macro->variadic && commas == macro->params-1)) {
+            commas++;
+            empty = false;
+            continue;
+        }
+
+        empty = false;
+
+        if (commas < macro->params)
+            ppListPush(&args[commas], &arg);
+    }
+
+    int given = empty ? 0 : commas+1;
+
+    if (   given != macro->params
+        && !(macro->params == 1 && given == 0)
+        && !(macro->variadic && given == macro->params-1)) {
+        ctx->location = t->location;
+        errorMacroDegree(ctx, macro->name, macro->params, given);
+    }
+
+    const ppHide* hide = ppHideAdd(ctx, ppHideIntersect(ctx, t->hide, rparen.hide), macro);
+    ppSubstitute(ctx, macro, args, t, hide);
+
+    for (int i = 0; i < max(macro->params, 1); i++)
+        ppListFree(&args[i]);
+
+    free(args);
+    return true;
+}
+
+/*Fully expand a list of tokens on its own, as an argument is*/
+static ppList ppExpandList (ppCtx* ctx, const ppList* in) {
+    /*An end of file to stop at, so nothing is read from the files*/
+    ppToken end = {tokenEOF, 0, "", 0, sourceNone, false, 0};
+    ppUnget(ctx, &end);
+
+    ppUngetList(ctx, in);
+
+    ppList out = {0};
+    ppToken t;
+
+    while ((t = ppGet(ctx)).tag != tokenEOF)
+        ppListPush(&out, &t);
+
+    return out;
+}
+
+/*==== Directives ====*/
+
+/*Lex the rest of a directive's line, from an offset into it, joining any
+  lines continued with a backslash*/
+static void ppLine (ppCtx* ctx, const ppToken* directive, int from, ppList* line) {
+    const char* in = directive->text;
+    char* text = ppAlloc(ctx, directive->length - from + 1);
+    int length = 0;
+
+    for (int i = from; i < directive->length; i++) {
+        if (in[i] == '\\' && in[i+1] == '\n')
+            i++;
+
+        else if (in[i] == '\\' && in[i+1] == '\r' && in[i+2] == '\n')
+            i += 2;
+
+        else
+            text[length++] = in[i];
+    }
+
+    text[length] = 0;
+
+    ctx->scratch.length = 0;
+    lexerScanText(text, length, &ctx->scratch);
+
+    line->length = 0;
+
+    for (int i = 0; i < ctx->scratch.length; i++) {
+        int start = (int) ctx->scratch.starts[i];
+
+        ppToken t = {
+            (tokenTag) ctx->scratch.tags[i], ctx->scratch.subtags[i], text + start, (int) ctx->scratch.lengths[i],
+            directive->location == sourceNone ? sourceNone : directive->location + (tokenLocation) (from + start),
+            start != 0 && ppIsSpace(text[start-1]),
+            0
+        };
+
+        ppListPush(line, &t);
+    }
+}
+
+static void ppDefine (ppCtx* ctx, const ppList* line) {
+    if (line->length == 0 || !ppIsName(&line->tokens[0])) {
+        errorDirectiveExpected(ctx, "a macro name", "#define");
+        return;
+    }
+
+    ppMacro* macro = ppMacroAdd(ctx, line->tokens[0].text, line->tokens[0].length);
+    ppList params = {0};
+    int i = 1;
+
+    /*Function-like if a parenthesis follows the name immediately*/
+    if (   i < line->length && ppIsPunct(&line->tokens[i], punctLParen)
+        && !line->tokens[i].space) {
+        static const ppToken variadic = {tokenIdent, 0, "__VA_ARGS__", 11, sourceNone, false, 0};
+
+        macro->function = true;
+        i++;
+
+        if (i < line->length && ppIsPunct(&line->tokens[i], punctRParen))
+            i++;
+
+        else while (true) {
+            const ppToken* param = i < line->length ? &line->tokens[i++] : 0;
+
+            if (param && ppIsPunct(param, punctEllipsis)) {
+                macro->variadic = true;
+                ppListPush(&params, &variadic);
+
+            } else if (param && ppIsName(param))
+                ppListPush(&params, param);
+
+            else {
+                macro->defined = false;
+                break;
+            }
+
+            if (i < line->length && ppIsPunct(&line->tokens[i], punctRParen)) {
+                i++;
+                break;
+            }
+
+            if (   macro->variadic || i == line->length
+                || !ppIsPunct(&line->tokens[i++], punctComma)) {
+                macro->defined = false;
+                break;
+            }
+        }
+
+        if (!macro->defined)
+            errorDirectiveExpected(ctx, "a parameter list", "#define");
+    }
+
+    macro->params = params.length;
+    macro->length = line->length - i;
+    macro->body = malloc(sizeof(ppToken)*max(macro->length, 1));
+    macro->bodyParams = malloc(sizeof(int)*max(macro->length, 1));
+
+    for (int j = 0; j < macro->length; j++) {
+        macro->body[j] = line->tokens[i+j];
+        macro->bodyParams[j] = macro->function ? ppFindParam(&params, &macro->body[j]) : -1;
+    }
+
+    ppListFree(&params);
+}
+
+static void ppUndef (ppCtx* ctx, const ppList* line) {
+    if (line->length == 0 || !ppIsName(&line->tokens[0])) {
+        errorDirectiveExpected(ctx, "a macro name", "#undef");
+        return;
+    }
+
+    ppMacro* macro = hashmapMap(&ctx->macros, ppTokenName(ctx, &line->tokens[0]));
+
+    if (macro)
+        macro->defined = false;
+}
+
+static void ppInclude (ppCtx* ctx, const ppList* line) {
+    /*Macros, which must expand to one of the other forms*/
+    ppList expanded = {0};
+
+    if (line->length != 0 && ppIsName(&line->tokens[0])) {
+        expanded = ppExpandList(ctx, line);
+        line = &expanded;
+    }
+
+    char* name = 0;
+    bool quoted = false;
+
+    if (line->length != 0 && line->tokens[0].tag == tokenStr) {
+        name = strdup(ppName(ctx, line->tokens[0].text+1, line->tokens[0].length));
+        quoted = true;
+
+    /*Everything up to the >, as spelt*/
+    } else if (line->length != 0 && ppIsPunct(&line->tokens[0], punctLess)) {
+        int end = 1, length = 0;
+
+        for (; end < line->length && !ppIsPunct(&line->tokens[end], punctGreater); end++)
+            length += ppSpelling(&line->tokens[end]) + 1;
+
+        if (end < line->length) {
+            name = malloc((size_t) length+1);
+            length = 0;
+
+            for (int i = 1; i < end; i++) {
+                const ppToken* t = &line->tokens[i];
+
+                if (i != 1 && t->space)
+                    name[length++] = ' ';
+
+                memcpy(name+length, t->text, (size_t) ppSpelling(t));
+                length += ppSpelling(t);
+            }
+
+            name[length] = 0;
+        }
+    }
+
+    ppListFree(&expanded);
+
+    if (!name) {
+        errorDirectiveExpected(ctx, "a file name", "#include");
+        return;
+    }
+
+    /*Quoted names are looked for next to the includer first*/
+    const ppFrame* frame = &ctx->frames[ctx->frameNo-1];
+    char* path = quoted ? fgetpath(frame->fullname, malloc) : 0;
+    char* fullname = parserFindFile(ctx->comp, name, path);
+    free(path);
+
+    if (!fullname)
+        errorIncludeNotFound(ctx, name);
+
+    else if (ctx->frameNo >= ppIncludeMax) {
+        errorIncludeDepth(ctx, name);
+        free(fullname);
+
+    } else {
+        ppFile* file = ppOpen(ctx, fullname);
+
+        /*Nothing to see again if it's guarded*/
+        bool skip =    (file->once && intsetTest(&ctx->included, (intptr_t) file))
+                    || (file->guard && ppIsDefined(ctx, file->guard));
+
+        if (!skip) {
+            intsetAdd(&ctx->included, (intptr_t) file);
+            ppEnter(ctx, &file->lexer->tokens, file->lexer->stream->str, file->lexer->stream->base,
+                    file, file->fullname);
+        }
+    }
+
+    free(name);
+}
+
+/*The expression of an #if or #elif*/
+static bool ppConditionalDirective (ppCtx* ctx, const ppToken* directive, const char* name, int length, int from) {
+    ppList line = {0};
+    bool value;
+
+    if (ppIs(name, length, "if") || ppIs(name, length, "elif"))
+        return ppCondition(ctx, directive, from);
+
+    ppLine(ctx, directive, from, &line);
+
+    if (line.length == 0 || !ppIsName(&line.tokens[0])) {
+        errorDirectiveExpected(ctx, "a macro name", ppIs(name, length, "ifdef") ? "#ifdef" : "#ifndef");
+        value = false;
+
+    } else
+        value = ppIsDefined(ctx, ppTokenName(ctx, &line.tokens[0])) == ppIs(name, length, "ifdef");
+
+    ppListFree(&line);
+    return value;
+}
+
+static void ppOpenConditional (ppCtx* ctx, bool taken) {
+    if (ctx->conditionalNo == ctx->conditionalCapacity) {
+        ctx->conditionalCapacity = ctx->conditionalCapacity ? 2*ctx->conditionalCapacity : 16;
+        ctx->conditionals = realloc(ctx->conditionals, sizeof(ppConditional)*ctx->conditionalCapacity);
+    }
+
+    ctx->conditionals[ctx->conditionalNo++] = (ppConditional) {ctx->location, taken, false};
+
+    if (!taken)
+        ppSkip(ctx);
+}
+
+/*Skip the rest of a group not taken, up to the #endif closing it or into
+  the next group to be taken, looking only at directives*/
+static void ppSkip (ppCtx* ctx) {
+    ppFrame* frame = &ctx->frames[ctx->frameNo-1];
+    int depth = 0;
+
+    for (; frame->tokens->tags[frame->index] != tokenEOF; frame->index++) {
+        if (frame->tokens->tags[frame->index] != tokenDirective)
+            continue;
+
+        ppToken directive = ppFromFrame(frame, frame->index);
+        int start, length = ppDirectiveName(directive.text, directive.length, &start);
+        const char* name = directive.text + start;
+
+        if (ppIs(name, length, "if") || ppIs(name, length, "ifdef") || ppIs(name, length, "ifndef"))
+            depth++;
+
+        else if (depth != 0) {
+            if (ppIs(name, length, "endif"))
+                depth--;
+
+        } else if (ppIs(name, length, "endif")) {
+            ctx->conditionalNo--;
+            frame->index++;
+            return;
+
+        } else if (ppIs(name, length, "else") || ppIs(name, length, "elif")) {
+            ppConditional* conditional = &ctx->conditionals[ctx->conditionalNo-1];
+            ctx->location = directive.location;
+
+            if (conditional->taken || conditional->otherwise) {
+                conditional->otherwise |= ppIs(name, length, "else");
+                continue;
+            }
+
+            conditional->otherwise = ppIs(name, length, "else");
+            conditional->taken =    conditional->otherwise
+                                 || ppCondition(ctx, &directive, start + length);
+
+            if (conditional->taken) {
+                frame->index++;
+                return;
+            }
+        }
+    }
+}
+
+static void ppDirective (ppCtx* ctx, const ppToken* directive) {
+    ctx->location = directive->location;
+
+    int start, length = ppDirectiveName(directive->text, directive->length, &start);
+    const char* name = directive->text + start;
+    int from = start + length;
+
+    const ppFrame* frame = &ctx->frames[ctx->frameNo-1];
+    ppList line = {0};
+
+    /*A # alone, or followed by a line number as in the output of other
+      preprocessors, which only moves diagnostics*/
+    if (length == 0 || ppIs(name, length, "line"))
+        ;
+
+    else if (ppIs(name, length, "define")) {
+        ppLine(ctx, directive, from, &line);
+        ppDefine(ctx, &line);
+
+    } else if (ppIs(name, length, "undef")) {
+        ppLine(ctx, directive, from, &line);
+        ppUndef(ctx, &line);
+
+    } else if (ppIs(name, length, "include")) {
+        ppLine(ctx, directive, from, &line);
+        ppInclude(ctx, &line);
+
+    } else if (ppIs(name, length, "if") || ppIs(name, length, "ifdef") || ppIs(name, length, "ifndef"))
+        ppOpenConditional(ctx, ppConditionalDirective(ctx, directive, name, length, from));
+
+    /*Ending a group that was taken, so the rest are skipped*/
+    else if (ppIs(name, length, "elif") || ppIs(name, length, "else") || ppIs(name, length, "endif")) {
+        if (ctx->conditionalNo == frame->conditionals)
+            errorUnmatchedDirective(ctx, ppIs(name, length, "endif") ? "#endif" :
+                                         ppIs(name, length, "else") ? "#else" : "#elif");
+
+        else if (ppIs(name, length, "endif"))
+            ctx->conditionalNo--;
+
+        else {
+            ctx->conditionals[ctx->conditionalNo-1].otherwise |= ppIs(name, length, "else");
+            ppSkip(ctx);
+        }
+
+    } else if (ppIs(name, length, "error") || ppIs(name, length, "warning")) {
+        int i = from;
+
+        while (i < directive->length && (directive->text[i] == ' ' || directive->text[i] == '\t'))
+            i++;
+
+        const char* message = ppName(ctx, directive->text + i, directive->length - i);
+
+        if (ppIs(name, length, "error"))
+            errorPreprocessor(ctx, "#error $s", message);
+
+        else
+            warningPreprocessor(ctx, "#warning $s", message);
+
+    /*Only #pragma once means anything here*/
+    } else if (ppIs(name, length, "pragma")) {
+        ppLine(ctx, directive, from, &line);
+
+        if (   line.length == 1 && frame->file
+            && ppIs(line.tokens[0].text, line.tokens[0].length, "once"))
+            frame->file->once = true;
+
+    } else
+        errorUnknownDirective(ctx, ppName(ctx, name, length));
+
+    ppListFree(&line);
+}
+
+/*==== Conditions ====*/
+
+typedef struct ppExpr {
+    ppCtx* ctx;
+    const ppList* tokens;
+    int index;
+    ///An error has been reported, so say no more
+    bool failed;
+} ppExpr;
+
+/**
+ * A value in a condition, of intmax_t or of uintmax_t, as C's usual
+ * arithmetic conversions make it
+ */
+typedef struct ppValue {
+    intmax_t n;
+    bool isUnsigned;
+} ppValue;
+
+static ppValue ppEvalTernary (ppExpr* expr, bool live);
+
+static const ppToken* ppExprPeek (const ppExpr* expr) {
+    return expr->index < expr->tokens->length ? &expr->tokens->tokens[expr->index] : 0;
+}
+
+static bool ppExprIsPunct (const ppExpr* expr, punctTag punct) {
+    const ppToken* t = ppExprPeek(expr);
+    return t && ppIsPunct(t, punct);
+}
+
+static void ppExprError (ppExpr* expr, const char* expected) {
+    if (expr->failed)
+        return;
+
+    const ppToken* t = ppExprPeek(expr);
+
+    if (t)
+        expr->ctx->location = t->location;
+
+    errorConditionExpected(expr->ctx, expected, t ? ppTokenName(expr->ctx, t) : "end of line");
+    expr->failed = true;
+}
+
+/*An integer, which may have been lexed as a number and identifiers, as
+  in 0x1F or 10u. Unsigned if it says so, or if too large to be signed.*/
+static ppValue ppEvalNumber (ppExpr* expr, const ppToken* t) {
+    const char* end = t->text + t->length;
+    const ppToken* next;
+
+    while (   (next = ppExprPeek(expr)) && next->text == end
+           && (next->tag == tokenInt || next->tag == tokenIdent)) {
+        end += next->length;
+        expr->index++;
+    }
+
+    const char* number = ppName(expr->ctx, t->text, (int) (end - t->text));
+    char* suffix;
+    uintmax_t value = strtoumax(number, &suffix, 0);
+    bool isUnsigned = value > INTMAX_MAX;
+
+    for (; *suffix && strchr("uUlL", *suffix); suffix++)
+        isUnsigned |= *suffix == 'u' || *suffix == 'U';
+
+    if (*suffix && !expr->failed) {
+        expr->ctx->location = t->location;
+        errorConditionExpected(expr->ctx, "an integer", number);
+        expr->failed = true;
+    }
+
+    return (ppValue) {(intmax_t) value, isUnsigned};
+}
+
+static intmax_t ppEvalChar (const ppToken* t) {
+    const char* c = t->text+1;
+
+    if (c[0] != '\\')
+        return c[0];
+
+    switch (c[1]) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case '0': return '\0';
+    case 'a': return '\a';
+    case 'b': return '\b';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    default: return c[1];
+    }
+}
+
+static ppValue ppEvalUnary (ppExpr* expr, bool live) {
+    const ppToken* t = ppExprPeek(expr);
+
+    if (!t) {
+        ppExprError(expr, "a value");
+        return (ppValue) {0, false};
+    }
+
+    expr->index++;
+
+    if (ppIsPunct(t, punctPlus))
+        return ppEvalUnary(expr, live);
+
+    else if (ppIsPunct(t, punctMinus)) {
+        ppValue value = ppEvalUnary(expr, live);
+        return (ppValue) {(intmax_t) -(uintmax_t) value.n, value.isUnsigned};
+
+    } else if (ppIsPunct(t, punctLogicalNot))
+        return (ppValue) {!ppEvalUnary(expr, live).n, false};
+
+    else if (ppIsPunct(t, punctBitwiseNot)) {
+        ppValue value = ppEvalUnary(expr, live);
+        return (ppValue) {~value.n, value.isUnsigned};
+
+    } else if (ppIsPunct(t, punctLParen)) {
+        ppValue value = ppEvalTernary(expr, live);
+
+        if (ppExprIsPunct(expr, punctRParen))
+            expr->index++;
+
+        else
+            ppExprError(expr, "')'");
+
+        return value;
+
+    } else if (t->tag == tokenInt)
+        return ppEvalNumber(expr, t);
+
+    else if (t->tag == tokenChar)
+        return (ppValue) {ppEvalChar(t), false};
+
+    /*Identifiers left after expansion are zero, but true is one*/
+    else if (t->tag == tokenIdent || t->tag == tokenKeyword)
+        return (ppValue) {t->tag == tokenKeyword && t->subtag == keywordTrue, false};
+
+    expr->index--;
+    ppExprError(expr, "a value");
+    return (ppValue) {0, false};
+}
+
+/*Of a binary operator, or zero*/
+static int ppPrecedence (const ppToken* t) {
+    if (!t || t->tag != tokenPunct)
+        return 0;
+
+    switch (t->subtag) {
+    case punctTimes: case punctDivide: case punctModulo: return 10;
+    case punctPlus: case punctMinus: return 9;
+    case punctShl: case punctShr: return 8;
+    case punctLess: case punctLessEqual: case punctGreater: case punctGreaterEqual: return 7;
+    case punctEqual: case punctNotEqual: return 6;
+    case punctBitwiseAnd: return 5;
+    case punctBitwiseXor: return 4;
+    case punctBitwiseOr: return 3;
+    case punctLogicalAnd: return 2;
+    case punctLogicalOr: return 1;
+    default: return 0;
+    }
+}
+
+/*Only division by zero in an operand that is evaluated (live) is an error.
+  Unsigned arithmetic avoids overflow, and gives the unsigned results
+  where either side is unsigned.*/
+static ppValue ppEvalOp (ppExpr* expr, punctTag o, ppValue L, ppValue R, bool live) {
+    intmax_t l = L.n, r = R.n;
+    uintmax_t ul = (uintmax_t) l, ur = (uintmax_t) r;
+    bool isUnsigned = L.isUnsigned || R.isUnsigned;
+
+    if ((o == punctDivide || o == punctModulo) && r == 0) {
+        if (live && !expr->failed) {
+            errorConditionDivision(expr->ctx);
+            expr->failed = true;
+        }
+
+        return (ppValue) {0, isUnsigned};
+
+    } else if (o == punctDivide)
+        return (ppValue) {  isUnsigned ? (intmax_t) (ul / ur)
+                          : r == -1 ? (intmax_t) -ul : l / r, isUnsigned};
+
+    else if (o == punctModulo)
+        return (ppValue) {  isUnsigned ? (intmax_t) (ul % ur)
+                          : r == -1 ? 0 : l % r, isUnsigned};
+
+    else if (o == punctTimes)
+        return (ppValue) {(intmax_t) (ul * ur), isUnsigned};
+
+    else if (o == punctPlus)
+        return (ppValue) {(intmax_t) (ul + ur), isUnsigned};
+
+    else if (o == punctMinus)
+        return (ppValue) {(intmax_t) (ul - ur), isUnsigned};
+
+    /*Shifts take the type of the left side alone*/
+    else if (o == punctShl)
+        return (ppValue) {(intmax_t) (ul << (ur & 63)), L.isUnsigned};
+
+    else if (o == punctShr)
+        return (ppValue) {L.isUnsigned ? (intmax_t) (ul >> (ur & 63)) : l >> (ur & 63), L.isUnsigned};
+
+    /*Comparisons give a signed int, whatever they compare*/
+    else if (o == punctLess)
+        return (ppValue) {isUnsigned ? ul < ur : l < r, false};
+
+    else if (o == punctLessEqual)
+        return (ppValue) {isUnsigned ? ul <= ur : l <= r, false};
+
+    else if (o == punctGreater)
+        return (ppValue) {isUnsigned ? ul > ur : l > r, false};
+
+    else if (o == punctGreaterEqual)
+        return (ppValue) {isUnsigned ? ul >= ur : l >= r, false};
+
+    else if (o == punctEqual)
+        return (ppValue) {l == r, false};
+
+    else if (o == punctNotEqual)
+        return (ppValue) {l != r, false};
+
+    else if (o == punctBitwiseAnd)
+        return (ppValue) {l & r, isUnsigned};
+
+    else if (o == punctBitwiseXor)
+        return (ppValue) {l ^ r, isUnsigned};
+
+    else if (o == punctBitwiseOr)
+        return (ppValue) {l | r, isUnsigned};
+
+    debugErrorUnhandled("ppEvalOp", "operator", punctTagGetStr(o));
+    return (ppValue) {0, false};
+}
+
+/*Operators of at least a given precedence, by precedence climbing*/
+static ppValue ppEvalBinary (ppExpr* expr, int least, bool live) {
+    ppValue l = ppEvalUnary(expr, live);
+    int precedence;
+
+    while ((precedence = ppPrecedence(ppExprPeek(expr))) >= least && precedence != 0) {
+        const ppToken* op = ppExprPeek(expr);
+        punctTag o = (punctTag) op->subtag;
+        expr->ctx->location = op->location;
+        expr->index++;
+
+        if (o == punctLogicalAnd) {
+            ppValue r = ppEvalBinary(expr, precedence+1, live && l.n);
+            l = (ppValue) {l.n && r.n, false};
+
+        } else if (o == punctLogicalOr) {
+            ppValue r = ppEvalBinary(expr, precedence+1, live && !l.n);
+            l = (ppValue) {l.n || r.n, false};
+
+        } else {
+            ppValue r = ppEvalBinary(expr, precedence+1, live);
+            l = ppEvalOp(expr, o, l, r, live);
+        }
+    }
+
+    return l;
+}
+
+static ppValue ppEvalTernary (ppExpr* expr, bool live) {
+    ppValue condition = ppEvalBinary(expr, 1, live);
+
+    if (!ppExprIsPunct(expr, punctQuestion))
+        return condition;
+
+    expr->index++;
+    ppValue l = ppEvalTernary(expr, live && condition.n);
+
+    if (ppExprIsPunct(expr, punctColon))
+        expr->index++;
+
+    else
+        ppExprError(expr, "':'");
+
+    ppValue r = ppEvalTernary(expr, live && !condition.n);
+
+    /*Either side makes both unsigned*/
+    ppValue value = condition.n ? l : r;
+    value.isUnsigned = l.isUnsigned || r.isUnsigned;
+    return value;
+}
+
+/*Evaluate the condition of an #if or #elif*/
+static bool ppCondition (ppCtx* ctx, const ppToken* directive, int from) {
+    ppList line = {0}, replaced = {0};
+    ppLine(ctx, directive, from, &line);
+
+    /*Whether macros are defined, before they're expanded*/
+    for (int i = 0; i < line.length; i++) {
+        const ppToken* t = &line.tokens[i];
+
+        if (t->tag != tokenIdent || !ppIs(t->text, t->length, "defined")) {
+            ppListPush(&replaced, t);
+            continue;
+        }
+
+        bool paren = i+1 < line.length && ppIsPunct(&line.tokens[i+1], punctLParen);
+        int at = i+1 + paren;
+        bool defined = false;
+
+        if (   at < line.length && ppIsName(&line.tokens[at])
+            && (!paren || (at+1 < line.length && ppIsPunct(&line.tokens[at+1], punctRParen)))) {
+            defined = ppIsDefined(ctx, ppTokenName(ctx, &line.tokens[at]));
+            i = at + paren;
+
+        } else {
+            ctx->location = t->location;
+            errorDirectiveExpected(ctx, "a macro name", "defined");
+        }
+
+        ppToken value = {tokenInt, 0, defined ? "1" : "0", 1, t->location, t->space, 0};
+        ppListPush(&replaced, &value);
+    }
+
+    ppList expanded = ppExpandList(ctx, &replaced);
+    ppExpr expr = {ctx, &expanded, 0, false};
+    ppValue value = ppEvalTernary(&expr, true);
+
+    if (expr.index < expanded.length)
+        ppExprError(&expr, "an operator");
+
+    ppListFree(&line);
+    ppListFree(&replaced);
+    ppListFree(&expanded);
+    return value.n != 0;
+}
+
+/*==== Output ====*/
+
+static void ppEmit (ppCtx* ctx, const ppToken* t) {
+    int spelling = ppSpelling(t);
+
+    if (ctx->textLength + spelling > ctx->textCapacity) {
+        ctx->textCapacity = max(2*ctx->textCapacity, ctx->textLength + spelling);
+        ctx->out.text = realloc(ctx->out.text, (size_t) ctx->textCapacity);
+    }
+
+    memcpy(ctx->out.text + ctx->textLength, t->text, (size_t) spelling);
+    lexerTokensPush(&ctx->out, t->tag, t->subtag, ctx->textLength, t->length);
+    ctx->textLength += spelling;
+
+    if (ctx->locationCapacity < ctx->out.capacity) {
+        ctx->locationCapacity = ctx->out.capacity;
+        ctx->out.locations = realloc(ctx->out.locations, sizeof(tokenLocation)*ctx->locationCapacity);
+    }
+
+    ctx->out.locations[ctx->out.length-1] = t->location;
+}
+
+/*==== Interface ====*/
+
+static void ppPredefine (ppCtx* ctx) {
+    static const ppToken one = {tokenInt, 0, "1", 1, sourceNone, true, 0};
+
+    ppMacro* fcc = ppMacroAdd(ctx, "__FCC__", 7);
+    fcc->length = 1;
+    fcc->body = malloc(sizeof(ppToken));
+    fcc->body[0] = one;
+    fcc->bodyParams = malloc(sizeof(int));
+    fcc->bodyParams[0] = -1;
+
+    ppMacroAdd(ctx, "__LINE__", 8)->builtin = ppBuiltinLine;
+    ppMacroAdd(ctx, "__FILE__", 8)->builtin = ppBuiltinFile;
+}
+
+void preprocess (compilerCtx* comp, lexerCtx* lexer, const char* fullname, int* errors, int* warnings) {
+    ppCtx ctx = {.comp = comp, .location = lexer->stream->base};
+
+    hashmapInit(&ctx.macros, 256);
+    intsetInit(&ctx.included, 64);
+    vectorInit(&ctx.blocks, 16);
+    lexerTokensInit(&ctx.scratch, 64);
+    lexerTokensInit(&ctx.out, lexer->tokens.length + 64);
+
+    ctx.textCapacity = lexer->stream->length + 64;
+    ctx.out.text = malloc((size_t) ctx.textCapacity);
+
+    ppPredefine(&ctx);
+    ppEnter(&ctx, &lexer->tokens, lexer->stream->str, lexer->stream->base, 0, fullname);
+
+    ppToken t;
+
+    while ((t = ppGet(&ctx)).tag != tokenEOF)
+        ppEmit(&ctx, &t);
+
+    for (; ctx.conditionalNo != 0; ctx.conditionalNo--) {
+        ctx.location = ctx.conditionals[ctx.conditionalNo-1].location;
+        errorUnterminatedConditional(&ctx);
+    }
+
+    ppEmit(&ctx, &t);
+
+    /*The lexer reads the output from the start*/
+    lexerTokensFree(&lexer->tokens);
+    lexer->tokens = ctx.out;
+    lexer->index = -1;
+
+    *errors += ctx.errors;
+    *warnings += ctx.warnings;
+
+    hashmapFreeObjs(&ctx.macros, 0, (hashmapValueDtor) ppMacroDestroy);
+    intsetFree(&ctx.included);
+    vectorFreeObjs(&ctx.blocks, free);
+    lexerTokensFree(&ctx.scratch);
+    ppListFree(&ctx.pending);
+    free(ctx.frames);
+    free(ctx.conditionals);
+    free(ctx.name);
+}
@@ -2,37 +2,43 @@
 
 #include "../inc/debug.h"
 
+#include "string.h"
+
 /*Indexes correspond to regXXX definitions
   Note rsp and rbp always used*/
-reg regs[regMax] = {
-    {1, {"undefined", "undefined", "undefined", "undefined"}, 0},
-    {1, {"al", "ax", "eax", "rax"}, 0},
-    {1, {"al", "bx", "ebx", "rbx"}, 0},
-    {1, {"cl", "cx", "ecx", "rcx"}, 0},
-    {1, {"dl", "dx", "edx", "rdx"}, 0},
-    {2, {0, "si", "esi", "rsi"}, 0},
-    {2, {0, "di", "edi", "rdi"}, 0},
-    {8, {0, 0, 0, "r8"}, 0},
-    {8, {0, 0, 0, "r9"}, 0},
-    {8, {0, 0, 0, "r10"}, 0},
-    {8, {0, 0, 0, "r11"}, 0},
-    {8, {0, 0, 0, "r12"}, 0},
-    {8, {0, 0, 0, "r13"}, 0},
-    {8, {0, 0, 0, "r14"}, 0},
-    {8, {0, 0, 0, "r15"}, 0},
-    {2, {0, "bp", "ebp", "rbp"}, 0},
-    {2, {0, "sp", "esp", "rsp"}, 0}
+static const reg regTemplates[regMax] = {
+    {regUndefined, 1, {"undefined", "undefined", "undefined", "undefined"}, 0},
+    {regRAX, 1, {"al", "ax", "eax", "rax"}, 0},
+    {regRBX, 1, {"bl", "bx", "ebx", "rbx"}, 0},
+    {regRCX, 1, {"cl", "cx", "ecx", "rcx"}, 0},
+    {regRDX, 1, {"dl", "dx", "edx", "rdx"}, 0},
+    {regRSI, 2, {0, "si", "esi", "rsi"}, 0},
+    {regRDI, 2, {0, "di", "edi", "rdi"}, 0},
+    {regR8, 8, {0, 0, 0, "r8"}, 0},
+    {regR9, 8, {0, 0, 0, "r9"}, 0},
+    {regR10, 8, {0, 0, 0, "r10"}, 0},
+    {regR11, 8, {0, 0, 0, "r11"}, 0},
+    {regR12, 8, {0, 0, 0, "r12"}, 0},
+    {regR13, 8, {0, 0, 0, "r13"}, 0},
+    {regR14, 8, {0, 0, 0, "r14"}, 0},
+    {regR15, 8, {0, 0, 0, "r15"}, 0},
+    {regRBP, 2, {0, "bp", "ebp", "rbp"}, 0},
+    {regRSP, 2, {0, "sp", "esp", "rsp"}, 0}
 };
 
-bool regIsUsed (regIndex r) {
+void regsInit (reg* regs) {
+    memcpy(regs, regTemplates, sizeof(regTemplates));
+}
+
+bool regIsUsed (const reg* regs, regIndex r) {
     return regs[r].allocatedAs != 0;
 }
 
-const reg* regGet (regIndex r) {
+const reg* regGet (const reg* regs, regIndex r) {
     return &regs[r];
 }
 
-reg* regRequest (regIndex r, int size) {
+reg* regRequest (reg* regs, regIndex r, int size) {
     if (size == 0) {
         debugError("regRequest", "zero sized register requested, %s", regIndexGetName(r, 8));
         size = regs[r].size == 8 ? 8 : 4;
@@ -50,19 +56,19 @@ void regFree (reg* r) {
     r->allocatedAs = false;
 }
 
-reg* regAlloc (int size) {
+reg* regAlloc (reg* regs, int size) {
     if (size == 0)
         return 0;
 
     /*Bugger RAX. Functions put their rets in there, so its just a hassle*/
     for (regIndex r = regRBX; r <= regR15; r++)
-        if (regRequest(r, size) != 0)
+        if (regRequest(regs, r, size) != 0)
             return &regs[r];
 
-    if (regIsUsed(regRAX))
+    if (regIsUsed(regs, regRAX))
         debugError("regAlloc", "no registers left");
 
-    return regRequest(regRAX, size);
+    return regRequest(regs, regRAX, size);
 }
 
 static const char* regGetName (const reg* r, int size) {
@@ -85,7 +91,7 @@ static const char* regGetName (const reg* r, int size) {
 }
 
 const char* regIndexGetName (regIndex r, int size) {
-    return regGetName(&regs[r], size);
+    return regGetName(&regTemplates[r], size);
 }
 
 const char* regGetStr (const reg* r) {
@@ -0,0 +1,134 @@
+#include "../inc/scan.h"
+
+/*Only GCC and Clang on x86 get the vector kernels, anything else (fcc
+  itself, for one) sees just the plain loops*/
+#if defined(__GNUC__) && defined(__SSE2__)
+    #define SCAN_VECTOR
+    #include "immintrin.h"
+#endif
+
+/*==== One at a time ====*/
+
+static const char* scanFindScalar (const char* str, const char* end, const char set[4], bool within) {
+    for (; str != end; str++) {
+        bool hit =    *str == set[0] || *str == set[1]
+                   || *str == set[2] || *str == set[3];
+
+        if (hit != within)
+            break;
+    }
+
+    return str;
+}
+
+static int scanCountScalar (const char* str, const char* end, char c) {
+    int count = 0;
+
+    for (; str != end; str++)
+        count += *str == c;
+
+    return count;
+}
+
+#ifdef SCAN_VECTOR
+
+/*==== SSE2, 16 at a time ====*/
+
+static const char* scanFindSSE2 (const char* str, const char* end, const char set[4], bool within) {
+    __m128i a = _mm_set1_epi8(set[0]), b = _mm_set1_epi8(set[1]),
+            c = _mm_set1_epi8(set[2]), d = _mm_set1_epi8(set[3]);
+
+    /*A bit for each character that stops the search*/
+    unsigned flip = within ? 0xFFFF : 0;
+
+    for (; end - str >= 16; str += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) str);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, a), _mm_cmpeq_epi8(chunk, b)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, c), _mm_cmpeq_epi8(chunk, d)));
+        unsigned mask = (unsigned) _mm_movemask_epi8(hits) ^ flip;
+
+        if (mask)
+            return str + __builtin_ctz(mask);
+    }
+
+    return scanFindScalar(str, end, set, within);
+}
+
+static int scanCountSSE2 (const char* str, const char* end, char c) {
+    __m128i match = _mm_set1_epi8(c);
+    int count = 0;
+
+    for (; end - str >= 16; str += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) str);
+        count += __builtin_popcount((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, match)));
+    }
+
+    return count + scanCountScalar(str, end, c);
+}
+
+/*==== AVX2, 32 at a time ====*/
+
+__attribute__((target("avx2")))
+static const char* scanFindAVX2 (const char* str, const char* end, const char set[4], bool within) {
+    __m256i a = _mm256_set1_epi8(set[0]), b = _mm256_set1_epi8(set[1]),
+            c = _mm256_set1_epi8(set[2]), d = _mm256_set1_epi8(set[3]);
+
+    unsigned flip = within ? 0xFFFFFFFF : 0;
+
+    for (; end - str >= 32; str += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) str);
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, a), _mm256_cmpeq_epi8(chunk, b)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(chunk, c), _mm256_cmpeq_epi8(chunk, d)));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(hits) ^ flip;
+
+        if (mask)
+            return str + __builtin_ctz(mask);
+    }
+
+    /*The tail, less than a full vector*/
+    return scanFindSSE2(str, end, set, within);
+}
+
+__attribute__((target("avx2")))
+static int scanCountAVX2 (const char* str, const char* end, char c) {
+    __m256i match = _mm256_set1_epi8(c);
+    int count = 0;
+
+    for (; end - str >= 32; str += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) str);
+        count += __builtin_popcount((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, match)));
+    }
+
+    return count + scanCountSSE2(str, end, c);
+}
+
+#endif
+
+/*==== Dispatch ====*/
+
+/*Not worth the setup for less than a vector*/
+enum {
+    scanShort = 16
+};
+
+const char* scanFind (const char* str, const char* end, const char set[4], bool within) {
+#ifdef SCAN_VECTOR
+    if (end - str >= scanShort)
+        return   __builtin_cpu_supports("avx2")
+               ? scanFindAVX2(str, end, set, within)
+               : scanFindSSE2(str, end, set, within);
+#endif
+
+    return scanFindScalar(str, end, set, within);
+}
+
+int scanCount (const char* str, const char* end, char c) {
+#ifdef SCAN_VECTOR
+    if (end - str >= scanShort)
+        return   __builtin_cpu_supports("avx2")
+               ? scanCountAVX2(str, end, c)
+               : scanCountSSE2(str, end, c);
+#endif
+
+    return scanCountScalar(str, end, c);
+}
@@ -0,0 +1,233 @@
+#include "../inc/server.h"
+
+#include "stdlib.h"
+#include "stdio.h"
+#include "string.h"
+#include "stdint.h"
+#include "unistd.h"
+#include "sys/types.h"
+#include "sys/socket.h"
+#include "sys/un.h"
+
+/*A request is the length of what follows, then the client's working
+  directory and the arguments, each null terminated. The response is the
+  exit status, then everything printed until the server hangs up.*/
+
+enum {
+    ///Pending connections to queue
+    serverBacklog = 16,
+    ///Largest request accepted
+    serverRequestMax = 1 << 20
+};
+
+static bool serverSend (int fd, const void* data, size_t length) {
+    const char* bytes = data;
+
+    while (length != 0) {
+        /*Don't die should the client leave early*/
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+
+        if (sent <= 0)
+            return false;
+
+        bytes += sent;
+        length -= (size_t) sent;
+    }
+
+    return true;
+}
+
+static bool serverReceive (int fd, void* data, size_t length) {
+    char* bytes = data;
+
+    while (length != 0) {
+        ssize_t got = recv(fd, bytes, length, 0);
+
+        if (got <= 0)
+            return false;
+
+        bytes += got;
+        length -= (size_t) got;
+    }
+
+    return true;
+}
+
+static bool serverAddress (const char* socket, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(socket) >= sizeof(address->sun_path))
+        return false;
+
+    strcpy(address->sun_path, socket);
+    return true;
+}
+
+/*==== Server ====*/
+
+/*Run a request with what's printed, by us or any child, going to a log*/
+static int serverHandle (serverHandler handler, void* ctx, FILE* log, int argc, char** argv) {
+    fflush(stdout);
+    fflush(stderr);
+
+    int out = dup(1), err = dup(2);
+    dup2(fileno(log), 1);
+    dup2(fileno(log), 2);
+
+    int status = handler(ctx, argc, argv);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    dup2(out, 1);
+    dup2(err, 2);
+    close(out);
+    close(err);
+
+    return status;
+}
+
+static void serverConnection (int client, serverHandler handler, void* ctx) {
+    uint32_t length;
+
+    if (   !serverReceive(client, &length, sizeof(length))
+        || length == 0 || length > serverRequestMax)
+        return;
+
+    /*Null terminated, whatever was sent*/
+    char* request = calloc(length+1, 1);
+
+    if (!serverReceive(client, request, length)) {
+        free(request);
+        return;
+    }
+
+    /*Split out the directory and arguments*/
+
+    int argc = 0;
+    char** argv = malloc(sizeof(char*)*(length+1));
+
+    for (uint32_t i = 0; i < length; i += (uint32_t) strlen(request+i) + 1)
+        argv[argc++] = request+i;
+
+    int status = 1;
+    FILE* log = tmpfile();
+
+    if (!log)
+        ;
+
+    else if (argc == 0 || chdir(argv[0]) != 0)
+        fprintf(log, "fcc: Server can't enter directory '%s'\n", argc ? argv[0] : "");
+
+    /*The first argument is the program name, as for main*/
+    else
+        status = serverHandle(handler, ctx, log, argc, argv);
+
+    int32_t response = status;
+
+    if (serverSend(client, &response, sizeof(response)) && log) {
+        rewind(log);
+
+        char buffer[4096];
+        size_t got;
+
+        while ((got = fread(buffer, 1, sizeof(buffer), log)) != 0)
+            if (!serverSend(client, buffer, got))
+                break;
+    }
+
+    if (log)
+        fclose(log);
+
+    free(argv);
+    free(request);
+}
+
+bool serverRun (const char* socketname, serverHandler handler, void* ctx) {
+    struct sockaddr_un address;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    /*Replacing any left by a server before*/
+    if (   listener < 0 || !serverAddress(socketname, &address)
+        || (unlink(socketname), bind(listener, (struct sockaddr*) &address, sizeof(address))) != 0
+        || listen(listener, serverBacklog) != 0) {
+        printf("fcc: Unable to serve on socket '%s'\n", socketname);
+
+        if (listener >= 0)
+            close(listener);
+
+        return true;
+    }
+
+    printf("fcc: Serving on socket '%s'\n", socketname);
+    fflush(stdout);
+
+    for (;;) {
+        int client = accept(listener, 0, 0);
+
+        if (client >= 0) {
+            serverConnection(client, handler, ctx);
+            close(client);
+        }
+    }
+}
+
+/*==== Client ====*/
+
+bool serverRequest (const char* socketname, int argc, char** argv, int* status) {
+    struct sockaddr_un address;
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (   server < 0 || !serverAddress(socketname, &address)
+        || connect(server, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        if (server >= 0)
+            close(server);
+
+        return false;
+    }
+
+    /*Directory, then the arguments, taking the place of the program name*/
+
+    char cwd[4096];
+
+    if (!getcwd(cwd, sizeof(cwd)))
+        cwd[0] = 0;
+
+    size_t length = strlen(cwd) + 1;
+
+    for (int i = 1; i < argc; i++)
+        length += strlen(argv[i]) + 1;
+
+    char* request = malloc(length);
+    size_t used = 0;
+
+    for (int i = 0; i < argc; i++) {
+        const char* str = i == 0 ? cwd : argv[i];
+        size_t size = strlen(str) + 1;
+        memcpy(request+used, str, size);
+        used += size;
+    }
+
+    uint32_t requestLength = (uint32_t) length;
+    int32_t response;
+
+    bool answered =    serverSend(server, &requestLength, sizeof(requestLength))
+                    && serverSend(server, request, length)
+                    && serverReceive(server, &response, sizeof(response));
+
+    if (answered) {
+        *status = response;
+
+        char buffer[4096];
+        ssize_t got;
+
+        while ((got = recv(server, buffer, sizeof(buffer), 0)) > 0)
+            fwrite(buffer, 1, (size_t) got, stdout);
+    }
+
+    free(request);
+    close(server);
+
+    return answered;
+}
@@ -0,0 +1,196 @@
+#include "../inc/source.h"
+
+#include "../inc/scan.h"
+
+#include "stdlib.h"
+#include "string.h"
+#include "threads.h"
+
+typedef struct sourceFile {
+    const char* filename;
+    char* text;
+    int length;
+    ///Takes [base, base+length]
+    tokenLocation base;
+
+    ///Offset of the start of each line, or null until first needed
+    int* lines;
+    int lineNo;
+} sourceFile;
+
+/*The files, in order of their ranges. Parsing happens on one thread, but
+  the lock makes no assumptions of that*/
+static sourceFile* sourceFiles;
+static int sourceNo, sourceCapacity;
+
+static mtx_t sourceLock;
+static once_flag sourceOnce = ONCE_FLAG_INIT;
+
+static void sourceInit (void) {
+    mtx_init(&sourceLock, mtx_plain);
+}
+
+static void sourceLockTake (void) {
+    call_once(&sourceOnce, sourceInit);
+    mtx_lock(&sourceLock);
+}
+
+/*==== Ranges ====*/
+
+/*The first base at which a range of a given size fits, and where in the
+  files it goes, placed after the last file while there is room, then in
+  the first gap left by a file released*/
+static tokenLocation sourceFindRange (uint32_t size, int* index) {
+    uint32_t last = sourceNo == 0 ? 1 : sourceFiles[sourceNo-1].base + (uint32_t) sourceFiles[sourceNo-1].length + 1;
+
+    if (UINT32_MAX - last >= size) {
+        *index = sourceNo;
+        return last;
+    }
+
+    uint32_t from = 1;
+
+    for (int i = 0; i < sourceNo; i++) {
+        if (sourceFiles[i].base - from >= size) {
+            *index = i;
+            return from;
+        }
+
+        from = sourceFiles[i].base + (uint32_t) sourceFiles[i].length + 1;
+    }
+
+    return sourceNone;
+}
+
+/*The index of the file containing a location, or -1*/
+static int sourceFind (tokenLocation loc) {
+    int low = 0, high = sourceNo;
+
+    /*The last file starting at or before it*/
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (sourceFiles[middle].base <= loc)
+            low = middle+1;
+
+        else
+            high = middle;
+    }
+
+    if (low == 0 || loc > sourceFiles[low-1].base + (uint32_t) sourceFiles[low-1].length)
+        return -1;
+
+    return low-1;
+}
+
+tokenLocation sourceAdd (const char* filename, char* text, int length) {
+    sourceLockTake();
+
+    int index;
+    tokenLocation base = sourceFindRange((uint32_t) length + 1, &index);
+
+    if (base != sourceNone) {
+        if (sourceNo == sourceCapacity) {
+            sourceCapacity = sourceCapacity ? 2*sourceCapacity : 16;
+            sourceFiles = realloc(sourceFiles, sizeof(sourceFile)*sourceCapacity);
+        }
+
+        memmove(&sourceFiles[index+1], &sourceFiles[index], sizeof(sourceFile)*(sourceNo - index));
+        sourceFiles[index] = (sourceFile) {filename, text, length, base, 0, 0};
+        sourceNo++;
+    }
+
+    mtx_unlock(&sourceLock);
+    return base;
+}
+
+void sourceRelease (tokenLocation loc) {
+    if (loc == sourceNone)
+        return;
+
+    sourceLockTake();
+
+    int index = sourceFind(loc);
+
+    if (index >= 0) {
+        free(sourceFiles[index].text);
+        free(sourceFiles[index].lines);
+
+        sourceNo--;
+        memmove(&sourceFiles[index], &sourceFiles[index+1], sizeof(sourceFile)*(sourceNo - index));
+    }
+
+    mtx_unlock(&sourceLock);
+}
+
+/*==== Positions ====*/
+
+static void sourceIndexLines (sourceFile* file) {
+    const char* end = file->text + file->length;
+    int capacity = 64;
+
+    file->lines = malloc(sizeof(int)*capacity);
+    file->lines[0] = 0;
+    file->lineNo = 1;
+
+    for (const char* newline = file->text;
+         (newline = scanFind(newline, end, "\n\n\n\n", false)) != end;
+         newline++) {
+        if (file->lineNo == capacity)
+            file->lines = realloc(file->lines, sizeof(int)*(capacity *= 2));
+
+        file->lines[file->lineNo++] = (int) (newline+1 - file->text);
+    }
+}
+
+sourcePosition sourceGetPosition (tokenLocation loc) {
+    sourcePosition pos = {0, 0, 0};
+
+    if (loc == sourceNone)
+        return pos;
+
+    sourceLockTake();
+
+    int index = sourceFind(loc);
+
+    if (index >= 0) {
+        sourceFile* file = &sourceFiles[index];
+        pos.filename = file->filename;
+
+        if (file->text) {
+            if (!file->lines)
+                sourceIndexLines(file);
+
+            int offset = (int) (loc - file->base);
+
+            /*The last line starting at or before it*/
+            int low = 0, high = file->lineNo;
+
+            while (high - low > 1) {
+                int middle = (low + high) / 2;
+
+                if (file->lines[middle] <= offset)
+                    low = middle;
+
+                else
+                    high = middle;
+            }
+
+            const char* lineStart = file->text + file->lines[low];
+            const char* at = file->text + offset;
+
+            pos.line = low+1;
+            pos.lineChar = 1 + (int) (at - lineStart) + 3*scanCount(lineStart, at, '\t');
+        }
+    }
+
+    mtx_unlock(&sourceLock);
+    return pos;
+}
+
+bool sourceIsSameFile (tokenLocation l, tokenLocation r) {
+    sourceLockTake();
+    bool same = sourceFind(l) == sourceFind(r);
+    mtx_unlock(&sourceLock);
+    return same;
+}
@@ -5,6 +5,7 @@
 #include "stdlib.h"
 #include "string.h"
 #include "stdarg.h"
+#include "sys/stat.h"
 
 /* ::::MISC:::: */
 
@@ -39,14 +40,9 @@ int logi (int x, int base) {
 }
 
 bool fexists (const char* filename) {
-    FILE* file = fopen(filename, "r");
-
-    if (file) {
-        fclose(file);
-        return true;
-
-    } else
-        return false;
+    /*Without opening it*/
+    struct stat info;
+    return !stat(filename, &info);
 }
 
 char* fgetpath (const char* fullname, void* (*allocator)(size_t)) {
@@ -2,69 +2,109 @@
 
 #include "../std/std.h"
 
+#include "../inc/scan.h"
+#include "../inc/source.h"
+
 #include "string.h"
 #include "stdlib.h"
 #include "stdio.h"
 
-streamCtx* streamInit (const char* filename) {
-    streamCtx* ctx = malloc(sizeof(streamCtx));
-    ctx->file = fopen(filename, "r");
+/*Read the whole file, returning its length*/
+static int streamRead (streamCtx* ctx, const char* fullname) {
+    FILE* file = fopen(fullname, "r");
+
+    int length = 0, capacity = 4096;
+    ctx->str = malloc(capacity);
+
+    if (file) {
+        size_t read;
+
+        while ((read = fread(ctx->str + length, 1, (size_t) (capacity-1 - length), file)) != 0) {
+            length += (int) read;
+
+            if (length == capacity-1)
+                ctx->str = realloc(ctx->str, capacity *= 2);
+        }
+
+        fclose(file);
+    }
 
-    ctx->current = 0;
-    ctx->line = 1;
-    ctx->lineChar = 0;
+    ctx->str[length] = 0;
+
+    /*A null or a 0xFF byte has always ended the stream*/
+    int end = (int) strlen(ctx->str);
+    char* eof = memchr(ctx->str, '\xFF', (size_t) end);
+
+    if (eof) {
+        *eof = 0;
+        end = (int) (eof - ctx->str);
+    }
+
+    return end;
+}
+
+streamCtx* streamInit (const char* fullname, const char* filename) {
+    streamCtx* ctx = malloc(sizeof(streamCtx));
+    ctx->length = streamRead(ctx, fullname);
+    ctx->base = sourceAdd(filename, ctx->str, ctx->length);
 
-    streamNext(ctx);
+    ctx->pos = 0;
+    ctx->current = ctx->str[0];
 
     return ctx;
 }
 
 void streamEnd (streamCtx* ctx) {
-    fclose(ctx->file);
+    /*Not taken by the source manager*/
+    if (ctx->base == sourceNone)
+        free(ctx->str);
+
     free(ctx);
 }
 
 char streamNext (streamCtx* ctx) {
     char old = ctx->current;
-    ctx->current = fgetc(ctx->file);
-
-    if (feof(ctx->file) || ctx->current == '\255')
-        ctx->current = 0;
-
-    ctx->lineChar++;
 
-    if (old == '\n') {
-        ctx->line++;
-        ctx->lineChar = 1;
+    if (ctx->pos < ctx->length)
+        ctx->pos++;
 
-    } else if (old == '\t')
-        ctx->lineChar += 3;
+    ctx->current = ctx->str[ctx->pos];
+    return old;
+}
 
+char streamPrev (streamCtx* ctx) {
+    char old = ctx->current;
 
-    //printf("%d\t%c\n", (int) ctx->current, ctx->current);
+    if (ctx->pos != 0)
+        ctx->current = ctx->str[--ctx->pos];
 
     return old;
 }
 
-char streamPrev (streamCtx* ctx) {
-    char old = ctx->current;
+static const char* streamSkip (streamCtx* ctx, const char* chars, bool within, int* length) {
+    /*Repeat the last to make four*/
+    char set[4];
+    int n = (int) strlen(chars);
 
-    fseek(ctx->file, -2, SEEK_CUR);
-    streamNext(ctx);
+    for (int i = 0; i < 4; i++)
+        set[i] = chars[min(i, n-1)];
 
-    ctx->lineChar--;
+    const char* from = ctx->str + ctx->pos;
+    const char* to = scanFind(from, ctx->str + ctx->length, set, within);
 
-    if (ctx->current == '\n') {
-        ctx->line--;
-        /*Since it would be such a hassle to go back and count chars
-          (or keep track of them for all lines), we'll just start
-          using Python indices (-1 = last char, -2 = second last etc)*/
-        ctx->lineChar = -1;
+    ctx->pos = (int) (to - ctx->str);
+    ctx->current = *to;
 
-    } else if (ctx->current == '\t')
-        ctx->lineChar -= 3;
+    if (length)
+        *length = (int) (to - from);
 
-    return old;
+    return from;
+}
 
+const char* streamSkipUntil (streamCtx* ctx, const char* chars, int* length) {
+    return streamSkip(ctx, chars, false, length);
 }
 
+void streamSkipWhile (streamCtx* ctx, const char* chars) {
+    streamSkip(ctx, chars, true, 0);
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Compiles a file with --compile-cache, again unchanged, which must be a
+# hit, and again after a header it imports changes, which must be a miss.
+# Usage: compile-cache.sh <fcc>
+
+FCC=$1
+DIR=`mktemp -d`
+trap 'rm -rf "$DIR"' EXIT
+
+cd "$DIR" || exit 1
+
+cat >lib.h <<'END'
+int twice (int x);
+END
+
+cat >main.c <<'END'
+using "lib.h";
+
+int twice (int x) {
+	return x*2;
+}
+
+int main () {
+	return twice(3) - 6;
+}
+END
+
+compile () {
+	"$FCC" -S --compile-cache cache --cache-stats main.c >stats.txt || exit 1
+
+	if ! grep -q "$1" stats.txt; then
+		echo "compile-cache: $2, expected '$1', got:" >&2
+		cat stats.txt >&2
+		exit 1
+	fi
+}
+
+compile "0 hits, 1 miss" "first compile"
+mv main.s cold.s || exit 1
+
+compile "1 hit, 0 misses" "unchanged compile"
+
+if ! cmp -s cold.s main.s; then
+	echo "compile-cache: a hit gave different assembly" >&2
+	exit 1
+fi
+
+echo "int thrice (int x);" >>lib.h
+compile "0 hits, 1 miss" "compile after the header changed"
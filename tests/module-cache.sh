@@ -0,0 +1,45 @@
+#!/bin/sh
+# Compiles a module with --module-cache twice, the second time from the
+# interface saved by the first, which must give the same assembly.
+# Usage: module-cache.sh <fcc>
+
+FCC=$1
+DIR=`mktemp -d`
+trap 'rm -rf "$DIR"' EXIT
+
+cd "$DIR" || exit 1
+
+cat >pair.h <<'END'
+typedef struct pair {
+	int x, y;
+} pair;
+
+typedef enum {first, second, third} order;
+
+pair* pairSwap (pair* p);
+int pairSum (const pair* p, order by);
+END
+
+cat >main.c <<'END'
+using "pair.h";
+
+int main () {
+	pair p = {1, second};
+	return pairSum(pairSwap(&p), third) - p.x;
+}
+END
+
+"$FCC" -S --module-cache cache main.c || exit 1
+mv main.s cold.s || exit 1
+
+if [ -z "`ls cache`" ]; then
+	echo "module-cache: no interface saved" >&2
+	exit 1
+fi
+
+"$FCC" -S --module-cache cache main.c || exit 1
+
+if ! cmp -s cold.s main.s; then
+	echo "module-cache: a warm compile gave different assembly" >&2
+	exit 1
+fi
@@ -0,0 +1,23 @@
+/*Built with --preprocess, see the makefile. Each directive should be
+  reported, and the compilation fail.*/
+
+#include "preprocess-missing.h"
+
+#bogus
+
+#if 1/0
+#endif
+
+#define PAIR(x, y) x + y
+int few = PAIR(1);
+int many = PAIR(1, 2, 3);
+
+#define PASTE(x, y) x##y
+int pasted = PASTE(+, /);
+
+#error "reached an #error"
+
+#if 1
+int main () {
+	return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef PREPROCESS_GUARDED_H
+#define PREPROCESS_GUARDED_H
+
+/*Would be defined twice if the guard didn't work*/
+int guardedCount = 1;
+
+#define SQUARE(x) ((x)*(x))
+
+#endif
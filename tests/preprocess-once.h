@@ -0,0 +1,3 @@
+#pragma once
+
+int onceValue = 2;
@@ -0,0 +1,85 @@
+/*Built with --preprocess, see the makefile*/
+
+#include "preprocess-guarded.h"
+#include "preprocess-once.h"
+#include "preprocess-guarded.h"
+#include "preprocess-once.h"
+
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define CAT(x, y) x##y
+#define ADD(...) add(__VA_ARGS__)
+#define FIRST(x, ...) x
+#define EMPTY
+#define VERSION 3
+
+#if VERSION*2 - 1 == 5 && (VERSION << 2) == 12 && defined(VERSION) && !defined UNDEFINED
+int version = VERSION;
+#elif 1
+#error "took the #elif after a true #if"
+#else
+int version = -1;
+#endif
+
+#if 0
+#error "took a false #if"
+#elif VERSION % 2 == 1 && (VERSION > 2 ? 1 : 1/0) && 0x10 == 16 && '\n' == 10
+int odd = 1;
+#else
+int odd = 0;
+#endif
+
+#ifdef UNDEFINED
+#bogus "a skipped group isn't looked at"
+#endif
+
+/*Either side unsigned makes both so, as in C*/
+#if -1 > 0u && 0xFFFFFFFFFFFFFFFF > 0 && -2 / 2u > 1 && (0u - 1) >> 63 == 1 && -1 >> 63 == -1
+int conversions = 1;
+#else
+int conversions = 0;
+#endif
+
+int add (int a, int b, int c) {
+	return a + b + c;
+}
+
+int self = 1;
+#define self self + 1
+
+int main () {
+	int CAT(x, y) = 5;
+	const char* spaced = STR( a  +  "b\n" );
+	const char* versionText = XSTR(VERSION);
+
+	if (guardedCount != 1 || onceValue != 2)
+		return 1;
+
+	if (xy != 5 EMPTY)
+		return 2;
+
+	if (   spaced[0] != 'a' || spaced[1] != ' ' || spaced[2] != '+' || spaced[3] != ' '
+	    || spaced[4] != '"' || spaced[6] != '\\' || spaced[7] != 'n')
+		return 3;
+
+	if (version != 3 || versionText[0] != '3' || versionText[1] != 0)
+		return 4;
+
+	if (ADD(1, 2, 3) != 6 || FIRST(7, 8, 9) != 7)
+		return 5;
+
+	if (odd != 1 || SQUARE(1 + 2) != 9)
+		return 6;
+
+	/*Not expanded again within its own expansion*/
+	if (self != 2)
+		return 7;
+
+	if (__LINE__ != 78)
+		return 8;
+
+	if (conversions != 1)
+		return 9;
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Starts a compile server and has it compile a file with --connect, which
+# must give the same assembly as compiling alone, before and after a header
+# it imports changes.
+# Usage: server.sh <fcc>
+
+FCC=$1
+DIR=`mktemp -d`
+SERVER=
+
+trap '[ -n "$SERVER" ] && kill $SERVER; rm -rf "$DIR"' EXIT
+
+cd "$DIR" || exit 1
+
+cat >lib.h <<'END'
+int twice (int x);
+END
+
+cat >main.c <<'END'
+using "lib.h";
+
+int twice (int x) {
+	return x*2;
+}
+
+int main () {
+	return twice(3) - 6;
+}
+END
+
+"$FCC" --server socket >server.txt 2>&1 &
+SERVER=$!
+
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+	[ -S socket ] && break
+	sleep 0.1
+done
+
+compare () {
+	"$FCC" -S main.c || exit 1
+	mv main.s alone.s || exit 1
+
+	"$FCC" -S --connect socket main.c >connect.txt 2>&1 || exit 1
+
+	if grep -q "No server" connect.txt; then
+		echo "server: --connect compiled alone, $1" >&2
+		cat server.txt >&2
+		exit 1
+	fi
+
+	if ! cmp -s alone.s main.s; then
+		echo "server: --connect gave different assembly, $1" >&2
+		exit 1
+	fi
+}
+
+compare "the first time"
+
+cat >lib.h <<'END'
+int twice (int x);
+int thrice (int x);
+END
+
+compare "after the header changed"
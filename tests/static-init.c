@@ -0,0 +1,109 @@
+/*Compound initializers of statics are serialized into the data sections,
+  large constant ones of locals are copied from a template*/
+
+struct Point {
+	int x, y;
+	char tag;
+};
+
+struct Shape {
+	Point corners[2];
+	int sides;
+};
+
+int primes[8] = {2, 3, 5, 7, 11, 13, 17, 19};
+
+const int squares[12] = {0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100, 121};
+
+Shape square = {{{0, 0, 'a'}, {.y = -2, .x = 2, .tag = 'b'}}, 4};
+
+char sparse[100] = {[3] = 3, [97] = 97};
+
+/*Addresses, relocated by the linker*/
+
+int answer = 42;
+
+char* greeting = "hi";
+
+int* pointer = &answer;
+
+char* names[] = {"a", "bc"};
+
+int* firstPrime = primes;
+
+struct Entry {
+	const char* name;
+	int* value;
+};
+
+Entry entries[2] = {{"answer", &answer}, {.value = primes, .name = "primes"}};
+
+int counter () {
+	static int calls = 10;
+	return calls++;
+}
+
+const char* where () {
+	static const char* name = "where";
+	return name;
+}
+
+int local (int i) {
+	int table[16] = {5, 4, 3, 2, 1, -1, -2, -3, -4, -5, 6, 7, 8, 9, 10, 11};
+	table[0] = 0;
+	return table[i];
+}
+
+int mostlyZero (int i) {
+	int table[64] = {[10] = 1};
+	return table[i];
+}
+
+int main () {
+	int sum = 0;
+
+	for (int i = 0; i < 8; i++)
+		sum += primes[i];
+
+	if (sum != 77)
+		return 1;
+
+	if (squares[11] != 121 || squares[3] != 9)
+		return 2;
+
+	if (   square.corners[0].tag != 'a' || square.corners[1].x != 2
+	    || square.corners[1].y != -2 || square.sides != 4)
+		return 3;
+
+	if (sparse[3] != 3 || sparse[97] != 97 || sparse[50] != 0)
+		return 4;
+
+	counter();
+
+	if (counter() != 11)
+		return 5;
+
+	/*Twice, as the first call changes its copy*/
+	if (local(0) != 0 || local(0) != 0 || local(9) != -5 || local(15) != 11)
+		return 6;
+
+	if (mostlyZero(10) != 1 || mostlyZero(11) != 0)
+		return 7;
+
+	if (greeting[0] != 'h' || greeting[1] != 'i' || greeting[2] != 0)
+		return 8;
+
+	if (*pointer != 42 || firstPrime[3] != 7)
+		return 9;
+
+	if (names[0][0] != 'a' || names[1][1] != 'c')
+		return 10;
+
+	if (*entries[0].value != 42 || entries[1].value[1] != 3 || entries[1].name[1] != 'r')
+		return 11;
+
+	if (where()[4] != 'e')
+		return 12;
+
+	return 0;
+}
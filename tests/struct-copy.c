@@ -0,0 +1,80 @@
+/*Block copies of each size: word moves, vector moves and rep movs*/
+
+struct Small {
+	int x[3];
+};
+
+struct Medium {
+	int x[13];
+	char tail[3];
+};
+
+struct Large {
+	int x[100];
+	char tail[3];
+};
+
+int sumMedium (Medium m) {
+	int sum = 0;
+
+	for (int i = 0; i < 13; i++)
+		sum += m.x[i];
+
+	return sum;
+}
+
+int sumLarge (Large l) {
+	int sum = 0;
+
+	for (int i = 0; i < 100; i++)
+		sum += l.x[i];
+
+	return sum;
+}
+
+Large makeLarge (int seed) {
+	Large l;
+
+	for (int i = 0; i < 100; i++)
+		l.x[i] = seed+i;
+
+	l.tail[0] = 1;
+	l.tail[1] = 2;
+	l.tail[2] = 3;
+	return l;
+}
+
+int main () {
+	Small s = {{1, 2, 3}}, t;
+	t = s;
+
+	if (t.x[0] != 1 || t.x[2] != 3)
+		return 1;
+
+	Medium m, n;
+
+	for (int i = 0; i < 13; i++)
+		m.x[i] = i;
+
+	m.tail[0] = 10;
+	m.tail[2] = 20;
+	n = m;
+
+	/*0+...+12 = 78*/
+	if (n.x[12] != 12 || n.tail[2] != 20 || sumMedium(n) != 78)
+		return 2;
+
+	/*100*5 + 0+...+99 = 5450*/
+	Large l = makeLarge(5), k;
+	k = l;
+
+	if (k.x[99] != 104 || k.tail[2] != 3 || sumLarge(k) != 5450)
+		return 3;
+
+	Large z = {};
+
+	if (z.x[0] != 0 || z.x[99] != 0 || z.tail[2] != 0)
+		return 4;
+
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*Dense: jump table*/
+int dense (int x) {
+	switch (x) {
+	case 1: return 10;
+	case 2: return 20;
+	case 3:
+	case 4: return 34;
+	case 6: return 60;
+	default: return -1;
+	}
+}
+
+/*Sparse: compare tree*/
+int sparse (int x) {
+	int r = 0;
+
+	switch (x) {
+	case -1000: r = 1; break;
+	case 7: r = 2; break;
+	case 100: r = 3; break;
+	case 5000: r = 4; break;
+	case 90000: r = 5; break;
+	case 123456: r = 6; break;
+	}
+
+	return r;
+}
+
+/*Small range, few targets: bit tests*/
+bool isVowel (char c) {
+	switch (c) {
+	case 'a': case 'e': case 'i': case 'o': case 'u':
+		return true;
+	}
+
+	return false;
+}
+
+/*Fall through, nested switches, break and continue inside*/
+int nested (int n) {
+	int total = 0;
+
+	for (int i = 0; i < n; i++) {
+		switch (i % 4) {
+		case 0:
+			total += 1;
+		case 1:
+			total += 10;
+			break;
+		case 2:
+			switch (i) {
+			case 2: total += 100; break;
+			default: total += 1000;
+			}
+			break;
+		default:
+			continue;
+		}
+
+		total += 5;
+	}
+
+	return total;
+}
+
+/*A label outside of braces labels only the statement after it*/
+int unbraced (int x) {
+	switch (x) case 1: return 5;
+	return 0;
+}
+
+/*A label inside another statement, jumped into*/
+int inside (int x, int y) {
+	int r = 0;
+
+	switch (x) {
+	case 0: if (y) case 1: r = 2; break;
+	}
+
+	return r;
+}
+
+int main () {
+	if (dense(1) != 10 || dense(4) != 34 || dense(5) != -1 || dense(6) != 60 || dense(-3) != -1 || dense(7) != -1)
+		return 1;
+
+	if (sparse(-1000) != 1 || sparse(7) != 2 || sparse(8) != 0 || sparse(90000) != 5 || sparse(123456) != 6)
+		return 2;
+
+	if (!isVowel('a') || !isVowel('u') || isVowel('b') || isVowel('z') || isVowel('A'))
+		return 3;
+
+	/*i=0: 11+5, i=1: 10+5, i=2: 100+5, i=3: none, i=4: 11+5, i=5: 10+5, i=6: 1000+5*/
+	if (nested(7) != 1172)
+		return 4;
+
+	if (unbraced(1) != 5 || unbraced(0) != 0 || unbraced(2) != 0)
+		return 5;
+
+	if (inside(0, 0) != 0 || inside(0, 1) != 2 || inside(1, 0) != 2 || inside(2, 1) != 0)
+		return 6;
+
+	return 0;
+}